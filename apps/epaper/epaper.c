@@ -421,6 +421,7 @@ void main()
     sleepInit();
 
     // SPI
+    spi0MasterDmaMode = 1;
     spi0MasterInit();
     spi0MasterSetFrequency(3000000);
     spi0MasterSetClockPhase(SPI_PHASE_EDGE_LEADING);
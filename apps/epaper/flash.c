@@ -75,9 +75,8 @@ void flash_read(uint8_t XDATA *buffer, uint32_t address, uint16_t length) {
     spi0MasterSendByte(address >> 8);
     spi0MasterSendByte(address);
     spi0MasterSendByte(FLASH_NOP); // read dummy byte
-    for (; length != 0; --length) {
-        *buffer++ = spi0MasterSendByte(FLASH_NOP);
-    }
+    spi0MasterTransfer(0, buffer, length);
+    while (spi0MasterBusy());
     flash_spi_teardown();
 }
 
@@ -117,9 +116,8 @@ void flash_write(uint32_t address, const uint8_t XDATA *buffer, uint16_t length)
     spi0MasterSendByte(address >> 8);
     spi0MasterSendByte(address);
 
-    while(length--) {
-        spi0MasterSendByte(*buffer++);
-    }
+    spi0MasterTransfer(buffer, 0, length);
+    while (spi0MasterBusy());
 
     flash_spi_teardown();
 }
@@ -18,6 +18,7 @@ http://www.pololu.com/docs/0J46
 #include <gpio.h>
 #include <radio_queue.h>
 #include <adc.h>
+#include <sleep.h>
 
 #define PIN_COUNT 15
 static uint8 CODE pins[PIN_COUNT] = {0, 1, 2, 3, 4, 5, 10, 11, 12, 13, 14, 15, 16, 17, 21};
@@ -62,6 +63,13 @@ int32 CODE param_P1_6_link = 0;
 int32 CODE param_P1_7_link = 0;
 int32 CODE param_P2_1_link = 1; // red LED
 
+// If this is not 0, Wixels that only have outputs save power by sleeping with
+// the radio off and waking up to listen for a carrier once every
+// param_sniff_interval_ms milliseconds (at most 1000), but only while USB is
+// not connected.  Wixels with inputs send each packet repeatedly for long
+// enough that a sleeping Wixel will hear it.  Every Wixel must use the same value.
+int32 CODE param_sniff_interval_ms = 0;
+
 /** Functions *****************************************************************/
 void updateLeds()
 {
@@ -169,6 +177,12 @@ void main(void)
     systemInit();
     usbInit();
 
+    if (param_sniff_interval_ms > 0 && param_sniff_interval_ms <= 1000)
+    {
+        // Send each packet for the sniff interval plus 2 ms, in units of 0.922 ms.
+        radioQueueTxRepeatTime = ((param_sniff_interval_ms + 2) * 139 >> 7) + 1;
+    }
+
     radioQueueInit();
 
     configurePins();
@@ -200,5 +214,11 @@ void main(void)
             // transmitting Wixel.
             txInterval = 7 + (adcRead(14 | ADC_BITS_7) & 3);
         }
+
+        // A Wixel with only outputs has nothing to do until the next packet arrives.
+        if (radioQueueTxRepeatTime && !txEnabled && !usbPowerPresent())
+        {
+            radioMacLowPowerListen(param_sniff_interval_ms);
+        }
     }
 }
@@ -2,12 +2,24 @@
 
 This app lets you test the radio_link library.  This app is mainly intended for
 people who are debugging the library.
+
+Commands (sent over USB):
+  ?      Show the state of the radio_link packet buffers, a histogram of how
+         many tries the data packets took, and how many times the radio
+         calibrated or skipped calibrating, and the data rate profile.
+  a-g    Queue a short test packet to be sent.
+  s      Start or stop streaming full packets as fast as possible.  While
+         streaming, both Wixels report the throughput once per second, so
+         this can be used to benchmark changes to the radio libraries.
+  x      Show all the counters from radio_mac and radio_link.
+  z      Reset all the counters from radio_mac and radio_link.
 */
 
 #include <wixel.h>
 #include <usb.h>
 #include <usb_com.h>
 #include <radio_link.h>
+#include <radio_registers.h>
 #include <random.h>
 #include <stdio.h>
 
@@ -18,6 +30,21 @@ extern volatile uint8 DATA radioLinkRxInterruptIndex;  // The index of the next
 extern volatile uint8 DATA radioLinkTxMainLoopIndex;   // The index of the next txPacket to write to in the main loop.
 extern volatile uint8 DATA radioLinkTxInterruptIndex;  // The index of the current txPacket we are trying to send on the radio.
 
+// Packets with this payload type are used for measuring throughput.  They are
+// counted but not reported individually.
+#define STREAM_PAYLOAD_TYPE RADIO_LINK_MAX_PAYLOAD_TYPE
+
+BIT streaming = 0;
+
+// The statistics from radio_link at the time of the last throughput report.
+RADIO_LINK_STATS XDATA lastStats;
+
+// The statistics being shown by the 'x' command.  A full report does not fit in
+// the USB TX buffer, so it is sent one line at a time by statsDumpService().
+RADIO_LINK_STATS XDATA dumpLinkStats;
+RADIO_MAC_STATS XDATA dumpMacStats;
+uint8 statsDumpLine = 0;
+
 void updateLeds()
 {
     usbShowStatusWithGreenLed();
@@ -49,7 +76,11 @@ void radioToUsb()
     uint8 XDATA * packet;
     static uint8 CODE resetString[] = "RX: RESET\r\n";
 
-    if ((packet = radioLinkRxCurrentPacket()) && usbComTxAvailable() >= packet[0]*2 + 30)
+    if ((packet = radioLinkRxCurrentPacket()) && radioLinkRxCurrentPayloadType() == STREAM_PAYLOAD_TYPE)
+    {
+        radioLinkRxDoneWithPacket();
+    }
+    else if (packet && usbComTxAvailable() >= packet[0]*2 + 30)
     {
         length = sprintf(buffer, "RX: %2d ", radioLinkRxCurrentPayloadType());
         for (i = 0; i < packet[0]; i++)
@@ -76,6 +107,87 @@ void radioToUsb()
 
 }
 
+void streamService()
+{
+    static uint32 lastReport = 0;
+    RADIO_LINK_STATS XDATA stats;
+    uint8 XDATA response[128];
+    uint8 responseLength;
+    uint8 XDATA * packet;
+    uint8 length;
+    uint8 i;
+
+    while (streaming && (packet = radioLinkTxCurrentPacket()))
+    {
+        length = radioLinkTxPayloadSize();
+        packet[0] = length;
+        for (i = 1; i <= length; i++)
+        {
+            packet[i] = i;
+        }
+        radioLinkTxSendPacket(STREAM_PAYLOAD_TYPE);
+    }
+
+    if ((uint32)(getMs() - lastReport) >= 1000 && usbComTxAvailable() >= sizeof(response))
+    {
+        lastReport = getMs();
+        radioLinkGetStats(&stats);
+        if (stats.txBytes != lastStats.txBytes || stats.rxBytes != lastStats.rxBytes)
+        {
+            responseLength = sprintf(response, "RATE: TX=%lu B/s, RX=%lu B/s, ACKs=%u/s, retx=%u/s, RTO=%d, RTT=%u us, busy=%d%%\r\n",
+                stats.txBytes - lastStats.txBytes, stats.rxBytes - lastStats.rxBytes,
+                (uint16)(stats.ackPackets - lastStats.ackPackets),
+                (uint16)(stats.retransmissions - lastStats.retransmissions),
+                stats.rto, stats.rtt, stats.utilization);
+            usbComTxSend(response, responseLength);
+        }
+        lastStats = stats;
+    }
+}
+
+void statsDumpService()
+{
+    uint8 XDATA response[128];
+    uint8 responseLength;
+
+    if (statsDumpLine == 0 || usbComTxAvailable() < 100)
+    {
+        return;
+    }
+
+    switch(statsDumpLine)
+    {
+    case 1:
+        responseLength = sprintf(response, "MAC: tx=%u, rx=%u, crc=%u, timeouts=%u, cal=%u/%u, deferred=%u, ovf=%u, unf=%u\r\n",
+            dumpMacStats.txPackets, dumpMacStats.rxPackets, dumpMacStats.crcErrors,
+            dumpMacStats.rxTimeouts, dumpMacStats.calibrations, dumpMacStats.calibrationsSkipped,
+            dumpMacStats.strobesDeferred, dumpMacStats.rxOverflows, dumpMacStats.txUnderflows);
+        break;
+    case 2:
+        responseLength = sprintf(response, "MAC: RSSI=%d/%d/%d dBm, LQI=%u/%u/%u\r\n",
+            dumpMacStats.rssiMin, dumpMacStats.rssiAverage, dumpMacStats.rssiMax,
+            dumpMacStats.lqiMin, dumpMacStats.lqiAverage, dumpMacStats.lqiMax);
+        break;
+    case 3:
+        responseLength = sprintf(response, "LINK: tx=%u, rx=%u, acks=%u, retx=%u, timeouts=%u, resets=%u\r\n",
+            dumpLinkStats.txPackets, dumpLinkStats.rxPackets, dumpLinkStats.ackPackets,
+            dumpLinkStats.retransmissions, dumpLinkStats.responseTimeouts, dumpLinkStats.resetPackets);
+        break;
+    default:
+        responseLength = sprintf(response, "LINK: TX=%lu B, RX=%lu B, naks=%u, pauses=%u, full=%u, trunc=%u\r\n",
+            dumpLinkStats.txBytes, dumpLinkStats.rxBytes, dumpLinkStats.nakPackets,
+            dumpLinkStats.txPauses, dumpLinkStats.rxBufferFull, dumpLinkStats.txTruncatedPackets);
+        break;
+    }
+
+    usbComTxSend(response, responseLength);
+
+    if (++statsDumpLine > 4)
+    {
+        statsDumpLine = 0;
+    }
+}
+
 void handleCommands()
 {
     uint8 XDATA txNotAvailable[] = "TX not available!\r\n";
@@ -83,14 +195,41 @@ void handleCommands()
     uint8 responseLength;
     static uint8 payloadType = 0;
 
-    if (usbComRxAvailable() && usbComTxAvailable() >= 50)
+    if (usbComRxAvailable() && usbComTxAvailable() >= 100)
     {
         uint8 byte = usbComRxReceiveByte();
         if (byte == (uint8)'?')
         {
-            responseLength = sprintf(response, "? RX=%d/%d, TX=%d/%d, M=%02x\r\n",
+            RADIO_LINK_STATS XDATA stats;
+            RADIO_MAC_STATS XDATA macStats;
+            radioLinkGetStats(&stats);
+            radioMacGetStats(&macStats);
+            responseLength = sprintf(response, "? RX=%d/%d, TX=%d/%d, M=%02x, tries=%u/%u/%u/%u/%u/%u, cal=%u/%u, profile=%d\r\n",
                     radioLinkRxMainLoopIndex, radioLinkRxInterruptIndex,
-                    radioLinkTxMainLoopIndex, radioLinkTxInterruptIndex, MARCSTATE);
+                    radioLinkTxMainLoopIndex, radioLinkTxInterruptIndex, MARCSTATE,
+                    stats.retries[0], stats.retries[1], stats.retries[2],
+                    stats.retries[3], stats.retries[4], stats.retries[5],
+                    macStats.calibrations, macStats.calibrationsSkipped, radioProfile);
+            usbComTxSend(response, responseLength);
+        }
+        else if (byte == (uint8)'x')
+        {
+            radioMacGetStats(&dumpMacStats);
+            radioLinkGetStats(&dumpLinkStats);
+            statsDumpLine = 1;
+        }
+        else if (byte == (uint8)'z')
+        {
+            radioMacResetStats();
+            radioLinkResetStats();
+            radioLinkGetStats(&lastStats);   // Keep the RATE report from going negative.
+            responseLength = sprintf(response, "STATS: RESET\r\n");
+            usbComTxSend(response, responseLength);
+        }
+        else if (byte == (uint8)'s')
+        {
+            streaming ^= 1;
+            responseLength = sprintf(response, streaming ? "STREAM: ON\r\n" : "STREAM: OFF\r\n");
             usbComTxSend(response, responseLength);
         }
         else if (byte >= (uint8)'a' && byte <= (uint8)'g')
@@ -109,7 +248,7 @@ void handleCommands()
                 radioLinkTxSendPacket(payloadType);
                 responseLength = sprintf(response, "TX: %2d %02x%02x%02x\r\n", payloadType, packet[1], packet[2], packet[3]);
                 usbComTxSend(response, responseLength);
-                if (payloadType == RADIO_LINK_MAX_PAYLOAD_TYPE)
+                if (payloadType == STREAM_PAYLOAD_TYPE - 1)
                 {
                     payloadType = 0;
                 }
@@ -127,6 +266,7 @@ void main()
     systemInit();
     usbInit();
 
+    radioLinkRequestedPayloadSize = RADIO_LINK_MAX_PAYLOAD_SIZE;
     radioLinkInit();
     randomSeedFromAdc();
 
@@ -141,6 +281,8 @@ void main()
         updateLeds();
         radioToUsb();
         handleCommands();
+        statsDumpService();
+        streamService();
         usbComService();
     }
 }
@@ -0,0 +1 @@
+APP_LIBS := usb_cdc_acm.lib usb.lib radio_net.lib radio_mac.lib radio_registers.lib wixel.lib random.lib dma.lib
\ No newline at end of file
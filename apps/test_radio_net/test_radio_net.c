@@ -0,0 +1,149 @@
+/** test_radio_net app:
+
+This app lets you test the radio_net library.  One Wixel should have its
+address parameter set to 0 so that it acts as the hub, and the other Wixels
+should have unique addresses from 1 to 254 so they act as nodes.
+
+Every node sends a packet with a counter in it to the hub every report_period_ms
+milliseconds.  The hub reports the packets it receives over USB, along with
+the address of the node that sent them, and the nodes report the packets they
+receive from the hub.
+
+Commands (sent over USB):
+  ?      Show the nodes in the hub's network.
+  a-g    On the hub, queue a short test packet to be sent to every node in the
+         network.  On a node, queue a short test packet to be sent to the hub.
+*/
+
+#include <wixel.h>
+#include <usb.h>
+#include <usb_com.h>
+#include <radio_net.h>
+#include <random.h>
+#include <stdio.h>
+
+/** Parameters ****************************************************************/
+
+int32 CODE param_address = 0;
+
+int32 CODE param_report_period_ms = 100;
+
+/** Functions *****************************************************************/
+
+void updateLeds()
+{
+    usbShowStatusWithGreenLed();
+    LED_YELLOW(radioNetConnected());
+    LED_RED(0);
+}
+
+void radioToUsb()
+{
+    uint8 XDATA buffer[128];
+    uint8 length;
+    uint8 i;
+    uint8 XDATA * packet;
+
+    if ((packet = radioNetRxCurrentPacket()) && usbComTxAvailable() >= packet[0]*3 + 20)
+    {
+        length = sprintf(buffer, "RX from %3d:", radioNetRxCurrentSource());
+        for (i = 0; i < packet[0]; i++)
+        {
+            length += sprintf(buffer + length, " %02x", packet[1+i]);
+        }
+        buffer[length++] = '\r';
+        buffer[length++] = '\n';
+
+        radioNetRxDoneWithPacket();
+        usbComTxSend(buffer, length);
+    }
+}
+
+void reportService()
+{
+    static uint16 lastReport = 0;
+    static uint16 counter = 0;
+    uint8 XDATA * packet;
+
+    if (!radioNetIsHub() && (uint16)(getMs() - lastReport) >= param_report_period_ms &&
+        (packet = radioNetTxCurrentPacket()))
+    {
+        lastReport = getMs();
+        counter++;
+        packet[0] = 2;
+        packet[1] = counter >> 8;
+        packet[2] = counter;
+        radioNetTxSendPacket(RADIO_NET_HUB_ADDRESS);
+    }
+}
+
+void sendTestPacket(uint8 address, uint8 byte)
+{
+    uint8 XDATA * packet = radioNetTxCurrentPacket();
+    if (packet != 0)
+    {
+        packet[0] = 3; // Packet length
+        packet[1] = byte;
+        packet[2] = byte + 1;
+        packet[3] = byte + 2;
+        radioNetTxSendPacket(address);
+    }
+}
+
+void handleCommands()
+{
+    uint8 XDATA response[128];
+    uint8 responseLength;
+    uint8 i;
+
+    if (usbComRxAvailable() && usbComTxAvailable() >= 100)
+    {
+        uint8 byte = usbComRxReceiveByte();
+        if (byte == (uint8)'?')
+        {
+            responseLength = sprintf(response, "? address=%d, discarded=%u, nodes=%d:",
+                radioNetAddress, radioNetTxDiscardedPackets(), radioNetPeerCount());
+            for (i = 0; i < radioNetPeerCount() && responseLength < sizeof(response) - 8; i++)
+            {
+                responseLength += sprintf(response + responseLength, " %d", radioNetPeerAddress(i));
+            }
+            response[responseLength++] = '\r';
+            response[responseLength++] = '\n';
+            usbComTxSend(response, responseLength);
+        }
+        else if (byte >= (uint8)'a' && byte <= (uint8)'g')
+        {
+            if (radioNetIsHub())
+            {
+                for (i = 0; i < radioNetPeerCount(); i++)
+                {
+                    sendTestPacket(radioNetPeerAddress(i), byte);
+                }
+            }
+            else
+            {
+                sendTestPacket(RADIO_NET_HUB_ADDRESS, byte);
+            }
+        }
+    }
+}
+
+void main()
+{
+    systemInit();
+    usbInit();
+
+    radioNetAddress = param_address;
+    radioNetInit();
+    randomSeedFromAdc();
+
+    while(1)
+    {
+        boardService();
+        updateLeds();
+        radioToUsb();
+        handleCommands();
+        reportService();
+        usbComService();
+    }
+}
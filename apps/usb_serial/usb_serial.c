@@ -102,5 +102,10 @@ void main()
         updateLeds();
         usbComService();
         usbToUartService();
+
+        // Stop the CPU until the next interrupt.  The USB and UART interrupts
+        // wake it up when there are bytes to move, and the 1 ms timer interrupt
+        // wakes it up for everything else.
+        usbIdle();
     }
 }
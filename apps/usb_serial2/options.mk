@@ -0,0 +1 @@
+APP_LIBS := wixel.lib dma.lib usb.lib usb_cdc_acm2.lib uart.lib gpio.lib
\ No newline at end of file
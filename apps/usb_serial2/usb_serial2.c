@@ -0,0 +1,126 @@
+/** usb_serial2 app:
+
+This app turns a Wixel into a USB-to-TTL serial adapter with two ports.  It
+uses usb_cdc_acm2.lib, so the computer sees two virtual COM ports: the first
+one is connected to UART1 and the second one is connected to UART0.  The
+baud rate, parity, and stop bits of each UART follow the settings of its
+virtual COM port.
+
+The Wixel uses USB product ID 0x2202 with this app, so it needs a driver for
+that product ID.  The SDK installer installs one; it is in
+installer/wixel_cdc_acm2.inf.
+
+
+== Pinout ==
+
+P1_6 = TX of the first port:  transmits data from computer
+P1_7 = RX of the first port:  receives data and sends it to the computer
+P0_3 = TX of the second port: transmits data from computer
+P0_2 = RX of the second port: receives data and sends it to the computer
+*/
+
+/** Dependencies **************************************************************/
+#include <cc2511_map.h>
+#include <board.h>
+#include <time.h>
+
+#include <usb.h>
+#include <usb_com.h>
+
+#include <uart0.h>
+#include <uart1.h>
+
+/** Global Variables **********************************************************/
+
+// Bytes on their way from one interface to another.  Moving them in blocks
+// takes much less CPU time than moving them one at a time.
+static uint8 XDATA buffer[64];
+
+/** Functions *****************************************************************/
+void updateLeds()
+{
+    usbShowStatusWithGreenLed();
+    LED_YELLOW(usbComPortRxControlSignals(0) & ACM_CONTROL_LINE_DTR);
+    LED_RED(usbComPortRxControlSignals(1) & ACM_CONTROL_LINE_DTR);
+}
+
+// Returns the number of bytes to move: as many as the source has and the
+// destination can take, but no more than fit in the buffer.
+uint8 blockSize(uint8 available, uint8 space)
+{
+    uint8 size = available < space ? available : space;
+    return size < sizeof(buffer) ? size : sizeof(buffer);
+}
+
+void usbToUartService()
+{
+    uint8 size;
+
+    size = blockSize(usbComPortRxAvailable(0), uart1TxAvailable());
+    if (size)
+    {
+        usbComPortRxReceive(0, buffer, size);
+        uart1TxSend(buffer, size);
+    }
+
+    size = blockSize(uart1RxAvailable(), usbComPortTxAvailable(0));
+    if (size)
+    {
+        uart1RxReceive(buffer, size);
+        usbComPortTxSend(0, buffer, size);
+    }
+
+    size = blockSize(usbComPortRxAvailable(1), uart0TxAvailable());
+    if (size)
+    {
+        usbComPortRxReceive(1, buffer, size);
+        uart0TxSend(buffer, size);
+    }
+
+    size = blockSize(uart0RxAvailable(), usbComPortTxAvailable(1));
+    if (size)
+    {
+        uart0RxReceive(buffer, size);
+        usbComPortTxSend(1, buffer, size);
+    }
+}
+
+void lineCodingChanged()
+{
+    ACM_LINE_CODING XDATA * lineCoding = usbComPortLineCoding(usbComLineCodingChangePort);
+
+    if (usbComLineCodingChangePort == 0)
+    {
+        uart1SetBaudRate(lineCoding->dwDTERate);
+        uart1SetParity(lineCoding->bParityType);
+        uart1SetStopBits(lineCoding->bCharFormat);
+    }
+    else
+    {
+        uart0SetBaudRate(lineCoding->dwDTERate);
+        uart0SetParity(lineCoding->bParityType);
+        uart0SetStopBits(lineCoding->bCharFormat);
+    }
+}
+
+void main()
+{
+    systemInit();
+    usbInit();
+    usbComLineCodingChangeHandler = &lineCodingChanged;
+
+    uart0Init();
+    uart1Init();
+    usbComLineCodingChangePort = 0;
+    lineCodingChanged();
+    usbComLineCodingChangePort = 1;
+    lineCodingChanged();
+
+    while(1)
+    {
+        boardService();
+        updateLeds();
+        usbComService();
+        usbToUartService();
+    }
+}
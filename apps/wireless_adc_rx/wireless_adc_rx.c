@@ -40,6 +40,17 @@ To use this data in your application, you can either write PC software that
 reads the data from the COM port and does something with it, or you can
 modify this app.
 
+== TDMA Mode ==
+
+If many transmitters are using the same channel, some of their reports will
+collide and be lost.  To avoid this, set the tdma_slots parameter to the same
+non-zero value (at most 120) on this receiver and on every transmitter, and
+give every transmitter a different slot with the tdma_slot parameter of
+wireless_adc_tx (a transmitter without a valid slot does not use TDMA).  The receiver will then send a beacon to start each frame,
+and each transmitter will only send reports in its own slot.  Each frame is
+about 1.8 ms times (tdma_slots + 2) long, and each transmitter can send at most
+one report per frame.  Only one receiver on each channel should use TDMA mode.
+
 */
 
 /** Dependencies **************************************************************/
@@ -50,6 +61,14 @@ modify this app.
 
 #include <stdio.h>
 
+/** Parameters ****************************************************************/
+
+// The number of TDMA slots (0-120).  If it is not 0, this Wixel sends TDMA beacons.
+int32 CODE param_tdma_slots = 0;
+
+// The largest number of TDMA slots supported by radio_queue.
+#define TDMA_MAX_SLOTS 120
+
 /** Types *********************************************************************/
 
 typedef struct adcReport
@@ -110,6 +129,12 @@ void main(void)
 {
     systemInit();
     usbInit();
+
+    if (param_tdma_slots > 0 && param_tdma_slots <= TDMA_MAX_SLOTS)
+    {
+        radioQueueTdmaSlotCount = (uint8)param_tdma_slots;
+        radioQueueTdmaBeaconSender = 1;
+    }
     radioQueueInit();
 
     while(1)
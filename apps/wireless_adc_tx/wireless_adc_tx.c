@@ -10,14 +10,12 @@ For more information about how to use this app, see the documentation in
 apps/wireless_adc_rx/wireless_adc_rx.c.
 */
 
-// TODO: Add a few ms of randomness to the timing so that we don't get into a
-// situation where two Wixels are interfering with each other for every packet?
-
 /** Dependencies **************************************************************/
 #include <wixel.h>
 #include <usb.h>
 #include <usb_com.h>
 #include <radio_queue.h>
+#include <random.h>
 
 
 /** Parameters ****************************************************************/
@@ -26,6 +24,18 @@ int32 CODE param_input_mode = 0;
 
 int32 CODE param_report_period_ms = 20;
 
+// The number of TDMA slots (0-120).  This must be the same as param_tdma_slots
+// in the receiver.  If it is 0, TDMA mode is disabled.
+int32 CODE param_tdma_slots = 0;
+
+// The TDMA slot that this Wixel transmits in (0 to param_tdma_slots - 1).
+// Every transmitter must be given a different slot.  TDMA mode is disabled
+// unless this is set to a valid slot.
+int32 CODE param_tdma_slot = -1;
+
+// The largest number of TDMA slots supported by radio_queue.
+#define TDMA_MAX_SLOTS 120
+
 
 /** Functions *****************************************************************/
 void analogInputsInit()
@@ -62,12 +72,19 @@ void updateLeds()
 void adcToRadioService()
 {
     static uint16 lastTx = 0;
+    static uint8 jitter = 0;
 
     uint8 XDATA * txPacket;
 
     // Check to see if it is time to send a report and
     // if there is a radio TX buffer available.
-    if ((uint16)(getMs() - lastTx) >= param_report_period_ms && (txPacket = radioQueueTxCurrentPacket()))
+    // In TDMA mode, we can send at most one report per frame, so we only queue
+    // one report at a time to make sure the reports are not stale when they are sent.
+    // Without TDMA, a few ms of random jitter is added to each period so that two
+    // transmitters with the same period do not collide on every report.
+    if ((uint16)(getMs() - lastTx) >= param_report_period_ms + jitter &&
+        (radioQueueTdmaSlotCount == 0 || radioQueueTxQueued() == 0) &&
+        (txPacket = radioQueueTxCurrentPacket()))
     {
         // Both of those conditions are true, so send a report.
 
@@ -76,6 +93,10 @@ void adcToRadioService()
 
         // This should be done before all the ADC readings, which take about 3 ms.
         lastTx = getMs();
+        if (radioQueueTdmaSlotCount == 0)
+        {
+            jitter = randomNumber() & 3;
+        }
 
         // Byte 0 is the length.
         txPacket[0] = 16;
@@ -98,11 +119,29 @@ void adcToRadioService()
     }
 }
 
+void tdmaInit()
+{
+    // TDMA is only used if the slot count and this Wixel's slot are both valid.
+    // A transmitter without a slot of its own would collide with another
+    // transmitter's reports in every frame, so it uses random jitter instead.
+    if (param_tdma_slots > 0 && param_tdma_slots <= TDMA_MAX_SLOTS &&
+        param_tdma_slot >= 0 && param_tdma_slot < param_tdma_slots)
+    {
+        radioQueueTdmaSlotCount = (uint8)param_tdma_slots;
+        radioQueueTdmaSlot = (uint8)param_tdma_slot;
+    }
+    else
+    {
+        radioQueueTdmaSlotCount = 0;
+    }
+}
+
 void main(void)
 {
     systemInit();
     analogInputsInit();
     usbInit();
+    tdmaInit();
     radioQueueInit();
 
     while(1)
@@ -7,7 +7,6 @@
 /*
  * TODO: To avoid damage, don't enable nDTR and nRTS outputs by default.
  * TODO: use LEDs to give feedback about sending/receiving bytes.
- * TODO: UART flow control.
  * TODO: Obey CDC-ACM Set Line Coding commands:
  *       In USB-RADIO mode, bauds 0-255 would correspond to radio channels.
  * TODO: shut down radio when we are in a different serial mode
@@ -39,6 +38,20 @@ int32 CODE param_serial_mode = SERIAL_MODE_AUTO;
 
 int32 CODE param_baud_rate = 9600;
 
+// 1 enables RTS/CTS flow control on the UART: P1_5 is nRTS and P1_4 is nCTS.
+int32 CODE param_flow_control = 0;
+
+// 1 makes the UART use DMA instead of interrupts (see uart1DmaMode), which
+// helps at high baud rates.  This takes all of the DMA channels that the USB
+// library would use, so USB transfers get a little slower.  Parity and framing
+// errors are not detected in this mode.
+int32 CODE param_uart_dma = 0;
+
+// 1 lets the radio link wait a few milliseconds for data to send back before
+// acknowledging a packet (see radioLinkDelayedAckMode).  This lowers the latency
+// of request/response traffic, but it can slow down transfers in one direction.
+int32 CODE param_delayed_ack = 0;
+
 int32 CODE param_nDTR_pin = 10;
 int32 CODE param_nRTS_pin = 11;
 int32 CODE param_nDSR_pin = 12;
@@ -281,19 +294,34 @@ void updateSerialMode()
     }
 }
 
+/* The bridge functions below move data in chunks instead of one byte at a time.
+   When the radio is involved, the data is read from or written to the radio packet
+   buffers in place, so it only gets copied once. */
+
+// Used for holding data that is moving between USB and the UART.
+static uint8 XDATA bridgeBuffer[64];
+
+static uint8 min(uint8 a, uint8 b)
+{
+    return a < b ? a : b;
+}
+
 void usbToRadioService()
 {
     uint8 signals;
+    uint8 count;
 
     // Data
-    while(usbComRxAvailable() && radioComTxAvailable())
+    while(count = min(usbComRxAvailable(), radioComTxBufferAvailable()))
     {
-        radioComTxSendByte(usbComRxReceiveByte());
+        usbComRxReceive(radioComTxBuffer(), count);
+        radioComTxCommit(count);
     }
 
-    while(radioComRxAvailable() && usbComTxAvailable())
+    while(count = min(radioComRxAvailable(), usbComTxAvailable()))
     {
-        usbComTxSendByte(radioComRxReceiveByte());
+        usbComTxSend(radioComRxBuffer(), count);
+        radioComRxConsume(count);
     }
 
     // Control Signals
@@ -307,15 +335,19 @@ void usbToRadioService()
 
 void uartToRadioService()
 {
+    uint8 count;
+
     // Data
-    while(uart1RxAvailable() && radioComTxAvailable())
+    while(count = min(uart1RxAvailable(), radioComTxBufferAvailable()))
     {
-        radioComTxSendByte(uart1RxReceiveByte());
+        uart1RxReceive(radioComTxBuffer(), count);
+        radioComTxCommit(count);
     }
 
-    while(radioComRxAvailable() && uart1TxAvailable())
+    while(count = min(radioComRxAvailable(), uart1TxAvailable()))
     {
-        uart1TxSendByte(radioComRxReceiveByte());
+        uart1TxSend(radioComRxBuffer(), count);
+        radioComRxConsume(count);
     }
 
     // Control Signals.
@@ -326,16 +358,19 @@ void uartToRadioService()
 void usbToUartService()
 {
     uint8 signals;
+    uint8 count;
 
     // Data
-    while(usbComRxAvailable() && uart1TxAvailable())
+    while(count = min(min(usbComRxAvailable(), uart1TxAvailable()), sizeof(bridgeBuffer)))
     {
-        uart1TxSendByte(usbComRxReceiveByte());
+        usbComRxReceive(bridgeBuffer, count);
+        uart1TxSend(bridgeBuffer, count);
     }
 
-    while(uart1RxAvailable() && usbComTxAvailable())
+    while(count = min(uart1RxBufferAvailable(), usbComTxAvailable()))
     {
-        usbComTxSendByte(uart1RxReceiveByte());
+        usbComTxSend(uart1RxBuffer(), count);
+        uart1RxConsume(count);
     }
 
     ioTxSignals(usbComRxControlSignals());
@@ -356,18 +391,27 @@ void main()
 
     usbInit();
 
+    uart1DmaMode = param_uart_dma ? 1 : 0;
     uart1Init();
     uart1SetBaudRate(param_baud_rate);
+    uart1SetFlowControl(param_flow_control ? 1 : 0);
 
     if (param_serial_mode != SERIAL_MODE_USB_UART)
     {
         radioComRxEnforceOrdering = 1;
+        radioLinkWindowedMode = 1;
+        radioLinkDelayedAckMode = param_delayed_ack ? 1 : 0;
+        radioLinkRequestedPayloadSize = RADIO_LINK_MAX_PAYLOAD_SIZE;  // Limited to the size radio_link.lib was built with.
         radioComInit();
     }
 
-    // Set up P1_5 to be the radio's TX debug signal.
-    P1DIR |= (1<<5);
-    IOCFG0 = 0b011011; // P1_5 = PA_PD (TX mode)
+    // Set up P1_5 to be the radio's TX debug signal, unless it is being
+    // used as nRTS for flow control.
+    if (!param_flow_control)
+    {
+        P1DIR |= (1<<5);
+        IOCFG0 = 0b011011; // P1_5 = PA_PD (TX mode)
+    }
 
     while(1)
     {
@@ -9,6 +9,7 @@
 #define _DMA_H_
 
 #include <cc2511_map.h>
+#include <cc2511_types.h>
 
 /*! Initializes the DMA1CFGL and DMA1CFGH registers to point
  * to ::dmaConfig.
@@ -29,13 +30,13 @@ typedef struct DMA14_CONFIG
      * radio packets. */
     volatile DMA_CONFIG radio;
 
-    /*! Config struct for DMA channel 2 (unassigned) */
+    /*! Config struct for DMA channel 2 (see dmaAllocateChannel()) */
     volatile DMA_CONFIG _2;
 
-    /*! Config struct for DMA channel 3 (unassigned) */
+    /*! Config struct for DMA channel 3 (see dmaAllocateChannel()) */
     volatile DMA_CONFIG _3;
 
-    /*! Config struct for DMA channel 4 (unassigned) */
+    /*! Config struct for DMA channel 4 (see dmaAllocateChannel()) */
     volatile DMA_CONFIG _4;
 } DMA14_CONFIG;
 
@@ -47,4 +48,63 @@ typedef struct DMA14_CONFIG
  (or systemInit()) for this struct to work. */
 extern DMA14_CONFIG XDATA dmaConfig;
 
+/*! Reserves one of the unassigned DMA channels (2, 3, or 4) so that
+ * no other library will use it.
+ *
+ * These libraries reserve channels:
+ * - <code>usb.lib</code>: one channel, the first time the Wixel is connected
+ *   to USB.
+ * - <code>spi0_master.lib</code> and <code>spi1_master.lib</code>: two
+ *   channels each in DMA mode (#spi0MasterDmaMode).
+ * - <code>uart.lib</code>: all three channels in DMA mode (#uart0DmaMode),
+ *   because the DMA controller can not tell us how many bytes it has
+ *   received, so a second channel is needed to keep track of that.
+ *
+ * So a UART in DMA mode can not share the channels with anything else,
+ * and an SPI master in DMA mode can only share them with USB.  Each of
+ * these libraries falls back to not using DMA if it can not get the
+ * channels it needs, so the library that is initialized first gets them.
+ *
+ * \return The number of the channel, or 0 if all of them are already
+ *   reserved.  Code that calls this should fall back to not using DMA
+ *   if it returns 0.
+ *
+ * This should be called once when a library is initialized, not before
+ * every transfer.  Use
+ * dmaChannelConfig() to get the channel's configuration struct. */
+uint8 dmaAllocateChannel(void);
+
+/*! Releases a channel that was reserved with dmaAllocateChannel() so it
+ * can be allocated again.  This is only needed by code that reserves
+ * several channels and then finds out it can not get all the channels it
+ * needs.  The channel must not be armed.
+ *
+ * \param channel A channel number returned by dmaAllocateChannel(). */
+void dmaFreeChannel(uint8 channel);
+
+/*! \return A pointer to the configuration struct in ::dmaConfig for
+ *   the specified DMA channel.
+ * \param channel A channel number from 1 to 4. */
+#define dmaChannelConfig(channel) (&dmaConfig.radio + ((channel) - 1))
+
+/*! A function that the DMA interrupt calls when a channel finishes a
+ * transfer.  It runs in the interrupt, so it must be reentrant. */
+typedef void (*DMA_CHANNEL_HANDLER)(void) __reentrant;
+
+/*! Makes the DMA interrupt call a function each time a channel finishes a
+ * transfer, and enables the DMA interrupt.  The channel's configuration
+ * must have the IRQMASK bit (DC7 bit 3) set, or the interrupt will not run.
+ *
+ * There is only one DMA interrupt, so libraries that need it share it
+ * through this function instead of defining their own ISR.  The DMA
+ * interrupt has the same priority as the RF interrupt.
+ *
+ * \param channel A channel number returned by dmaAllocateChannel().
+ * \param handler The function to call, or 0 to stop calling one. */
+void dmaSetChannelHandler(uint8 channel, DMA_CHANNEL_HANDLER handler);
+
+/*! A prototype for the DMA interrupt, which calls the handlers set with
+ * dmaSetChannelHandler(). */
+ISR(DMA, 0);
+
 #endif
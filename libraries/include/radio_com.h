@@ -27,6 +27,36 @@
 
 #include <radio_link.h>
 
+/*! Statistics about the data sent and received by <code>radio_com.lib</code>.
+ * See radioComGetStats().  The statistics for the lower layers are available
+ * from radioLinkGetStats() and radioMacGetStats(). */
+typedef struct RADIO_COM_STATS
+{
+    /*! The number of data bytes given to the radio link layer to send. */
+    uint32 txBytes;
+
+    /*! The number of data bytes received from the other Wixel. */
+    uint32 rxBytes;
+
+    /*! The number of data packets given to the radio link layer to send. */
+    uint16 txPackets;
+
+    /*! The number of data packets that were sent before they were full, either
+     * to reduce latency or because control signals needed to be sent.
+     * If this is close to txPackets, calling radioComTxService() less often or
+     * writing bytes in bigger chunks might improve throughput. */
+    uint16 txPartialPackets;
+
+    /*! The number of data packets received from the other Wixel. */
+    uint16 rxPackets;
+
+    /*! The number of control signal packets sent. */
+    uint16 txSignalPackets;
+
+    /*! The number of control signal packets received. */
+    uint16 rxSignalPackets;
+} RADIO_COM_STATS;
+
 /*! Initializes the <code>radio_com.lib</code> library and the
  * lower-level libraries that it depends on.
  * This must be called before any of the other radioCom* functions. */
@@ -68,6 +98,46 @@ uint8 radioComRxAvailable(void);
  * radioComRxAvailable(). */
 uint8 radioComRxReceiveByte(void);
 
+/*! Reads the specified number of bytes from the RX buffer and stores them in memory.
+ *
+ * \param buffer The buffer to store the data in.
+ * \param size The number of bytes to read.
+ *
+ * This is a non-blocking function: you must call radioComRxAvailable() before calling
+ * this function and be sure not to read too many bytes.
+ * The \p size parameter should not exceed the last value returned by
+ * radioComRxAvailable().
+ *
+ * See also radioComRxReceiveByte() and radioComRxBuffer(). */
+void radioComRxReceive(uint8 XDATA * buffer, uint8 size);
+
+/*! \return A pointer to the next byte in the RX buffer.
+ *
+ * This function lets you read the received bytes directly from the radio
+ * packet buffer instead of copying them.  The number of bytes that can be
+ * read from the returned pointer is the value returned by radioComRxAvailable().
+ * When you are done reading them, call radioComRxConsume() to remove them from the
+ * RX buffer.  Example usage:
+\code
+uint8 count = radioComRxAvailable();
+if (count != 0)
+{
+    uint8 XDATA * data = radioComRxBuffer();
+    // Process up to count bytes from data here.
+    radioComRxConsume(count);
+}
+\endcode
+ *
+ * The pointer is only valid until the next call to a radioComRx function. */
+uint8 XDATA * radioComRxBuffer(void);
+
+/*! Removes bytes from the RX buffer without reading them.
+ * This should be called after reading bytes with radioComRxBuffer().
+ *
+ * \param size The number of bytes to remove.  This should not exceed the last
+ *   value returned by radioComRxAvailable().  A size of 0 does nothing. */
+void radioComRxConsume(uint8 size);
+
 /*! This function must be called regularly if you want to send data
  * or control signals to the other Wixel. */
 void radioComTxService(void);
@@ -87,6 +157,53 @@ uint8 radioComTxAvailable(void);
  * If you call this function, you must also call radioComTxService() regularly. */
 void radioComTxSendByte(uint8 byte);
 
+/*! Adds bytes to the TX buffer, which means they will be eventually
+ * sent to the other Wixel over the radio.
+ *
+ * \param buffer A pointer to the bytes to send.
+ * \param size The number of bytes to send.
+ *
+ * This is a non-blocking function: you must call radioComTxAvailable() before calling this
+ * function and be sure not to add too many bytes to the buffer.
+ * The \p size parameter should not exceed the last value returned by radioComTxAvailable().
+ *
+ * If you call this function, you must also call radioComTxService() regularly. */
+void radioComTxSend(const uint8 XDATA * buffer, uint8 size);
+
+/*! \return The number of bytes that can be written to the pointer returned
+ *   by radioComTxBuffer().
+ *
+ * This is the amount of space left in the radio packet that is currently
+ * being populated, so it will never be more than radioLinkTxPayloadSize(),
+ * even if radioComTxAvailable() is higher. */
+uint8 radioComTxBufferAvailable(void);
+
+/*! \return A pointer to the space in the TX buffer where the next byte will go.
+ *
+ * This function lets you write bytes directly into the radio packet buffer
+ * instead of copying them.  You should call radioComTxBufferAvailable() first
+ * and only call this function if it returns a non-zero value.  After writing
+ * the bytes, call radioComTxCommit() to add them to the TX buffer.  Example usage:
+\code
+uint8 count = radioComTxBufferAvailable();
+if (count != 0)
+{
+    uint8 XDATA * space = radioComTxBuffer();
+    // Write up to count bytes to space here.
+    radioComTxCommit(count);
+}
+\endcode
+ *
+ * If you call this function, you must also call radioComTxService() regularly. */
+uint8 XDATA * radioComTxBuffer(void);
+
+/*! Adds the bytes that were written to the pointer returned by radioComTxBuffer()
+ * to the TX buffer.
+ *
+ * \param size The number of bytes that were written.  This should not exceed the
+ *   last value returned by radioComTxBufferAvailable(). */
+void radioComTxCommit(uint8 size);
+
 /*! \param controlSignals The state of the eight virtual TX control signals.
  *   Each bit represents a different control signal.
  *
@@ -113,4 +230,14 @@ void radioComTxControlSignals(uint8 controlSignals);
  * signals) is determined by higher-level code. */
 uint8 radioComRxControlSignals(void);
 
+/*! Copies the statistics about the data sent and received by this library
+ * to the specified struct.
+ *
+ * These numbers are only updated when your code calls the radioCom functions,
+ * so this function should be called from the same place. */
+void radioComGetStats(RADIO_COM_STATS XDATA * stats);
+
+/*! Sets all the counters returned by radioComGetStats() to zero. */
+void radioComResetStats(void);
+
 #endif /* RADIO_COM_H_ */
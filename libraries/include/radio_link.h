@@ -28,17 +28,30 @@
 #include <cc2511_types.h>
 #include <radio_mac.h>
 
-/*! Each packet can contain at most 18 bytes of payload.
- * This limit is imposed by the <code>radio_link.lib</code> library,
- * not the CC2511. */
+/*! Each packet can contain at least 18 bytes of payload.
+ * Every Wixel using this library can receive packets of this size, so
+ * a packet with this much payload can always be sent.
+ * Larger packets can be used if both Wixels support them: see
+ * #radioLinkRequestedPayloadSize and radioLinkTxPayloadSize(). */
 #define RADIO_LINK_PAYLOAD_SIZE 18
 
+/*! The largest payload that this library can send or receive in one packet.
+ * This limit is imposed by the protocol and the CC2511's 64-byte FIFO.
+ * By default, the packet buffers of <code>radio_link.lib</code> only have room
+ * for #RADIO_LINK_PAYLOAD_SIZE bytes, to save RAM.  To use larger payloads,
+ * the library must be compiled with a larger RADIO_LINK_BUFFER_PAYLOAD_SIZE
+ * (see libraries/src/radio_link/lib_options.mk). */
+#define RADIO_LINK_MAX_PAYLOAD_SIZE 62
+
 /*! Each packet has a "Payload Type" attached to it,
  * which is a number between 0 and #RADIO_LINK_MAX_PAYLOAD_TYPE.
  * The meanings of the different payload types can be defined by
  * higher-level code. */
 #define RADIO_LINK_MAX_PAYLOAD_TYPE 15
 
+/*! The maximum number of channels in #radioLinkHopChannels. */
+#define RADIO_LINK_MAX_HOP_CHANNELS 15
+
 /*! Defines the frequency to use.  Valid values are from
  * 0 to 255.  To avoid interference, the channel numbers of
  * different Wixel pairs operating in the should be at least
@@ -94,6 +107,119 @@ extern int32 CODE param_radio_channel;
  */
 extern volatile BIT radioLinkResetPacketReceived;
 
+/*! Set this bit to 1 before calling radioLinkInit() to allow the library
+ * to use its windowed protocol.  The default value is 0.
+ *
+ * In the windowed protocol, up to 8 data packets can be sent in a burst
+ * before the other Wixel acknowledges them, and only the packets that were
+ * lost get sent again.  This can greatly increase the throughput of the link.
+ *
+ * The windowed protocol is only used if both Wixels have enabled it.  The
+ * Wixels tell each other which protocols they support when they exchange
+ * reset packets, so a Wixel with this bit set can still communicate with one
+ * that has it cleared or that is running an older version of this library.
+ * You can call radioLinkWindowed() to find out which protocol is being used. */
+extern BIT radioLinkWindowedMode;
+
+/*! Set this bit to 1 before calling radioLinkInit() to allow the library
+ * to delay its acknowledgments in the windowed protocol.  The default value is 0.
+ *
+ * Normally, when the other Wixel finishes sending a burst of packets and
+ * this Wixel has no data to send back, it sends an acknowledgment right away.
+ * With this bit set, it waits up to about 9 ms first, and if the
+ * higher-level code queues some data during that time, the acknowledgment
+ * is sent right away along with that data instead of in a separate packet.
+ * This reduces the number of packets and collisions when small amounts of
+ * data are flowing in both directions.  The acknowledgment is never delayed
+ * when the other Wixel has more data queued than its window lets it send,
+ * so one-way bulk transfers are not slowed down, but a sender that trickles
+ * data in one direction can still see its latency go up by the delay.
+ *
+ * This only has an effect if the windowed protocol is being used (see
+ * #radioLinkWindowedMode) and both Wixels have set this bit. */
+extern BIT radioLinkDelayedAckMode;
+
+/*! The largest payload that this Wixel is willing to receive in one packet.
+ * Set this before calling radioLinkInit().  Valid values are from
+ * #RADIO_LINK_PAYLOAD_SIZE (the default) to #RADIO_LINK_MAX_PAYLOAD_SIZE.
+ * radioLinkInit() lowers this to the size of the library's packet buffers
+ * if it is larger (see #RADIO_LINK_MAX_PAYLOAD_SIZE).
+ *
+ * Larger packets have less overhead from the preamble, sync word, header,
+ * and CRC, so they can give much higher throughput, but each one takes
+ * longer to send so it is more likely to be corrupted by interference.
+ *
+ * The Wixels tell each other this value when they exchange reset packets,
+ * and each one sends packets no bigger than what the other can receive.
+ * See radioLinkTxPayloadSize(). */
+extern uint8 radioLinkRequestedPayloadSize;
+
+/*! The extra channels to use in frequency hopping mode.  To enable
+ * frequency hopping, fill this array with channel numbers (the same
+ * kind of values as the radio_channel parameter) and set
+ * #radioLinkHopChannelCount before calling radioLinkInit().
+ *
+ * Both Wixels must use the same list in the same order.  The channel
+ * specified by the radio_channel parameter is the "home" channel: it is
+ * always part of the hop sequence, and it is where the Wixels exchange
+ * reset packets and where they go to find each other again if they lose
+ * contact.
+ *
+ * In frequency hopping mode, the Wixels move to the next channel in the
+ * list every time one of them finishes sending and the other one starts.
+ * Each Wixel keeps loss statistics for every channel (see
+ * radioLinkGetHopStats()), and channels that lose too many packets are
+ * blacklisted by both Wixels and skipped (see radioLinkHopBlacklist()).
+ * Frequency hopping is only used if both Wixels have enabled it.
+ *
+ * The radio calibrates its frequency synthesizer (roughly 0.8 ms) the first
+ * time it uses each channel and about once a second after that; the other
+ * channel changes only restart the radio.  So hopping reduces the maximum
+ * throughput a little in exchange for being more robust against
+ * interference on any single channel. */
+extern uint8 XDATA radioLinkHopChannels[RADIO_LINK_MAX_HOP_CHANNELS];
+
+/*! The number of channels in #radioLinkHopChannels that should be used.
+ * The default is 0, which disables frequency hopping. */
+extern uint8 radioLinkHopChannelCount;
+
+/*! Set this bit to 1 before calling radioLinkInit() to allow the library
+ * to use the radio's forward error correction (FEC).  The default value is 0.
+ *
+ * With FEC, the radio encodes each packet so that the receiver can correct
+ * short bursts of bit errors, which greatly reduces the number of packets
+ * that have to be sent again on a noisy or distant link.  The cost is that
+ * every packet takes twice as long to send, and because the CC2511 only
+ * supports FEC with fixed-length packets, every packet (including packets
+ * that only contain an acknowledgment) is padded to the largest payload size
+ * that both Wixels agreed on.  If you enable FEC, you should probably leave
+ * #radioLinkRequestedPayloadSize small.
+ *
+ * FEC is only used if both Wixels have enabled it.  The reset packets are
+ * always sent without FEC, and both Wixels switch to FEC after they have
+ * exchanged them.  If the Wixels stop hearing each other for a while, they
+ * both switch back to sending without FEC until they hear each other again,
+ * so they cannot get stuck using different settings.  You can call
+ * radioLinkFec() to find out whether FEC is being used. */
+extern BIT radioLinkFecMode;
+
+/*! Set this bit to 1 before calling radioLinkInit() to let the library
+ * change the radio's data rate to suit the link.  The default value is 0.
+ *
+ * The link always starts with the data rate profile in #radioProfile (see
+ * radio_registers.h).  When responses from the other Wixel keep getting lost,
+ * the library switches both Wixels to the next slower profile, which has a
+ * better range.  When many exchanges in a row succeed and the signal is strong,
+ * it switches to the next faster profile.  The library will not go slower than
+ * #RADIO_PROFILE_100K or faster than #RADIO_PROFILE_350K (but it will start
+ * at #RADIO_PROFILE_500K if that is what #radioProfile is).
+ *
+ * Auto-rate mode is only used if both Wixels have enabled it and start with
+ * the same profile.  If the Wixels stop hearing each other for a while, they
+ * both return to the profile they started with.  You can read #radioProfile
+ * to find out which profile is being used. */
+extern BIT radioLinkAutoRateMode;
+
 /*! Initializes the <code>radio_link.lib</code> library and the lower-level
  *  libraries that it depends on.  This must be called before
  *  any other functions in the library. */
@@ -107,11 +233,21 @@ uint8 radioLinkTxAvailable(void);
  * (holding a data packet that has not been successfully sent yet). */
 uint8 radioLinkTxQueued(void);
 
+/*! \return The largest payload that can currently be sent to the other Wixel.
+ *
+ * This is at least #RADIO_LINK_PAYLOAD_SIZE, and it is only larger if both Wixels
+ * set #radioLinkRequestedPayloadSize to a larger value.  This value can change
+ * whenever a reset packet is received.  If the other Wixel gets reset and
+ * starts accepting smaller packets, then any bytes beyond the new limit in the
+ * packets that are already queued will be dropped, and
+ * RADIO_LINK_STATS::txTruncatedPackets will be incremented. */
+uint8 radioLinkTxPayloadSize(void);
+
 /*! \return A pointer to the current TX packet, or 0 if no packet is available.
  *
  * To populate this packet, you should
  * write the length of the payload data (which must not exceed
- * #RADIO_LINK_PAYLOAD_SIZE) to offset 0, and write the data starting at
+ * radioLinkTxPayloadSize()) to offset 0, and write the data starting at
  * offset 1.  After you have put this data in the packet, call
  * radioLinkTxSendPacket() to actually queue the packet up to be sent on
  * the radio.
@@ -151,6 +287,11 @@ void radioLinkTxSendPacket(uint8 payloadType);
  *
  * When you are done reading the packet you should call
  * radioLinkRxDoneWithPacket() to advance to the next packet.
+ *
+ * The library has 16 RX packet buffers by default (see lib_options.mk).  While
+ * all but one of them are waiting to be processed by higher-level code, the
+ * other Wixel is told to stop sending data, so if your code is slow to process
+ * packets, the throughput will drop but no packets will be lost.
  */
 uint8 XDATA * radioLinkRxCurrentPacket(void);  // returns 0 if no packet is available.
 
@@ -171,6 +312,143 @@ void radioLinkRxDoneWithPacket(void);
  * will never change from 1 to 0. */
 BIT radioLinkConnected(void);
 
+/*! \return 1 if this Wixel is sending data packets using the windowed protocol.
+ *
+ * This will only return 1 if #radioLinkWindowedMode is 1 and the other Wixel
+ * said that it supports the windowed protocol.  See #radioLinkWindowedMode. */
+BIT radioLinkWindowed(void);
+
+/*! \return 1 if this Wixel is using frequency hopping.
+ *
+ * This will only return 1 if #radioLinkHopChannelCount is not zero and
+ * the other Wixel said that it supports frequency hopping. */
+BIT radioLinkHopping(void);
+
+/*! \return 1 if this Wixel agreed with the other Wixel to use forward
+ * error correction.  See #radioLinkFecMode. */
+BIT radioLinkFec(void);
+
+/*! \return 1 if this Wixel agreed with the other Wixel to adapt the data
+ * rate to the link.  See #radioLinkAutoRateMode. */
+BIT radioLinkAutoRate(void);
+
+/*! Statistics about one of the channels used in frequency hopping mode.
+ * See radioLinkGetHopStats(). */
+typedef struct RADIO_LINK_HOP_STATS
+{
+    /*! The number of packets we sent that expected a response, either on
+     * this channel or with the response expected on this channel. */
+    uint16 tries;
+
+    /*! The number of those packets for which no response was received. */
+    uint16 losses;
+} RADIO_LINK_HOP_STATS;
+
+/*! Copies the statistics of a channel to the specified struct.
+ *
+ * \param index The position of the channel in the hop sequence: 0 is the
+ *   home channel and N is radioLinkHopChannels[N-1].  Must be at most
+ *   #radioLinkHopChannelCount.
+ * \param stats A pointer to the struct to copy the statistics to. */
+void radioLinkGetHopStats(uint8 index, RADIO_LINK_HOP_STATS XDATA * stats);
+
+/*! \return A bitmask of the channels that are currently blacklisted in
+ * frequency hopping mode.  Bit N corresponds to hop index N, as defined
+ * in radioLinkGetHopStats(). */
+uint16 radioLinkHopBlacklist(void);
+
+/*! The number of entries in the RADIO_LINK_STATS::retries histogram. */
+#define RADIO_LINK_STATS_RETRY_BUCKETS 6
+
+/*! Statistics about the data transferred by the <code>radio_link.lib</code>
+ * library since it was initialized.  See radioLinkGetStats(). */
+typedef struct RADIO_LINK_STATS
+{
+    /*! The number of payload bytes sent to the other Wixel and acknowledged by it. */
+    uint32 txBytes;
+
+    /*! The number of payload bytes received from the other Wixel and given
+     * to the higher-level code. */
+    uint32 rxBytes;
+
+    /*! The number of packets sent that only contained an acknowledgment (or
+     * a NAK) and no data.  Comparing this to the number of bytes transferred
+     * shows how efficiently the acknowledgments are being sent. */
+    uint16 ackPackets;
+
+    /*! A histogram of how many times each data packet had to be sent before
+     * it was acknowledged.  Entry 0 counts the packets that were acknowledged
+     * after the first try, entry 1 counts the ones that took 2 tries, and
+     * entry N counts the ones that took from 2<sup>N-1</sup>+1 to 2<sup>N</sup>
+     * tries.  The last entry also counts everything that took more tries. */
+    uint16 retries[RADIO_LINK_STATS_RETRY_BUCKETS];
+
+    /*! The total number of times that data packets had to be sent again
+     * before they were acknowledged.  This is useful for deciding whether
+     * to enable #radioLinkFecMode: compare it to the number of packets sent
+     * (the sum of the #retries histogram) with FEC enabled and disabled. */
+    uint16 retransmissions;
+
+    /*! The number of packets sent on the radio, including retransmissions,
+     * acknowledgments, and Reset packets. */
+    uint16 txPackets;
+
+    /*! The number of valid packets received from the other Wixel. */
+    uint16 rxPackets;
+
+    /*! The number of times this Wixel was waiting for a response and did not
+     * get one in time.  Each of these usually leads to a retransmission. */
+    uint16 responseTimeouts;
+
+    /*! The number of Reset packets received (see #radioLinkResetPacketReceived). */
+    uint16 resetPackets;
+
+    /*! The number of NAK packets received, meaning that the other Wixel had no
+     * room for the data this Wixel sent.  Only the original (non-windowed)
+     * protocol uses NAKs. */
+    uint16 nakPackets;
+
+    /*! The number of times this Wixel stopped sending data in the windowed
+     * protocol because the other Wixel said it had no room. */
+    uint16 txPauses;
+
+    /*! The number of data packets from the other Wixel that this Wixel could
+     * not accept because the higher-level code had not freed enough RX packets
+     * (see radioLinkRxDoneWithPacket()).  If this is high, your code is not
+     * reading the data fast enough. */
+    uint16 rxBufferFull;
+
+    /*! The number of queued packets whose payload had to be shortened because
+     * the other Wixel was reset and now accepts smaller packets than it did
+     * when the packet was queued (see radioLinkTxPayloadSize()).  The bytes
+     * beyond the new limit were not sent. */
+    uint16 txTruncatedPackets;
+
+    /*! The current retransmit timeout: how long the library waits for a
+     * response before sending a packet again, in units of 0.922 ms.
+     * This is computed from the measured round-trip time and doubles every
+     * time a response is not received, so it adapts to the conditions on
+     * the channel. */
+    uint8 rto;
+
+    /*! The smoothed round-trip time, in microseconds: the time between the end
+     * of a packet sent by this Wixel and the end of the response. */
+    uint16 rtt;
+
+    /*! An estimate of the percentage of time that this Wixel is transmitting.
+     * Add the values from both Wixels to estimate how busy the channel is. */
+    uint8 utilization;
+} RADIO_LINK_STATS;
+
+/*! Copies the current statistics of the library to the specified struct.
+ * The counters wrap around to zero when they overflow, so to compute the
+ * throughput, you should call this function periodically and look at
+ * the differences between the values. */
+void radioLinkGetStats(RADIO_LINK_STATS XDATA * stats);
+
+/*! Sets all the counters returned by radioLinkGetStats() to zero. */
+void radioLinkResetStats(void);
+
 /*! The library will set this bit to 1 whenever it receives a packet that
  * has payload data in it or sends a packet.
  * Higher-level code may check this bit and clear it. */
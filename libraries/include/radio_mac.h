@@ -10,8 +10,9 @@
  * in an ISR.  The higher-level code can then decide what to do next by
  * calling radioMacTx() or radioMacRx() from the event handler.
  *
- * This library does not currently support any way of turning off the
- * radio to save power.
+ * To save power, a receiver can use radioMacLowPowerListen() to turn off
+ * the radio and sleep most of the time, and a sender can use
+ * radioMacTxRepeated() to make sure such a receiver hears its packets.
  *
  * This library defines an ISR, so radio_mac.h must be included in the
  * file that defines main() in order for this library to work.
@@ -67,6 +68,31 @@ void radioMacStrobe(void);
  * This function will only work if it is called from radioMacEventHandler(). */
 void radioMacTx(uint8 XDATA * packet);
 
+/*! Sets up the radio to transmit the same packet over and over again.
+ *
+ * This is like radioMacTx(), except that the packet is sent repeatedly with
+ * almost no gap until the specified duration has passed.  Then a single
+ * #RADIO_MAC_EVENT_TX event happens.  This is used to send packets to a
+ * receiver that is using radioMacLowPowerListen(): the duration should be
+ * longer than the receiver's sniff interval plus 2 ms, so that one of the
+ * receiver's sniffs will overlap with the transmission.
+ *
+ * The receiver might receive more than one copy of the packet, so the
+ * higher-level code needs to be able to ignore duplicates.
+ *
+ * \param packet A pointer to the packet to transmit (see radioMacTx()).
+ * \param duration How long to send the packet for, in units of 0.922 ms.
+ *   Values larger than #RADIO_MAC_TX_REPEAT_MAX (about 1020 ms) are treated
+ *   as #RADIO_MAC_TX_REPEAT_MAX.
+ *
+ * This function will only work if it is called from radioMacEventHandler(). */
+void radioMacTxRepeated(uint8 XDATA * packet, uint16 duration);
+
+/*! The largest duration that radioMacTxRepeated() supports, in units of
+ * 0.922 ms.  This is enough for a receiver with a sniff interval of up to
+ * 1000 ms. */
+#define RADIO_MAC_TX_REPEAT_MAX 1108
+
 /*! Sets up the radio to receive a packet.
  *
  * \param packet A pointer to the location to store the packet.
@@ -83,6 +109,89 @@ void radioMacTx(uint8 XDATA * packet);
  */
 void radioMacRx(uint8 XDATA * packet, uint8 timeout);
 
+/*! Changes the radio channel (the CHANNR register).
+ *
+ * This puts the radio into the IDLE state.  The first time the radio uses
+ * a channel, the frequency synthesizer will be calibrated for it (which takes
+ * roughly 0.8 ms) when the radio starts receiving or transmitting.  The
+ * results are saved for up to 16 channels and restored when this function
+ * returns to one of them, so switching between a few channels (frequency
+ * hopping) only calibrates each of them about once a second.
+ *
+ * This function will only work if it is called from radioMacEventHandler(). */
+void radioMacSetChannel(uint8 channel);
+
+/*! Switches the radio to a different data rate profile (see
+ * radioSetProfile()).
+ *
+ * \param profile One of the RADIO_PROFILE_* values defined in radio_registers.h.
+ *
+ * This puts the radio into the IDLE state, and the frequency synthesizer will
+ * be calibrated the next time the radio starts receiving or transmitting.
+ *
+ * This function will only work if it is called from radioMacEventHandler(). */
+void radioMacSetProfile(uint8 profile);
+
+/*! Turns the radio's forward error correction (FEC) on or off.
+ *
+ * With FEC enabled, the radio encodes every packet with a convolutional code
+ * and interleaves it, so it can correct short bursts of bit errors at the cost
+ * of doubling the time each packet spends on the air.  Both devices must use
+ * the same setting or they will not be able to receive each other's packets.
+ *
+ * The CC2511 only supports FEC with fixed-length packets, so while FEC is
+ * enabled, PKTLEN is the total length of every packet, including the length
+ * byte at packet[0], which is sent as ordinary data.  radioMacTx() always sends
+ * PKTLEN bytes (so the buffer must be at least that big) and radioMacRx() always
+ * receives PKTLEN bytes plus the two status bytes.  The caller is responsible
+ * for setting PKTLEN, and for checking the length byte of received packets.
+ *
+ * This puts the radio into the IDLE state.
+ *
+ * This function will only work if it is called from radioMacEventHandler(). */
+void radioMacSetFec(BIT enable);
+
+/*! Turns off the radio, puts the processor into sleep mode 2 for the
+ * specified interval, and then turns on the radio briefly to sniff for a
+ * carrier.
+ *
+ * This lets a battery-powered Wixel stay reachable by radio while using
+ * much less power than it would if the radio was always on.  The sniff
+ * takes about 1 ms, plus about 0.8 ms if the radio needs to calibrate
+ * (see #RADIO_MAC_STATS).  If a carrier or preamble is detected during that
+ * time, the radio keeps listening and the packet will be received normally
+ * (#RADIO_MAC_EVENT_RX).  Otherwise, radioMacEventHandler() will be called
+ * with #RADIO_MAC_EVENT_RX_TIMEOUT.
+ *
+ * The interval trades latency for current: the receiver spends about
+ * 2 ms out of every (interval + 2) ms with the radio on, and packets can
+ * be delayed by up to one interval.  For example, with the radio drawing
+ * about 20 mA while it is on:
+ * - interval = 100 ms: duty cycle 2%, average current about 400 uA.
+ * - interval = 500 ms: duty cycle 0.4%, average current about 80 uA.
+ * - interval = 1000 ms: duty cycle 0.2%, average current about 40 uA.
+ * These estimates do not include the time the main loop spends awake
+ * or the current drawn by anything else on the board.  The sender must
+ * send its packets with radioMacTxRepeated() for at least
+ * (interval + 2) ms, which uses a lot more power on the sending side.
+ *
+ * This function should be called from the main loop whenever the
+ * higher-level code is idle (it has nothing to send and it is just
+ * listening for packets with no timeout).  If the radio is busy,
+ * this function returns 0 right away without sleeping.  It returns 1
+ * after it has slept and started a sniff.
+ *
+ * All interrupts other than the sleep timer are disabled while sleeping,
+ * and USB does not work in sleep mode 2, so this function is intended
+ * for Wixels that are not connected to USB.  See sleepMode2Ms().
+ * Because this uses the sleep timer interrupt, you must write
+ * <code>include <sleep.h></code> in the source file that contains your
+ * main() function.
+ *
+ * \param interval The time to sleep, in milliseconds.
+ */
+BIT radioMacLowPowerListen(uint16 interval);
+
 /*! This is a callback function that should be defined by higher-level code.
  *
  * This function is called in the RF ISR whenever a radio-related event happens.
@@ -104,6 +213,72 @@ void radioMacRx(uint8 XDATA * packet, uint8 timeout);
  */
 void radioMacEventHandler(uint8 event);
 
+/*! Statistics about the <code>radio_mac.lib</code> library since it was
+ * initialized.  See radioMacGetStats(). */
+typedef struct RADIO_MAC_STATS
+{
+    /*! The number of times the radio calibrated its frequency synthesizer.
+     *
+     * The radio only needs to calibrate when it starts receiving or
+     * transmitting from the IDLE state (for example, after an RX timeout),
+     * and this library only lets it do that if the channel changed, if it
+     * has not calibrated for about 1 second, or every 16th time. */
+    uint16 calibrations;
+
+    /*! The number of times the radio started receiving or transmitting from
+     * the IDLE state without calibrating.  Each of these saved about 0.8 ms. */
+    uint16 calibrationsSkipped;
+
+    /*! The number of packets sent.  Every copy of a packet sent with
+     * radioMacTxRepeated() is counted. */
+    uint16 txPackets;
+
+    /*! The number of packets received with a correct CRC. */
+    uint16 rxPackets;
+
+    /*! The number of packets received with an incorrect CRC.  A high number
+     * compared to #rxPackets means that there is interference or that the
+     * other radio is too far away. */
+    uint16 crcErrors;
+
+    /*! The number of times the radio stopped listening because the timeout
+     * passed to radioMacRx() expired. */
+    uint16 rxTimeouts;
+
+    /*! The number of times radioMacStrobe() could not take effect right away
+     * because the radio was transmitting, receiving a packet, or about to
+     * time out (within about 10 ms).  Each of these adds latency. */
+    uint16 strobesDeferred;
+
+    /*! The number of RX overflow errors (see #radioRxOverflowOccurred). */
+    uint16 rxOverflows;
+
+    /*! The number of TX underflow errors (see #radioTxUnderflowOccurred). */
+    uint16 txUnderflows;
+
+    /*! The weakest, strongest, and average signal strength (RSSI) of the
+     * packets counted in #rxPackets, in dBm.  The average is a moving average
+     * that mostly reflects the last 8 packets.  These are 0 if no packets
+     * have been received.  See radioRssi(). */
+    int8 rssiMin;
+    int8 rssiMax;
+    int8 rssiAverage;
+
+    /*! The lowest, highest, and average Link Quality Indicator of the packets
+     * counted in #rxPackets.  The average is a moving average that mostly
+     * reflects the last 8 packets.  See radioLqi(). */
+    uint8 lqiMin;
+    uint8 lqiMax;
+    uint8 lqiAverage;
+} RADIO_MAC_STATS;
+
+/*! Copies the current statistics of the library to the specified struct.
+ * The counters wrap around to zero when they overflow. */
+void radioMacGetStats(RADIO_MAC_STATS XDATA * stats);
+
+/*! Sets all the statistics returned by radioMacGetStats() to zero. */
+void radioMacResetStats(void);
+
 /*! The library will set this bit to 1 when an RX overflow occurs.
  *
  * An RX overflow is an error that indicates that incoming data was
@@ -0,0 +1,162 @@
+/*! \file radio_net.h
+ * The <code>radio_net.lib</code> library lets one Wixel (the hub) exchange
+ * data reliably with many other Wixels (the nodes) using a star network.
+ * This library depends on <code>radio_mac.lib</code>, which uses an interrupt.
+ *
+ * Every Wixel in the network has a one-byte address.  The hub's address is
+ * #RADIO_NET_HUB_ADDRESS, and each node must have a different address from
+ * 1 to #RADIO_NET_MAX_ADDRESS.  Nodes can only send data to the hub, and the
+ * hub can send data to any node that has joined the network.
+ *
+ * To avoid collisions, the nodes never transmit unless the hub asks them to.
+ * The hub takes turns polling each node that has joined the network: it
+ * sends the node a packet (which might contain data for that node) and the
+ * node immediately responds (with data for the hub if it has any).
+ * Every packet carries sequence bits for one direction of data and an
+ * acknowledgment for the other direction, so each node gets reliable ordered
+ * delivery of data packets in both directions, just like with
+ * <code>radio_link.lib</code>.
+ *
+ * After each round of polls, the hub sends a broadcast packet to ask new nodes
+ * to join, and then listens for a few milliseconds.  Each node that has not
+ * joined responds after a random delay.  If a node stops responding to
+ * polls, the hub removes it from the network, and it will join again later.
+ *
+ * Each poll and response takes about 2 to 4 ms, so each node gets
+ * to send one packet to the hub every (2 to 4 ms) &times; (number of nodes),
+ * plus a few milliseconds for the join window.  This means the throughput
+ * of each node goes down and the latency goes up linearly with the number of
+ * nodes, but it does not collapse the way it would if the nodes were all
+ * competing for the channel.
+ */
+
+#ifndef _RADIO_NET_H
+#define _RADIO_NET_H
+
+#include <cc2511_types.h>
+#include <radio_mac.h>
+
+/*! Each packet can contain at most 32 bytes of payload. */
+#define RADIO_NET_PAYLOAD_SIZE 32
+
+/*! The maximum number of nodes that can join the hub's network. */
+#define RADIO_NET_MAX_PEERS 32
+
+/*! The address of the hub. */
+#define RADIO_NET_HUB_ADDRESS 0
+
+/*! The largest address that a node can have. */
+#define RADIO_NET_MAX_ADDRESS 254
+
+/*! Defines the frequency to use.  Valid values are from
+ * 0 to 255.  To avoid interference, the channel numbers of
+ * different networks operating in the same area should be at least
+ * 2 apart.  (This is a Wixel App parameter; the user can set
+ * it using the Wixel Configuration Utility.)
+ */
+extern int32 CODE param_radio_channel;
+
+/*! The address of this Wixel.  Set this before calling radioNetInit().
+ * The default value is #RADIO_NET_HUB_ADDRESS, which makes this Wixel
+ * the hub.  Every other Wixel in the network must be a node with a unique
+ * address from 1 to #RADIO_NET_MAX_ADDRESS. */
+extern uint8 radioNetAddress;
+
+/*! Initializes the <code>radio_net.lib</code> library and the lower-level
+ *  libraries that it depends on.  This must be called before
+ *  any other functions in the library. */
+void radioNetInit(void);
+
+/*! \return 1 if this Wixel is the hub. */
+BIT radioNetIsHub(void);
+
+/*! \return On a node, this returns 1 if the node has joined the hub's network.
+ * On the hub, this returns 1 if at least one node has joined. */
+BIT radioNetConnected(void);
+
+/*! \return The number of nodes that are currently in the hub's network.
+ * This is always 0 on a node. */
+uint8 radioNetPeerCount(void);
+
+/*! \return The address of one of the nodes in the hub's network.
+ * \param index A number less than radioNetPeerCount().
+ *
+ * The order of the nodes changes when nodes leave the network. */
+uint8 radioNetPeerAddress(uint8 index);
+
+/*! \return The number of radio packet buffers that are currently free
+ * (available to hold data).
+ *
+ * This function has no side effects. */
+uint8 radioNetTxAvailable(void);
+
+/*! \return The number of radio packet buffers that are currently busy
+ * (holding a data packet that has not been successfully sent yet).
+ *
+ * This function has no side effects. */
+uint8 radioNetTxQueued(void);
+
+/*! Returns a pointer to the current packet, or 0 if no packet is available.
+ * This function has no side effects.  To populate this packet, you should
+ * write the length of the payload data (which must not exceed
+ * RADIO_NET_PAYLOAD_SIZE) to offset 0, and write the data starting at
+ * offset 1.  After you have put this data in the packet, call
+ * radioNetTxSendPacket() to actually queue the packet up to be sent on
+ * the radio.
+ * Example usage:
+\code
+uint8 XDATA * packet = radioNetTxCurrentPacket();
+if (packet != 0)
+{
+    packet[0] = 3;   // payload length.  Must not exceed RADIO_NET_PAYLOAD_SIZE.
+    packet[1] = 'a';
+    packet[2] = 'b';
+    packet[3] = 'c';
+    radioNetTxSendPacket(5);
+}
+\endcode
+ */
+uint8 XDATA * radioNetTxCurrentPacket(void);
+
+/*! Sends the current TX packet.  See the documentation of
+ * radioNetTxCurrentPacket() for details.
+ *
+ * \param address The address to send the packet to.  On a node, this
+ *   parameter is ignored because nodes can only send to the hub.
+ *
+ * Packets for each node are sent in the order they were queued.  On the hub,
+ * a packet for a node that is slow to respond does not delay packets for
+ * other nodes, but the buffers of the packets queued after it only become
+ * available again once it has been delivered.
+ * If the destination node is not in the network when the packet gets to the
+ * front of the queue, the packet is discarded and counted by
+ * radioNetTxDiscardedPackets(). */
+void radioNetTxSendPacket(uint8 address);
+
+/*! \return The number of data packets that the hub has discarded since it
+ * was initialized because their destination node was not in the network.
+ * This is always 0 on a node. */
+uint16 radioNetTxDiscardedPackets(void);
+
+/*! \return A pointer to the current RX packet.
+ *   This is the earliest packet received by this Wixel that has not been
+ *   processed yet by higher-level code.  Returns 0 if there is no RX
+ *   packet available.
+ *
+ * The RX packet has the same format as the TX packet: the length of the
+ * payload is at offset 0 and the data starts at offset 1.  When you are done
+ * reading the packet, you should call radioNetRxDoneWithPacket().
+ * This frees the current packet buffer so it can receive another packet. */
+uint8 XDATA * radioNetRxCurrentPacket(void);  // returns 0 if no packet is available.
+
+/*! \return The address of the Wixel that sent the current RX packet.
+ *
+ * This should only be called if radioNetRxCurrentPacket() recently returned
+ * a non-zero pointer. */
+uint8 radioNetRxCurrentSource(void);
+
+/*! Frees the current RX packet so that you can advance to processing
+ * the next one.  See the radioNetRxCurrentPacket() documentation for details. */
+void radioNetRxDoneWithPacket(void);
+
+#endif
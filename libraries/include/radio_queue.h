@@ -31,6 +31,52 @@ extern int32 CODE param_radio_channel;
  */
 extern BIT radioQueueAllowCrcErrors;
 
+/*! If this variable is non-zero, each packet is sent repeatedly for this
+ * amount of time (in units of 0.922 ms) so that receivers using
+ * radioMacLowPowerListen() will hear it.  This should be longer than the
+ * receivers' sniff interval plus 2 ms, and at most #RADIO_MAC_TX_REPEAT_MAX.
+ * See radioMacTxRepeated().
+ * The receivers might get several copies of each packet.
+ * This variable has a value of 0 by default, and it is not used in TDMA mode.
+ */
+extern uint16 radioQueueTxRepeatTime;
+
+/*! The number of transmitter slots in each TDMA frame.  Set this before calling
+ * radioQueueInit() to enable TDMA mode.  The default value is 0, which disables
+ * TDMA mode.  The maximum value is 120.
+ *
+ * Without TDMA, each device sends its packets whenever it wants to (after
+ * listening for a random 1-4 ms), so when many devices are sending packets
+ * to one receiver, more and more of the packets collide.
+ * In TDMA mode, one device (usually the receiver) is the beacon sender (see
+ * #radioQueueTdmaBeaconSender).  It sends a short beacon packet at the start of
+ * every frame, and each transmitter only sends its packets in its own slot
+ * of the frame (see #radioQueueTdmaSlot), so transmitters with different slots
+ * never collide.  Each transmitter sends at most one packet per frame.
+ * Each slot is about 1.8 ms long, and the beacon and the beacon sender's own
+ * packet have a slot each, so a frame with N slots is about
+ * 1.8&times;(N+2) ms long.
+ *
+ * All devices on the channel should use the same value.  A transmitter that
+ * has not heard a beacon recently sends its packets whenever it wants to,
+ * just like when TDMA mode is disabled, so it still works with a receiver that
+ * is not sending beacons. */
+extern uint8 radioQueueTdmaSlotCount;
+
+/*! The slot that this device uses to transmit in TDMA mode, from 0 to
+ * #radioQueueTdmaSlotCount - 1.  Set this before calling radioQueueInit().
+ * Every transmitter on the channel must have a different slot, so the slots
+ * should be assigned explicitly (see the tdma_slot parameter of the
+ * wireless_adc_tx app).  Values derived from serial numbers or other
+ * pseudo-random sources will eventually collide. */
+extern uint8 radioQueueTdmaSlot;
+
+/*! Set this bit to 1 before calling radioQueueInit() to make this device send
+ * the TDMA beacons.  There should only be one beacon sender on each channel.
+ * The beacon sender does not need a slot: it sends its own packets right after
+ * the beacon (at most one per frame). */
+extern BIT radioQueueTdmaBeaconSender;
+
 /*! Initializes the radio_queue library and the lower-level
  *  libraries that radio_queue depends on.  This must be called before
  *  any other functions in the library. */
@@ -10,11 +10,44 @@
 
 #include <cc2511_types.h>
 
+/*! The fastest data rate profile: 500 kbps, MSK, 750 kHz bandwidth.
+ * Pololu found that data rates above 400 kbps cause many packet errors,
+ * so this profile is only useful for short links. */
+#define RADIO_PROFILE_500K 0
+
+/*! The default data rate profile: 350 kbps, MSK, 600 kHz bandwidth.
+ * These are the settings that have been tested the most. */
+#define RADIO_PROFILE_350K 1
+
+/*! 250 kbps, MSK, 500 kHz bandwidth. */
+#define RADIO_PROFILE_250K 2
+
+/*! 100 kbps, MSK, 300 kHz bandwidth. */
+#define RADIO_PROFILE_100K 3
+
+/*! The slowest data rate profile: 10 kbps, GFSK, 107 kHz bandwidth.
+ * This has the best range, but a full-size packet takes about 60 ms to send. */
+#define RADIO_PROFILE_10K 4
+
+/*! The number of data rate profiles. */
+#define RADIO_PROFILE_COUNT 5
+
+/*! The data rate profile that the radio is using: one of the
+ * RADIO_PROFILE_* values.  The default is #RADIO_PROFILE_350K.
+ *
+ * You can set this before calling radioRegistersInit() (or any function that
+ * calls it, such as radioMacInit()) to choose which profile the radio starts
+ * with.  After that, you should only change it with radioSetProfile().
+ *
+ * Slower profiles have a better sensitivity, so they work over longer
+ * distances.  Both radios must use the same profile to communicate. */
+extern uint8 radioProfile;
+
 /*! Configures the CC2511's radio module using settings that have
  * been tested by Pololu and are known to work.
  *
  * In summary, these settings are:
- * - Data rate = 350 kbps
+ * - Data rate = 350 kbps (or another rate, see #radioProfile)
  * - Modulation = MSK
  * - Channel 0 frequency = 2403.47 MHz
  * - Channel spacing = 286.4 kHz
@@ -25,6 +58,19 @@
  */
 void radioRegistersInit();
 
+/*! Switches the radio to a different data rate profile by setting the
+ * FSCTRL1, MDMCFG4, MDMCFG3, MDMCFG2, DEVIATN, FOCCFG, BSCFG, AGCCTRL2,
+ * AGCCTRL1, AGCCTRL0, and FREND1 registers, and updates #radioProfile.
+ * The 10 kbps profile uses the receiver settings that TI recommends for low
+ * data rates; the other profiles use the ones for high data rates.
+ *
+ * \param profile One of the RADIO_PROFILE_* values.
+ *
+ * The radio must be in the IDLE state when this is called, and the frequency
+ * synthesizer should be calibrated before the radio is used again.  If you
+ * are using <code>radio_mac.lib</code>, call radioMacSetProfile() instead. */
+void radioSetProfile(uint8 profile);
+
 /*! \return The Link Quality Indicator (LQI) of the last packet received.
  *
  * According to the CC2511F32 datasheet, the LQI is a metric of the quality of
@@ -51,9 +97,11 @@ int8 radioRssi();
  * was corrupted and should not be relied upon. */
 BIT radioCrcPassed();
 
-/*! An offset used by radioRssi() to calculate the RSSI.
+/*! An offset used by radioRssi() to calculate the RSSI with the default
+ * profile (#RADIO_PROFILE_350K).
  * According to Table 68 of the CC2511F32 datasheet, RSSI
- * offset for 250kbps is 71. */
+ * offset for 250kbps is 71.  radioRssi() uses the offset that
+ * matches #radioProfile. */
 #define RSSI_OFFSET 71
 
 #endif /* RADIO_REGISTERS_H_ */
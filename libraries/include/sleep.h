@@ -32,6 +32,13 @@ void sleepMode1(uint16 seconds);
 */
 void sleepMode2(uint16 seconds, uint8 port_interrupts);
 
+/*! Enters sleep mode 2 for x milliseconds
+* This works like sleepMode2(), but the sleep timer has a resolution of
+* 1/1024 second instead of 1 second, so the longest possible sleep is
+* about 64 seconds.
+*/
+void sleepMode2Ms(uint16 milliseconds, uint8 port_interrupts);
+
 /*! Enters sleep mode 3 until an external interrupt occurs
 * Note that the sleep timer cannot be used to wake up from PM3
 */
@@ -2,8 +2,9 @@
  *
  * The <code>spi_master.lib</code> library allows you to do SPI master
  * communication using USART0 and/or USART1.
- * This library uses interrupts to transfer data so it is capable of
- * sending/receiving in the background while other tasks are performed.
+ * This library uses interrupts (or DMA, see #spi0MasterDmaMode) to transfer
+ * data so it is capable of sending/receiving in the background while other
+ * tasks are performed.
  *
  * To use this library, you must include spi0_master.h or spi1_master.h
  * in your app:
@@ -39,6 +40,26 @@
 #include <cc2511_types.h>
 #include <spi.h>
 
+/*! Set this bit to 1 before calling spi0MasterInit() to make
+ * spi0MasterTransfer() use DMA instead of an interrupt.  The default value is 0.
+ *
+ * With the interrupt, the CPU has to run the interrupt for every byte,
+ * which limits the speed of the transfer and takes time away from other
+ * tasks.  In DMA mode, the DMA controller moves the bytes and the USART0
+ * interrupt is not used, so the bytes can be sent back to back at the
+ * highest SPI frequency.
+ *
+ * DMA mode needs two of the DMA channels that are available to libraries
+ * (see dmaAllocateChannel()).  If they are not both free when
+ * spi0MasterInit() is called, the library uses the interrupt as usual.
+ *
+ * The DMA controller can only transfer 8191 bytes at once, so longer
+ * transfers are done in pieces, and the DMA interrupt starts each piece
+ * when the previous one is done (see dmaSetChannelHandler()).  In DMA mode,
+ * spi0MasterBytesLeft() only goes down at the end of each piece.
+ */
+extern BIT spi0MasterDmaMode;
+
 /*! Initializes the library.
  *
  * This must be called before any other functions with names that
@@ -96,7 +117,8 @@ void spi0MasterSetClockPhase(BIT phase);
 void spi0MasterSetBitOrder(BIT bitOrder);
 
 /*! \return 1 if the library is busy transferring of data, 0 if it
-    is not busy.
+    is not busy.  You can call this after spi0MasterTransfer() to find out
+    when the transfer is complete.
 
     This is equivalent to <code>spi0MasterBytesLeft() != 0</code>
     but it is faster and doesn't affect the speed of the transfer. */
@@ -117,9 +139,12 @@ uint16 spi0MasterBytesLeft(void);
  * This is a non-blocking function.
  *
  * \param txBuffer A pointer to a buffer holding the bytes to be sent to the SPI slave.
+ *   If this is 0, the library sends 0xFF for every byte, which is useful for
+ *   reading data from a slave.
  * \param rxBuffer A pointer to a buffer to hold bytes received by the SPI slave
  *   during this transfer.  This may be equal to txBuffer, which would cause the
- *   transmitted data to be overwritten with received data.
+ *   transmitted data to be overwritten with received data.  If this is 0, the
+ *   received bytes are discarded.
  * \param size The number of bytes to transmit/receive.
  *
  * This function should not be called if the library is busy doing a transfer
@@ -136,7 +161,8 @@ void spi0MasterTransfer(const uint8 XDATA * txBuffer, uint8 XDATA * rxBuffer, ui
 
 /*! Transmits one byte to the SPI slave, simultaneously receiving a byte from
  * the slave.  This is a synchronous, blocking function so be careful about using
- * it in apps that have regular tasks to perform.
+ * it in apps that have regular tasks to perform.  It does not use the
+ * interrupt or DMA.
  *
  * This function should not be called if the library is busy doing a transfer
  * (i.e. spi0MasterBusy() returns 1).
@@ -11,6 +11,7 @@
 #include <cc2511_types.h>
 #include <spi.h>
 
+extern BIT spi1MasterDmaMode;
 void spi1MasterInit(void);
 void spi1MasterSetFrequency(uint32 freq);
 void spi1MasterSetClockPolarity(BIT polarity);
@@ -30,8 +30,33 @@
 void timeInit();
 
 /*! Returns the number of milliseconds that have elapsed since timeInit()
- * was called. */
-uint32 getMs();
+ * was called.
+ *
+ * This function can be called from interrupts. */
+uint32 getMs(void) __reentrant;
+
+/*! The number of milliseconds that have elapsed since timeInit() was
+ * called.  This is incremented by the Timer 4 interrupt, so most code
+ * should use getMs() instead.  Reading just the lowest byte is safe, and it
+ * can be combined with T4CNT to measure time with a resolution of one
+ * Timer 4 tick (1/188 ms). */
+extern PDATA volatile uint32 timeMs;
+
+/*! The number of ticks per millisecond returned by getTicks(). */
+#define TICKS_PER_MS 32
+
+/*! \return The time since timeInit() was called, in units of 1/32 ms
+ * (31.25 microseconds).  The value wraps around to 0 every 2048 ms, so
+ * it should only be used to measure intervals shorter than that, by
+ * subtracting two values as uint16s.
+ *
+ * This is computed from the millisecond count and the Timer 4 counter, so
+ * unlike the radio's sleep timer it keeps counting steadily while the
+ * radio is in use.  It does not count while the CPU is in a sleep mode
+ * that stops Timer 4 (see sleep.h).
+ *
+ * This function can be called from interrupts. */
+uint16 getTicks(void) __reentrant;
 
 /*! This interrupt fires once per millisecond (approximately) and
  * increments timeMs. */
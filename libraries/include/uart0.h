@@ -1,8 +1,8 @@
 /*! \file uart0.h
  *  The <code>uart.lib</code> library allows you to send and receive a stream
  *  of asynchronous serial bytes on USART0 and/or USART1 in UART mode.
- *  This library uses circular buffers and interrupts for both RX and TX
- *  so it is capable of sending
+ *  This library uses circular buffers and interrupts (or DMA, see
+ *  #uart0DmaMode) for both RX and TX so it is capable of sending
  *  and receiving a continuous stream of bytes with no gaps.
  *
  *  To use this library, you must include uart0.h or uart1.h in your app:
@@ -30,6 +30,46 @@
 #include <cc2511_types.h>
 #include <com.h>
 
+/*! Set this bit to 1 before calling uart0Init() to make the library use
+ * DMA instead of interrupts for both RX and TX.  The default value is 0.
+ *
+ * At high baud rates, the RX and TX interrupts fire so often that they can
+ * take up a large fraction of the CPU's time, and a received byte can be
+ * lost if the RX interrupt is delayed by another interrupt for more than one
+ * byte time.  In DMA mode, the DMA controller copies received bytes directly
+ * into the RX buffer and copies bytes from the TX buffer to the UART, so the
+ * library does not use any interrupts.
+ *
+ * DMA mode only works if the library was compiled with the default RX buffer
+ * size of 256 bytes.
+ *
+ * DMA mode needs all three of the DMA channels that are available to
+ * libraries (see dmaAllocateChannel()), so only one UART can use it, and
+ * the SPI master libraries and the USB library can not use DMA at the same
+ * time (see dma.h).  If the channels are not all free when uart0Init() is
+ * called, the library uses interrupts as usual.  Since the USB library
+ * reserves a channel the first time the Wixel is connected to USB,
+ * uart0Init() should be called before that happens.  The USB library
+ * works without its DMA channel, but copies data to and from the USB
+ * FIFOs more slowly.
+ *
+ * In DMA mode:
+ * - Received bytes are written to the RX buffer even if it is full, so you
+ *   must call uart0RxAvailable() and read bytes often enough to keep it
+ *   from overflowing.  If the library notices that unread bytes were
+ *   overwritten, it discards the contents of the RX buffer and sets
+ *   #uart0RxBufferFullOccurred.  It can not notice this if 256 or more
+ *   bytes were received since the last time one of its RX functions was
+ *   called.
+ * - Parity and framing errors are not detected.
+ * - The TX buffer is only sent to the UART by the library's functions, so
+ *   you should call uart0TxAvailable() or uart0RxAvailable() regularly
+ *   (most apps already do this in their main loop).  There may be a gap
+ *   of about one byte time on the TX line each time the library wraps
+ *   around to the beginning of its TX buffer.
+ */
+extern BIT uart0DmaMode;
+
 /*! Initializes the library.
  *
  * This must be called before any of other functions with names that
@@ -67,7 +107,74 @@ void uart0SetParity(uint8 parity);
  */
 void uart0SetStopBits(uint8 stopBits);
 
-/*! \return The number of bytes available in the TX buffer.
+/*! Enables or disables hardware RTS/CTS flow control.
+ *
+ * \param enable 1 to enable flow control, 0 to disable it.
+ *
+ * When flow control is enabled, P0_5 is the RTS output and P0_4 is the CTS
+ * input (P1_5 and P1_4 for UART1).  Both signals are active low.
+ * The library drives RTS high when the RX buffer is almost full, to tell the
+ * other device to stop sending, and drives it low again after enough bytes
+ * have been read from the buffer with uart0RxReceiveByte().  The library only
+ * sends bytes while CTS is low.  CTS has a pull-up resistor by default, so
+ * no bytes will be sent if it is not connected.
+ *
+ * RTS is driven high early enough to leave room in the RX buffer for a few
+ * bytes that the other device might send before it notices.
+ * When flow control is disabled, RTS is an input again.
+ *
+ * The library notices that CTS has gone low when you call uart0TxAvailable()
+ * or uart0RxAvailable(), so you should call one of those regularly.
+ *
+ * The default is disabled.
+ */
+void uart0SetFlowControl(BIT enable);
+
+/*! Sets the idle time on the RX line that ends a frame, for use with
+ * uart0RxFrameComplete().
+ *
+ * \param characterTimes The length of the idle time, in units of the time it
+ *   takes to receive one character at the current baud rate, parity, and
+ *   stop bit settings.  For example, Modbus RTU requires 3.5 character
+ *   times, so you would use 4.  A value of 0 disables frame detection,
+ *   which is the default.
+ *
+ * The idle time is measured with Timer 4 (see time.h), so it has a
+ * resolution of about 5.3 microseconds, and it can not be longer than
+ * about 210 ms.  Frame detection only starts working after you call
+ * uart0SetBaudRate(). */
+void uart0SetRxFrameTimeout(uint8 characterTimes);
+
+/*! \return 1 if a frame has ended: bytes have been received since the last
+ * time this function returned 1, and the RX line has been idle for the time
+ * specified with uart0SetRxFrameTimeout() since the last byte.
+ *
+ * The library records the time of every byte it receives, so this function
+ * does not need to be called at any particular rate, but it should be
+ * called at least every 200 ms or so while frames are being received.
+ * After it returns 1, the complete frame can be read from the RX buffer.
+ * Example usage:
+\code
+if (uart0RxFrameComplete())
+{
+    uint8 count = uart0RxAvailable();
+    // Forward count bytes as one packet here.
+}
+\endcode
+ *
+ * In DMA mode (see #uart0DmaMode), there is no interrupt to record when
+ * each byte arrived, so the library records the time when it notices new
+ * bytes in uart0RxAvailable() or this function.
+ */
+BIT uart0RxFrameComplete(void);
+
+/*! \return The number of bytes available in the TX buffer, or 255 if
+ *   there are more than 255.
+ *
+ * The size of the TX buffer is 256 bytes (255 of which can be used) unless
+ * the library was compiled with a different UART_TX_BUFFER_SIZE.
+ * The RX buffer size is set the same way with UART_RX_BUFFER_SIZE.  See
+ * libraries/src/uart/lib_options.mk.
  */
 uint8 uart0TxAvailable(void);
 
@@ -90,7 +197,8 @@ void uart0TxSendByte(uint8 byte);
  */
 void uart0TxSend(const uint8 XDATA * buffer, uint8 size);
 
-/*! \return The number of bytes in the RX buffer.
+/*! \return The number of bytes in the RX buffer, or 255 if there are
+ *   more than 255.
  *
  * You can use this function to see if any bytes have been received, and
  * then use uart0RxReceiveByte() to actually get the byte and process it.
@@ -109,6 +217,60 @@ uint8 uart0RxAvailable(void);
  */
 uint8 uart0RxReceiveByte(void);
 
+/*! Reads the specified number of bytes from the RX buffer and stores them in memory.
+ *
+ * \param buffer The buffer to store the data in.
+ * \param size The number of bytes to read.
+ *
+ * This is a non-blocking function: you must call uart0RxAvailable() before calling
+ * this function and be sure not to read too many bytes.
+ * The \p size parameter should not exceed the last value returned by
+ * uart0RxAvailable().
+ *
+ * See also uart0RxReceiveByte() and uart0RxBuffer(). */
+void uart0RxReceive(uint8 XDATA * buffer, uint8 size);
+
+/*! \return The next byte in the RX buffer, without removing it from the buffer.
+ *
+ * This is a non-blocking function: you must call uart0RxAvailable() before calling
+ * this function and make sure it returned a non-zero value. */
+uint8 uart0RxPeek(void);
+
+/*! \return A pointer to the next byte in the RX buffer.
+ *
+ * This function lets you read the received bytes directly from the library's
+ * RX buffer instead of copying them.  The RX buffer is circular, so the
+ * number of bytes that can be read from the returned pointer is the value
+ * returned by uart0RxBufferAvailable(), which can be less than the value
+ * returned by uart0RxAvailable().
+ * When you are done reading them, call uart0RxConsume() to remove them from the
+ * RX buffer.  Example usage:
+\code
+uint8 count = uart0RxBufferAvailable();
+if (count != 0)
+{
+    uint8 XDATA * data = uart0RxBuffer();
+    // Process up to count bytes from data here.
+    uart0RxConsume(count);
+}
+\endcode
+ *
+ * The bytes stay valid until you remove them with uart0RxConsume(),
+ * uart0RxReceive(), or uart0RxReceiveByte(). */
+uint8 XDATA * uart0RxBuffer(void);
+
+/*! \return The number of bytes that can be read from the pointer returned
+ * by uart0RxBuffer().  This is the number of bytes in the RX buffer
+ * before the point where it wraps around, or 255 if there are more than 255. */
+uint8 uart0RxBufferAvailable(void);
+
+/*! Removes bytes from the RX buffer without reading them.
+ * This should be called after reading bytes with uart0RxBuffer().
+ *
+ * \param size The number of bytes to remove.  This should not exceed the last
+ *   value returned by uart0RxAvailable(). */
+void uart0RxConsume(uint8 size);
+
 /*! Transmit interrupt. */
 ISR(UTX0, 0);
 
@@ -11,15 +11,24 @@
 #include <cc2511_types.h>
 #include <com.h>
 
+extern BIT uart1DmaMode;
 void uart1Init();
 void uart1SetBaudRate(uint32 baudrate);
 void uart1SetParity(uint8 parity);
 void uart1SetStopBits(uint8 stopBits);
+void uart1SetFlowControl(BIT enable);
+void uart1SetRxFrameTimeout(uint8 characterTimes);
+BIT uart1RxFrameComplete(void);
 uint8 uart1TxAvailable(void);
 void uart1TxSendByte(uint8 byte);
 void uart1TxSend(const uint8 XDATA * buffer, uint8 size);
 uint8 uart1RxAvailable(void);
 uint8 uart1RxReceiveByte(void);
+void uart1RxReceive(uint8 XDATA * buffer, uint8 size);
+uint8 uart1RxPeek(void);
+uint8 XDATA * uart1RxBuffer(void);
+uint8 uart1RxBufferAvailable(void);
+void uart1RxConsume(uint8 size);
 ISR(UTX1, 0);
 ISR(URX1, 0);
 extern volatile BIT uart1RxParityErrorOccurred;
@@ -21,6 +21,7 @@
 #ifndef _USB_H
 #define _USB_H
 
+#include <cc2511_map.h>
 #include <cc2511_types.h>
 
 /*! This is the Vendor ID assigned to Pololu Corporation by the USB
@@ -255,9 +256,41 @@ void usbInit(void);
  * This function calls the usbCallback* functions when needed.
  *
  * This function should be called regularly (more often than every 50&nbsp;ms).
+ * The USB interrupt records events as they happen, so this function does not
+ * need to be called in a tight loop: you can call usbIdle() between calls to
+ * save power without missing anything.
  */
 void usbPoll(void);
 
+/*! Puts the processor in Power Mode 0 (idle) until the next interrupt, unless
+ * there is a USB event that has not been handled by usbPoll() yet, in which
+ * case this function returns immediately.
+ *
+ * You can call this at the end of your main loop if there is nothing else to
+ * do until something happens.  The USB interrupt wakes the processor up when
+ * the USB host does something, so USB latency is not affected.  Other
+ * interrupts (such as the 1&nbsp;ms timer interrupt from time.c or the radio
+ * interrupt) also wake it up, so this does not stop any of the other libraries
+ * from working.  The peripherals keep running in Power Mode 0; only the CPU
+ * clock is stopped.
+ *
+ * Example usage:
+\code
+while(1)
+{
+    boardService();
+    usbComService();
+    // Do other things here.
+    usbIdle();
+}
+\endcode */
+void usbIdle(void);
+
+/*! The USB Interrupt Service Routine (ISR).  It shares a vector with the
+ * Port 2 interrupt, so you can not define your own P2INT ISR if you are
+ * using this library. */
+ISR(USB, 0);
+
 /*! Tells the USB library to start a Control Read
  * (Device-to-Host) transfer.
  *
@@ -1,6 +1,25 @@
 /*! \file usb_com.h
  * The <code>usb_com.lib</code> library implements a virtual COM/serial port
  * over USB using the CDC ACM class.  See also com.h.
+ *
+ * The <code>usb_cdc_acm2.lib</code> library has the same functions, but it
+ * makes the Wixel a composite device with two virtual COM ports, so you
+ * can (for example) send data on one port and debugging information on the
+ * other, with independent flow control.  To use it, put
+ * <code>usb_cdc_acm2.lib</code> instead of <code>usb_cdc_acm.lib</code> in
+ * your app's <code>APP_LIBS</code>.  The functions with "Port" in their
+ * names take the port number (0 or 1) as their first argument, and the other
+ * functions use port 0.  In <code>usb_cdc_acm.lib</code>, the only valid port
+ * number is 0.
+ *
+ * The composite device uses USB product ID 0x2202 instead of the
+ * single-port device's 0x2200, so the computer does not load the
+ * single-port drivers for it.  On Windows it needs a driver that matches
+ * the individual interfaces (MI_00 and MI_02) instead of the whole device;
+ * installer/wixel_cdc_acm2.inf is one, and the SDK installer installs it.
+ * Either library can be built with a different product ID by adding
+ * <code>-DUSB_COM_PRODUCT_ID=N</code> to its C_FLAGS in lib_options.mk.
+ * See the usb_serial2 app for an example that uses both ports.
  */
 
 #ifndef _USB_COM_H
@@ -90,9 +109,19 @@ void usbComTxControlSignalEvents(uint8 signalEvents);
 extern ACM_LINE_CODING XDATA usbComLineCoding;
 
 /*! A pointer to a function that will be called whenever #usbComLineCoding gets set
- * by the USB host. */
+ * by the USB host.  If there are two ports, it is also called when the other
+ * port's line coding gets set; see #usbComLineCodingChangePort. */
 extern HandlerFunction * usbComLineCodingChangeHandler;
 
+/*! The number of the port whose line coding was set most recently.  You can
+ * read this in your #usbComLineCodingChangeHandler to find out which port
+ * changed. */
+extern uint8 usbComLineCodingChangePort;
+
+/*! \return A pointer to the line coding of the specified port.
+ *   For port 0, this is the same as &#usbComLineCoding. */
+ACM_LINE_CODING XDATA * usbComPortLineCoding(uint8 port);
+
 /*! This function should be called regularly (at least every 50&nbsp;ms) if you are
  * using this library.
  * One of the things this function does is call usbPoll(). */
@@ -137,9 +166,48 @@ void usbComRxReceive(const uint8 XDATA * buffer, uint8 size);
  *
  * The <code>usb_cdc_acm.lib</code> library uses a double-buffered endpoint
  * with 64-byte buffers, so if the USB host keeps reading data from the device
- * then this function will eventually return 128. */
+ * then this function will eventually return 128.
+ *
+ * In streaming mode (see usbComTxStreamingEnable()) there can be more space
+ * than this function can report, so it returns at most 255.  Use
+ * usbComTxSpace() to get the full amount. */
 uint8 usbComTxAvailable(void);
 
+/*! \return The number of bytes available in the TX buffers, including the
+ *   ring buffer used in streaming mode.
+ *
+ * This is the same as usbComTxAvailable() except that it can return numbers
+ * higher than 255.  Like usbComTxAvailable(), it returns 0 until the USB host
+ * has configured the device.  Any bytes still in the ring buffer when the host
+ * configures the device again (e.g. after a USB reset) are discarded. */
+uint16 usbComTxSpace(void);
+
+/*! Enables streaming mode, in which bytes that do not fit in the USB
+ * endpoint's FIFO are stored in the specified ring buffer.  Whenever the USB
+ * host reads a packet, usbComService() loads the next one from the ring
+ * buffer, so the endpoint stays busy as long as there is data in the ring
+ * buffer, even if your main loop is slow.
+ *
+ * \param buffer A buffer in XDATA to use as the ring buffer.  The library
+ *   uses it for as long as your program runs, so it should not be a local
+ *   variable.
+ * \param size The size of the buffer in bytes.  This must be a power of
+ *   two (e.g. 256 or 512).  One byte of the buffer is never used.
+ *
+ * This should be called before sending any data.  Example usage:
+\code
+uint8 XDATA usbTxRing[512];
+
+void main()
+{
+    systemInit();
+    usbInit();
+    usbComTxStreamingEnable(usbTxRing, sizeof(usbTxRing));
+    ...
+}
+\endcode */
+void usbComTxStreamingEnable(uint8 XDATA * buffer, uint16 size);
+
 /*! Adds a byte to the TX buffer, which means it will be eventually
  * sent to the USB host.
  *
@@ -156,9 +224,44 @@ void usbComTxSendByte(uint8 byte);
  * \param buffer A pointer to the bytes to send.
  * \param size The number of bytes to send.
  *
- * This is a non-blocking function: you must call usbComTxAvailable() before calling this
- * function and be sure not to add too many bytes to the buffer.
- * The \p size parameter should not exceed the last value returned by usbComTxAvailable(). */
-void usbComTxSend(const uint8 XDATA * buffer, uint8 size);
+ * This is a non-blocking function: you must call usbComTxAvailable() or
+ * usbComTxSpace() before calling this function and be sure not to add too many
+ * bytes to the buffer.  The \p size parameter should not exceed the last value
+ * returned by one of those functions. */
+void usbComTxSend(const uint8 XDATA * buffer, uint16 size);
+
+/*! Same as usbComRxAvailable(), but for the specified port. */
+uint8 usbComPortRxAvailable(uint8 port);
+
+/*! Same as usbComRxReceiveByte(), but for the specified port. */
+uint8 usbComPortRxReceiveByte(uint8 port);
+
+/*! Same as usbComRxReceive(), but for the specified port. */
+void usbComPortRxReceive(uint8 port, uint8 XDATA * buffer, uint8 size);
+
+/*! Same as usbComTxAvailable(), but for the specified port. */
+uint8 usbComPortTxAvailable(uint8 port);
+
+/*! Same as usbComTxSpace(), but for the specified port. */
+uint16 usbComPortTxSpace(uint8 port);
+
+/*! Same as usbComTxStreamingEnable(), but for the specified port.
+ * Each port needs its own buffer. */
+void usbComPortTxStreamingEnable(uint8 port, uint8 XDATA * buffer, uint16 size);
+
+/*! Same as usbComTxSendByte(), but for the specified port. */
+void usbComPortTxSendByte(uint8 port, uint8 byte);
+
+/*! Same as usbComTxSend(), but for the specified port. */
+void usbComPortTxSend(uint8 port, const uint8 XDATA * buffer, uint16 size);
+
+/*! Same as usbComRxControlSignals(), but for the specified port. */
+uint8 usbComPortRxControlSignals(uint8 port);
+
+/*! Same as usbComTxControlSignals(), but for the specified port. */
+void usbComPortTxControlSignals(uint8 port, uint8 signals);
+
+/*! Same as usbComTxControlSignalEvents(), but for the specified port. */
+void usbComPortTxControlSignalEvents(uint8 port, uint8 signalEvents);
 
 #endif
@@ -4,7 +4,64 @@
 
 DMA14_CONFIG XDATA dmaConfig;
 
+// Bit N is 1 if DMA channel N has been assigned to a library.
+static uint8 XDATA dmaChannelsAllocated = (1<<DMA_CHANNEL_RADIO);
+
+// The function to call when each channel finishes a transfer, or 0.
+// Entries 0 and 1 are not used.
+static DMA_CHANNEL_HANDLER XDATA dmaChannelHandlers[5];
+
 void dmaInit()
 {
     DMA1CFG = (uint16)&dmaConfig;
 }
+
+uint8 dmaAllocateChannel()
+{
+    uint8 channel;
+    for (channel = 2; channel <= 4; channel++)
+    {
+        if (!(dmaChannelsAllocated & (1<<channel)))
+        {
+            dmaChannelsAllocated |= (1<<channel);
+            return channel;
+        }
+    }
+    return 0;
+}
+
+void dmaFreeChannel(uint8 channel)
+{
+    if (channel != DMA_CHANNEL_RADIO)
+    {
+        dmaChannelsAllocated &= ~(1<<channel);
+    }
+}
+
+void dmaSetChannelHandler(uint8 channel, DMA_CHANNEL_HANDLER handler)
+{
+    dmaChannelHandlers[channel] = handler;
+    if (handler)
+    {
+        DMAIE = 1;
+    }
+}
+
+ISR(DMA, 0)
+{
+    uint8 channel;
+
+    // Clear DMAIF first so that a transfer that finishes while we are in
+    // here makes the interrupt run again.
+    DMAIF = 0;
+
+    for (channel = 2; channel <= 4; channel++)
+    {
+        if ((DMAIRQ & (1<<channel)) && dmaChannelHandlers[channel])
+        {
+            // Writing 1 to a DMAIRQ bit does nothing, so this only clears ours.
+            DMAIRQ = ~(1<<channel);
+            dmaChannelHandlers[channel]();
+        }
+    }
+}
@@ -18,6 +18,8 @@ static uint8 radioComTxSignals = 0;
 static uint8 lastRxSignals = 0; // The last RX signals sent to the higher-level code.
 static BIT sendSignalsSoon = 0; // 1 iff we should transmit control signals soon
 
+static RADIO_COM_STATS XDATA stats;
+
 // For highest throughput, we want to send as much data in each packet
 // as possible.  But for lower latency, we sometimes need to send packets
 // that are NOT full.
@@ -72,11 +74,14 @@ static void receiveMorePackets(void)
             // discard zero-length packets in radio_com.c.
             rxBytesLeft = packet[0];  // Read the packet length.
             rxPointer = packet+1;              // Make rxPointer point to the data.
+            stats.rxPackets++;
+            stats.rxBytes += rxBytesLeft;
             return;
 
         case PAYLOAD_TYPE_CONTROL_SIGNALS:
             // We received a command to set the control signals.
             radioComRxSignals = packet[1];
+            stats.rxSignalPackets++;
 
             radioLinkRxDoneWithPacket();
 
@@ -122,6 +127,47 @@ uint8 radioComRxReceiveByte(void)
     return tmp;
 }
 
+// Assumption: The user recently called radioComRxAvailable and it returned
+// a value greater than or equal to size.
+void radioComRxReceive(uint8 XDATA * buffer, uint8 size)
+{
+    uint8 XDATA * src = rxPointer;
+    uint8 count = size;
+
+    while (count--)
+    {
+        *buffer++ = *src++;
+    }
+
+    radioComRxConsume(size);
+}
+
+uint8 XDATA * radioComRxBuffer(void)
+{
+    receiveMorePackets();
+    return rxPointer;
+}
+
+// Assumption: The user recently called radioComRxAvailable and it returned
+// a value greater than or equal to size.
+void radioComRxConsume(uint8 size)
+{
+    if (size == 0)
+    {
+        // Nothing to consume.  If no packet is held, rxBytesLeft is 0 and
+        // we must not release a packet we do not own.
+        return;
+    }
+
+    rxPointer += size;
+    rxBytesLeft -= size;
+
+    if (rxBytesLeft == 0)     // If there are no bytes left in this packet...
+    {
+        radioLinkRxDoneWithPacket();  // Tell the radio link layer we are done with it so we can receive more.
+    }
+}
+
 uint8 radioComRxControlSignals(void)
 {
     receiveMorePackets();
@@ -133,6 +179,13 @@ uint8 radioComRxControlSignals(void)
 
 static void radioComSendDataNow()
 {
+    stats.txPackets++;
+    stats.txBytes += txBytesLoaded;
+    if (txBytesLoaded < radioLinkTxPayloadSize())
+    {
+        stats.txPartialPackets++;
+    }
+
     *packetPointer = txBytesLoaded;
     radioLinkTxSendPacket(PAYLOAD_TYPE_DATA);
     txBytesLoaded = 0;
@@ -150,6 +203,7 @@ static void radioComSendControlSignalsNow()
     packet[1] = radioComTxSignals;
     sendSignalsSoon = 0;
     radioLinkTxSendPacket(PAYLOAD_TYPE_CONTROL_SIGNALS);
+    stats.txSignalPackets++;
 }
 
 void radioComTxService(void)
@@ -206,10 +260,16 @@ uint8 radioComTxAvailable(void)
     }
     else
     {
-        // Assumption: If txBytesLoaded is non-zero, radioLinkTxAvailable will be non-zero,
-        // so the subtraction below does not overflow.
-        // Assumption: The multiplication below does not overflow ever.
-        return radioLinkTxAvailable()*RADIO_LINK_PAYLOAD_SIZE - txBytesLoaded;
+        // Assumption: If txBytesLoaded is non-zero, radioLinkTxAvailable will be non-zero.
+        // The payload size can shrink while we are populating a packet (if the other
+        // Wixel is reset), so we still have to check that the subtraction does not overflow.
+        uint16 available = radioLinkTxAvailable() * radioLinkTxPayloadSize();
+        if (available <= txBytesLoaded)
+        {
+            return 0;
+        }
+        available -= txBytesLoaded;
+        return available > 255 ? 255 : available;
     }
 }
 
@@ -225,12 +285,85 @@ void radioComTxSendByte(uint8 byte)
     *txPointer = byte;
     txBytesLoaded++;
 
-    if (txBytesLoaded == RADIO_LINK_PAYLOAD_SIZE)
+    if (txBytesLoaded >= radioLinkTxPayloadSize())
     {
         radioComSendDataNow();
     }
 }
 
+uint8 radioComTxBufferAvailable(void)
+{
+    uint8 payloadSize;
+
+    if (sendSignalsSoon)
+    {
+        // See the comment in radioComTxAvailable.
+        return 0;
+    }
+
+    payloadSize = radioLinkTxPayloadSize();
+
+    if (txBytesLoaded == 0)
+    {
+        return radioLinkTxAvailable() ? payloadSize : 0;
+    }
+
+    // The payload size can shrink while we are populating a packet (if the other Wixel is reset).
+    return txBytesLoaded < payloadSize ? payloadSize - txBytesLoaded : 0;
+}
+
+// Assumption: The user recently called radioComTxBufferAvailable and it returned
+// a non-zero value.
+uint8 XDATA * radioComTxBuffer(void)
+{
+    if (txBytesLoaded == 0)
+    {
+        txPointer = packetPointer = radioLinkTxCurrentPacket();
+    }
+
+    // txPointer points to the last byte that was written.
+    return txPointer + 1;
+}
+
+// Assumption: The user called radioComTxBuffer and wrote size bytes to the buffer,
+// and size does not exceed the last value returned by radioComTxBufferAvailable.
+void radioComTxCommit(uint8 size)
+{
+    txPointer += size;
+    txBytesLoaded += size;
+
+    if (txBytesLoaded >= radioLinkTxPayloadSize())
+    {
+        radioComSendDataNow();
+    }
+}
+
+// Assumption: The user recently called radioComTxAvailable and it returned
+// a value greater than or equal to size.
+void radioComTxSend(const uint8 XDATA * buffer, uint8 size)
+{
+    uint8 XDATA * dest;
+    uint8 chunkSize;
+    uint8 count;
+
+    while (size)
+    {
+        // Copy as many bytes as will fit in the current packet.
+        chunkSize = radioComTxBufferAvailable();
+        if (chunkSize > size){ chunkSize = size; }
+
+        dest = radioComTxBuffer();
+        count = chunkSize;
+        while (count--)
+        {
+            *dest++ = *buffer++;
+        }
+
+        radioComTxCommit(chunkSize);
+        size -= chunkSize;
+    }
+}
+
 // If we are in the middle of building a packet, send it.
 void radioComTxControlSignals(uint8 controlSignals)
 {
@@ -241,3 +374,21 @@ void radioComTxControlSignals(uint8 controlSignals)
         radioComTxService();
     }
 }
+
+/** STATISTICS ****************************************************************/
+
+void radioComGetStats(RADIO_COM_STATS XDATA * s)
+{
+    *s = stats;
+}
+
+void radioComResetStats(void)
+{
+    uint8 XDATA * p = (uint8 XDATA *)&stats;
+    uint8 i;
+
+    for (i = 0; i < sizeof(stats); i++)
+    {
+        p[i] = 0;
+    }
+}
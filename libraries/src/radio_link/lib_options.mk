@@ -0,0 +1,11 @@
+# To let radio_link send and receive payloads larger than RADIO_LINK_PAYLOAD_SIZE
+# (18 bytes), add a flag like this.  The value must be from 18 to 62.
+# Every byte added to the payload size uses about 33 bytes of XDATA for the
+# packet buffers.
+#libraries/src/radio_link/radio_link.rel : C_FLAGS += -DRADIO_LINK_BUFFER_PAYLOAD_SIZE=62
+
+# radio_link has 16 RX packet buffers by default, so the windowed protocol can
+# use its whole window of 8 packets.  With 18-byte payloads they take 400 bytes
+# of XDATA (1104 bytes with 62-byte payloads).  To save XDATA, use fewer (it must
+# be a power of 2, and the window is limited to one less than the count):
+#libraries/src/radio_link/radio_link.rel : C_FLAGS += -DRADIO_LINK_RX_PACKET_COUNT=8
@@ -9,11 +9,31 @@
  *  transmitted by the radio.  A data packet is a piece of data that needs to be sent to the
  *  other device, and it might correspond to several RF packets because there are retries and
  *  ACKs.
+ *
+ *  This layer speaks two protocols:
+ *  - The original stop-and-wait protocol uses a single sequence bit and
+ *    every data packet must be ACKed before the next one can be sent.
+ *  - The windowed protocol (enabled by radioLinkWindowedMode) uses 4-bit
+ *    sequence numbers and lets up to TX_WINDOW_SIZE data packets be in flight.
+ *    The sender transmits a burst of data packets back-to-back, and only the
+ *    last packet of the burst has the POLL flag set, which asks the receiver
+ *    to respond.  Every windowed packet carries a three-byte trailer with
+ *    a cumulative ACK (the next sequence number the receiver expects), a
+ *    selective ACK bitmap of the packets it has buffered out of order, and
+ *    the number of packets the receiver has room for, so one response
+ *    acknowledges the whole burst, only the missing packets get
+ *    retransmitted, and the sender pauses instead of sending packets that
+ *    the receiver would have to drop.
+ *  Both devices advertise what they support in their Reset packets, and the
+ *  windowed protocol is only used if the other device supports it too.
+ *  Otherwise we fall back to the stop-and-wait protocol, so we can still talk
+ *  to devices running older firmware.
  */
 
 #include <radio_link.h>
 #include <radio_registers.h>
 #include <random.h>
+#include <time.h>
 
 /* PARAMETERS *****************************************************************/
 
@@ -21,12 +41,40 @@ int32 CODE param_radio_channel = 128;
 
 /* PACKET VARIABLES AND DEFINES ***********************************************/
 
-// Compute the max size of on-the-air packets.  This value is stored in the PKTLEN register.
-#define RADIO_MAX_PACKET_SIZE  (RADIO_LINK_PAYLOAD_SIZE + RADIO_LINK_PACKET_HEADER_LENGTH)
+// The largest payload that the packet buffers can hold.  Every buffer costs XDATA, so by
+// default they only have room for RADIO_LINK_PAYLOAD_SIZE bytes and radioLinkRequestedPayloadSize
+// can not be raised.  To allow larger payloads, define this when compiling the library
+// (see lib_options.mk).  It must be from RADIO_LINK_PAYLOAD_SIZE to RADIO_LINK_MAX_PAYLOAD_SIZE.
+#ifndef RADIO_LINK_BUFFER_PAYLOAD_SIZE
+#define RADIO_LINK_BUFFER_PAYLOAD_SIZE RADIO_LINK_PAYLOAD_SIZE
+#endif
+
+#if RADIO_LINK_BUFFER_PAYLOAD_SIZE < RADIO_LINK_PAYLOAD_SIZE || RADIO_LINK_BUFFER_PAYLOAD_SIZE > RADIO_LINK_MAX_PAYLOAD_SIZE
+#error RADIO_LINK_BUFFER_PAYLOAD_SIZE must be from RADIO_LINK_PAYLOAD_SIZE to RADIO_LINK_MAX_PAYLOAD_SIZE.
+#endif
+
+// Compute the max size of on-the-air packets.  The packet buffers are sized with this,
+// and the PKTLEN register is set to a value no bigger than this.
+#define RADIO_MAX_PACKET_SIZE  (RADIO_LINK_BUFFER_PAYLOAD_SIZE + RADIO_LINK_PACKET_HEADER_LENGTH + RADIO_LINK_PACKET_TRAILER_LENGTH)
 
 // The link layer will add a one byte header to the beginning of each packet.
 #define RADIO_LINK_PACKET_HEADER_LENGTH 1
 
+// Windowed packets have a three-byte trailer at the end:
+//   byte 0: Sequence number of this packet (bits 7:4) and the next sequence number we expect to receive (bits 3:0).
+//   byte 1: Selective ACK bitmap.  Bit N means we have received the packet whose sequence number is N+1 more than
+//           the next sequence number we expect.
+//   byte 2: Receive window (bits 6:0): the number of packets, starting with the next sequence number we expect,
+//           that we have room for.  The sender must not send packets beyond the window (except to probe it when
+//           it is 0).  Bit 7 is TRAILER_FLAG_TX_BLOCKED.
+#define RADIO_LINK_PACKET_TRAILER_LENGTH 3
+
+// Bit 7 of the receive window byte means that the sender has data packets queued that it could not
+// send because of the window, so it needs an ACK before it can make progress.  The receiver never
+// delays that ACK (see ACK_DELAY).
+#define TRAILER_FLAG_TX_BLOCKED 0x80
+#define TRAILER_WINDOW_MASK     0x7F
+
 #define RADIO_LINK_PACKET_LENGTH_OFFSET 0
 #define RADIO_LINK_PACKET_TYPE_OFFSET   1
 
@@ -39,14 +87,66 @@ int32 CODE param_radio_channel = 128;
 #define PACKET_TYPE_ACK   (2 << 6) // An ACK packet (with optional data)
 #define PACKET_TYPE_RESET (3 << 6) // A Reset packet (the next packet transmitted by the sender of this packet will have a sequence number of 0)
 
+// Older versions of this library ignore bit 5 of the header, so we use it to mark packets that
+// use the extensions described below.
+// In a Reset packet or in the ACK of a Reset packet, it means that the packet contains more
+// bytes after the header: the LINK_OPTION_* bits supported by the sender, followed by the
+// largest payload size the sender can receive.
+// In a Ping packet, it means that the packet uses the windowed protocol and has a trailer.
+#define PACKET_FLAG_EXTENDED (1 << 5)
+
+// In windowed packets, bit 0 of the header is the POLL flag instead of the sequence bit.
+// It means that the sender is done transmitting and expects a response.
+#define PACKET_FLAG_POLL 1
+
+#define LINK_OPTION_WINDOWED    (1 << 0)  // The device supports the windowed protocol.
+#define LINK_OPTION_DELAYED_ACK (1 << 1)  // The device supports delayed ACKs in the windowed protocol.
+#define LINK_OPTION_HOPPING     (1 << 2)  // The device has a hop sequence and wants to use it.
+#define LINK_OPTION_FEC         (1 << 3)  // The device wants to use forward error correction.
+#define LINK_OPTION_AUTO_RATE   (1 << 4)  // The device wants to adapt the data rate to the link.
+
+// A NAK packet with the extended flag is a Control packet, used in frequency hopping mode
+// and auto-rate mode.  It contains two more bytes after the header: a bit mask of the
+// channels in the hop sequence that should not be used (bit N corresponds to hop index N).
+// In auto-rate mode, it contains a third byte: the data rate profile that both devices
+// should use after this turn.  If bit 0 of the header is 1, the sender expects the
+// receiver to respond with its own Control packet.
+#define PACKET_FLAG_REPLY_REQUESTED 1
+
+// The maximum number of data packets that can be in flight in windowed mode.
+// This must be at most 8, because the sequence numbers are 4 bits and the
+// receiver needs to be able to tell new packets from old retransmissions.
+#define TX_WINDOW_SIZE 8
+
+// In windowed mode with delayed ACKs, this is how long (in units of 0.922 ms) we will wait
+// for the main loop to queue some data before responding to a POLL with just an ACK.
+// If the main loop queues data sooner, radioLinkTxSendPacket strobes the MAC and the data
+// goes out right away with the ACK.  radio_mac ignores strobes while it is listening with
+// a timeout shorter than 10 (MAX_LATENCY_OF_STROBE in radio_mac.c), so this must be at
+// least 10.  The other device waits this much longer than usual for our response.
+// We never delay a response to a packet with TRAILER_FLAG_TX_BLOCKED, because the other
+// device can't send any more data until it gets our ACK.
+#define ACK_DELAY 10
+
 /*  rxPackets:
  *  We need to be prepared at all times to receive a full packet from the other party,
- *  even if all we can do is NAK it.  Therefore, we need (at least) THREE buffers, so
- *  that two can be owned by the main loop while another is owned by the ISR and ready
- *  to receive the next packet.
+ *  even if all we can do is NAK it.  Therefore, the ISR always owns at least one buffer
+ *  that is ready to receive the next packet, and the main loop can own the others.
+ *  The number of buffers must be a power of 2 so the indices can wrap around with a mask.
+ *  It can be changed by defining RADIO_LINK_RX_PACKET_COUNT when compiling this library.
+ *  More buffers let the main loop fall further behind before the other device has
+ *  to stop sending.
+ *
+ *  In the windowed protocol, the window we advertise is the number of free buffers,
+ *  so with N buffers at most N-1 packets can be in flight.  The default is the
+ *  smallest power of 2 that is more than TX_WINDOW_SIZE, so the other device can
+ *  use its whole window.  With 4 buffers, the window was limited to 3 packets and
+ *  the throughput in the simulator (tools/radio_sim) was 16% lower with no delay
+ *  and 53% lower with 2 ms of delay.
  *
- *  If a packet is received and the main loop still owns the other two buffers,
- *  we respond with a NAK to the other device.
+ *  If a packet is received and the main loop owns all the other buffers,
+ *  we respond with a NAK to the other device (or advertise a window of 0 in the
+ *  windowed protocol, so the other device waits until we have room).
  *
  *  Ownership of the RX packet buffers is determined from radioLinkRxMainLoopIndex and radioLinkRxInterruptIndex.
  *  The main loop owns all the buffers from radioLinkRxMainLoopIndex to radioLinkRxInterruptIndex-1 inclusive.
@@ -57,7 +157,10 @@ int32 CODE param_radio_channel = 128;
  *                0 |                1 | rxBuffer[0]
  *                0 |                2 | rxBuffer[0 and 1]
  */
-#define RX_PACKET_COUNT  3
+#ifndef RADIO_LINK_RX_PACKET_COUNT
+#define RADIO_LINK_RX_PACKET_COUNT 16
+#endif
+#define RX_PACKET_COUNT  RADIO_LINK_RX_PACKET_COUNT
 static volatile uint8 XDATA radioLinkRxPacket[RX_PACKET_COUNT][1 + RADIO_MAX_PACKET_SIZE + 2];  // The first byte is the length, 2nd byte is link header.
 volatile uint8 DATA radioLinkRxMainLoopIndex = 0;   // The index of the next rxBuffer to read from the main loop.
 volatile uint8 DATA radioLinkRxInterruptIndex = 0;  // The index of the next rxBuffer to write to when a packet comes from the radio.
@@ -68,7 +171,9 @@ static volatile uint8 XDATA radioLinkTxPacket[TX_PACKET_COUNT][1 + RADIO_MAX_PAC
 volatile uint8 DATA radioLinkTxMainLoopIndex = 0;   // The index of the next txPacket to write to in the main loop.
 volatile uint8 DATA radioLinkTxInterruptIndex = 0;  // The index of the current txPacket we are trying to send on the radio.
 
-uint8 XDATA shortTxPacket[2];
+// This is as big as the other TX packets because in FEC mode, the radio sends
+// PKTLEN bytes from the buffer no matter what the length byte says.
+uint8 XDATA shortTxPacket[1 + RADIO_MAX_PACKET_SIZE];
 
 // The number of times the current TX packet has been transmitted.
 // Does NOT overflow.  If we have transmitting the current packet more than 255
@@ -76,6 +181,26 @@ uint8 XDATA shortTxPacket[2];
 uint8 DATA radioLinkTxCurrentPacketTries = 0;
 
 static volatile BIT sendingReset = 0;
+
+// 1 if the RF ISR is listening without waiting for anything in particular (or is
+// delaying an ACK until there is data to send with it), so radioLinkTxSendPacket has
+// to strobe the MAC to get new data sent.  While the ISR waits for a response, the
+// rest of a burst, a NAK backoff or a window probe, it looks for new data when the
+// wait ends, and a strobe would only cut the wait short.
+static volatile BIT rxListening = 0;
+
+// In the stop-and-wait protocol, this is how long (in units of 0.922 ms) we wait after
+// the other device NAKs our data before we send it again.  It doubles with every NAK,
+// up to NAK_BACKOFF_MAX, and goes back to NAK_BACKOFF_MIN when the data is ACKed.
+#define NAK_BACKOFF_MIN 4
+#define NAK_BACKOFF_MAX 128
+static uint8 XDATA nakBackoff = NAK_BACKOFF_MIN;
+
+uint8 radioLinkRequestedPayloadSize = RADIO_LINK_PAYLOAD_SIZE;
+
+// The largest payload we are allowed to send to the other device.
+static uint8 txPayloadSize;
+
 static volatile BIT acceptAnySequenceBit = 0;
 
 volatile BIT radioLinkResetPacketReceived;
@@ -95,11 +220,302 @@ static volatile BIT rxSequenceBit;
 // send.
 static volatile BIT txSequenceBit;
 
+/* WINDOWED MODE VARIABLES ****************************************************/
+
+BIT radioLinkWindowedMode = 0;
+BIT radioLinkDelayedAckMode = 0;
+
+// 1 if we are sending data packets using the windowed protocol.  This is only
+// set if radioLinkWindowedMode is 1 and the other device said it supports it.
+static volatile BIT txWindowed = 0;
+
+// 1 if we are in the middle of transmitting a burst of windowed packets and
+// the last one we sent did not have the POLL flag.
+static volatile BIT txBurstActive = 0;
+
+// 1 if we are allowed to delay our ACKs; see ACK_DELAY.
+static volatile BIT txDelayedAck = 0;
+
+// 1 if we received a POLL and have not sent the ACK information yet.
+static volatile BIT ackPending = 0;
+
+// 1 if the last trailer we received had TRAILER_FLAG_TX_BLOCKED, so the other device is
+// waiting for our ACK to send more data.
+static volatile BIT rxPeerTxBlocked = 0;
+
+// When the other device says it has no room for our data, we wait this long
+// (in units of 0.922 ms) for it to tell us that it has room before we probe
+// its window by sending a packet anyway.
+#define WINDOW_PROBE_DELAY 100
+
+// The receive window advertised by the other device in the last trailer we received:
+// the number of packets, starting at radioLinkTxInterruptIndex, that it has room for.
+static uint8 XDATA txPeerWindow;
+
+// 1 if we have waited WINDOW_PROBE_DELAY for the other device to open its window.
+static volatile BIT txWindowProbeDue = 0;
+
+// 1 if the last trailer we sent advertised a window of 0, so we need to tell the
+// other device when the main loop frees an RX packet buffer.
+static volatile BIT rxWindowClosed = 0;
+
+// The sequence number of the packet in radioLinkTxPacket[i] is (i - txSequenceOffset) & 15.
+// Assumption: TX_PACKET_COUNT is 16, which is also the number of sequence numbers.
+static uint8 DATA txSequenceOffset;
+
+// The number of packets, starting at radioLinkTxInterruptIndex, that have
+// been transmitted at least once and not acknowledged yet.
+static uint8 DATA txInFlight;
+
+// Bit N is 1 if the packet at radioLinkTxInterruptIndex + N was selectively
+// acknowledged by the other device, so we don't need to send it again.
+static uint8 DATA txAckedMask;
+
+// The offset (from radioLinkTxInterruptIndex) of the next packet to consider
+// sending in the current burst.
+static uint8 DATA txBurstOffset;
+
+// The sequence number of the next packet we expect to receive.  This packet will
+// go in radioLinkRxPacket[radioLinkRxInterruptIndex].
+static uint8 DATA rxNextSequence;
+
+// Bit N is 1 if we have received the packet with sequence number rxNextSequence + N
+// and put it in radioLinkRxPacket[radioLinkRxInterruptIndex + N] (wrapping around) but
+// we could not give it to the main loop yet because an earlier one is missing.
+static uint8 DATA rxParkedMask;
+
 
 /* GENERAL VARIABLES **********************************************************/
 
 volatile BIT radioLinkActivityOccurred;
 
+static RADIO_LINK_STATS XDATA stats;
+
+/* TIMING VARIABLES ***********************************************************/
+/* The retransmit timeout (how long we listen for a response after sending a
+   packet) is computed from the measured round-trip time, using the algorithm
+   from RFC 6298.  Times are measured with getTicks(), whose ticks are
+   1/32 ms long. */
+
+// The shortest and longest retransmit timeouts, in units of 0.922 ms (the units of radioMacRx).
+#define RTO_MIN 1
+#define RTO_MAX 60
+
+// The retransmit timeout we use before any round-trip time has been measured.
+#define RTO_INITIAL 2
+
+// The maximum number of times the retransmit timeout will be doubled when
+// responses are not received.
+#define RTO_MAX_BACKOFF 4
+
+// 1 if we have measured the round-trip time at least once.
+static BIT rttMeasured = 0;
+
+// The smoothed round-trip time times 8, in getTicks() ticks.
+static uint16 XDATA rttSmoothed8;
+
+// The round-trip time variation times 4, in getTicks() ticks.
+static uint16 XDATA rttVariation4;
+
+// The retransmit timeout computed from rttSmoothed8 and rttVariation4,
+// in units of 0.922 ms.
+static uint8 XDATA rto;
+
+// The number of times the retransmit timeout has been doubled because
+// no response was received.
+static uint8 XDATA rtoBackoff;
+
+// 1 if we sent a packet and are listening for the response.
+static volatile BIT awaitingResponse = 0;
+
+// 1 if the last packet we sent requires a response (it had data or was a Reset packet).
+// Packets that only contain an ACK do not require a response, so the time until the
+// next packet from the other device is not a round-trip time.
+static volatile BIT txNeedsResponse = 0;
+
+// The getTicks() value when we finished sending the last packet.
+static uint16 XDATA txEndTime;
+
+// The getTicks() value when we started sending the last packet.
+static uint16 XDATA txStartTime;
+
+// Averages (times 8) of how long it takes to send a packet and of the
+// time between the starts of two packets, in getTicks() ticks.
+// These are used to estimate the fraction of time we are transmitting.
+static uint16 XDATA txAirTime8;
+static uint16 XDATA txPeriod8;
+
+// The number of times each TX packet has been sent in windowed mode.
+static uint8 XDATA txTries[TX_PACKET_COUNT];
+
+/* FREQUENCY HOPPING VARIABLES ************************************************/
+/* In frequency hopping mode, both devices move to the next channel in the hop
+   sequence whenever a turn ends: after sending a packet that expects a response
+   (or is a response), and after receiving such a packet.  Hop index 0 is the
+   home channel (param_radio_channel), and indices 1 and up are the channels in
+   radioLinkHopChannels.
+
+   If a packet or its response is lost, the devices can end up on different
+   channels: the other device is either still on the channel the packet was
+   sent on, or two channels further if it sent a response that was lost (or if
+   it received the packet with a bad CRC).  The device that is retransmitting
+   picks one of those two channels randomly after every timeout, so it will
+   soon find the other device.  If that takes too long, both devices give up
+   and return to the home channel, where they wait for each other.
+
+   Each device keeps loss statistics for every channel and blacklists channels
+   that lose too many packets.  The blacklist is shared with Control packets so
+   that both devices skip the same channels.  A packet and its response are sent
+   on consecutive channels of the sequence, and when the response does not come
+   we can not tell which of the two was lost, so the loss counts for both
+   channels.  A bad channel loses all of its exchanges while its neighbors in
+   the sequence only lose the ones they share with it, so the threshold for
+   blacklisting is well above half. */
+
+// The number of consecutive RX timeouts after which we return to the home channel
+// (and stop using FEC and go back to the profile we started with).
+#define RESYNC_TIMEOUTS 8
+
+// When there is nothing to do in hopping mode or FEC mode, we listen with this
+// timeout (in units of 0.922 ms) so that we can count the timeouts.
+#define IDLE_TIMEOUT 100
+
+// In hopping mode, the other device might calibrate its radio for the new channel
+// (about 0.8 ms) before it sends its response, so we wait this much longer for it
+// (in units of 0.922 ms).
+#define HOP_CALIBRATION_DELAY 1
+
+// The loss statistics of a channel are evaluated every HOP_WINDOW exchanges on that channel,
+// and the channel is blacklisted if at least HOP_BLACKLIST_LOSSES of them failed.
+#define HOP_WINDOW            32
+#define HOP_BLACKLIST_LOSSES  24
+
+uint8 XDATA radioLinkHopChannels[RADIO_LINK_MAX_HOP_CHANNELS];
+uint8 radioLinkHopChannelCount = 0;
+
+// 1 if both devices agreed to use frequency hopping.
+static volatile BIT txHopping = 0;
+
+// 1 if we need to send a Control packet with our blacklist to the other device.
+static volatile BIT hopBlacklistPending = 0;
+
+// The hop index of the channel we are on now.
+static uint8 XDATA hopIndex;
+
+// The hop index of the channel we last sent a packet on.
+static uint8 XDATA hopTxIndex;
+
+// The hop index of the channel we listened for the response on.
+static uint8 XDATA hopResponseIndex;
+
+// The hop index of the channel we sent the packet on when we stopped getting responses.
+static uint8 XDATA hopLostIndex;
+
+// The number of consecutive RX timeouts.
+static uint8 XDATA rxTimeouts;
+
+/* After a Reset exchange, the device that sent the ACK can not tell whether the ACK
+   arrived, so neither device starts using the new options (hopping, FEC and the
+   profile) when that exchange ends.  Instead, they start at the end of the first
+   turn in which the device that sent the Reset packet transmits (and the other device
+   receives).  If the devices lose contact before that, they do not wait any longer. */
+
+// 1 if we have not started using the options from the last Reset exchange.
+static volatile BIT optionsPending = 0;
+
+// 1 if we sent the Reset packet, so we start using the options after we transmit.
+static volatile BIT optionsStartOnTx = 0;
+
+// The channels that both devices skip (bit N corresponds to hop index N).
+static uint16 XDATA hopBlacklist;
+
+// The channels that this device found to be bad.
+static uint16 XDATA hopBadChannels;
+
+// Statistics for each channel since radioLinkInit.
+static RADIO_LINK_HOP_STATS XDATA hopStats[RADIO_LINK_MAX_HOP_CHANNELS + 1];
+
+// Statistics for each channel in the current evaluation window.
+static uint8 XDATA hopWindowTries[RADIO_LINK_MAX_HOP_CHANNELS + 1];
+static uint8 XDATA hopWindowLosses[RADIO_LINK_MAX_HOP_CHANNELS + 1];
+
+/* FORWARD ERROR CORRECTION VARIABLES *****************************************/
+/* In FEC mode, every packet has the same length (see radioMacSetFec): the length
+   of the largest packet that either device is allowed to send.  Reset packets and
+   their ACKs are always sent without FEC because the other device might not
+   support it, so both devices switch to FEC at the same turn end as they start
+   hopping (see optionsPending).
+
+   If a packet is lost at the wrong time, the devices can end up using different
+   settings.  They will both stop hearing each other, so after RESYNC_TIMEOUTS
+   consecutive timeouts each device switches back to sending without FEC, and they
+   switch to FEC again when the next turn ends. */
+
+BIT radioLinkFecMode = 0;
+
+// 1 if both devices agreed to use forward error correction.
+static volatile BIT txFec = 0;
+
+// 1 if the radio is currently using forward error correction.
+static volatile BIT fecActive = 0;
+
+/* AUTO-RATE VARIABLES ********************************************************/
+/* In auto-rate mode, each device watches the exchanges it starts.  If too many
+   responses in a row are lost, it asks the other device to switch to the next
+   slower data rate profile (see radioSetProfile).  If many exchanges in a row
+   succeed and the signal of every response was strong enough for the next faster
+   profile, it asks to switch to that profile.  This is similar to the Automatic
+   Rate Fallback algorithm used in Wi-Fi.  The LQI is not used because its scale
+   depends on the modulation, so it cannot be compared between profiles.
+
+   The request is a Control packet.  Both devices switch profiles when the turn
+   that carried the Control packet ends, the same way they hop to the next
+   channel.  Reset packets are always sent with the profile that radioLinkInit
+   started with, and if the devices lose contact (RESYNC_TIMEOUTS consecutive
+   timeouts), they both return to that profile. */
+
+// The number of consecutive successful exchanges after which we consider switching to a faster profile.
+#define RATE_UP_EXCHANGES 64
+
+// The number of consecutive lost responses after which we switch to a slower profile.
+#define RATE_DOWN_LOSSES 3
+
+// radio_link's timeouts are too short for profiles slower than this.
+#define RATE_SLOWEST_PROFILE RADIO_PROFILE_100K
+
+// Data rates above 400 kbps cause many packet errors (see RADIO_PROFILE_500K), so
+// we never switch to a profile faster than this.  An app can still start with
+// RADIO_PROFILE_500K.
+#define RATE_FASTEST_PROFILE RADIO_PROFILE_350K
+
+// The weakest response signal (in dBm) that lets us switch to each profile.
+// These are about 15 dB above the sensitivity of each profile.
+static int8 CODE rateUpRssi[RADIO_PROFILE_COUNT] = { -68, -72, -75, -80, -90 };
+
+BIT radioLinkAutoRateMode = 0;
+
+// 1 if both devices agreed to use auto-rate mode.
+static volatile BIT txAutoRate = 0;
+
+// 1 if we need to send a Control packet to request rateWanted.
+static volatile BIT ratePending = 0;
+
+// The profile we use for Reset packets and when we lose contact.
+static uint8 XDATA rateBaseProfile;
+
+// The profile that both devices will use after the current turn ends.
+static uint8 XDATA rateNext;
+
+// The profile we want to ask the other device to switch to.
+static uint8 XDATA rateWanted;
+
+// The number of consecutive exchanges that succeeded or failed.
+static uint8 XDATA rateSuccesses;
+static uint8 XDATA rateLosses;
+
+// The weakest response signal during the current run of successful exchanges.
+static int8 XDATA rateMinRssi;
+
 /* GENERAL FUNCTIONS **********************************************************/
 
 void radioLinkInit()
@@ -110,17 +526,58 @@ void radioLinkInit()
 
     txSequenceBit = 0;
 
-    PKTLEN = RADIO_MAX_PACKET_SIZE;
+    if (radioLinkRequestedPayloadSize > RADIO_LINK_BUFFER_PAYLOAD_SIZE)
+    {
+        radioLinkRequestedPayloadSize = RADIO_LINK_BUFFER_PAYLOAD_SIZE;
+    }
+    else if (radioLinkRequestedPayloadSize < RADIO_LINK_PAYLOAD_SIZE)
+    {
+        radioLinkRequestedPayloadSize = RADIO_LINK_PAYLOAD_SIZE;
+    }
+
+    // Until the other device tells us otherwise, assume it can only receive the
+    // payload size that every version of this library supports.
+    txPayloadSize = RADIO_LINK_PAYLOAD_SIZE;
+
+    PKTLEN = radioLinkRequestedPayloadSize + RADIO_LINK_PACKET_HEADER_LENGTH + RADIO_LINK_PACKET_TRAILER_LENGTH;
     CHANNR = param_radio_channel;
 
     acceptAnySequenceBit = 1;
+    rxNextSequence = 0;
+    rto = RTO_INITIAL;
+
+    if (radioLinkHopChannelCount > RADIO_LINK_MAX_HOP_CHANNELS)
+    {
+        radioLinkHopChannelCount = RADIO_LINK_MAX_HOP_CHANNELS;
+    }
+    rxParkedMask = 0;
+
     radioMacInit();
 
+    // radioMacInit set up the radio with the profile in radioProfile.
+    rateBaseProfile = radioProfile;
+    rateNext = radioProfile;
+
     // Start trying to send a reset packet.
     sendingReset = 1;
     radioMacStrobe();
 }
 
+// Returns the retransmit timeout, including the exponential backoff, in units of 0.922 ms.
+static uint8 currentRto()
+{
+    uint16 delay;
+
+    // 200 and 250 were chosen arbitrarily.
+    if (radioLinkTxCurrentPacketTries > 200)
+    {
+        return 250;
+    }
+
+    delay = (uint16)rto << rtoBackoff;
+    return delay > RTO_MAX ? RTO_MAX : delay;
+}
+
 // Returns a random delay in units of 0.922 ms (the same units of radioMacRx).
 // This is used to decide how long to wait before retransmitting.
 // This is used to decide when to next transmit a queued data packet.
@@ -131,13 +588,566 @@ void radioLinkInit()
 // http://en.wikipedia.org/wiki/Exponential_backoff
 static uint8 randomTxDelay()
 {
-    // 200 and 250 were chosen arbitrarily.
-    return (radioLinkTxCurrentPacketTries > 200 ? 250 : 1) + (randomNumber() & 3);
+    // The random part helps prevent both devices from transmitting at the same time over and over.
+    return currentRto() + (randomNumber() & 3);
+}
+
+// Sends a packet on the radio.
+static void txPacket(uint8 XDATA * packet)
+{
+    uint16 now = getTicks();
+    uint16 period = now - txStartTime;
+    if (period > 8191)
+    {
+        period = 8191;
+    }
+    txPeriod8 += period - (txPeriod8 >> 3);
+    txStartTime = now;
+    stats.txPackets++;
+    txNeedsResponse = packet != shortTxPacket || sendingReset;
+    hopTxIndex = hopIndex;
+    radioMacTx(packet);
+}
+
+// Called when we finish sending a packet.
+static void txDone()
+{
+    uint16 airTime = getTicks() - txStartTime;
+    if (airTime > 8191)
+    {
+        airTime = 8191;
+    }
+    txAirTime8 += airTime - (txAirTime8 >> 3);
+}
+
+// Starts listening for the response to the packet we just sent.
+static void rxResponse(uint8 timeout)
+{
+    txEndTime = getTicks();
+    awaitingResponse = txNeedsResponse;
+    rxListening = !txNeedsResponse;
+    hopResponseIndex = hopIndex;
+    radioMacRx(radioLinkRxPacket[radioLinkRxInterruptIndex], timeout);
+}
+
+// Returns the channel number (the value for CHANNR) of the specified hop index.
+static uint8 hopChannel(uint8 index)
+{
+    return index == 0 ? param_radio_channel : radioLinkHopChannels[index - 1];
+}
+
+// Moves to the specified hop index.
+static void hopTo(uint8 index)
+{
+    hopIndex = index;
+    radioMacSetChannel(hopChannel(index));
+}
+
+// Returns the hop index of the channel after the specified one in the hop sequence,
+// skipping the blacklisted channels.
+static uint8 hopIndexAfter(uint8 index)
+{
+    do
+    {
+        index = index >= radioLinkHopChannelCount ? 0 : index + 1;
+    }
+    while (hopBlacklist & ((uint16)1 << index));   // Assumption: The home channel is not blacklisted.
+    return index;
+}
+
+// Moves to the next channel in the hop sequence that is not blacklisted.
+static void hopNext()
+{
+    hopTo(hopIndexAfter(hopIndex));
+}
+
+// Records the result of an exchange on one channel, and blacklists the channel if
+// it has been losing too many.
+static void hopRecordChannel(uint8 index, BIT lost)
+{
+    hopStats[index].tries++;
+    hopWindowTries[index]++;
+    if (lost)
+    {
+        hopStats[index].losses++;
+        hopWindowLosses[index]++;
+    }
+
+    if (hopWindowTries[index] >= HOP_WINDOW)
+    {
+        if (index != 0 && hopWindowLosses[index] >= HOP_BLACKLIST_LOSSES)
+        {
+            hopBadChannels |= (uint16)1 << index;
+            if (hopBadChannels & ~hopBlacklist)
+            {
+                hopBlacklistPending = 1;
+            }
+        }
+        hopWindowTries[index] = 0;
+        hopWindowLosses[index] = 0;
+    }
+}
+
+// Records whether the response to the last packet we sent was received, for the
+// channel the packet was sent on and the channel the response was expected on.
+// Only the first loss after a response counts: after that, the devices are
+// probably on different channels, and the losses say nothing about the channels.
+static void hopRecordExchange(BIT lost)
+{
+    if (!txHopping || (lost && rtoBackoff))
+    {
+        return;
+    }
+
+    hopRecordChannel(hopTxIndex, lost);
+    if (hopResponseIndex != hopTxIndex)
+    {
+        hopRecordChannel(hopResponseIndex, lost);
+    }
+}
+
+// Turns forward error correction on or off and sets the packet length to match.
+static void fecSet(BIT enable)
+{
+    fecActive = enable;
+    radioMacSetFec(enable);
+    if (enable)
+    {
+        // In fixed-length mode, PKTLEN includes the length byte.
+        PKTLEN = 1 + RADIO_LINK_PACKET_HEADER_LENGTH + txPayloadSize + RADIO_LINK_PACKET_TRAILER_LENGTH;
+    }
+    else
+    {
+        PKTLEN = radioLinkRequestedPayloadSize + RADIO_LINK_PACKET_HEADER_LENGTH + RADIO_LINK_PACKET_TRAILER_LENGTH;
+    }
+}
+
+// Called when a turn ends (see the explanations of frequency hopping and FEC above).
+// transmitted: 1 if we sent the packet that ended the turn.
+static void turnEnded(BIT transmitted)
+{
+    if (optionsPending)
+    {
+        if (transmitted != optionsStartOnTx && rxTimeouts < RESYNC_TIMEOUTS)
+        {
+            return;
+        }
+        optionsPending = 0;
+    }
+
+    if (txHopping)
+    {
+        hopNext();
+    }
+
+    if (txFec && !fecActive)
+    {
+        fecSet(1);
+    }
+
+    if (radioProfile != rateNext)
+    {
+        radioMacSetProfile(rateNext);
+        rateSuccesses = 0;
+        rateLosses = 0;
+    }
+}
+
+// Called when we get an RX timeout in frequency hopping mode.
+// wasAwaitingResponse: 1 if we were waiting for a response to a packet we sent.
+static void hopTimeout(BIT wasAwaitingResponse)
+{
+    if (rxTimeouts >= RESYNC_TIMEOUTS)
+    {
+        // We have lost contact with the other device, so go to the home channel and wait there.
+        if (hopIndex != 0)
+        {
+            hopTo(0);
+        }
+    }
+    else if (wasAwaitingResponse)
+    {
+        // Either our packet was lost, and the other device is still on the channel we sent it
+        // on, or the response was lost, and the other device has moved on to the channel after
+        // the one we were listening on.  We can not tell which, so we try one of them randomly
+        // until we find it.  Those channels are relative to the first lost exchange, not to
+        // the retransmissions that the other device did not hear either.
+        if (rtoBackoff == 0)
+        {
+            hopLostIndex = hopTxIndex;
+        }
+        if (randomNumber() & 1)
+        {
+            hopTo(hopLostIndex);
+        }
+        else
+        {
+            hopTo(hopIndexAfter(hopIndexAfter(hopLostIndex)));
+        }
+    }
+}
+
+// Called when we get an RX timeout in FEC mode.
+static void fecTimeout()
+{
+    if (fecActive && rxTimeouts >= RESYNC_TIMEOUTS)
+    {
+        // We have lost contact with the other device, which might not be using FEC.
+        fecSet(0);
+    }
+}
+
+// Called when an exchange that we started in auto-rate mode succeeds or fails.
+// lost: 1 if we did not get a response.
+static void rateRecordExchange(BIT lost)
+{
+    int8 rssi;
+
+    if (!txAutoRate || ratePending)
+    {
+        return;
+    }
+
+    if (lost)
+    {
+        rateSuccesses = 0;
+        if (++rateLosses >= RATE_DOWN_LOSSES && radioProfile < RATE_SLOWEST_PROFILE)
+        {
+            rateWanted = radioProfile + 1;
+            ratePending = 1;
+        }
+        return;
+    }
+
+    // This is called right after receiving the response, so radioRssi() is the signal strength of the response.
+    rssi = radioRssi();
+    if (rateSuccesses == 0 || rssi < rateMinRssi)
+    {
+        rateMinRssi = rssi;
+    }
+    rateLosses = 0;
+
+    if (++rateSuccesses >= RATE_UP_EXCHANGES)
+    {
+        if (radioProfile > RATE_FASTEST_PROFILE && rateMinRssi >= rateUpRssi[radioProfile - 1])
+        {
+            rateWanted = radioProfile - 1;
+            ratePending = 1;
+        }
+        rateSuccesses = 0;
+    }
+}
+
+// Called when we get an RX timeout in auto-rate mode.
+static void rateTimeout()
+{
+    if (rxTimeouts >= RESYNC_TIMEOUTS && (radioProfile != rateBaseProfile || rateNext != rateBaseProfile))
+    {
+        // We have lost contact with the other device, so go back to the profile we started with.
+        rateNext = rateBaseProfile;
+        ratePending = 0;
+        radioMacSetProfile(rateBaseProfile);
+        rateSuccesses = 0;
+        rateLosses = 0;
+    }
+}
+
+// Sends a Control packet with all the channels we know are bad and the profile
+// we want to use.
+static void txControlPacket(uint8 flags)
+{
+    // hopBlacklistPending will be cleared when the other device tells us it has the same blacklist.
+    hopBlacklist |= hopBadChannels;
+
+    if (ratePending && (flags & PACKET_FLAG_REPLY_REQUESTED))
+    {
+        // We will switch to this profile when our turn ends (see turnEnded),
+        // and the other device will switch when it receives this packet.
+        rateNext = rateWanted;
+    }
+
+    shortTxPacket[RADIO_LINK_PACKET_LENGTH_OFFSET] = txAutoRate ? 4 : 3;
+    shortTxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] = PACKET_TYPE_NAK | PACKET_FLAG_EXTENDED | flags;
+    shortTxPacket[RADIO_LINK_PACKET_TYPE_OFFSET + 1] = (uint8)hopBlacklist;
+    shortTxPacket[RADIO_LINK_PACKET_TYPE_OFFSET + 2] = (uint8)(hopBlacklist >> 8);
+    shortTxPacket[RADIO_LINK_PACKET_TYPE_OFFSET + 3] = rateNext;
+    txPacket(shortTxPacket);
+
+    if (flags & PACKET_FLAG_REPLY_REQUESTED)
+    {
+        txNeedsResponse = 1;
+    }
+}
+
+static void takeInitiative();
+
+// Handles a Control packet that we received.
+static void rxControlPacket(uint8 XDATA * packet)
+{
+    uint8 length = packet[RADIO_LINK_PACKET_LENGTH_OFFSET];
+
+    if (!(txHopping || txAutoRate) || length < 3)
+    {
+        // Invalid packet.
+        takeInitiative();
+        return;
+    }
+
+    if (txHopping)
+    {
+        // The other device has switched to this blacklist, so we switch too before hopping.
+        // The home channel can never be blacklisted.
+        hopBlacklist = (packet[RADIO_LINK_PACKET_TYPE_OFFSET + 1] | ((uint16)packet[RADIO_LINK_PACKET_TYPE_OFFSET + 2] << 8)) & ~1;
+        hopBlacklistPending = (hopBadChannels & ~hopBlacklist) != 0;
+    }
+
+    if (txAutoRate && length >= 4 && packet[RADIO_LINK_PACKET_TYPE_OFFSET + 3] < RADIO_PROFILE_COUNT)
+    {
+        // The other device will switch to this profile when this turn ends, so we switch too.
+        rateNext = packet[RADIO_LINK_PACKET_TYPE_OFFSET + 3];
+        if (rateNext == rateWanted)
+        {
+            ratePending = 0;
+        }
+    }
+
+    turnEnded(0);
+
+    if (packet[RADIO_LINK_PACKET_TYPE_OFFSET] & PACKET_FLAG_REPLY_REQUESTED)
+    {
+        // Reply with the blacklist, including any channels we know are bad.
+        txControlPacket(0);
+    }
+    else
+    {
+        takeInitiative();
+    }
+}
+
+// Listens for packets when we have nothing else to do.
+static void rxIdle()
+{
+    // In frequency hopping mode, FEC mode, and auto-rate mode, we need to count
+    // the timeouts (see hopTimeout, fecTimeout, and rateTimeout).
+    rxListening = 1;
+    radioMacRx(radioLinkRxPacket[radioLinkRxInterruptIndex], (txHopping || txFec || txAutoRate) ? IDLE_TIMEOUT : 0);
+}
+
+// Called when we received a valid packet.  If it was the response to a packet we
+// sent, this measures the round-trip time and updates the retransmit timeout.
+static void rtoResponseReceived()
+{
+    uint16 rtt;
+    uint16 error;
+
+    if (!awaitingResponse)
+    {
+        return;
+    }
+    awaitingResponse = 0;
+    rtoBackoff = 0;
+    hopRecordExchange(0);
+    rateRecordExchange(0);
+
+    rtt = getTicks() - txEndTime;
+    if (rtt > 2047)
+    {
+        rtt = 2047;
+    }
+
+    if (!rttMeasured)
+    {
+        // This is the first measurement.
+        rttMeasured = 1;
+        rttSmoothed8 = rtt << 3;
+        rttVariation4 = rtt << 1;
+    }
+    else
+    {
+        error = rtt > (rttSmoothed8 >> 3) ? rtt - (rttSmoothed8 >> 3) : (rttSmoothed8 >> 3) - rtt;
+        rttVariation4 += error - (rttVariation4 >> 2);
+        rttSmoothed8 += rtt - (rttSmoothed8 >> 3);
+    }
+
+    // RTO = SRTT + 4*RTTVAR, converted from getTicks() ticks to units of 0.922 ms
+    // (29.5 ticks) and rounded up.  This is rtt * 9 / 256, done with shifts because
+    // this runs in the RF ISR and SDCC's multiplication routines are not reentrant.
+    rtt = (rttSmoothed8 >> 3) + rttVariation4;
+    rtt = ((((uint32)rtt << 3) + rtt) >> 8) + 1;
+    rto = rtt < RTO_MIN ? RTO_MIN : (rtt > RTO_MAX ? RTO_MAX : rtt);
+}
+
+// Called when we did not receive a response in time.
+static void rtoTimeout()
+{
+    if (awaitingResponse)
+    {
+        awaitingResponse = 0;
+        stats.responseTimeouts++;
+        hopRecordExchange(1);
+        rateRecordExchange(1);
+        if (rtoBackoff < RTO_MAX_BACKOFF)
+        {
+            rtoBackoff++;
+        }
+    }
+}
+
+// Records how many times a data packet was sent before it was acknowledged.
+static void recordTries(uint8 tries)
+{
+    uint8 bucket = 0;
+
+    // Bucket N holds the packets that took from 2^(N-1)+1 to 2^N tries.
+    tries--;
+    stats.retransmissions += tries;
+    while (tries && bucket < RADIO_LINK_STATS_RETRY_BUCKETS - 1)
+    {
+        tries >>= 1;
+        bucket++;
+    }
+    stats.retries[bucket]++;
+}
+
+// Returns how long to listen for a response after sending a packet, in the same
+// units as randomTxDelay.  If delayed ACKs are enabled, the other device might
+// wait ACK_DELAY before responding, so we have to wait longer, and the same goes
+// for HOP_CALIBRATION_DELAY in hopping mode.
+static uint8 responseDelay()
+{
+    uint8 delay = randomTxDelay();
+    if (txDelayedAck && delay <= 255 - ACK_DELAY)
+    {
+        delay += ACK_DELAY;
+    }
+    if (txHopping && delay <= 255 - HOP_CALIBRATION_DELAY)
+    {
+        delay += HOP_CALIBRATION_DELAY;
+    }
+    return delay;
+}
+
+BIT radioLinkConnected()
+{
+    return !sendingReset;
+}
+
+uint8 radioLinkTxPayloadSize()
+{
+    return txPayloadSize;
+}
+
+BIT radioLinkWindowed()
+{
+    return txWindowed;
+}
+
+// Returns the LINK_OPTION_* bits that we put in our Reset packets and in the
+// ACKs of Reset packets.
+static uint8 linkOptions()
+{
+    uint8 options = radioLinkHopChannelCount ? LINK_OPTION_HOPPING : 0;
+    if (radioLinkFecMode)
+    {
+        options |= LINK_OPTION_FEC;
+    }
+    if (radioLinkAutoRateMode)
+    {
+        options |= LINK_OPTION_AUTO_RATE;
+    }
+    if (radioLinkWindowedMode)
+    {
+        options |= LINK_OPTION_WINDOWED;
+        if (radioLinkDelayedAckMode)
+        {
+            options |= LINK_OPTION_DELAYED_ACK;
+        }
+    }
+    return options;
+}
+
+BIT radioLinkHopping()
+{
+    return txHopping;
+}
+
+BIT radioLinkFec()
+{
+    return txFec;
+}
+
+BIT radioLinkAutoRate()
+{
+    return txAutoRate;
+}
+
+uint16 radioLinkHopBlacklist()
+{
+    uint16 blacklist;
+    uint8 oldRfie = IEN2 & 0x01;
+    IEN2 &= ~0x01;
+    blacklist = hopBlacklist;
+    IEN2 |= oldRfie;
+    return blacklist;
+}
+
+void radioLinkGetHopStats(uint8 index, RADIO_LINK_HOP_STATS XDATA * s)
+{
+    uint8 oldRfie = IEN2 & 0x01;
+    IEN2 &= ~0x01;
+    *s = hopStats[index];
+    IEN2 |= oldRfie;
+}
+
+void radioLinkGetStats(RADIO_LINK_STATS XDATA * s)
+{
+    uint8 oldRfie = IEN2 & 0x01;
+    uint16 period;
+
+    IEN2 &= ~0x01;     // Disable the RF interrupt so we get a consistent copy.
+    *s = stats;
+
+    s->rto = currentRto();
+    s->rtt = (uint32)(rttSmoothed8 >> 3) * 125 >> 2;
+
+    // If we have not transmitted for a while, then the average period is too low.
+    period = getTicks() - txStartTime;
+    period = period > 8191 ? 0xFFFF : period << 3;
+    if (period < txPeriod8)
+    {
+        period = txPeriod8;
+    }
+    s->utilization = period ? (uint32)txAirTime8 * 100 / period : 0;
+
+    IEN2 |= oldRfie;   // Restore the RF interrupt to its original state.
+}
+
+void radioLinkResetStats()
+{
+    uint8 oldRfie = IEN2 & 0x01;
+    uint8 XDATA * p = (uint8 XDATA *)&stats;
+    uint8 i;
+
+    IEN2 &= ~0x01;
+    for (i = 0; i < sizeof(stats); i++)
+    {
+        p[i] = 0;
+    }
+    IEN2 |= oldRfie;
+}
+
+// Returns the index of the RX packet buffer that is n buffers after the given one.
+// Assumption: RX_PACKET_COUNT is a power of 2.
+static uint8 rxIndexAdd(uint8 index, uint8 n)
+{
+    return (index + n) & (RX_PACKET_COUNT - 1);
 }
 
-BIT radioLinkConnected()
+// Returns the number of times that radioLinkRxInterruptIndex can be advanced before
+// it would catch up to radioLinkRxMainLoopIndex.
+static uint8 rxFreeBuffers()
 {
-    return !sendingReset;
+    return (radioLinkRxMainLoopIndex - radioLinkRxInterruptIndex - 1) & (RX_PACKET_COUNT - 1);
 }
 
 /* TX FUNCTIONS (called by higher-level code in main loop) ********************/
@@ -182,8 +1192,12 @@ void radioLinkTxSendPacket(uint8 payloadType)
     }
 
     // Make sure that radioMacEventHandler runs soon so it can see this new data and send it.
-    // This must be done LAST.
-    radioMacStrobe();
+    // This must be done LAST, because the ISR might look at the new data and stop
+    // listening as soon as radioLinkTxMainLoopIndex changes.
+    if (rxListening)
+    {
+        radioMacStrobe();
+    }
 }
 
 /* RX FUNCTIONS (called by higher-level code in main loop) ********************/
@@ -205,23 +1219,120 @@ uint8 radioLinkRxCurrentPayloadType(void)
 
 void radioLinkRxDoneWithPacket(void)
 {
-    if (radioLinkRxMainLoopIndex == RX_PACKET_COUNT - 1)
+    radioLinkRxMainLoopIndex = (radioLinkRxMainLoopIndex + 1) & (RX_PACKET_COUNT - 1);
+
+    if (rxWindowClosed)
     {
-        radioLinkRxMainLoopIndex = 0;
+        // We told the other device that we had no room, so make radioMacEventHandler
+        // tell it that we have room now.
+        radioMacStrobe();
     }
-    else
+}
+
+/* FUNCTIONS CALLED IN RF_ISR *************************************************/
+
+// Forgets everything we knew about the windowed transmission state.
+// This is called whenever the other device resets (or acknowledges our Reset),
+// because at that point it will expect the next data packet to have a sequence
+// number of 0.
+// peerOptions: The LINK_OPTION_* bits the other device supports.
+// peerPayloadSize: The largest payload the other device can receive.
+static void txRestart(uint8 peerOptions, uint8 peerPayloadSize)
+{
+    txWindowed = radioLinkWindowedMode && (peerOptions & LINK_OPTION_WINDOWED);
+    txDelayedAck = txWindowed && radioLinkDelayedAckMode && (peerOptions & LINK_OPTION_DELAYED_ACK);
+    ackPending = 0;
+
+    // Both devices start hopping from the home channel.
+    txHopping = radioLinkHopChannelCount && (peerOptions & LINK_OPTION_HOPPING);
+    hopBlacklist = 0;
+    hopBlacklistPending = hopBadChannels != 0;
+    rxTimeouts = 0;
+    if (hopIndex != 0)
+    {
+        hopTo(0);
+    }
+
+    if (peerPayloadSize < RADIO_LINK_PAYLOAD_SIZE)
     {
-        radioLinkRxMainLoopIndex++;
+        peerPayloadSize = RADIO_LINK_PAYLOAD_SIZE;
     }
+    txPayloadSize = peerPayloadSize < radioLinkRequestedPayloadSize ? peerPayloadSize : radioLinkRequestedPayloadSize;
+
+    // Both devices switch to FEC when they start using the new options (see turnEnded).
+    txFec = radioLinkFecMode && (peerOptions & LINK_OPTION_FEC);
+    if (fecActive)
+    {
+        fecSet(0);
+    }
+
+    // Both devices start with the profile they used for the Reset exchange.
+    txAutoRate = radioLinkAutoRateMode && (peerOptions & LINK_OPTION_AUTO_RATE);
+    ratePending = 0;
+    rateNext = rateBaseProfile;
+    rateSuccesses = 0;
+    rateLosses = 0;
+
+    txSequenceOffset = radioLinkTxInterruptIndex;
+    txInFlight = 0;
+    txAckedMask = 0;
+    txBurstActive = 0;
+    txPeerWindow = TX_WINDOW_SIZE;
+    txWindowProbeDue = 0;
+    rxWindowClosed = 0;
+    nakBackoff = NAK_BACKOFF_MIN;
+
+    optionsPending = 1;
+    optionsStartOnTx = 0;
 }
 
-/* FUNCTIONS CALLED IN RF_ISR *************************************************/
+// Sends a Reset packet or the ACK of a Reset packet, with the bytes that tell
+// the other device which options we support.
+static void txLinkOptionsPacket(uint8 packetType)
+{
+    shortTxPacket[RADIO_LINK_PACKET_LENGTH_OFFSET] = 3;
+    shortTxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] = packetType | PACKET_FLAG_EXTENDED;
+    shortTxPacket[RADIO_LINK_PACKET_TYPE_OFFSET + 1] = linkOptions();
+    shortTxPacket[RADIO_LINK_PACKET_TYPE_OFFSET + 2] = radioLinkRequestedPayloadSize;
+    txPacket(shortTxPacket);
+}
+
+// Reads the bytes that were added to a Reset packet (or the ACK of a Reset packet)
+// by txLinkOptionsPacket and passes them to txRestart.
+static void txRestartFromPacket(uint8 XDATA * packet)
+{
+    txRestart(packet[RADIO_LINK_PACKET_TYPE_OFFSET + 1],
+        packet[RADIO_LINK_PACKET_LENGTH_OFFSET] >= 3 ? packet[RADIO_LINK_PACKET_TYPE_OFFSET + 2] : RADIO_LINK_PAYLOAD_SIZE);
+}
+
+// Sets the length byte of a TX packet so that it has the specified trailer length.
+// If the payload is bigger than what the other device can currently receive (which
+// can happen if the other device was reset after the packet was queued), the end
+// of the payload is dropped and counted in stats.txTruncatedPackets.  The packet
+// can not be split because its sequence number might already be in use.
+static void txSetPacketLength(uint8 XDATA * packet, uint8 trailerLength)
+{
+    uint8 length = packet[RADIO_LINK_PACKET_LENGTH_OFFSET];
+
+    if (packet[RADIO_LINK_PACKET_TYPE_OFFSET] & PACKET_FLAG_EXTENDED)
+    {
+        // This packet was last sent in windowed mode, so remove the trailer.
+        length -= RADIO_LINK_PACKET_TRAILER_LENGTH;
+    }
+
+    if (length > txPayloadSize + RADIO_LINK_PACKET_HEADER_LENGTH)
+    {
+        length = txPayloadSize + RADIO_LINK_PACKET_HEADER_LENGTH;
+        stats.txTruncatedPackets++;
+    }
+
+    packet[RADIO_LINK_PACKET_LENGTH_OFFSET] = length + trailerLength;
+}
 
 static void txResetPacket()
 {
-    shortTxPacket[RADIO_LINK_PACKET_LENGTH_OFFSET] = 1;
-    shortTxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] = PACKET_TYPE_RESET;
-    radioMacTx(shortTxPacket);
+    // Older versions of this library ignore the extra bytes in Reset packets.
+    txLinkOptionsPacket(PACKET_TYPE_RESET);
     if (radioLinkTxCurrentPacketTries < 255)
     {
         radioLinkTxCurrentPacketTries++;
@@ -230,15 +1341,301 @@ static void txResetPacket()
 
 static void txDataPacket(uint8 packetType)
 {
+    txSetPacketLength(radioLinkTxPacket[radioLinkTxInterruptIndex], 0);
+
     radioLinkTxPacket[radioLinkTxInterruptIndex][RADIO_LINK_PACKET_TYPE_OFFSET] =
             (radioLinkTxPacket[radioLinkTxInterruptIndex][RADIO_LINK_PACKET_TYPE_OFFSET] & RADIO_LINK_PAYLOAD_TYPE_MASK) | packetType | txSequenceBit;
-    radioMacTx(radioLinkTxPacket[radioLinkTxInterruptIndex]);
+    txPacket(radioLinkTxPacket[radioLinkTxInterruptIndex]);
     if (radioLinkTxCurrentPacketTries < 255)
     {
         radioLinkTxCurrentPacketTries++;
     }
 }
 
+/* WINDOWED MODE FUNCTIONS CALLED IN RF_ISR ***********************************/
+
+// Returns the offset (from radioLinkTxInterruptIndex) of the first packet at or after
+// the given offset that still needs to be transmitted in windowed mode, or
+// TX_WINDOW_SIZE if there is no such packet.
+static uint8 txFindBurstPacket(uint8 offset)
+{
+    while (offset < TX_WINDOW_SIZE && offset < txPeerWindow &&
+        ((radioLinkTxInterruptIndex + offset) & (TX_PACKET_COUNT - 1)) != radioLinkTxMainLoopIndex)
+    {
+        if (!(txAckedMask & (1 << offset)))
+        {
+            return offset;
+        }
+        offset++;
+    }
+    return TX_WINDOW_SIZE;
+}
+
+// Writes the windowed trailer (our sequence number and our ACK information)
+// to the end of a packet.  The length byte must already include the trailer.
+static void writeTrailer(uint8 XDATA * packet, uint8 sequence)
+{
+    uint8 length = packet[RADIO_LINK_PACKET_LENGTH_OFFSET];
+    uint8 window = rxFreeBuffers();
+    uint8 queued = (radioLinkTxMainLoopIndex - radioLinkTxInterruptIndex) & (TX_PACKET_COUNT - 1);
+    packet[length - 2] = (sequence << 4) | rxNextSequence;
+    packet[length - 1] = rxParkedMask >> 1;
+    packet[length] = window;
+    if (txWindowed && (queued > TX_WINDOW_SIZE || queued > txPeerWindow))
+    {
+        packet[length] |= TRAILER_FLAG_TX_BLOCKED;
+    }
+    rxWindowClosed = window == 0;
+    ackPending = 0;
+}
+
+// Transmits the next packet of the current burst, if there is one.
+// If probe is 1, the packet will have the POLL flag, ending the burst.
+// Returns 1 if a packet was transmitted.
+static BIT txBurstPacket(BIT probe)
+{
+    uint8 offset = txFindBurstPacket(txBurstOffset);
+    uint8 index;
+    uint8 XDATA * packet;
+
+    if (offset == TX_WINDOW_SIZE)
+    {
+        txBurstActive = 0;
+        return 0;
+    }
+
+    txBurstOffset = offset + 1;
+    txBurstActive = !probe && txFindBurstPacket(txBurstOffset) != TX_WINDOW_SIZE;
+
+    index = (radioLinkTxInterruptIndex + offset) & (TX_PACKET_COUNT - 1);
+    packet = radioLinkTxPacket[index];
+
+    txSetPacketLength(packet, RADIO_LINK_PACKET_TRAILER_LENGTH);
+
+    packet[RADIO_LINK_PACKET_TYPE_OFFSET] = (packet[RADIO_LINK_PACKET_TYPE_OFFSET] & RADIO_LINK_PAYLOAD_TYPE_MASK) |
+        PACKET_TYPE_PING | PACKET_FLAG_EXTENDED | (txBurstActive ? 0 : PACKET_FLAG_POLL);
+    writeTrailer(packet, (index - txSequenceOffset) & 0x0F);
+    txPacket(packet);
+
+    if (offset >= txInFlight)
+    {
+        txInFlight = offset + 1;
+    }
+
+    if (txTries[index] < 255)
+    {
+        txTries[index]++;
+    }
+
+    if (offset == 0 && radioLinkTxCurrentPacketTries < 255)
+    {
+        radioLinkTxCurrentPacketTries++;
+    }
+
+    radioLinkActivityOccurred = 1;
+    return 1;
+}
+
+// Processes the ACK information and the receive window from the trailer of a windowed packet.
+static void txProcessAck(uint8 nextSequence, uint8 selectiveAcks, uint8 window)
+{
+    // Compute how many packets were acknowledged cumulatively.
+    uint8 acked = (nextSequence - (radioLinkTxInterruptIndex - txSequenceOffset)) & 0x0F;
+
+    if (acked > txInFlight)
+    {
+        // This ACK does not make sense; the other device is probably
+        // talking about packets from before it was reset.
+        return;
+    }
+
+    if (acked)
+    {
+        txInFlight -= acked;
+        txAckedMask >>= acked;
+
+        // Give ownership of the acknowledged TX packets back to the main loop.
+        while (acked--)
+        {
+            stats.txBytes += radioLinkTxPacket[radioLinkTxInterruptIndex][RADIO_LINK_PACKET_LENGTH_OFFSET]
+                - RADIO_LINK_PACKET_HEADER_LENGTH - RADIO_LINK_PACKET_TRAILER_LENGTH;
+            recordTries(txTries[radioLinkTxInterruptIndex]);
+            txTries[radioLinkTxInterruptIndex] = 0;
+            radioLinkTxInterruptIndex = (radioLinkTxInterruptIndex + 1) & (TX_PACKET_COUNT - 1);
+        }
+
+        // Reset the transmission counter.
+        radioLinkTxCurrentPacketTries = 0;
+    }
+
+    txAckedMask |= selectiveAcks << 1;
+
+    txPeerWindow = window;
+    if (window)
+    {
+        txWindowProbeDue = 0;
+    }
+}
+
+// Processes the data in a windowed packet that we received.
+// Assumption: The packet contains data.
+static void rxWindowedData(uint8 XDATA * packet, uint8 sequence)
+{
+    uint8 offset = (sequence - rxNextSequence) & 0x0F;
+    uint8 payloadType;
+    uint8 XDATA * parkedPacket;
+    uint8 i;
+
+    if (offset >= TX_WINDOW_SIZE)
+    {
+        // This is a retransmission of a packet we already gave to the main loop.
+        return;
+    }
+
+    if (rxParkedMask & (1 << offset))
+    {
+        // This is a retransmission of a packet we already received.
+        return;
+    }
+
+    if (offset >= rxFreeBuffers())
+    {
+        // The main loop is using too many of the RX packet buffers, so we can't accept this
+        // packet.  We will not acknowledge it, so the other device will send it again later.
+        stats.rxBufferFull++;
+        return;
+    }
+
+    // Convert the packet to the format read by the main loop (see the non-windowed code below).
+    payloadType = (packet[RADIO_LINK_PACKET_TYPE_OFFSET] & RADIO_LINK_PAYLOAD_TYPE_MASK) >> RADIO_LINK_PAYLOAD_TYPE_BIT_OFFSET;
+    packet[RADIO_LINK_PACKET_HEADER_LENGTH] = packet[RADIO_LINK_PACKET_LENGTH_OFFSET] - RADIO_LINK_PACKET_HEADER_LENGTH - RADIO_LINK_PACKET_TRAILER_LENGTH;
+    packet[0] = payloadType;
+
+    if (offset)
+    {
+        // This packet arrived before some earlier packets, so store it in the right
+        // buffer and wait for the earlier ones.
+        // This copy only happens when packets are lost, so it is not worth optimizing.
+        parkedPacket = radioLinkRxPacket[rxIndexAdd(radioLinkRxInterruptIndex, offset)];
+        for (i = 0; i < packet[RADIO_LINK_PACKET_HEADER_LENGTH] + 2; i++)
+        {
+            parkedPacket[i] = packet[i];
+        }
+        rxParkedMask |= (1 << offset);
+        return;
+    }
+
+    // This is the packet we were expecting, so give it to the main loop,
+    // along with any packets right after it that we already received.
+    do
+    {
+        stats.rxBytes += radioLinkRxPacket[radioLinkRxInterruptIndex][RADIO_LINK_PACKET_HEADER_LENGTH];
+        radioLinkRxInterruptIndex = rxIndexAdd(radioLinkRxInterruptIndex, 1);
+        rxNextSequence = (rxNextSequence + 1) & 0x0F;
+        rxParkedMask >>= 1;
+    }
+    while (rxParkedMask & 1);
+}
+
+// Sends a windowed packet that only contains ACK information.
+static void txWindowedAck()
+{
+    shortTxPacket[RADIO_LINK_PACKET_LENGTH_OFFSET] = RADIO_LINK_PACKET_HEADER_LENGTH + RADIO_LINK_PACKET_TRAILER_LENGTH;
+    shortTxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] = PACKET_TYPE_PING | PACKET_FLAG_EXTENDED;
+    writeTrailer(shortTxPacket, 0);
+    txPacket(shortTxPacket);
+    stats.ackPackets++;
+}
+
+// Sends a response to a windowed packet that had the POLL flag:
+// either a burst of data packets or just a short ACK.
+static void txWindowedResponse()
+{
+    if (txWindowed && !sendingReset)
+    {
+        txBurstOffset = 0;
+        if (txBurstPacket(0))
+        {
+            return;
+        }
+
+        if (txDelayedAck && !ackPending && !rxPeerTxBlocked)
+        {
+            // We have no data to send right now.  Instead of sending the ACK by itself,
+            // give the main loop a chance to queue some data so the ACK can ride along
+            // with it.  If nothing gets queued, takeInitiative will send the ACK when the
+            // RX timeout happens.  We don't do this if the other device is waiting for
+            // the ACK to send more data, because that would stall bulk transfers.
+            ackPending = 1;
+            rxListening = 1;
+            radioMacRx(radioLinkRxPacket[radioLinkRxInterruptIndex], ACK_DELAY);
+            return;
+        }
+    }
+
+    txWindowedAck();
+}
+
+// Handles a windowed packet that we received.
+static void rxWindowedPacket(uint8 XDATA * packet)
+{
+    uint8 length = packet[RADIO_LINK_PACKET_LENGTH_OFFSET];
+    uint8 header = packet[RADIO_LINK_PACKET_TYPE_OFFSET];
+    uint8 sequence;
+
+    if (length < RADIO_LINK_PACKET_HEADER_LENGTH + RADIO_LINK_PACKET_TRAILER_LENGTH)
+    {
+        // Invalid packet.
+        turnEnded(0);
+        takeInitiative();
+        return;
+    }
+
+    if (length == RADIO_LINK_PACKET_HEADER_LENGTH + RADIO_LINK_PACKET_TRAILER_LENGTH || (header & PACKET_FLAG_POLL))
+    {
+        // This packet ends the other device's turn.
+        turnEnded(0);
+    }
+
+    sequence = packet[length - 2] >> 4;
+    rxPeerTxBlocked = (packet[length] & TRAILER_FLAG_TX_BLOCKED) ? 1 : 0;
+    txProcessAck(packet[length - 2] & 0x0F, packet[length - 1], packet[length] & TRAILER_WINDOW_MASK);
+
+    if (length > RADIO_LINK_PACKET_HEADER_LENGTH + RADIO_LINK_PACKET_TRAILER_LENGTH)
+    {
+        // The packet contains data.
+        // If we are still sending Reset packets, then this data might have been sent
+        // before the other device found out that we were reset, so ignore it.
+        if (!sendingReset)
+        {
+            rxWindowedData(packet, sequence);
+        }
+        radioLinkActivityOccurred = 1;
+
+        if (!(header & PACKET_FLAG_POLL))
+        {
+            // The other device is in the middle of a burst, so wait for the next packet.
+            radioMacRx(radioLinkRxPacket[radioLinkRxInterruptIndex], randomTxDelay());
+            return;
+        }
+    }
+    else if (!(header & PACKET_FLAG_POLL))
+    {
+        // We received a packet that only had ACK information in it.
+        takeInitiative();
+        return;
+    }
+
+    if (sendingReset)
+    {
+        takeInitiative();
+    }
+    else
+    {
+        txWindowedResponse();
+    }
+}
+
 static void takeInitiative()
 {
     if (sendingReset)
@@ -247,6 +1644,51 @@ static void takeInitiative()
         txResetPacket();
         radioLinkActivityOccurred = 1;
     }
+    else if ((txHopping && hopBlacklistPending) || ratePending)
+    {
+        // Tell the other device which channels we want to stop using or which profile we want to switch to.
+        txControlPacket(PACKET_FLAG_REPLY_REQUESTED);
+    }
+    else if (txWindowed)
+    {
+        // Start a new burst.  If some packets are in flight already, then our last burst
+        // (or the response to it) was probably lost, so just send the first unacknowledged
+        // packet with the POLL flag to find out what the other device has received.
+        txBurstOffset = 0;
+        if (txBurstPacket(txInFlight != 0))
+        {
+            // The burst carries our ACK information.
+        }
+        else if (ackPending || (rxWindowClosed && rxFreeBuffers()))
+        {
+            // We delayed an ACK but no data was queued in time, or the main loop
+            // made room after we told the other device we had none, so send the
+            // ACK information by itself.
+            txWindowedAck();
+        }
+        else if (txPeerWindow == 0 && radioLinkTxInterruptIndex != radioLinkTxMainLoopIndex)
+        {
+            // The other device has no room for our data.  It will tell us when it has room,
+            // but that packet could be lost, so every WINDOW_PROBE_DELAY we send the first
+            // packet anyway to find out the current window.
+            if (txWindowProbeDue)
+            {
+                txWindowProbeDue = 0;
+                txPeerWindow = 1;
+                txBurstPacket(1);
+            }
+            else
+            {
+                txWindowProbeDue = 1;
+                stats.txPauses++;
+                radioMacRx(radioLinkRxPacket[radioLinkRxInterruptIndex], WINDOW_PROBE_DELAY);
+            }
+        }
+        else
+        {
+            rxIdle();
+        }
+    }
     else if (radioLinkTxInterruptIndex != radioLinkTxMainLoopIndex)
     {
         // Try to send the next data packet.
@@ -255,21 +1697,33 @@ static void takeInitiative()
     }
     else
     {
-        radioMacRx(radioLinkRxPacket[radioLinkRxInterruptIndex], 0);
+        rxIdle();
     }
 }
 
 void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
 {
+    rxListening = 0;
+
     if (event == RADIO_MAC_EVENT_STROBE)
     {
+        awaitingResponse = 0;
         takeInitiative();
         return;
     }
     else if (event == RADIO_MAC_EVENT_TX)
     {
-        // We sent a packet, so now lets give the other party a chance to talk.
-        radioMacRx(radioLinkRxPacket[radioLinkRxInterruptIndex], randomTxDelay());
+        txDone();
+
+        if (txBurstActive && txBurstPacket(0))
+        {
+            // We are in the middle of a windowed burst, so we sent the next packet.
+            return;
+        }
+
+        // We sent a packet that ends our turn, so now lets give the other party a chance to talk.
+        turnEnded(1);
+        rxResponse(responseDelay());
         return;
     }
     else if (event == RADIO_MAC_EVENT_RX)
@@ -278,36 +1732,110 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
 
         if (!radioCrcPassed())
         {
+            if (txHopping && !awaitingResponse)
+            {
+                // The other device will not get a response to this packet, so it will look for
+                // us on this channel and on the channel after the next one (see hopTimeout).
+                // If interference garbled the packet, this channel is not a good place to wait.
+                hopTo(hopIndexAfter(hopIndexAfter(hopIndex)));
+            }
             if (radioLinkTxInterruptIndex != radioLinkTxMainLoopIndex)
             {
                 radioMacRx(currentRxPacket, randomTxDelay());
             }
             else
             {
-                radioMacRx(currentRxPacket, 0);
+                rxIdle();
             }
             return;
         }
 
+        rtoResponseReceived();
+        rxTimeouts = 0;
+        stats.rxPackets++;
+
         if ((currentRxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] & PACKET_TYPE_MASK) == PACKET_TYPE_RESET)
         {
             // The other Wixel sent a Reset packet, which means the next packet it sends will have a sequence bit of 0.
             // So this Wixel should set its "previously received" sequence bit to 1 so it expects a 0 next.
             rxSequenceBit = 1;
 
+            // Similarly, the next windowed packet it sends will have a sequence number of 0.
+            rxNextSequence = 0;
+            rxParkedMask = 0;
+
+            if (sendingReset)
+            {
+                // Both Wixels started at about the same time.  The other Wixel only sends
+                // a Reset packet right after radioLinkInit, so it already expects our
+                // sequence numbers to start over and we can stop sending our own Reset.
+                // Otherwise we would keep sending it after the other Wixel had switched
+                // to the options in our ACK (e.g. FEC or hopping), and mistake the next
+                // ACK we got for the ACK of an old version of this library.
+                sendingReset = 0;
+                radioLinkTxCurrentPacketTries = 0;
+                txSequenceBit = 0;
+            }
+
+            // The other Wixel has forgotten about the packets we sent, so we need to
+            // start our sequence numbers over, possibly in a different mode.
+            if (currentRxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] & PACKET_FLAG_EXTENDED)
+            {
+                txRestartFromPacket(currentRxPacket);
+
+                // Send an ACK that tells the other Wixel which options we support.
+                txLinkOptionsPacket(PACKET_TYPE_ACK);
+            }
+            else
+            {
+                txRestart(0, RADIO_LINK_PAYLOAD_SIZE);
+
+                // Send an ACK that older versions of this library can understand.
+                shortTxPacket[RADIO_LINK_PACKET_LENGTH_OFFSET] = 1;
+                shortTxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] = PACKET_TYPE_ACK;
+                txPacket(shortTxPacket);
+            }
+
             // Notify the higher-level code.
             radioLinkResetPacketReceived = 1;
-
-            // Send an ACK
-            shortTxPacket[RADIO_LINK_PACKET_LENGTH_OFFSET] = 1;
-            shortTxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] = PACKET_TYPE_ACK;
-            radioMacTx(shortTxPacket);
+            stats.resetPackets++;
 
             radioLinkActivityOccurred = 1;
 
             return;
         }
 
+        if ((currentRxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] & (PACKET_TYPE_MASK | PACKET_FLAG_EXTENDED)) == (PACKET_TYPE_PING | PACKET_FLAG_EXTENDED))
+        {
+            rxWindowedPacket(currentRxPacket);
+            return;
+        }
+
+        if ((currentRxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] & (PACKET_TYPE_MASK | PACKET_FLAG_EXTENDED)) == (PACKET_TYPE_NAK | PACKET_FLAG_EXTENDED))
+        {
+            rxControlPacket(currentRxPacket);
+            return;
+        }
+
+        if ((currentRxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] & (PACKET_TYPE_MASK | PACKET_FLAG_EXTENDED)) == (PACKET_TYPE_ACK | PACKET_FLAG_EXTENDED))
+        {
+            // The other Wixel acknowledged our Reset packet and told us which options it supports.
+            if (sendingReset)
+            {
+                sendingReset = 0;
+                radioLinkTxCurrentPacketTries = 0;
+                txSequenceBit = 0;
+                txRestartFromPacket(currentRxPacket);
+                optionsStartOnTx = 1;
+            }
+            turnEnded(0);
+            takeInitiative();
+            return;
+        }
+
+        // Every packet in the original protocol ends the sender's turn.
+        turnEnded(0);
+
         if ((currentRxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] & PACKET_TYPE_MASK) == PACKET_TYPE_ACK)
         {
             // The packet we received contained an acknowledgment.
@@ -322,13 +1850,20 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
 
                 // Make sure the next packet we transmit has a sequence bit of 0.
                 txSequenceBit = 0;
+
+                // The other Wixel does not support any of our extensions.
+                txRestart(0, RADIO_LINK_PAYLOAD_SIZE);
+                optionsStartOnTx = 1;
             }
-            else if (radioLinkTxInterruptIndex != radioLinkTxMainLoopIndex)
+            else if (!txWindowed && radioLinkTxInterruptIndex != radioLinkTxMainLoopIndex)
             {
                 // Check to see if there is actually any TX packet that we were sending that
                 // can be acknowledged.  This check should return true unless there is a bug
                 // on the other Wixel.
 
+                stats.txBytes += radioLinkTxPacket[radioLinkTxInterruptIndex][RADIO_LINK_PACKET_LENGTH_OFFSET] - RADIO_LINK_PACKET_HEADER_LENGTH;
+                recordTries(radioLinkTxCurrentPacketTries);
+
                 // Give ownership of the current TX packet back to the main loop by updated radioLinkTxInterruptIndex.
                 if (radioLinkTxInterruptIndex == TX_PACKET_COUNT - 1)
                 {
@@ -341,13 +1876,22 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
 
                 // Reset the transmission counter.
                 radioLinkTxCurrentPacketTries = 0;
+                nakBackoff = NAK_BACKOFF_MIN;
 
                 // The next packet we transmit will have a different sequence bit.
                 txSequenceBit ^= 1;
             }
         }
 
-        if (currentRxPacket[RADIO_LINK_PACKET_LENGTH_OFFSET] > RADIO_LINK_PACKET_HEADER_LENGTH)
+        if (sendingReset)
+        {
+            // The other device does not know that we were reset, so this data might have been
+            // sent before we were.  If we ACKed it, the other device would also think that we
+            // got the ACK of our Reset packet (see optionsPending), so ignore it and keep
+            // sending our Reset packet, like we do in the windowed protocol.
+            takeInitiative();
+        }
+        else if (currentRxPacket[RADIO_LINK_PACKET_LENGTH_OFFSET] > RADIO_LINK_PACKET_HEADER_LENGTH)
         {
             // We received a packet that contains actual data.
 
@@ -357,19 +1901,8 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
             {
                 // This packet is NOT a retransmission of the last packet we received.
 
-                uint8 nextradioLinkRxInterruptIndex;
-
                 // See if we can give the data to the main loop.
-                if (radioLinkRxInterruptIndex == RX_PACKET_COUNT - 1)
-                {
-                    nextradioLinkRxInterruptIndex = 0;
-                }
-                else
-                {
-                    nextradioLinkRxInterruptIndex = radioLinkRxInterruptIndex + 1;
-                }
-
-                if (nextradioLinkRxInterruptIndex != radioLinkRxMainLoopIndex)
+                if (rxFreeBuffers())
                 {
                     // We can accept this packet and send an ACK!
 
@@ -390,20 +1923,23 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
                     // (This overrides the 1-byte RF packet length.)
                     currentRxPacket[0] = payloadType;
 
-                    radioLinkRxInterruptIndex = nextradioLinkRxInterruptIndex;
+                    stats.rxBytes += currentRxPacket[RADIO_LINK_PACKET_HEADER_LENGTH];
+
+                    radioLinkRxInterruptIndex = rxIndexAdd(radioLinkRxInterruptIndex, 1);
                 }
                 else
                 {
                     // The main loop is already using all of the other RX packet buffers,
                     // so we can't give this packet to the main loop and we will send a NAK.
                     responsePacketType = PACKET_TYPE_NAK;
+                    stats.rxBufferFull++;
                 }
 
             }
 
             // Send an ACK or NAK to the other party.
 
-            if (radioLinkTxInterruptIndex != radioLinkTxMainLoopIndex)
+            if (!txWindowed && radioLinkTxInterruptIndex != radioLinkTxMainLoopIndex)
             {
                 // Send some data along with the ACK or NAK.
                 txDataPacket(responsePacketType);
@@ -414,24 +1950,50 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
 
                 shortTxPacket[RADIO_LINK_PACKET_LENGTH_OFFSET] = 1;
                 shortTxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] = responsePacketType;
-                radioMacTx(shortTxPacket);
+                txPacket(shortTxPacket);
+                stats.ackPackets++;
             }
 
             radioLinkActivityOccurred = 1;
         }
+        else if ((currentRxPacket[RADIO_LINK_PACKET_TYPE_OFFSET] & PACKET_TYPE_MASK) == PACKET_TYPE_NAK &&
+            !txWindowed && radioLinkTxInterruptIndex != radioLinkTxMainLoopIndex)
+        {
+            // The other device has no room for our data.  Instead of sending it again right away
+            // (which would just get another NAK), give its main loop some time to catch up.
+            // The other device might send us data in the meantime.
+            stats.nakPackets++;
+            radioMacRx(currentRxPacket, nakBackoff);
+            if (nakBackoff < NAK_BACKOFF_MAX)
+            {
+                nakBackoff <<= 1;
+            }
+        }
         else
         {
-            // TODO: if radioLinkTxCurrentPacketTries > 200 then we should probably just go
-            // into RX mode here so we can avoid having this conversation 4 times per second:
-            // DATA, NAK, DATA, NAK, DATA, NAK, DATA, NAK, DATA, NAK, ...
-            // (It starts when the sender takes initiative and sends his (failing) data every
-            // 250ms, and it ends as soon as one packet is lost.)
             takeInitiative();
         }
         return;
     }
     else if (event == RADIO_MAC_EVENT_RX_TIMEOUT)
     {
+        if (rxTimeouts < 255)
+        {
+            rxTimeouts++;
+        }
+        if (txHopping)
+        {
+            hopTimeout(awaitingResponse);
+        }
+        if (txFec)
+        {
+            fecTimeout();
+        }
+        if (txAutoRate)
+        {
+            rateTimeout();
+        }
+        rtoTimeout();
         takeInitiative();
         return;
     }
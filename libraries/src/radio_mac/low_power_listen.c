@@ -0,0 +1,72 @@
+/* low_power_listen.c:
+ *  A receiver calls radioMacLowPowerListen() from the main loop whenever it is idle.  It turns
+ *  off the radio, puts the processor in PM2 for the requested interval, and then starts a sniff:
+ *  a short RX with MCSM2.RX_TIME_RSSI and RX_TIME_QUAL set, so the radio keeps receiving after
+ *  the timeout only if it detected a carrier or a preamble.  Whatever happens next (a packet or
+ *  a timeout) is reported to radioMacEventHandler as usual.
+ *
+ *  This is in a separate file from radio_mac.c so that apps that do not use it do not
+ *  need the code from sleep.c.
+ */
+
+#include <radio_mac.h>
+#include <cc2511_map.h>
+#include <dma.h>
+#include <sleep.h>
+
+#include "radio_mac_internal.h"
+
+// The length of a sniff, in units of 0.922 ms.  This does not include the
+// 0.8 ms calibration that happens first.
+#define SNIFF_TIMEOUT 1
+
+BIT radioMacLowPowerListen(uint16 interval)
+{
+    uint8 test2, test1, test0;
+
+    // Disable the RF interrupt so the state of the MAC can not change while we look at it.
+    IEN2 &= ~0x01;
+
+    if ((S1CON & 0x03) || radioMacSniffing || radioMacState != RADIO_MAC_STATE_RX || (MCSM2 & 7) != 7 ||
+        (MARCSTATE == 0x0D && (PKTSTATUS & (1<<3))))
+    {
+        // The radio is busy: an RF interrupt is pending, it is sending, it is receiving
+        // a packet, the higher-level code is waiting for a response (a timeout is set),
+        // or we are already sniffing.
+        IEN2 |= 0x01;
+        return 0;
+    }
+
+    // Turn off the radio.  The radio DMA channel is still configured by the last
+    // call to radioMacRx(), so we can use it again for the sniff.
+    RFST = SIDLE;
+    while(MARCSTATE != 0x01);
+    DMAARM = 0x80 | (1<<DMA_CHANNEL_RADIO);
+    DMAIRQ &= ~(1<<DMA_CHANNEL_RADIO);
+
+    // The TEST registers are not retained in PM2.
+    test2 = TEST2;
+    test1 = TEST1;
+    test0 = TEST0;
+
+    sleepInit();
+    sleepMode2Ms(interval, 0);
+
+    TEST2 = test2;
+    TEST1 = test1;
+    TEST0 = test0;
+
+    // Start the sniff.  The radio might calibrate first because it is coming from IDLE.
+    radioMacCalibrateIfNeeded();
+    MCSM2 = 0x18;   // RX_TIME_RSSI = 1, RX_TIME_QUAL = 1, RX_TIME = 0.
+    WORCTRL = 0;    // WOR_RES = 0.  See radioMacRx.
+    WOREVT1 = SNIFF_TIMEOUT;
+    WOREVT0 = 0;
+    radioMacSniffing = 1;
+    RFIF = ~0x30;
+    DMAARM |= (1<<DMA_CHANNEL_RADIO);
+    RFST = SRX;
+
+    IEN2 |= 0x01;
+    return 1;
+}
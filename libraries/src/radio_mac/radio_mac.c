@@ -1,17 +1,22 @@
 /*  NOTE: Calibration of the frequency synthesizer and other RF hardware takes about 800 us and
  *  must be done regularly.  There are several options for when to do the calibration and not.
- *  We configured the radio to automatically calibrate whenever going from the IDLE state to TX
- *  or RX (MCSM0.FS_AUTOCAL = 01).  The radio will go into the idle state whenever the is an RX
- *  timeout.  However, to enable a quick turnaround between TX and RX, we configured the radio to
- *  automatically go into the FSTXON mode after it is done with RX or TX mode.  FSTXON means that
- *  the frequency synthesizer is on and the radio is ready to go into RX or TX mode quickly
- *  (but it goes to TX mode faster).
+ *  To enable a quick turnaround between TX and RX, we configured the radio to automatically go
+ *  into the FSTXON mode after it is done with RX or TX mode.  FSTXON means that the frequency
+ *  synthesizer is on and the radio is ready to go into RX or TX mode quickly (but it goes to TX
+ *  mode faster), so bursts of packets never need to calibrate.  The radio will go into the idle
+ *  state whenever there is an RX timeout.
  *
- *  So basically we are depending on the RX timeout feature to schedule our calibrations for us,
- *  instead of doing it manually.  This should work, but it will probaby hinder our ability to
- *  quickly recover from lost packets (the RX timeout event is what happens when a packet is lost).
- *  An easy alternative would be to only calibrate after every 10th RX timeout or something like
- *  that.
+ *  We used to calibrate on every start from IDLE (MCSM0.FS_AUTOCAL = 01), but that added 800 us
+ *  to every RX timeout, which slowed down recovery from lost packets (the RX timeout event is what
+ *  happens when a packet is lost).  Now automatic calibration is normally off, and
+ *  radioMacCalibrateIfNeeded() turns it on for a single start from IDLE when a calibration is due:
+ *  after the channel changes, after every CALIBRATION_STARTS starts from IDLE, and once in every
+ *  CALIBRATION_INTERVAL (to follow temperature and supply voltage drift).
+ *
+ *  The results of a calibration are in FSCAL1, FSCAL2 and FSCAL3, and they only depend on the
+ *  frequency (and the slow drift).  So that frequency hopping does not have to calibrate on every
+ *  hop, we save the results after the first calibration on each channel, and radioMacSetChannel()
+ *  writes them back when it returns to that channel (see the FSCAL CACHE section below).
  */
 
 /*  The definition of the maximum packet size (and the code that sets the PKTLEN register) is not
@@ -27,16 +32,11 @@
 #include <radio_registers.h>
 
 #include <random.h>
+#include <time.h>
 
-#define MAX_LATENCY_OF_STROBE  10
+#include "radio_mac_internal.h"
 
-// The RFST register is how we tell the radio to do something, and these are the
-// command strobes we can write to it:
-#define SFSTXON 0
-#define SCAL    1
-#define SRX     2
-#define STX     3
-#define SIDLE   4
+#define MAX_LATENCY_OF_STROBE  10
 
 static void radioMacEvent(uint8 event);
 
@@ -47,12 +47,224 @@ static volatile BIT strobe = 0;
 volatile BIT radioRxOverflowOccurred = 0;
 volatile BIT radioTxUnderflowOccurred = 0;
 
-// Radio MAC states
-#define RADIO_MAC_STATE_OFF      0
-#define RADIO_MAC_STATE_IDLE     1
-#define RADIO_MAC_STATE_RX       2
-#define RADIO_MAC_STATE_TX       3
+// These are shared with low_power_listen.c (see radio_mac_internal.h).
 volatile uint8 DATA radioMacState = RADIO_MAC_STATE_OFF;
+volatile BIT radioMacSniffing = 0;
+
+/*  REPEATED TX:
+ *  A sender that wants to reach a receiver using radioMacLowPowerListen() (low_power_listen.c)
+ *  uses radioMacTxRepeated() to send the same packet back-to-back for at least one sniff
+ *  interval, so one of the receiver's sniffs is guaranteed to overlap it.
+ */
+
+// 1 if the radio is sending the same packet repeatedly (see radioMacTxRepeated).
+static volatile BIT txRepeating = 0;
+
+// The time (in getTicks() ticks) when we should stop sending the repeated packet.
+static volatile uint16 XDATA txRepeatEndTime;
+
+/* CALIBRATION ****************************************************************/
+
+// We calibrate on every Nth start from IDLE even if nothing else requires it.
+#define CALIBRATION_STARTS 16
+
+// We calibrate on each channel at least once in every period of this many milliseconds
+// (see the FSCAL CACHE section).  This is measured with getMs() because getTicks() wraps
+// around every 2048 ms, which would hide a long time without any calibration.
+#define CALIBRATION_INTERVAL 1000
+
+// MCSM0 values.  PO_TIMEOUT = 01: Wait 64 XOSC periods for the crystal to stabilize.
+#define MCSM0_AUTOCAL    0x14   // FS_AUTOCAL = 01: Calibrate when going from IDLE to RX or TX.
+#define MCSM0_NO_AUTOCAL 0x04   // FS_AUTOCAL = 00: Never calibrate automatically.
+
+static RADIO_MAC_STATS XDATA stats;
+
+// 1 if stats has the signal strength and LQI of at least one packet.
+static volatile BIT rxSampled = 0;
+
+// The averages of the signal strength and LQI, times 8 so that they can be
+// updated cheaply in the ISR.
+static int16 XDATA rssiAverage8;
+static uint16 XDATA lqiAverage8;
+
+// 1 if the next start from IDLE must calibrate, because the last calibration might not have finished.
+static volatile BIT calibrationNeeded = 1;
+
+// The number of starts from IDLE since the last calibration.
+static uint8 XDATA startsSinceCalibration;
+
+/*  FSCAL CACHE:
+ *  The calibration results of the last RADIO_MAC_FSCAL_CACHE_SIZE channels we calibrated on.
+ *  Time is divided into periods of CALIBRATION_INTERVAL.  Results from an earlier period are
+ *  stale: they are still good enough to use, but the next start in TX on that channel
+ *  calibrates again.  We wait for a TX start because the other device does not know that we
+ *  are calibrating, so it would send its packet while our receiver is still starting up; if we
+ *  calibrate before transmitting instead, the other device just gets our packet 0.7 ms later.
+ *  Results that stayed stale for a whole period are dropped.
+ *  The whole cache is also dropped when the data rate profile changes (the profile sets the
+ *  IF frequency, which the synthesizer is tuned to in RX).
+ *  A start from IDLE right after the results were restored does not count towards
+ *  CALIBRATION_STARTS, because it is like a start right after a calibration.
+ */
+
+// The number of channels in the cache (at most 16).  Each one uses 4 bytes of XDATA.
+#ifndef RADIO_MAC_FSCAL_CACHE_SIZE
+#define RADIO_MAC_FSCAL_CACHE_SIZE 16
+#endif
+
+#define FSCAL_CACHE_NONE 0xFF
+
+typedef struct FSCAL_CACHE_ENTRY
+{
+    uint8 channel;
+    uint8 fscal1;
+    uint8 fscal2;
+    uint8 fscal3;
+} FSCAL_CACHE_ENTRY;
+
+static FSCAL_CACHE_ENTRY XDATA fscalCache[RADIO_MAC_FSCAL_CACHE_SIZE];
+
+// Bit N is 1 if fscalCache[N] holds the results of a calibration.
+static uint16 XDATA fscalCacheValid;
+
+// Bit N is 1 if the results in fscalCache[N] are from the current period.
+static uint16 XDATA fscalCacheFresh;
+
+// The entry to replace when the cache is full.
+static uint8 XDATA fscalCacheNext;
+
+// The entry for the current channel (CHANNR), or FSCAL_CACHE_NONE.
+static uint8 XDATA fscalCacheCurrent = FSCAL_CACHE_NONE;
+
+// The time when the current period started, from getMs().
+static uint32 XDATA periodStartTime;
+
+// 1 if the radio was told to calibrate and we have not saved the results yet.
+static volatile BIT fscalSavePending = 0;
+
+// 1 if radioMacSetChannel() restored saved results since the last start from IDLE.
+static volatile BIT fscalRestored = 0;
+
+// Returns the index of the cache entry for the specified channel, or FSCAL_CACHE_NONE.
+static uint8 fscalCacheFind(uint8 channel)
+{
+    uint8 i;
+    for (i = 0; i < RADIO_MAC_FSCAL_CACHE_SIZE; i++)
+    {
+        if ((fscalCacheValid & ((uint16)1 << i)) && fscalCache[i].channel == channel)
+        {
+            return i;
+        }
+    }
+    return FSCAL_CACHE_NONE;
+}
+
+// Saves the results of the last calibration, which was on the current channel.
+static void fscalCacheSave()
+{
+    uint8 i = fscalCacheFind(CHANNR);
+
+    if (i == FSCAL_CACHE_NONE)
+    {
+        i = fscalCacheNext;
+        if (++fscalCacheNext >= RADIO_MAC_FSCAL_CACHE_SIZE)
+        {
+            fscalCacheNext = 0;
+        }
+    }
+
+    fscalCache[i].channel = CHANNR;
+    fscalCache[i].fscal1 = FSCAL1;
+    fscalCache[i].fscal2 = FSCAL2;
+    fscalCache[i].fscal3 = FSCAL3;
+    fscalCacheValid |= (uint16)1 << i;
+    fscalCacheFresh |= (uint16)1 << i;
+    fscalCacheCurrent = i;
+}
+
+// See radio_mac_internal.h.  (It is also called from low_power_listen.c.)
+void radioMacCalibrateIfNeeded()
+{
+    uint32 now = getMs();
+    uint16 currentBit;
+
+    if (now - periodStartTime >= CALIBRATION_INTERVAL)
+    {
+        periodStartTime = now;
+        fscalCacheValid &= fscalCacheFresh;
+        fscalCacheFresh = 0;
+    }
+
+    currentBit = fscalCacheCurrent == FSCAL_CACHE_NONE ? 0 : (uint16)1 << fscalCacheCurrent;
+
+    if (!(fscalCacheValid & currentBit))
+    {
+        // We have no results for this channel (or they are too old).
+        calibrationNeeded = 1;
+    }
+    else if (!(fscalCacheFresh & currentBit) && (radioMacState == RADIO_MAC_STATE_TX || !fscalRestored))
+    {
+        // The results are stale.  On a channel we hopped to, wait for a start in TX (see above).
+        calibrationNeeded = 1;
+    }
+
+    if (fscalRestored)
+    {
+        fscalRestored = 0;
+    }
+    else if (++startsSinceCalibration >= CALIBRATION_STARTS)
+    {
+        calibrationNeeded = 1;
+    }
+
+    if (calibrationNeeded)
+    {
+        MCSM0 = MCSM0_AUTOCAL;
+        calibrationNeeded = 0;
+        startsSinceCalibration = 0;
+        fscalSavePending = 1;
+        stats.calibrations++;
+    }
+    else
+    {
+        MCSM0 = MCSM0_NO_AUTOCAL;
+        stats.calibrationsSkipped++;
+    }
+}
+
+// Updates the statistics after a packet was received.
+static void recordRx()
+{
+    uint8 lqi;
+    int8 rssi;
+
+    if (!radioCrcPassed())
+    {
+        stats.crcErrors++;
+        return;
+    }
+    stats.rxPackets++;
+
+    lqi = radioLqi();
+    rssi = radioRssi();
+
+    if (!rxSampled)
+    {
+        rxSampled = 1;
+        stats.rssiMin = stats.rssiMax = rssi;
+        stats.lqiMin = stats.lqiMax = lqi;
+        rssiAverage8 = (int16)rssi << 3;
+        lqiAverage8 = (uint16)lqi << 3;
+        return;
+    }
+
+    if (rssi < stats.rssiMin){ stats.rssiMin = rssi; }
+    if (rssi > stats.rssiMax){ stats.rssiMax = rssi; }
+    if (lqi < stats.lqiMin){ stats.lqiMin = lqi; }
+    if (lqi > stats.lqiMax){ stats.lqiMax = lqi; }
+    rssiAverage8 += rssi - (rssiAverage8 >> 3);
+    lqiAverage8 += lqi - (lqiAverage8 >> 3);
+}
 
 ISR(RF, 0)
 {
@@ -60,15 +272,27 @@ ISR(RF, 0)
 
     if (RFIF & 0x10) // Check IRQ_DONE
     {
-        if (radioMacState == RADIO_MAC_STATE_TX)
+        if (radioMacState == RADIO_MAC_STATE_TX && txRepeating && (int16)(getTicks() - txRepeatEndTime) < 0)
+        {
+            // We just sent a copy of a repeated packet, so send it again without
+            // bothering the higher-level code.  The radio is in FSTXON now, so this is quick.
+            RFIF = ~0x10;
+            DMAIRQ &= ~(1<<DMA_CHANNEL_RADIO);
+            DMAARM |= (1<<DMA_CHANNEL_RADIO);
+            RFST = STX;
+            stats.txPackets++;
+        }
+        else if (radioMacState == RADIO_MAC_STATE_TX)
         {
             // We just sent a packet.
+            stats.txPackets++;
             radioMacEvent(RADIO_MAC_EVENT_TX);
         }
         else if (radioMacState == RADIO_MAC_STATE_RX)
         {
             // We just received a packet, but it might have an invalid CRC or be irrelevant
             // for other reasons.
+            recordRx();
             radioMacEvent(RADIO_MAC_EVENT_RX);
         }
     }
@@ -77,6 +301,7 @@ ISR(RF, 0)
     {
         // We were listening for packets but we didn't receive anything
         // and the timeout period expired.
+        stats.rxTimeouts++;
         radioMacEvent(RADIO_MAC_EVENT_RX_TIMEOUT);
     }
 
@@ -88,6 +313,7 @@ ISR(RF, 0)
         {
             // We are currently transmitting, so we will wait for the end of that packet.
             // Then, we will issue a RADIO_MAC_EVENT_TX.
+            stats.strobesDeferred++;
             return;
         }
 
@@ -99,6 +325,7 @@ ISR(RF, 0)
                 // packet and then issue a RADIO_MAC_EVENT_RX.
                 // ASSUMPTION: There is no automatic address filtering, and packets with
                 // bad CRCs still result in a RAIDO_MAC_EVENT_RX.
+                stats.strobesDeferred++;
                 return;
             }
             if ((MCSM2&7) != 7 && WOREVT1 < MAX_LATENCY_OF_STROBE)
@@ -106,6 +333,7 @@ ISR(RF, 0)
                 // We are currently listening for a packet and the timeout is going to happen
                 // soon (within 10 ms if MSCM2==1 or 20 ms if MCSMS2==0), so we will not actually issue a RADIO_MAC_EVENT_STROBE
                 // right now.
+                stats.strobesDeferred++;
                 return;
             }
         }
@@ -120,6 +348,7 @@ ISR(RF, 0)
         if (MARCSTATE != 0x0D)
         {
             RFST = SIDLE;
+            while(MARCSTATE != 0x01);  // Wait so that radioMacCalibrateIfNeeded knows we are starting from IDLE.
         }
 
         // We are not currently transmitting and nothing is being received at the
@@ -133,6 +362,7 @@ ISR(RF, 0)
         // TX underflow.  This should not happen because we use DMA to send
         // the data.  Report it as an error.
         radioTxUnderflowOccurred = 1;
+        stats.txUnderflows++;
         RFIF = ~0x80;
     }
 
@@ -142,6 +372,7 @@ ISR(RF, 0)
         // We were not reading data from the radio fast enough, so there was
         // a RX overflow.  This should not happen.  Report it as an error.
         radioRxOverflowOccurred = 1;
+        stats.rxOverflows++;
         RFIF = ~0x40;
 
         // The radio module is probably now in the RX_OVERFLOW state where it can not
@@ -154,6 +385,23 @@ ISR(RF, 0)
 
 void radioMacEvent(uint8 event)
 {
+    /** Save the results of the last calibration. ******************************/
+    if (fscalSavePending)
+    {
+        fscalSavePending = 0;
+        if (event != RADIO_MAC_EVENT_STROBE || MARCSTATE == 0x0D)
+        {
+            // The radio got to RX or TX, so it finished calibrating.
+            fscalCacheSave();
+        }
+        else
+        {
+            // The strobe stopped the radio while it was starting up, maybe in the
+            // middle of the calibration, so do it again.
+            calibrationNeeded = 1;
+        }
+    }
+
     /** Turn off the radio. ****************************************************/
     /* This is necessary because David has observed that sometimes (maybe every
      * time?) when a packet with a bad CRC is received, the radio stays in RX
@@ -173,6 +421,8 @@ void radioMacEvent(uint8 event)
     /** Report the event to the higher-level code so it can decide what to do. **/
     radioMacState = RADIO_MAC_STATE_RX;    // Default next state: RX
     MCSM2 = 0x07;                          // Default next timeout: infinite.
+    radioMacSniffing = 0;
+    txRepeating = 0;
     radioMacEventHandler(event);
 
     /** Clear the some flags from the radio ***********************************/
@@ -182,6 +432,11 @@ void radioMacEvent(uint8 event)
     RFIF = ~0x30;  // Clear IRQ_DONE and IRQ_TIMEOUT if they are set.
 
     /** Start up the radio in the new state which was decided above. **/
+    if (MARCSTATE == 0x01)
+    {
+        radioMacCalibrateIfNeeded();
+    }
+
     switch(radioMacState)
     {
     case RADIO_MAC_STATE_RX:
@@ -210,8 +465,8 @@ void radioMacInit()
 {
     radioRegistersInit();
 
-    // MCSM.FS_AUTOCAL = 1: Calibrate freq when going from IDLE to RX or TX (or FSTXON).
-    MCSM0 = 0x14;    // Main Radio Control State Machine Configuration
+    // MCSM.FS_AUTOCAL = 0: Do not calibrate automatically (see radioMacCalibrateIfNeeded).
+    MCSM0 = MCSM0_NO_AUTOCAL;    // Main Radio Control State Machine Configuration
     MCSM1 = 0x05;    // Disable CCA.  After RX, go to FSTXON.  After TX, go to FSTXON.
     MCSM2 = 0x07;    // NOTE: MCSM2 also gets set every time we go into RX mode.
 
@@ -241,8 +496,17 @@ void radioMacRx(uint8 XDATA * packet, uint8 timeout)
     dmaConfig.radio.SRCADDRL = XDATA_SFR_ADDRESS(RFD);
     dmaConfig.radio.DESTADDRH = (unsigned int)packet >> 8;
     dmaConfig.radio.DESTADDRL = (unsigned int)packet;
-    dmaConfig.radio.LENL = 1 + PKTLEN + 2;
-    dmaConfig.radio.VLEN_LENH = 0b10000000; // Transfer length is FirstByte+3
+    if (PKTCTRL0 & 0x03)
+    {
+        dmaConfig.radio.LENL = 1 + PKTLEN + 2;
+        dmaConfig.radio.VLEN_LENH = 0b10000000; // Transfer length is FirstByte+3
+    }
+    else
+    {
+        // Fixed packet length mode (see radioMacSetFec).
+        dmaConfig.radio.LENL = PKTLEN + 2;
+        dmaConfig.radio.VLEN_LENH = 0;          // Transfer length is LEN
+    }
     // Assumption: DC6 is set correctly
     dmaConfig.radio.DC7 = 0x10; // SRCINC = 0, DESTINC = 1, IRQMASK = 0, M8 = 0, PRIORITY = 0
 
@@ -257,10 +521,120 @@ void radioMacTx(uint8 XDATA * packet)
     dmaConfig.radio.SRCADDRL = (unsigned int)packet;
     dmaConfig.radio.DESTADDRH = XDATA_SFR_ADDRESS(RFD) >> 8;
     dmaConfig.radio.DESTADDRL = XDATA_SFR_ADDRESS(RFD);
-    dmaConfig.radio.LENL = 1 + PKTLEN;
-    dmaConfig.radio.VLEN_LENH = 0b00100000; // Transfer length is FirstByte+1
+    if (PKTCTRL0 & 0x03)
+    {
+        dmaConfig.radio.LENL = 1 + PKTLEN;
+        dmaConfig.radio.VLEN_LENH = 0b00100000; // Transfer length is FirstByte+1
+    }
+    else
+    {
+        // Fixed packet length mode (see radioMacSetFec).
+        dmaConfig.radio.LENL = PKTLEN;
+        dmaConfig.radio.VLEN_LENH = 0;          // Transfer length is LEN
+    }
     // Assumption: DC6 is set correctly
     dmaConfig.radio.DC7 = 0x40; // SRCINC = 1, DESTINC = 0, IRQMASK = 0, M8 = 0, PRIORITY = 0
 
     radioMacState = RADIO_MAC_STATE_TX;
 }
+
+// Called by the user from radioMacEventHandler to switch to a different channel.
+void radioMacSetChannel(uint8 channel)
+{
+    uint8 i;
+
+    // CHANNR can only be changed safely while the radio is idle.  The frequency
+    // synthesizer must be calibrated for the new channel when the radio starts up again,
+    // unless we saved the results of a recent calibration on that channel.
+    RFST = SIDLE;
+    while(MARCSTATE != 0x01);
+    CHANNR = channel;
+
+    // If the radio was calibrating for the old channel, do not save the results for the new one.
+    fscalSavePending = 0;
+
+    i = fscalCacheFind(channel);
+    fscalCacheCurrent = i;
+    if (i != FSCAL_CACHE_NONE)
+    {
+        FSCAL1 = fscalCache[i].fscal1;
+        FSCAL2 = fscalCache[i].fscal2;
+        FSCAL3 = fscalCache[i].fscal3;
+        fscalRestored = 1;
+    }
+}
+
+// Called by the user from radioMacEventHandler to switch to a different data rate profile.
+void radioMacSetProfile(uint8 profile)
+{
+    RFST = SIDLE;
+    while(MARCSTATE != 0x01);
+    radioSetProfile(profile);
+    fscalCacheValid = 0;
+}
+
+// Called by the user from radioMacEventHandler to turn forward error correction on or off.
+void radioMacSetFec(BIT enable)
+{
+    // The packet format can only be changed safely while the radio is idle.
+    RFST = SIDLE;
+    while(MARCSTATE != 0x01);
+    if (enable)
+    {
+        // FEC requires fixed-length packets, so the length byte is sent as data.
+        MDMCFG1 |= 0x80;                            // FEC_EN = 1
+        PKTCTRL0 &= ~0x03;                          // LENGTH_CONFIG = 0: Fixed packet length.
+    }
+    else
+    {
+        MDMCFG1 &= ~0x80;                           // FEC_EN = 0
+        PKTCTRL0 = (PKTCTRL0 & ~0x03) | 0x01;       // LENGTH_CONFIG = 1: Variable packet length.
+    }
+}
+
+// Called by the user from radioMacEventHandler to send a packet repeatedly.
+void radioMacTxRepeated(uint8 XDATA * packet, uint16 duration)
+{
+    radioMacTx(packet);
+
+    // The end time is compared to getTicks() as a signed 16-bit difference,
+    // so it must be less than 32768 ticks away.
+    if (duration > RADIO_MAC_TX_REPEAT_MAX)
+    {
+        duration = RADIO_MAC_TX_REPEAT_MAX;
+    }
+
+    // Convert the duration from units of 0.922 ms to getTicks() ticks (29.5 ticks per unit).
+    // This is done with shifts (59 = 64 - 4 - 1) because we are in an interrupt and the
+    // 16-bit multiplication routine is not reentrant.  The intermediate values can
+    // overflow, but the result is correct modulo 65536 and fits in 16 bits.
+    txRepeatEndTime = getTicks() + (((duration << 6) - (duration << 2) - duration) >> 1);
+    txRepeating = 1;
+}
+
+void radioMacGetStats(RADIO_MAC_STATS XDATA * s)
+{
+    uint8 oldRfie = IEN2 & 0x01;
+    IEN2 &= ~0x01;
+    *s = stats;
+    s->rssiAverage = rssiAverage8 >> 3;
+    s->lqiAverage = lqiAverage8 >> 3;
+    IEN2 |= oldRfie;
+}
+
+void radioMacResetStats()
+{
+    uint8 oldRfie = IEN2 & 0x01;
+    uint8 XDATA * p = (uint8 XDATA *)&stats;
+    uint8 i;
+
+    IEN2 &= ~0x01;
+    for (i = 0; i < sizeof(stats); i++)
+    {
+        p[i] = 0;
+    }
+    rxSampled = 0;
+    rssiAverage8 = 0;
+    lqiAverage8 = 0;
+    IEN2 |= oldRfie;
+}
@@ -0,0 +1,34 @@
+/* radio_mac_internal.h:
+ *  Definitions shared by the files of radio_mac.lib (radio_mac.c and low_power_listen.c).
+ *  This is not part of the public interface in radio_mac.h.
+ */
+
+#ifndef _RADIO_MAC_INTERNAL_H_
+#define _RADIO_MAC_INTERNAL_H_
+
+#include <cc2511_types.h>
+
+// The RFST register is how we tell the radio to do something, and these are the
+// command strobes we can write to it:
+#define SFSTXON 0
+#define SCAL    1
+#define SRX     2
+#define STX     3
+#define SIDLE   4
+
+// Radio MAC states
+#define RADIO_MAC_STATE_OFF      0
+#define RADIO_MAC_STATE_IDLE     1
+#define RADIO_MAC_STATE_RX       2
+#define RADIO_MAC_STATE_TX       3
+extern volatile uint8 DATA radioMacState;
+
+// 1 if the radio is sniffing for a carrier (see low_power_listen.c).  Set to 1
+// when we start a sniff, and cleared by the next event.
+extern volatile BIT radioMacSniffing;
+
+// This must be called when the radio is in the IDLE state, right before telling it to go to RX or TX
+// (after radioMacState is set).  It decides whether the radio should calibrate first.
+void radioMacCalibrateIfNeeded(void);
+
+#endif
@@ -0,0 +1,701 @@
+/* radio_net.c:
+ *  This layer uses radio_mac.c to provide reliable ordered delivery of data packets
+ *  between one hub and many nodes in a star network.
+ *
+ *  The hub controls all access to the channel, so there are no collisions (except
+ *  during join windows):
+ *  - The hub polls each node in its peer table in turn.  A poll is a packet addressed
+ *    to the node which might contain a data packet for that node: the earliest one in the
+ *    TX queue, so a node that is slow to respond does not hold up data for the others.
+ *  - When a node receives a poll, it responds immediately.  The response might contain
+ *    a data packet for the hub.  Nodes never transmit at any other time.
+ *  - After polling every node once, the hub broadcasts a Join Poll and listens for
+ *    JOIN_WINDOW.  Nodes that are not in the network respond with a Join packet after a
+ *    random delay, and the hub adds them to its peer table.
+ *  - If a node misses MAX_MISSES polls in a row, the hub removes it from the table.  A node
+ *    that hears NODE_REJOIN_POLLS Join Polls without being polled assumes that it has been
+ *    removed and joins again.
+ *
+ *  Each direction of each hub-node pair uses the same stop-and-wait protocol as radio_link:
+ *  every packet has the sequence bit of its data and the sequence bit that its sender
+ *  expects to receive next, which acknowledges the last data packet that the sender received.
+ *  The first poll after a node joins has the RESET flag, which tells the node to forget its
+ *  sequence state.
+ */
+
+#include <radio_net.h>
+#include <radio_registers.h>
+#include <random.h>
+
+/* PARAMETERS *****************************************************************/
+
+int32 CODE param_radio_channel = 128;
+
+/* PACKET VARIABLES AND DEFINES ***********************************************/
+
+// The net layer adds a three byte header to the beginning of each packet.
+#define RADIO_NET_PACKET_HEADER_LENGTH 3
+
+// Compute the max size of on-the-air packets.  This value is stored in the PKTLEN register.
+#define RADIO_MAX_PACKET_SIZE  (RADIO_NET_PAYLOAD_SIZE + RADIO_NET_PACKET_HEADER_LENGTH)
+
+#define RADIO_NET_PACKET_LENGTH_OFFSET      0
+#define RADIO_NET_PACKET_DESTINATION_OFFSET 1
+#define RADIO_NET_PACKET_SOURCE_OFFSET      2
+#define RADIO_NET_PACKET_CONTROL_OFFSET     3
+
+#define PACKET_TYPE_MASK      (3 << 6) // These are the bits that determine the packet type.
+#define PACKET_TYPE_DATA      (0 << 6) // A poll from the hub or a response from a node.  Might contain data.
+#define PACKET_TYPE_JOIN_POLL (1 << 6) // The hub is asking new nodes to join.
+#define PACKET_TYPE_JOIN      (2 << 6) // A node is asking to join.
+
+#define PACKET_FLAG_RESET     (1 << 2) // The node should forget its sequence state.
+#define PACKET_FLAG_NEXT      (1 << 1) // The sequence bit that the sender expects to receive next.
+#define PACKET_FLAG_SEQUENCE  (1 << 0) // The sequence bit of the data in this packet.
+
+#define RADIO_NET_BROADCAST_ADDRESS 255
+
+/*  rxPackets:
+ *  See radio_queue.c for an explanation of how ownership of the buffers works.
+ *  The hub gets data from many nodes, so we have one more buffer than radio_queue.
+ *  If a data packet is received and the main loop owns all the other buffers, we
+ *  do not acknowledge it, so the node will send it again later. */
+#define RX_PACKET_COUNT  4
+static volatile uint8 XDATA radioNetRxPacket[RX_PACKET_COUNT][1 + RADIO_MAX_PACKET_SIZE + 2];  // The first byte is the length.
+static volatile uint8 DATA radioNetRxMainLoopIndex = 0;   // The index of the next rxBuffer to read from the main loop.
+static volatile uint8 DATA radioNetRxInterruptIndex = 0;  // The index of the next rxBuffer to write to when a packet comes from the radio.
+
+/* txPackets are handled similarly, except that the hub can finish with a packet that is
+ * not at the front of the queue.  It marks the packet by setting its destination to
+ * TX_PACKET_DONE_ADDRESS, and gives it back to the main loop when the packets ahead of
+ * it are done too. */
+#define TX_PACKET_COUNT 16
+#define TX_PACKET_DONE_ADDRESS RADIO_NET_BROADCAST_ADDRESS
+static volatile uint8 XDATA radioNetTxPacket[TX_PACKET_COUNT][1 + RADIO_MAX_PACKET_SIZE];  // The first byte is the length.
+static volatile uint8 DATA radioNetTxMainLoopIndex = 0;   // The index of the next txPacket to write to in the main loop.
+static volatile uint8 DATA radioNetTxInterruptIndex = 0;  // The index of the current txPacket we are trying to send on the radio.
+
+// This is a packet that gets sent when we have no data to send (empty polls, empty responses,
+// Join Polls, and Join packets).
+static volatile uint8 XDATA shortTxPacket[1 + RADIO_NET_PACKET_HEADER_LENGTH];
+
+uint8 radioNetAddress = RADIO_NET_HUB_ADDRESS;
+
+/* TIMING *********************************************************************/
+
+// How long the hub waits for a node to respond to a poll, in units of 0.922 ms.
+// A full packet takes about 1.2 ms to send at 350 kbps.
+#define RESPONSE_TIMEOUT 3
+
+// How long the hub listens for Join packets after sending a Join Poll, in units of 0.922 ms.
+// Nodes wait 1-4 units before sending a Join packet, so this must be more than that.
+#define JOIN_WINDOW 6
+
+// The number of polls in a row that a node can miss before the hub removes it.
+#define MAX_MISSES 8
+
+// The number of Join Polls in a row that a node can hear without being polled before it
+// assumes the hub has removed it.  This is more than MAX_MISSES so that the hub removes the
+// node before the node tries to join again.
+#define NODE_REJOIN_POLLS (2 * MAX_MISSES)
+
+/* HUB VARIABLES **************************************************************/
+
+// The peer table: the nodes that have joined the network.
+static uint8 XDATA peerCount = 0;
+static uint8 XDATA peerAddress[RADIO_NET_MAX_PEERS];
+static uint8 XDATA peerMisses[RADIO_NET_MAX_PEERS];
+static uint8 XDATA peerFlags[RADIO_NET_MAX_PEERS];
+
+// Bits in peerFlags.
+#define PEER_TX_SEQUENCE  (1 << 0) // The sequence bit of the next data packet we will send to the node.
+#define PEER_RX_NEXT      (1 << 1) // The sequence bit of the next data packet we expect from the node.
+#define PEER_RESETTING    (1 << 2) // The node has not responded since it joined.
+
+// The index of the node the hub is polling, or peerCount if the hub is in a join window.
+static uint8 XDATA hubPollIndex = 0;
+
+// The index of the data packet in radioNetTxPacket that the last poll contained,
+// or TX_PACKET_COUNT if it did not contain one.
+static uint8 XDATA hubTxSentIndex = TX_PACKET_COUNT;
+
+// The number of data packets the hub discarded because their destination was not
+// in the network.
+static uint16 XDATA hubTxDiscarded = 0;
+
+/* NODE VARIABLES *************************************************************/
+
+// 1 if the node is in the hub's peer table (as far as we know).
+static volatile BIT nodeJoined = 0;
+
+// 1 if the node is waiting for its random delay to end so it can send a Join packet.
+static BIT nodeJoinPending = 0;
+
+// The number of Join Polls we have heard since the hub last polled us.
+static uint8 XDATA nodeJoinPollsHeard = 0;
+
+// The sequence bit of the next data packet we will send.
+static BIT nodeTxSequence = 0;
+
+// The sequence bit of the next data packet we expect from the hub.
+static BIT nodeRxNext = 0;
+
+/* GENERAL FUNCTIONS **********************************************************/
+
+void radioNetInit()
+{
+    randomSeedFromSerialNumber();
+
+    PKTLEN = RADIO_MAX_PACKET_SIZE;
+    CHANNR = param_radio_channel;
+
+    radioMacInit();
+    radioMacStrobe();
+}
+
+BIT radioNetIsHub()
+{
+    return radioNetAddress == RADIO_NET_HUB_ADDRESS;
+}
+
+BIT radioNetConnected()
+{
+    return radioNetIsHub() ? peerCount != 0 : nodeJoined;
+}
+
+uint8 radioNetPeerCount()
+{
+    return peerCount;
+}
+
+uint8 radioNetPeerAddress(uint8 index)
+{
+    return peerAddress[index];
+}
+
+uint16 radioNetTxDiscardedPackets()
+{
+    uint8 oldRfie = IEN2 & 0x01;
+    uint16 count;
+
+    IEN2 &= ~0x01;     // Disable the RF interrupt so we get a consistent copy.
+    count = hubTxDiscarded;
+    IEN2 |= oldRfie;
+    return count;
+}
+
+// Returns a random delay in units of 0.922 ms (the same units of radioMacRx).
+// This is used by nodes to decide when to send a Join packet.
+static uint8 randomJoinDelay()
+{
+    return 1 + (randomNumber() & 3);
+}
+
+/* TX FUNCTIONS (called by higher-level code in main loop) ********************/
+
+uint8 radioNetTxAvailable(void)
+{
+    // Assumption: TX_PACKET_COUNT is a power of 2
+    return (radioNetTxInterruptIndex - radioNetTxMainLoopIndex - 1) & (TX_PACKET_COUNT - 1);
+}
+
+uint8 radioNetTxQueued(void)
+{
+    return (radioNetTxMainLoopIndex - radioNetTxInterruptIndex) & (TX_PACKET_COUNT - 1);
+}
+
+uint8 XDATA * radioNetTxCurrentPacket()
+{
+    if (!radioNetTxAvailable())
+    {
+        return 0;
+    }
+
+    return radioNetTxPacket[radioNetTxMainLoopIndex] + RADIO_NET_PACKET_HEADER_LENGTH;
+}
+
+void radioNetTxSendPacket(uint8 address)
+{
+    uint8 XDATA * packet = radioNetTxPacket[radioNetTxMainLoopIndex];
+
+    // Now we set the length byte and the addresses.  The control byte gets set in the ISR.
+    packet[RADIO_NET_PACKET_LENGTH_OFFSET] = packet[RADIO_NET_PACKET_HEADER_LENGTH] + RADIO_NET_PACKET_HEADER_LENGTH;
+    packet[RADIO_NET_PACKET_DESTINATION_OFFSET] = radioNetIsHub() ? address : RADIO_NET_HUB_ADDRESS;
+    packet[RADIO_NET_PACKET_SOURCE_OFFSET] = radioNetAddress;
+
+    // Update our index of which packet to populate in the main loop.
+    // We do not need to strobe the MAC: the hub sends the packet when it next polls
+    // the destination, and a node sends it when it gets polled.
+    if (radioNetTxMainLoopIndex == TX_PACKET_COUNT - 1)
+    {
+        radioNetTxMainLoopIndex = 0;
+    }
+    else
+    {
+        radioNetTxMainLoopIndex++;
+    }
+}
+
+/* RX FUNCTIONS (called by higher-level code in main loop) ********************/
+
+uint8 XDATA * radioNetRxCurrentPacket(void)
+{
+    if (radioNetRxMainLoopIndex == radioNetRxInterruptIndex)
+    {
+        return 0;
+    }
+
+    return radioNetRxPacket[radioNetRxMainLoopIndex] + RADIO_NET_PACKET_HEADER_LENGTH;
+}
+
+uint8 radioNetRxCurrentSource(void)
+{
+    return radioNetRxPacket[radioNetRxMainLoopIndex][RADIO_NET_PACKET_SOURCE_OFFSET];
+}
+
+void radioNetRxDoneWithPacket(void)
+{
+    if (radioNetRxMainLoopIndex == RX_PACKET_COUNT - 1)
+    {
+        radioNetRxMainLoopIndex = 0;
+    }
+    else
+    {
+        radioNetRxMainLoopIndex++;
+    }
+}
+
+/* FUNCTIONS CALLED IN RF_ISR *************************************************/
+
+// Gives the packet in the current RX buffer to the main loop if there is room.
+// Returns 1 if successful.
+static BIT rxAccept()
+{
+    uint8 XDATA * packet = radioNetRxPacket[radioNetRxInterruptIndex];
+    uint8 nextRadioNetRxInterruptIndex;
+
+    if (radioNetRxInterruptIndex == RX_PACKET_COUNT - 1)
+    {
+        nextRadioNetRxInterruptIndex = 0;
+    }
+    else
+    {
+        nextRadioNetRxInterruptIndex = radioNetRxInterruptIndex + 1;
+    }
+
+    if (nextRadioNetRxInterruptIndex == radioNetRxMainLoopIndex)
+    {
+        // The main loop owns all the other buffers.
+        return 0;
+    }
+
+    // Replace the control byte with the payload length, so the packet has the format
+    // documented in radio_net.h.
+    packet[RADIO_NET_PACKET_CONTROL_OFFSET] = packet[RADIO_NET_PACKET_LENGTH_OFFSET] - RADIO_NET_PACKET_HEADER_LENGTH;
+    radioNetRxInterruptIndex = nextRadioNetRxInterruptIndex;
+    return 1;
+}
+
+// Gives ownership of the current TX packet back to the main loop.
+static void txDoneWithPacket()
+{
+    if (radioNetTxInterruptIndex == TX_PACKET_COUNT - 1)
+    {
+        radioNetTxInterruptIndex = 0;
+    }
+    else
+    {
+        radioNetTxInterruptIndex++;
+    }
+}
+
+// Sends a packet with no data.
+static void txShortPacket(uint8 destination, uint8 control)
+{
+    shortTxPacket[RADIO_NET_PACKET_LENGTH_OFFSET] = RADIO_NET_PACKET_HEADER_LENGTH;
+    shortTxPacket[RADIO_NET_PACKET_DESTINATION_OFFSET] = destination;
+    shortTxPacket[RADIO_NET_PACKET_SOURCE_OFFSET] = radioNetAddress;
+    shortTxPacket[RADIO_NET_PACKET_CONTROL_OFFSET] = control;
+    radioMacTx(shortTxPacket);
+}
+
+static void rxListen(uint8 timeout)
+{
+    radioMacRx(radioNetRxPacket[radioNetRxInterruptIndex], timeout);
+}
+
+/* HUB FUNCTIONS (called in RF_ISR) *******************************************/
+
+// Returns the index of the specified node in the peer table, or 0xFF if it is not there.
+static uint8 hubFindPeer(uint8 address)
+{
+    uint8 i;
+    for (i = 0; i < peerCount; i++)
+    {
+        if (peerAddress[i] == address)
+        {
+            return i;
+        }
+    }
+    return 0xFF;
+}
+
+// Gives the packets at the front of the TX queue back to the main loop if we are done
+// with them.  Packets for nodes that are not in the network are discarded when they
+// get to the front, because otherwise they would take up buffers forever.
+static void hubTxTrim()
+{
+    uint8 destination;
+
+    while (radioNetTxInterruptIndex != radioNetTxMainLoopIndex)
+    {
+        destination = radioNetTxPacket[radioNetTxInterruptIndex][RADIO_NET_PACKET_DESTINATION_OFFSET];
+        if (destination != TX_PACKET_DONE_ADDRESS)
+        {
+            if (hubFindPeer(destination) != 0xFF)
+            {
+                return;
+            }
+            hubTxDiscarded++;
+        }
+        txDoneWithPacket();
+    }
+}
+
+// Returns the index of the earliest data packet in the TX queue for the specified node,
+// or TX_PACKET_COUNT if there is none.
+static uint8 hubTxFind(uint8 address)
+{
+    uint8 i = radioNetTxInterruptIndex;
+    uint8 end = radioNetTxMainLoopIndex;
+
+    while (i != end)
+    {
+        if (radioNetTxPacket[i][RADIO_NET_PACKET_DESTINATION_OFFSET] == address)
+        {
+            return i;
+        }
+        i = (i + 1) & (TX_PACKET_COUNT - 1);
+    }
+    return TX_PACKET_COUNT;
+}
+
+// Sends the poll for hubPollIndex.
+static void hubPoll()
+{
+    uint8 flags;
+    uint8 control;
+    uint8 index;
+
+    hubTxSentIndex = TX_PACKET_COUNT;
+    hubTxTrim();
+
+    if (hubPollIndex >= peerCount)
+    {
+        hubPollIndex = peerCount;
+        txShortPacket(RADIO_NET_BROADCAST_ADDRESS, PACKET_TYPE_JOIN_POLL);
+        return;
+    }
+
+    flags = peerFlags[hubPollIndex];
+    control = PACKET_TYPE_DATA;
+    if (flags & PEER_RX_NEXT) { control |= PACKET_FLAG_NEXT; }
+
+    if (flags & PEER_RESETTING)
+    {
+        txShortPacket(peerAddress[hubPollIndex], control | PACKET_FLAG_RESET);
+    }
+    else if ((index = hubTxFind(peerAddress[hubPollIndex])) != TX_PACKET_COUNT)
+    {
+        // There is a data packet for this node, so send it with the poll.
+        if (flags & PEER_TX_SEQUENCE) { control |= PACKET_FLAG_SEQUENCE; }
+        radioNetTxPacket[index][RADIO_NET_PACKET_CONTROL_OFFSET] = control;
+        radioMacTx(radioNetTxPacket[index]);
+        hubTxSentIndex = index;
+    }
+    else
+    {
+        txShortPacket(peerAddress[hubPollIndex], control);
+    }
+}
+
+// Moves on to the next node (or the join window) and polls it.
+static void hubPollNext()
+{
+    if (hubPollIndex >= peerCount)
+    {
+        hubPollIndex = 0;
+    }
+    else
+    {
+        hubPollIndex++;
+    }
+    hubPoll();
+}
+
+// Called when the node we polled did not respond.
+static void hubMiss()
+{
+    if (++peerMisses[hubPollIndex] >= MAX_MISSES)
+    {
+        // Remove the node from the table by moving the last node into its place.
+        // Then poll the node that took its place (or start the join window).
+        peerCount--;
+        peerAddress[hubPollIndex] = peerAddress[peerCount];
+        peerMisses[hubPollIndex] = peerMisses[peerCount];
+        peerFlags[hubPollIndex] = peerFlags[peerCount];
+        hubPoll();
+        return;
+    }
+    hubPollNext();
+}
+
+// Called when we receive a Join packet during the join window.
+static void hubRxJoin(uint8 address)
+{
+    uint8 index;
+
+    if (address == RADIO_NET_HUB_ADDRESS || address > RADIO_NET_MAX_ADDRESS)
+    {
+        return;
+    }
+
+    index = hubFindPeer(address);
+    if (index == 0xFF)
+    {
+        if (peerCount >= RADIO_NET_MAX_PEERS)
+        {
+            // The table is full.
+            return;
+        }
+        index = peerCount++;
+        peerAddress[index] = address;
+    }
+
+    // The node is new, or it thinks we removed it, so start over with it.
+    peerMisses[index] = 0;
+    peerFlags[index] = PEER_RESETTING;
+}
+
+// Called when we receive the response from the node we polled.
+static void hubRxResponse(uint8 XDATA * packet)
+{
+    uint8 control = packet[RADIO_NET_PACKET_CONTROL_OFFSET];
+    uint8 flags = peerFlags[hubPollIndex];
+
+    peerMisses[hubPollIndex] = 0;
+
+    if (flags & PEER_RESETTING)
+    {
+        // The node has reset its sequence state, so ignore its sequence bits this time.
+        peerFlags[hubPollIndex] = 0;
+        return;
+    }
+
+    if (hubTxSentIndex != TX_PACKET_COUNT && !(control & PACKET_FLAG_NEXT) != !(flags & PEER_TX_SEQUENCE))
+    {
+        // The node received the data packet we sent.  hubPoll will give it back
+        // to the main loop when the packets ahead of it are done.
+        flags ^= PEER_TX_SEQUENCE;
+        radioNetTxPacket[hubTxSentIndex][RADIO_NET_PACKET_DESTINATION_OFFSET] = TX_PACKET_DONE_ADDRESS;
+    }
+
+    if (packet[RADIO_NET_PACKET_LENGTH_OFFSET] > RADIO_NET_PACKET_HEADER_LENGTH &&
+        !(control & PACKET_FLAG_SEQUENCE) == !(flags & PEER_RX_NEXT))
+    {
+        // The response contains a data packet we have not received before.
+        if (rxAccept())
+        {
+            flags ^= PEER_RX_NEXT;
+        }
+    }
+
+    peerFlags[hubPollIndex] = flags;
+}
+
+static void hubEventHandler(uint8 event)
+{
+    if (event == RADIO_MAC_EVENT_STROBE)
+    {
+        hubPoll();
+        return;
+    }
+    else if (event == RADIO_MAC_EVENT_TX)
+    {
+        rxListen(hubPollIndex >= peerCount ? JOIN_WINDOW : RESPONSE_TIMEOUT);
+        return;
+    }
+    else if (event == RADIO_MAC_EVENT_RX)
+    {
+        uint8 XDATA * currentRxPacket = radioNetRxPacket[radioNetRxInterruptIndex];
+        uint8 valid = radioCrcPassed() &&
+            currentRxPacket[RADIO_NET_PACKET_LENGTH_OFFSET] >= RADIO_NET_PACKET_HEADER_LENGTH &&
+            currentRxPacket[RADIO_NET_PACKET_DESTINATION_OFFSET] == RADIO_NET_HUB_ADDRESS;
+
+        if (hubPollIndex >= peerCount)
+        {
+            // We are in the join window.
+            if (valid && (currentRxPacket[RADIO_NET_PACKET_CONTROL_OFFSET] & PACKET_TYPE_MASK) == PACKET_TYPE_JOIN)
+            {
+                hubRxJoin(currentRxPacket[RADIO_NET_PACKET_SOURCE_OFFSET]);
+            }
+
+            // Keep listening for more Join packets.  If a node was added, it has taken the place of
+            // the join window in the table, but that is fine because we will start at 0 next time.
+            hubPollIndex = peerCount;
+            rxListen(JOIN_WINDOW);
+            return;
+        }
+
+        if (valid && (currentRxPacket[RADIO_NET_PACKET_CONTROL_OFFSET] & PACKET_TYPE_MASK) == PACKET_TYPE_DATA &&
+            currentRxPacket[RADIO_NET_PACKET_SOURCE_OFFSET] == peerAddress[hubPollIndex])
+        {
+            hubRxResponse(currentRxPacket);
+            hubPollNext();
+        }
+        else
+        {
+            hubMiss();
+        }
+        return;
+    }
+    else if (event == RADIO_MAC_EVENT_RX_TIMEOUT)
+    {
+        if (hubPollIndex >= peerCount)
+        {
+            // The join window is over, so start the next round of polls.
+            hubPollNext();
+        }
+        else
+        {
+            hubMiss();
+        }
+        return;
+    }
+}
+
+/* NODE FUNCTIONS (called in RF_ISR) ******************************************/
+
+// Called when the hub polls us.
+static void nodeRxPoll(uint8 XDATA * packet)
+{
+    uint8 control = packet[RADIO_NET_PACKET_CONTROL_OFFSET];
+
+    nodeJoined = 1;
+    nodeJoinPollsHeard = 0;
+
+    if (control & PACKET_FLAG_RESET)
+    {
+        // The hub just added us to its table.
+        nodeTxSequence = 0;
+        nodeRxNext = 0;
+    }
+    else
+    {
+        if (radioNetTxInterruptIndex != radioNetTxMainLoopIndex &&
+            !(control & PACKET_FLAG_NEXT) != !nodeTxSequence)
+        {
+            // The hub received the data packet we sent.
+            nodeTxSequence = !nodeTxSequence;
+            txDoneWithPacket();
+        }
+
+        if (packet[RADIO_NET_PACKET_LENGTH_OFFSET] > RADIO_NET_PACKET_HEADER_LENGTH &&
+            !(control & PACKET_FLAG_SEQUENCE) == !nodeRxNext)
+        {
+            // The poll contains a data packet we have not received before.
+            if (rxAccept())
+            {
+                nodeRxNext = !nodeRxNext;
+            }
+        }
+    }
+
+    // Respond immediately.
+    control = PACKET_TYPE_DATA;
+    if (nodeRxNext) { control |= PACKET_FLAG_NEXT; }
+
+    if (radioNetTxInterruptIndex != radioNetTxMainLoopIndex)
+    {
+        if (nodeTxSequence) { control |= PACKET_FLAG_SEQUENCE; }
+        radioNetTxPacket[radioNetTxInterruptIndex][RADIO_NET_PACKET_CONTROL_OFFSET] = control;
+        radioMacTx(radioNetTxPacket[radioNetTxInterruptIndex]);
+    }
+    else
+    {
+        txShortPacket(RADIO_NET_HUB_ADDRESS, control);
+    }
+}
+
+// Called when the hub asks new nodes to join.
+static void nodeRxJoinPoll()
+{
+    if (nodeJoined)
+    {
+        if (++nodeJoinPollsHeard < NODE_REJOIN_POLLS)
+        {
+            rxListen(0);
+            return;
+        }
+
+        // The hub has not polled us for a long time, so it must have removed us.
+        nodeJoined = 0;
+    }
+
+    // Wait for a random delay before sending the Join packet so that we probably
+    // will not collide with other nodes that are joining.
+    nodeJoinPending = 1;
+    rxListen(randomJoinDelay());
+}
+
+static void nodeEventHandler(uint8 event)
+{
+    if (event == RADIO_MAC_EVENT_RX)
+    {
+        uint8 XDATA * currentRxPacket = radioNetRxPacket[radioNetRxInterruptIndex];
+
+        // If we were waiting to send a Join packet, the channel is busy so give up
+        // until the next Join Poll.
+        nodeJoinPending = 0;
+
+        if (radioCrcPassed() &&
+            currentRxPacket[RADIO_NET_PACKET_LENGTH_OFFSET] >= RADIO_NET_PACKET_HEADER_LENGTH &&
+            currentRxPacket[RADIO_NET_PACKET_SOURCE_OFFSET] == RADIO_NET_HUB_ADDRESS)
+        {
+            if (currentRxPacket[RADIO_NET_PACKET_DESTINATION_OFFSET] == radioNetAddress &&
+                (currentRxPacket[RADIO_NET_PACKET_CONTROL_OFFSET] & PACKET_TYPE_MASK) == PACKET_TYPE_DATA)
+            {
+                nodeRxPoll(currentRxPacket);
+                return;
+            }
+
+            if (currentRxPacket[RADIO_NET_PACKET_DESTINATION_OFFSET] == RADIO_NET_BROADCAST_ADDRESS &&
+                (currentRxPacket[RADIO_NET_PACKET_CONTROL_OFFSET] & PACKET_TYPE_MASK) == PACKET_TYPE_JOIN_POLL)
+            {
+                nodeRxJoinPoll();
+                return;
+            }
+        }
+    }
+    else if (event == RADIO_MAC_EVENT_RX_TIMEOUT && nodeJoinPending)
+    {
+        nodeJoinPending = 0;
+        txShortPacket(RADIO_NET_HUB_ADDRESS, PACKET_TYPE_JOIN);
+        return;
+    }
+
+    // Nodes only talk when the hub asks them to, so just listen.
+    rxListen(0);
+}
+
+void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
+{
+    if (radioNetIsHub())
+    {
+        hubEventHandler(event);
+    }
+    else
+    {
+        nodeEventHandler(event);
+    }
+}
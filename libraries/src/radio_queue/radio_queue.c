@@ -14,11 +14,21 @@
  *  Radio_queue is essentially a stripped-down version of the radio_link
  *  library, so radio_link is a good alternative if you want a more specialized
  *  implementation with more features.
+ *
+ *  In TDMA mode (radioQueueTdmaSlotCount != 0), time is divided into frames.
+ *  The beacon sender starts each frame by sending a beacon (a packet with no
+ *  payload), then it has a slot for the beacon sender's own data packet, and then
+ *  one slot for each transmitter.  A transmitter
+ *  that has heard a beacon recently only sends in its own slot, with at most one
+ *  packet per frame.  The slot times are measured from the end of the beacon with
+ *  getTicks() (Timer 4), so a transmitter keeps to its slots even if it misses
+ *  a few beacons.
  */
 
 #include <radio_queue.h>
 #include <radio_registers.h>
 #include <random.h>
+#include <time.h>
 
 /* PARAMETERS *****************************************************************/
 
@@ -62,6 +72,66 @@ static volatile uint8 DATA radioQueueTxInterruptIndex = 0;  // The index of the
 
 BIT radioQueueAllowCrcErrors = 0;
 
+uint16 radioQueueTxRepeatTime = 0;
+
+// 1 if the ISR is listening with no timeout because it had nothing to send, so
+// radioQueueTxSendPacket() has to wake it up.  Otherwise the ISR will look at the
+// TX queue when its current listening interval or TDMA wait ends, and waking it up
+// early would cut short the random delay between packets (or the wait for our slot).
+static volatile BIT radioQueueTxIdle = 0;
+
+// This is a packet with no payload which is used as the TDMA beacon.
+static volatile uint8 XDATA beaconPacket[1] = {0};
+
+/* TDMA VARIABLES *************************************************************/
+
+uint8 radioQueueTdmaSlotCount = 0;
+uint8 radioQueueTdmaSlot = 0;
+BIT radioQueueTdmaBeaconSender = 0;
+
+// The length of each slot, in getTicks() ticks (1/32 ms).  This is 2 units of
+// 0.922 ms, which is enough for the radio to calibrate (about 0.8 ms) and then send
+// a full packet (about 0.8 ms).
+#define TDMA_SLOT_TICKS 59
+
+// The largest allowed value of radioQueueTdmaSlotCount.  This keeps the frame
+// length under 255 units of 0.922 ms so it can be used as an RX timeout.
+#define TDMA_MAX_SLOT_COUNT 120
+
+// If we are less than this many getTicks() ticks away from the time we want to
+// transmit, we transmit right away instead of waiting.
+#define TDMA_EARLY_TICKS 15
+
+// A transmitter stops using TDMA if it has not heard a beacon in this many frames.
+#define TDMA_LOST_FRAMES 8
+
+// The length of the TDMA frame in getTicks() ticks (the beacon slot, the beacon sender's
+// data slot, and one slot for each transmitter).
+static uint16 XDATA tdmaFrameTicks;
+
+// The next two are computed in radioQueueInit() so that the ISR does not need to
+// multiply: SDCC's multiplication routines are not reentrant, so calling them from
+// an ISR could corrupt a multiplication in the main loop.
+
+// The time from the end of a beacon to the start of our slot, in getTicks() ticks.
+static uint16 XDATA tdmaSlotOffsetTicks;
+
+// TDMA_LOST_FRAMES frames, in getTicks() ticks.
+static uint16 XDATA tdmaLostTicks;
+
+// Beacon sender: the time to send the next beacon.
+// Transmitter: the start of our next slot.
+static uint16 XDATA tdmaNextTime;
+
+// The time we last received a beacon.
+static uint16 XDATA tdmaLastBeaconTime;
+
+// 1 if this transmitter has heard a beacon recently.
+static BIT tdmaSynchronized = 0;
+
+// 1 if the last packet sent was a beacon.
+static BIT tdmaBeaconSent = 0;
+
 /* GENERAL FUNCTIONS **********************************************************/
 
 void radioQueueInit()
@@ -71,6 +141,23 @@ void radioQueueInit()
     PKTLEN = RADIO_MAX_PACKET_SIZE;
     CHANNR = param_radio_channel;
 
+    if (radioQueueTdmaSlotCount > TDMA_MAX_SLOT_COUNT)
+    {
+        radioQueueTdmaSlotCount = TDMA_MAX_SLOT_COUNT;
+    }
+    if (radioQueueTdmaSlotCount)
+    {
+        radioQueueTdmaSlot %= radioQueueTdmaSlotCount;
+    }
+    // The slots are measured from the end of the beacon, so the beacon needs a slot
+    // of its own: without it, the last slot would end after the next beacon starts.
+    tdmaFrameTicks = (radioQueueTdmaSlotCount + 2) * TDMA_SLOT_TICKS;
+
+    // Our slot starts this many slots after the end of the beacon.  The first slot is
+    // left for the beacon sender's own data packet.
+    tdmaSlotOffsetTicks = (radioQueueTdmaSlot + 1) * TDMA_SLOT_TICKS;
+    tdmaLostTicks = TDMA_LOST_FRAMES * tdmaFrameTicks;
+
     radioMacInit();
     radioMacStrobe();
 }
@@ -118,8 +205,12 @@ void radioQueueTxSendPacket(void)
     }
 
     // Make sure that radioMacEventHandler runs soon so it can see this new data and send it.
-    // This must be done LAST.
-    radioMacStrobe();
+    // This must be done LAST: if the ISR runs before we read radioQueueTxIdle, it sees
+    // the new packet and does not wait for us.
+    if (radioQueueTxIdle)
+    {
+        radioMacStrobe();
+    }
 }
 
 /* RX FUNCTIONS (called by higher-level code in main loop) ********************/
@@ -147,21 +238,130 @@ void radioQueueRxDoneWithPacket(void)
 
 /* FUNCTIONS CALLED IN RF_ISR *************************************************/
 
+// Listens for packets until the specified number of getTicks() ticks have passed.
+static void tdmaListen(uint16 ticks)
+{
+    // Convert to units of 0.922 ms (29.5 ticks), rounding down so we wake up a little early.
+    // ticks/32 + ticks/512 + ticks/2048 is ticks/29.68.
+    uint8 units = (ticks >> 5) + (ticks >> 9) + (ticks >> 11);
+    radioMacRx(radioQueueRxPacket[radioQueueRxInterruptIndex], units ? units : 1);
+}
+
+// Called instead of the normal takeInitiative when this device is the TDMA beacon sender.
+static void tdmaBeaconSenderTakeInitiative()
+{
+    int16 remaining = tdmaNextTime - getTicks();
+
+    if (remaining <= TDMA_EARLY_TICKS)
+    {
+        // It is time to start a new frame.
+        if (remaining < -(int16)TDMA_SLOT_TICKS)
+        {
+            // We are very late (maybe we were receiving a packet), so start the schedule over.
+            tdmaNextTime = getTicks();
+        }
+        tdmaNextTime += tdmaFrameTicks;
+        tdmaBeaconSent = 1;
+        radioMacTx(beaconPacket);
+    }
+    else
+    {
+        tdmaListen(remaining);
+    }
+}
+
+// Called by takeInitiative when this device is a TDMA transmitter that heard a beacon recently.
+static void tdmaTransmitterTakeInitiative()
+{
+    int16 remaining;
+
+    if (radioQueueTxInterruptIndex == radioQueueTxMainLoopIndex)
+    {
+        // We have nothing to send.
+        radioQueueTxIdle = 1;
+        radioMacRx(radioQueueRxPacket[radioQueueRxInterruptIndex], 0);
+        return;
+    }
+
+    remaining = tdmaNextTime - getTicks();
+    while (remaining < -(int16)(TDMA_SLOT_TICKS / 2))
+    {
+        // Our slot has passed (or we are too far into it), so wait for the slot in the next frame.
+        tdmaNextTime += tdmaFrameTicks;
+        remaining += tdmaFrameTicks;
+    }
+
+    if (remaining <= TDMA_EARLY_TICKS)
+    {
+        tdmaNextTime += tdmaFrameTicks;  // Only send one packet per frame.
+        radioMacTx(radioQueueTxPacket[radioQueueTxInterruptIndex]);
+    }
+    else
+    {
+        tdmaListen(remaining);
+    }
+}
+
+// Called when we receive a TDMA beacon.
+static void tdmaRxBeacon()
+{
+    tdmaLastBeaconTime = getTicks();
+    tdmaSynchronized = 1;
+    tdmaNextTime = tdmaLastBeaconTime + tdmaSlotOffsetTicks;
+}
+
+// Returns 1 if we are following a TDMA schedule, so we should not use random delays.
+static BIT tdmaScheduled()
+{
+    return radioQueueTdmaSlotCount && (radioQueueTdmaBeaconSender || tdmaSynchronized);
+}
+
 static void takeInitiative()
 {
+    if (radioQueueTdmaSlotCount)
+    {
+        if (radioQueueTdmaBeaconSender)
+        {
+            tdmaBeaconSenderTakeInitiative();
+            return;
+        }
+
+        if (tdmaSynchronized && (uint16)(getTicks() - tdmaLastBeaconTime) > tdmaLostTicks)
+        {
+            // We have not heard a beacon in a long time, so go back to sending packets whenever we want.
+            tdmaSynchronized = 0;
+        }
+
+        if (tdmaSynchronized)
+        {
+            tdmaTransmitterTakeInitiative();
+            return;
+        }
+    }
+
     if (radioQueueTxInterruptIndex != radioQueueTxMainLoopIndex)
     {
         // Try to send the next data packet.
-        radioMacTx(radioQueueTxPacket[radioQueueTxInterruptIndex]);
+        if (radioQueueTxRepeatTime)
+        {
+            radioMacTxRepeated(radioQueueTxPacket[radioQueueTxInterruptIndex], radioQueueTxRepeatTime);
+        }
+        else
+        {
+            radioMacTx(radioQueueTxPacket[radioQueueTxInterruptIndex]);
+        }
     }
     else
     {
+        radioQueueTxIdle = 1;
         radioMacRx(radioQueueRxPacket[radioQueueRxInterruptIndex], 0);
     }
 }
 
 void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
 {
+    radioQueueTxIdle = 0;
+
     if (event == RADIO_MAC_EVENT_STROBE)
     {
         takeInitiative();
@@ -169,6 +369,21 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
     }
     else if (event == RADIO_MAC_EVENT_TX)
     {
+        if (tdmaBeaconSent)
+        {
+            tdmaBeaconSent = 0;
+            if (radioQueueTxInterruptIndex != radioQueueTxMainLoopIndex)
+            {
+                // Send one of our own data packets in the first slot of the frame.
+                radioMacTx(radioQueueTxPacket[radioQueueTxInterruptIndex]);
+            }
+            else
+            {
+                takeInitiative();
+            }
+            return;
+        }
+
         // Give ownership of the current TX packet back to the main loop by updated radioQueueTxInterruptIndex.
         if (radioQueueTxInterruptIndex == TX_PACKET_COUNT - 1)
         {
@@ -179,6 +394,13 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
             radioQueueTxInterruptIndex++;
         }
 
+        if (tdmaScheduled())
+        {
+            // In TDMA mode, we already know when we can send next.
+            takeInitiative();
+            return;
+        }
+
         // We sent a packet, so now let's give another party a chance to talk.
         radioMacRx(radioQueueRxPacket[radioQueueRxInterruptIndex], randomTxDelay());
         return;
@@ -189,18 +411,31 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
 
         if (!radioQueueAllowCrcErrors && !radioCrcPassed())
         {
-            if (radioQueueTxInterruptIndex != radioQueueTxMainLoopIndex)
+            if (tdmaScheduled())
+            {
+                takeInitiative();
+            }
+            else if (radioQueueTxInterruptIndex != radioQueueTxMainLoopIndex)
             {
                 radioMacRx(currentRxPacket, randomTxDelay());
             }
             else
             {
+                radioQueueTxIdle = 1;
                 radioMacRx(currentRxPacket, 0);
             }
             return;
         }
 
-        if (currentRxPacket[RADIO_QUEUE_PACKET_LENGTH_OFFSET] > 0)
+        if (currentRxPacket[RADIO_QUEUE_PACKET_LENGTH_OFFSET] == 0)
+        {
+            // We received a TDMA beacon.
+            if (radioQueueTdmaSlotCount && !radioQueueTdmaBeaconSender && radioCrcPassed())
+            {
+                tdmaRxBeacon();
+            }
+        }
+        else
         {
             // We received a packet that contains actual data.
 
@@ -1,6 +1,84 @@
 #include <radio_registers.h>
 #include <cc2511_map.h>
 
+// The registers that are different in each data rate profile.
+typedef struct RADIO_PROFILE
+{
+    uint8 fsctrl1;
+    uint8 mdmcfg4;
+    uint8 mdmcfg3;
+    uint8 mdmcfg2;
+    uint8 deviatn;
+    uint8 foccfg;
+    uint8 bscfg;
+    uint8 agcctrl2;
+    uint8 agcctrl1;
+    uint8 agcctrl0;
+    uint8 frend1;
+    int8 rssiOffset;
+} RADIO_PROFILE;
+
+// Data rate = (256 + MDMCFG3) * 2^(MDMCFG4 & 0xF) * 24 MHz / 2^28
+// Channel bandwidth = 24 MHz / (8 * (4 + (MDMCFG4 >> 4 & 3)) * 2^(MDMCFG4 >> 6))
+// FREQ_IF = 24 MHz / 2^10 * FSCTRL1
+// The RSSI offsets come from Table 68 of the CC2511F32 datasheet.
+// DEVIATN has no effect with MSK, so the MSK profiles leave it at its reset value.
+// FOCCFG, BSCFG, AGCCTRL2-0 and FREND1 are the values SmartRF Studio recommends
+// for high data rates (the MSK profiles) and for low data rates (the GFSK profile):
+// the low rate settings use a narrower frequency offset compensation loop, a
+// slower bit synchronization loop, and AGC settings suited to a narrow channel.
+static RADIO_PROFILE CODE profiles[RADIO_PROFILE_COUNT] =
+{
+    // FSCTRL1 MDMCFG4 MDMCFG3 MDMCFG2 DEVIATN FOCCFG BSCFG AGCCTRL2 AGCCTRL1 AGCCTRL0 FREND1 RSSI offset
+    {  0x12,   0x0E,   0x55,   0x73,   0x47,   0x1D,  0x1C, 0xC7,    0x00,    0xB2,    0xB6,  72 },  // 500 kbps MSK, 750 kHz bandwidth, IF = 422 kHz
+    {  0x0A,   0x1D,   0xDE,   0x73,   0x47,   0x1D,  0x1C, 0xC7,    0x00,    0xB2,    0xB6,  71 },  // 350 kbps MSK, 600 kHz bandwidth, IF = 234 kHz
+    {  0x0A,   0x2D,   0x55,   0x73,   0x47,   0x1D,  0x1C, 0xC7,    0x00,    0xB2,    0xB6,  71 },  // 250 kbps MSK, 500 kHz bandwidth, IF = 234 kHz
+    {  0x08,   0x5C,   0x11,   0x73,   0x47,   0x1D,  0x1C, 0xC7,    0x00,    0xB2,    0xB6,  71 },  // 100 kbps MSK, 300 kHz bandwidth, IF = 188 kHz
+    {  0x06,   0xB8,   0xB5,   0x13,   0x45,   0x16,  0x6C, 0x43,    0x40,    0x91,    0x56,  69 },  // 10 kbps GFSK, 107 kHz bandwidth, IF = 141 kHz, deviation = 38 kHz
+};
+
+uint8 radioProfile = RADIO_PROFILE_350K;
+
+void radioSetProfile(uint8 profile)
+{
+    RADIO_PROFILE CODE * p = &profiles[profile];
+
+    radioProfile = profile;
+
+    // Controls the FREQ_IF used for RX.
+    // This is affected by MDMCFG2.DEM_DCFILT_OFF according to p.212 of datasheet.
+    FSCTRL1 = p->fsctrl1;  // Frequency Synthesizer Control
+
+    // Sets the data rate (symbol rate) used in TX and RX.  See Sec 13.5 of the datasheet.
+    // Also sets the channel bandwidth.
+    MDMCFG4 = p->mdmcfg4;
+    MDMCFG3 = p->mdmcfg3;
+
+    // MDMCFG2.DEM_DCFILT_OFF = 0, enable digital DC blocking filter before
+    //   demodulator.  This affects the FREQ_IF according to p.212 of datasheet.
+    // MDMCFC2.MANCHESTER_EN = 0 is required because we are using MSK (see Sec 13.9.2)
+    // MDMCFG2.MOD_FORMAT = 111: MSK modulation (001: GFSK in the 10 kbps profile)
+    // MDMCFG2.SYNC_MODE = 111: Strictest requirements for receiving a packet.
+    MDMCFG2 = p->mdmcfg2;
+
+    DEVIATN = p->deviatn;  // Modem Deviation Setting.  See Sec 13.9.
+
+    // F0CFG and BSCFG configure details of the PID loop used to correct the
+    // bit rate and frequency of the signal (RX only I believe).
+    FOCCFG = p->foccfg;  // Frequency Offset Compensation Configuration
+    BSCFG = p->bscfg;    // Bit Synchronization Configuration
+
+    // AGC Control:
+    // This affects many things, including:
+    //    Carrier Sense Absolute Threshold (Sec 13.10.5).
+    //    Carrier Sense Relative Threshold (Sec 13.10.6).
+    AGCCTRL2 = p->agcctrl2;
+    AGCCTRL1 = p->agcctrl1;
+    AGCCTRL0 = p->agcctrl0;
+
+    FREND1 = p->frend1;  // Front End RX Configuration (adjusts various things, not well documented)
+}
+
 void radioRegistersInit()
 {
     // Transmit power: one of the highest settings, but not the highest.
@@ -15,7 +93,7 @@ void radioRegistersInit()
     // Note: We had to modify MDMCFG1 from the settings given by
     // SmartRF Studio to be compatible with the datasheet.
     // (NUM_PREAMBLE should be 8 at 500 kbps and having it be high is a good idea in general).
-    // MDMCFG1.FEC_EN = 0 : Disable Forward Error Correction
+    // MDMCFG1.FEC_EN = 0 : Disable Forward Error Correction (see radioMacSetFec).
     // MDMCFG1.NUM_PREAMBLE = 100 : Minimum number of preamble bytes is 8.
     // MDMCFG1.CHANSPC_E = 11 : Channel spacing exponent.
     // MDMCFG0.CHANSPC_M = 0x87 : Channel spacing mantissa.
@@ -26,43 +104,18 @@ void radioRegistersInit()
     MDMCFG1 = 0x43;
     MDMCFG0 = 0x87;  // Modem Configuration
 
-    // Controls the FREQ_IF used for RX.
-    // This is affected by MDMCFG2.DEM_DCFILT_OFF according to p.212 of datasheet.
-    FSCTRL1 = 0x0A;  // Frequency Synthesizer Control
     FSCTRL0 = 0x00;  // Frequency Synthesizer Control
 
-    // Sets the data rate (symbol rate) used in TX and RX.  See Sec 13.5 of the datasheet.
-    // Also sets the channel bandwidth.
+    // Sets FSCTRL1, MDMCFG4, MDMCFG3, MDMCFG2, DEVIATN, FOCCFG, BSCFG, AGCCTRL2-0, and FREND1.
     // We tried different data rates: 375 kbps was pretty good, but 400 kbps and above caused lots of packet errors.
-    // NOTE: If you change this, you must change RSSI_OFFSET in radio_registers.h
-    MDMCFG4 = 0x1D;  MDMCFG3 = 0xDE; // Modem configuration (data rate = 350 kbps, bandwidth = 600 kHz).
+    if (radioProfile >= RADIO_PROFILE_COUNT)
+    {
+        radioProfile = RADIO_PROFILE_350K;
+    }
+    radioSetProfile(radioProfile);
 
-    // MDMCFG2.DEM_DCFILT_OFF = 0, enable digital DC blocking filter before
-    //   demodulator.  This affects the FREQ_IF according to p.212 of datasheet.
-    // MDMCFC2.MANCHESTER_EN = 0 is required because we are using MSK (see Sec 13.9.2)
-    // MDMCFG2.MOD_FORMAT = 111: MSK modulation
-    // MDMCFG2.SYNC_MODE = 111: Strictest requirements for receiving a packet.
-    MDMCFG2 = 0x73;  // Modem Configuration
-
-    //DEVIATN = 0x00;  // Modem Deviation Setting.  No effect because we are using MSK.
-    // See Sec 13.9.2.
-
-    FREND1 = 0xB6;   // Front End RX Configuration (adjusts various things, not well documented)
     FREND0 = 0x10;   // Front End TX Configuration (adjusts current TX LO buffer, not well documented)
 
-    // F0CFG and BSCFG configure details of the PID loop used to correct the
-    // bit rate and frequency of the signal (RX only I believe).
-    FOCCFG = 0x1D;  // Frequency Offset Compensation Configuration
-    BSCFG = 0x1C;   // Bit Synchronization Configuration
-
-    // AGC Control:
-    // This affects many things, including:
-    //    Carrier Sense Absolute Threshold (Sec 13.10.5).
-    //    Carrier Sense Relative Threshold (Sec 13.10.6).
-    AGCCTRL2 = 0xC7;
-    AGCCTRL1 = 0x00;
-    AGCCTRL0 = 0xB2;
-
     // Frequency Synthesizer registers that are not fully documented.
     FSCAL3 = 0xEA;
     FSCAL2 = 0x0A;
@@ -92,5 +145,5 @@ uint8 radioLqi()
 
 int8 radioRssi()
 {
-    return ((int8)RSSI)/2 - RSSI_OFFSET;
+    return ((int8)RSSI)/2 - profiles[radioProfile].rssiOffset;
 }
@@ -5,6 +5,7 @@
 
 #include <cc2511_map.h>
 #include <cc2511_types.h>
+#include <dma.h>
 
 #if defined(__CDT_PARSER__)
 #define SPI0
@@ -19,6 +20,8 @@
 #define UNGCR                       U0GCR
 #define UNBAUD                      U0BAUD
 #define UNDBUF                      U0DBUF
+#define DMA_TRIGGER_URX             14
+#define spiNMasterDmaMode           spi0MasterDmaMode
 #define spiNMasterInit              spi0MasterInit
 #define spiNMasterSetFrequency      spi0MasterSetFrequency
 #define spiNMasterSetClockPolarity  spi0MasterSetClockPolarity
@@ -39,6 +42,8 @@
 #define UNGCR                       U1GCR
 #define UNBAUD                      U1BAUD
 #define UNDBUF                      U1DBUF
+#define DMA_TRIGGER_URX             16
+#define spiNMasterDmaMode           spi1MasterDmaMode
 #define spiNMasterInit              spi1MasterInit
 #define spiNMasterSetFrequency      spi1MasterSetFrequency
 #define spiNMasterSetClockPolarity  spi1MasterSetClockPolarity
@@ -51,15 +56,39 @@
 #define spiNMasterReceiveByte       spi1MasterReceiveByte
 #endif
 
-// txPointer points to the last byte that was written to SPI.
+// txPointer points to the last byte that was written to SPI, or 0 if we are sending 0xFF.
+// In DMA mode, it points to the first byte of the current chunk instead.
 static volatile const uint8 XDATA * DATA txPointer = 0;
 
-// rxPointer points to the location to store the next byte received from SPI.
+// rxPointer points to the location to store the next byte received from SPI, or 0 if
+// received bytes are being discarded.
+// In DMA mode, it points to the location of the first byte of the current chunk instead.
 static volatile uint8 XDATA * DATA rxPointer = 0;
 
 // bytesLeft is the number of bytes we still need to send to/receive from SPI.
+// In DMA mode, this includes the whole current chunk.
 static volatile uint16 DATA bytesLeft = 0;
 
+// DMA mode:
+// The RX channel copies each received byte from UNDBUF to the RX buffer, and the
+// TX channel copies the next byte from the TX buffer to UNDBUF.  Both are
+// triggered when a byte is received, so a new byte is never written before the
+// previous one has been received.  The CPU writes the first byte of each chunk.
+// The DMA controller can only do 8191 bytes at once, so longer transfers are
+// split into chunks.  The RX channel's DMA interrupt runs spiDmaChunkDone at
+// the end of each chunk, and it starts the next one.
+#define SPI_DMA_MAX_CHUNK 8191
+
+BIT spiNMasterDmaMode = 0;
+
+static uint8 XDATA spiRxDmaChannel;   // 0 if DMA mode is not being used.
+static uint8 XDATA spiTxDmaChannel;
+static uint16 XDATA spiDmaChunk;      // The size of the current chunk.
+static uint8 XDATA spiDmaDummy;       // The RX channel writes here if the received bytes are being discarded.
+static uint8 CODE spiDmaFF = 0xFF;    // The TX channel reads from here if no TX buffer was specified.
+
+static void spiDmaChunkDone(void) __reentrant;
+
 void spiNMasterInit(void)
 {
     /* From datasheet Table 50 */
@@ -113,6 +142,85 @@ void spiNMasterInit(void)
 
     URXNIF = 0; // Clear RX flag.
     EA = 1;     // Enable interrupts in general.
+
+    if (spiNMasterDmaMode && !spiRxDmaChannel)
+    {
+        spiRxDmaChannel = dmaAllocateChannel();
+        spiTxDmaChannel = dmaAllocateChannel();
+        if (!spiRxDmaChannel || !spiTxDmaChannel)
+        {
+            // We could not get both channels, so use the interrupt instead.
+            if (spiRxDmaChannel){ dmaFreeChannel(spiRxDmaChannel); }
+            if (spiTxDmaChannel){ dmaFreeChannel(spiTxDmaChannel); }
+            spiRxDmaChannel = spiTxDmaChannel = 0;
+        }
+        else
+        {
+            dmaSetChannelHandler(spiRxDmaChannel, spiDmaChunkDone);
+        }
+    }
+}
+
+// Called from spiNMasterTransfer and from the DMA interrupt.
+static void spiDmaStartChunk(void) __reentrant
+{
+    volatile DMA_CONFIG XDATA * config;
+    uint16 address;
+
+    spiDmaChunk = bytesLeft;
+    if (spiDmaChunk > SPI_DMA_MAX_CHUNK)
+    {
+        spiDmaChunk = SPI_DMA_MAX_CHUNK;
+    }
+
+    // RX channel: UNDBUF -> rxPointer.
+    address = rxPointer ? (uint16)rxPointer : (uint16)&spiDmaDummy;
+    config = dmaChannelConfig(spiRxDmaChannel);
+    config->SRCADDRH = XDATA_SFR_ADDRESS(UNDBUF) >> 8;
+    config->SRCADDRL = XDATA_SFR_ADDRESS(UNDBUF);
+    config->DESTADDRH = address >> 8;
+    config->DESTADDRL = address;
+    config->VLEN_LENH = spiDmaChunk >> 8;
+    config->LENL = spiDmaChunk;
+    config->DC6 = DMA_TRIGGER_URX;  // WORDSIZE = 0, TMODE = 0 (single), TRIG = URXN
+    config->DC7 = rxPointer ? 0x1A : 0x0A;  // SRCINC = 0, DESTINC = 1 (or 0), IRQMASK = 1, M8 = 0, PRIORITY = 2 (high)
+    DMAARM |= (1<<spiRxDmaChannel);
+
+    if (spiDmaChunk > 1)
+    {
+        // TX channel: the rest of the chunk -> UNDBUF.
+        address = txPointer ? (uint16)(txPointer + 1) : (uint16)&spiDmaFF;
+        config = dmaChannelConfig(spiTxDmaChannel);
+        config->SRCADDRH = address >> 8;
+        config->SRCADDRL = address;
+        config->DESTADDRH = XDATA_SFR_ADDRESS(UNDBUF) >> 8;
+        config->DESTADDRL = XDATA_SFR_ADDRESS(UNDBUF);
+        config->VLEN_LENH = (spiDmaChunk - 1) >> 8;
+        config->LENL = (spiDmaChunk - 1);
+        config->DC6 = DMA_TRIGGER_URX;  // WORDSIZE = 0, TMODE = 0 (single), TRIG = URXN
+        config->DC7 = txPointer ? 0x41 : 0x01;  // SRCINC = 1 (or 0), DESTINC = 0, IRQMASK = 0, M8 = 0, PRIORITY = 1 (assured)
+        DMAARM |= (1<<spiTxDmaChannel);
+    }
+
+    // The DMA controller takes 9 cycles to load the configuration after the channel is armed.
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+
+    UNDBUF = txPointer ? *txPointer : 0xFF; // transmit first byte
+}
+
+// Called from the DMA interrupt when the RX channel finishes the current chunk.
+static void spiDmaChunkDone(void) __reentrant
+{
+    bytesLeft -= spiDmaChunk;
+    if (txPointer){ txPointer += spiDmaChunk; }
+    if (rxPointer){ rxPointer += spiDmaChunk; }
+
+    if (bytesLeft)
+    {
+        spiDmaStartChunk();
+    }
 }
 
 void spiNMasterSetFrequency(uint32 freq)
@@ -184,6 +292,10 @@ void spiNMasterSetBitOrder(BIT bitOrder)
 
 BIT spiNMasterBusy(void)
 {
+    if (spiRxDmaChannel)
+    {
+        return spiNMasterBytesLeft() != 0;
+    }
     return URXNIE;
 }
 
@@ -191,6 +303,15 @@ uint16 spiNMasterBytesLeft(void)
 {
     uint16 bytes;
 
+    if (spiRxDmaChannel)
+    {
+        // The DMA interrupt updates bytesLeft at the end of each chunk.
+        DMAIE = 0;
+        bytes = bytesLeft;
+        DMAIE = 1;
+        return bytes;
+    }
+
     // bytesLeft is 16 bits, so it takes more than one instruction to read. Disable interrupts so it's not updated while we do this
     URXNIE = 0;
     bytes = bytesLeft;
@@ -207,23 +328,26 @@ void spiNMasterTransfer(const uint8 XDATA * txBuffer, uint8 XDATA * rxBuffer, ui
         rxPointer = rxBuffer;
         bytesLeft = size;
 
-        UNDBUF = *txBuffer; // transmit first byte
+        if (spiRxDmaChannel)
+        {
+            spiDmaStartChunk();
+            return;
+        }
+
+        UNDBUF = txBuffer ? *txBuffer : 0xFF; // transmit first byte
         URXNIE = 1;         // Enable RX interrupt.
     }
 }
 
 uint8 spiNMasterSendByte(uint8 XDATA byte)
 {
-    uint8 XDATA rxByte;
-
-    rxPointer = &rxByte;
-    bytesLeft = 1;
-
+    // The RX interrupt is disabled while no transfer is in progress, so we
+    // can just wait for the flag instead of taking an interrupt.
+    URXNIF = 0;
     UNDBUF = byte;
-    URXNIE = 1; // Enable RX interrupt.
-
-    while (bytesLeft);
-    return rxByte;
+    while (!URXNIF);
+    URXNIF = 0;
+    return UNDBUF;
 }
 
 uint8 spiNMasterReceiveByte(void)
@@ -233,16 +357,29 @@ uint8 spiNMasterReceiveByte(void)
 
 ISR_URX()
 {
+    uint8 rxByte;
+
     URXNIF = 0;
 
-    *rxPointer = UNDBUF;
-    rxPointer++;
+    rxByte = UNDBUF;
+    if (rxPointer)
+    {
+        *rxPointer = rxByte;
+        rxPointer++;
+    }
     bytesLeft--;
 
     if (bytesLeft)
     {
-        txPointer++;
-        UNDBUF = *txPointer;
+        if (txPointer)
+        {
+            txPointer++;
+            UNDBUF = *txPointer;
+        }
+        else
+        {
+            UNDBUF = 0xFF;
+        }
     }
     else
     {
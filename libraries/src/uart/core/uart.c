@@ -5,6 +5,8 @@
 
 #include <cc2511_map.h>
 #include <cc2511_types.h>
+#include <dma.h>
+#include <time.h>
 
 #if defined(__CDT_PARSER__)
 #define UART0
@@ -24,6 +26,16 @@
 #define UNBAUD                      U0BAUD
 #define UNDBUF                      U0DBUF
 #define BV_UTXNIE                   (1<<2)
+#define DMA_TRIGGER_URX             14
+#define DMA_TRIGGER_UTX             15
+#define uartNDmaMode                uart0DmaMode
+#define UART_RTS                    P0_5
+#define UART_CTS                    P0_4
+#define UART_RTS_DIR                P0DIR
+#define BV_UART_RTS                 (1<<5)
+#define uartNSetFlowControl         uart0SetFlowControl
+#define uartNSetRxFrameTimeout      uart0SetRxFrameTimeout
+#define uartNRxFrameComplete        uart0RxFrameComplete
 #define uartNRxParityErrorOccurred  uart0RxParityErrorOccurred
 #define uartNRxFramingErrorOccurred uart0RxFramingErrorOccurred
 #define uartNRxBufferFullOccurred   uart0RxBufferFullOccurred
@@ -35,6 +47,11 @@
 #define uartNSetStopBits            uart0SetStopBits
 #define uartNTxSend                 uart0TxSend
 #define uartNRxReceiveByte          uart0RxReceiveByte
+#define uartNRxReceive              uart0RxReceive
+#define uartNRxPeek                 uart0RxPeek
+#define uartNRxBuffer               uart0RxBuffer
+#define uartNRxBufferAvailable      uart0RxBufferAvailable
+#define uartNRxConsume              uart0RxConsume
 #define uartNTxSend                 uart0TxSend
 #define uartNTxSendByte             uart0TxSendByte
 
@@ -52,6 +69,16 @@
 #define UNBAUD                      U1BAUD
 #define UNDBUF                      U1DBUF
 #define BV_UTXNIE                   (1<<3)
+#define DMA_TRIGGER_URX             16
+#define DMA_TRIGGER_UTX             17
+#define uartNDmaMode                uart1DmaMode
+#define UART_RTS                    P1_5
+#define UART_CTS                    P1_4
+#define UART_RTS_DIR                P1DIR
+#define BV_UART_RTS                 (1<<5)
+#define uartNSetFlowControl         uart1SetFlowControl
+#define uartNSetRxFrameTimeout      uart1SetRxFrameTimeout
+#define uartNRxFrameComplete        uart1RxFrameComplete
 #define uartNRxParityErrorOccurred  uart1RxParityErrorOccurred
 #define uartNRxFramingErrorOccurred uart1RxFramingErrorOccurred
 #define uartNRxBufferFullOccurred   uart1RxBufferFullOccurred
@@ -63,27 +90,280 @@
 #define uartNSetStopBits            uart1SetStopBits
 #define uartNTxSend                 uart1TxSend
 #define uartNRxReceiveByte          uart1RxReceiveByte
+#define uartNRxReceive              uart1RxReceive
+#define uartNRxPeek                 uart1RxPeek
+#define uartNRxBuffer               uart1RxBuffer
+#define uartNRxBufferAvailable      uart1RxBufferAvailable
+#define uartNRxConsume              uart1RxConsume
 #define uartNTxSend                 uart1TxSend
 #define uartNTxSendByte             uart1TxSendByte
 #endif
 
-static volatile uint8 XDATA uartTxBuffer[256];         // sizeof(uartTxBuffer) must be a power of two
-static volatile uint8 DATA uartTxBufferMainLoopIndex;  // Index of next byte main loop will write.
-static volatile uint8 DATA uartTxBufferInterruptIndex; // Index of next byte interrupt will read.
+// The sizes of the buffers can be changed by adding -DUART_TX_BUFFER_SIZE=N
+// and -DUART_RX_BUFFER_SIZE=N to the C_FLAGS in lib_options.mk.
+// Each size must be a power of two from 2 to 1024.
+#ifndef UART_TX_BUFFER_SIZE
+#define UART_TX_BUFFER_SIZE 256
+#endif
+
+#ifndef UART_RX_BUFFER_SIZE
+#define UART_RX_BUFFER_SIZE 256
+#endif
+
+#if (UART_TX_BUFFER_SIZE & (UART_TX_BUFFER_SIZE - 1)) || UART_TX_BUFFER_SIZE < 2 || UART_TX_BUFFER_SIZE > 1024
+#error UART_TX_BUFFER_SIZE must be a power of two from 2 to 1024.
+#endif
+
+#if (UART_RX_BUFFER_SIZE & (UART_RX_BUFFER_SIZE - 1)) || UART_RX_BUFFER_SIZE < 2 || UART_RX_BUFFER_SIZE > 1024
+#error UART_RX_BUFFER_SIZE must be a power of two from 2 to 1024.
+#endif
+
+// Buffers bigger than 256 bytes need 16-bit indices.  The main loop can not
+// read or write a 16-bit index in one instruction, so it disables the
+// interrupt that shares the index while it accesses it.
+#if UART_TX_BUFFER_SIZE > 256
+#define UART_TX_INDEX               uint16
+#define UART_TX_LOCK()              { uartTxInterruptEnabled = IEN2 & BV_UTXNIE; IEN2 &= ~BV_UTXNIE; }
+#define UART_TX_UNLOCK()            { IEN2 |= uartTxInterruptEnabled; }
+static uint8 DATA uartTxInterruptEnabled;
+#else
+#define UART_TX_INDEX               uint8
+#define UART_TX_LOCK()
+#define UART_TX_UNLOCK()
+#endif
+
+#if UART_RX_BUFFER_SIZE > 256
+#define UART_RX_INDEX               uint16
+#define UART_RX_LOCK()              { uartRxInterruptEnabled = URXNIE; URXNIE = 0; }
+#define UART_RX_UNLOCK()            { URXNIE = uartRxInterruptEnabled; }
+static BIT uartRxInterruptEnabled;
+#else
+#define UART_RX_INDEX               uint8
+#define UART_RX_LOCK()
+#define UART_RX_UNLOCK()
+#endif
+
+// Flow control: when the number of free bytes in the RX buffer drops below
+// UART_RX_STOP_FREE_BYTES, we drive RTS high to ask the other device to
+// stop sending.  We drive it low again when the main loop has made at least
+// UART_RX_RESUME_FREE_BYTES free.  The margin allows for devices that send
+// a few more bytes after RTS goes high.
+#define UART_RX_STOP_FREE_BYTES     (UART_RX_BUFFER_SIZE / 8)
+#define UART_RX_RESUME_FREE_BYTES   (UART_RX_BUFFER_SIZE / 4)
+
+// With flow control in DMA mode, CTS is only checked between segments, so
+// segments are limited to this length.
+#define UART_TX_FLOW_CONTROL_DMA_SEGMENT 16
+
+static volatile uint8 XDATA uartTxBuffer[UART_TX_BUFFER_SIZE];
+static volatile UART_TX_INDEX DATA uartTxBufferMainLoopIndex;  // Index of next byte main loop will write.
+static volatile UART_TX_INDEX DATA uartTxBufferInterruptIndex; // Index of next byte interrupt will read.
 
 #define UART_TX_BUFFER_FREE_BYTES() ((uartTxBufferInterruptIndex - uartTxBufferMainLoopIndex - 1) & (sizeof(uartTxBuffer) - 1))
 
-static volatile uint8 XDATA uartRxBuffer[256];     // sizeof(uartRxBuffer) must be a power of two
-static volatile uint8 DATA uartRxBufferMainLoopIndex;  // Index of next byte main loop will read.
-static volatile uint8 DATA uartRxBufferInterruptIndex; // Index of next byte interrupt will write.
+static volatile uint8 XDATA uartRxBuffer[UART_RX_BUFFER_SIZE];
+static volatile UART_RX_INDEX DATA uartRxBufferMainLoopIndex;  // Index of next byte main loop will read.
+static volatile UART_RX_INDEX DATA uartRxBufferInterruptIndex; // Index of next byte interrupt will write.
+
+static volatile BIT uartFlowControl;   // 1 if RTS/CTS flow control is enabled.
 
 #define UART_RX_BUFFER_FREE_BYTES() ((uartRxBufferMainLoopIndex - uartRxBufferInterruptIndex - 1) & (sizeof(uartRxBuffer) - 1))
 #define UART_RX_BUFFER_USED_BYTES() ((uartRxBufferInterruptIndex - uartRxBufferMainLoopIndex) & (sizeof(uartRxBuffer) - 1))
 
+// DMA mode:
+// The RX data channel copies each received byte from UNDBUF into uartRxBuffer.
+// The CC2511's DMA controller has no register that tells us how far a channel
+// has gotten, so the RX index channel runs on the same trigger and copies the
+// next entry of uartDmaRxIndexTable into uartRxDmaIndex.  Both channels use
+// repeated single mode with a length of 256, so they wrap around together.
+// This only works if UART_RX_BUFFER_SIZE is 256.
+// The TX channel sends one contiguous segment of uartTxBuffer at a time;
+// uartTxDmaService starts the next segment when the previous one is done.
+static uint8 XDATA uartRxDmaChannel;       // 0 if DMA mode is not being used.
+static uint8 XDATA uartRxIndexDmaChannel;
+static uint8 XDATA uartTxDmaChannel;
+static volatile uint8 XDATA uartRxDmaIndex; // Index of next byte the RX data channel will write.
+static uint16 XDATA uartTxDmaLength;        // Length of the segment being sent by the TX channel, or 0.
+static BIT uartTxDmaStarted;                // 1 if the TX channel has written any bytes to UNDBUF.
+
+#if UART_RX_BUFFER_SIZE == 256
+#define UART_DMA_SUPPORTED
+#endif
+
+#ifdef UART_DMA_SUPPORTED
+
+// uartDmaRxIndexTable[i] == (i + 1) % 256.  The DMA controller can read this
+// from flash because flash is mapped into the XDATA memory space.
+#define UART_INDEX_ROW(n) (n)+1,(n)+2,(n)+3,(n)+4,(n)+5,(n)+6,(n)+7,(n)+8, \
+    (n)+9,(n)+10,(n)+11,(n)+12,(n)+13,(n)+14,(n)+15,((n)+16) & 0xFF
+static uint8 CODE uartDmaRxIndexTable[256] =
+{
+    UART_INDEX_ROW(0),   UART_INDEX_ROW(16),  UART_INDEX_ROW(32),  UART_INDEX_ROW(48),
+    UART_INDEX_ROW(64),  UART_INDEX_ROW(80),  UART_INDEX_ROW(96),  UART_INDEX_ROW(112),
+    UART_INDEX_ROW(128), UART_INDEX_ROW(144), UART_INDEX_ROW(160), UART_INDEX_ROW(176),
+    UART_INDEX_ROW(192), UART_INDEX_ROW(208), UART_INDEX_ROW(224), UART_INDEX_ROW(240),
+};
+#endif
+
+BIT uartNDmaMode = 0;
+
+// Frame detection: the RX interrupt records the time of each byte it receives
+// as the low byte of timeMs and the value of T4CNT.  The main loop turns that
+// into a number of Timer 4 ticks (188 per millisecond) and compares it to the
+// current time.  Only 256 ms worth of ticks fit in the timestamp, so the
+// timeout is limited to UART_FRAME_TIMEOUT_MAX_TICKS.
+#define UART_TICKS_PER_MS             188
+#define UART_TICKS_PERIOD             (256 * (uint16)UART_TICKS_PER_MS)
+#define UART_FRAME_TIMEOUT_MAX_TICKS  40000
+#define UART_T4_FREQUENCY             187500
+
+// Reads the low byte of timeMs and T4CNT consistently.  If the timer has
+// overflowed but its interrupt has not run yet (because we are in a
+// higher-priority interrupt or interrupts are disabled), the low byte is
+// corrected.  The loop only repeats if the Timer 4 interrupt ran in between.
+#define UART_READ_TIME(ms, cnt) do { \
+        ms = timeMs; cnt = T4CNT; \
+    } while (ms != (uint8)timeMs); \
+    if (T4IF && cnt < UART_TICKS_PER_MS / 2){ ms++; }
+
+static uint32 XDATA uartBaudRate;            // 0 if uartNSetBaudRate has not been called.
+static uint8 XDATA uartFrameTimeoutCharacters;
+static uint16 XDATA uartFrameTimeoutTicks;   // 0 if frame detection is disabled.
+static volatile uint8 DATA uartRxLastByteMs;
+static volatile uint8 DATA uartRxLastByteCnt;
+static volatile BIT uartRxFrameActive;       // 1 if bytes were received since the last frame ended.
+static BIT uartRxFrameDetection;             // 1 if uartFrameTimeoutTicks is not 0.
+
 volatile BIT uartNRxParityErrorOccurred;
 volatile BIT uartNRxFramingErrorOccurred;
 volatile BIT uartNRxBufferFullOccurred;
 
+static void uartDmaConfigure(uint8 channel, uint16 src, uint16 dest, uint16 length, uint8 dc6, uint8 dc7)
+{
+    volatile DMA_CONFIG XDATA * config = dmaChannelConfig(channel);
+    config->SRCADDRH = src >> 8;
+    config->SRCADDRL = src;
+    config->DESTADDRH = dest >> 8;
+    config->DESTADDRL = dest;
+    config->VLEN_LENH = length >> 8;
+    config->LENL = length;
+    config->DC6 = dc6;
+    config->DC7 = dc7;
+}
+
+#ifdef UART_DMA_SUPPORTED
+// Reserves the three DMA channels used in DMA mode, or none of them if they are not all free.
+static void uartDmaAllocate(void)
+{
+    uartRxDmaChannel = dmaAllocateChannel();
+    uartRxIndexDmaChannel = dmaAllocateChannel();
+    uartTxDmaChannel = dmaAllocateChannel();
+
+    if (!uartRxDmaChannel || !uartRxIndexDmaChannel || !uartTxDmaChannel)
+    {
+        if (uartRxDmaChannel){ dmaFreeChannel(uartRxDmaChannel); }
+        if (uartRxIndexDmaChannel){ dmaFreeChannel(uartRxIndexDmaChannel); }
+        if (uartTxDmaChannel){ dmaFreeChannel(uartTxDmaChannel); }
+        uartRxDmaChannel = uartRxIndexDmaChannel = uartTxDmaChannel = 0;
+    }
+}
+
+static void uartDmaInit(void)
+{
+    // Stop any transfers left over from a previous call to uartNInit.
+    DMAARM = 0x80 | (1<<uartRxDmaChannel) | (1<<uartRxIndexDmaChannel) | (1<<uartTxDmaChannel);
+
+    uartRxDmaIndex = 0;
+    uartTxDmaLength = 0;
+    uartTxDmaStarted = 0;
+
+    // RX data channel: UNDBUF -> uartRxBuffer.
+    // WORDSIZE = 0, TMODE = 3 (repeated single), TRIG = URXN.
+    // SRCINC = 0, DESTINC = 1, IRQMASK = 0, M8 = 0, PRIORITY = 2 (high).
+    uartDmaConfigure(uartRxDmaChannel, XDATA_SFR_ADDRESS(UNDBUF), (uint16)uartRxBuffer,
+        sizeof(uartRxBuffer), 0x60 | DMA_TRIGGER_URX, 0x12);
+
+    // RX index channel: uartDmaRxIndexTable -> uartRxDmaIndex.
+    // This has a lower priority than the data channel so that the index never
+    // gets updated before the byte it refers to is in the buffer.
+    // SRCINC = 1, DESTINC = 0, IRQMASK = 0, M8 = 0, PRIORITY = 1 (assured).
+    uartDmaConfigure(uartRxIndexDmaChannel, (uint16)uartDmaRxIndexTable, (uint16)&uartRxDmaIndex,
+        sizeof(uartDmaRxIndexTable), 0x60 | DMA_TRIGGER_URX, 0x41);
+
+    DMAARM |= (1<<uartRxDmaChannel) | (1<<uartRxIndexDmaChannel);
+}
+#endif
+
+// In DMA mode, this is called from most of the library's functions to start
+// sending the next contiguous part of the TX buffer when the TX channel is done.
+static void uartTxDmaService(void)
+{
+    uint8 mask = 1 << uartTxDmaChannel;
+
+    if (DMAARM & mask)
+    {
+        return;  // The TX channel is still busy.
+    }
+
+    if (uartTxDmaLength)
+    {
+        // The TX channel finished sending its segment.
+        uartTxBufferInterruptIndex = (uartTxBufferInterruptIndex + uartTxDmaLength) & (sizeof(uartTxBuffer) - 1);
+        uartTxDmaLength = 0;
+    }
+
+    if (uartTxBufferInterruptIndex == uartTxBufferMainLoopIndex)
+    {
+        return;  // Nothing to send.
+    }
+
+    if (uartFlowControl && UART_CTS)
+    {
+        return;  // The other device is not ready to receive.
+    }
+
+    // Wait for the last byte written by the TX channel to be transmitted,
+    // so that UNDBUF is empty and we can write the first byte of the
+    // new segment with a software trigger.
+    // UNCSR.TX_BYTE (1) == 1 : Last byte written to the data buffer was transmitted.
+    if (uartTxDmaStarted && !(UNCSR & 0x02))
+    {
+        return;
+    }
+
+    if (uartTxBufferMainLoopIndex > uartTxBufferInterruptIndex)
+    {
+        uartTxDmaLength = uartTxBufferMainLoopIndex - uartTxBufferInterruptIndex;
+    }
+    else
+    {
+        uartTxDmaLength = sizeof(uartTxBuffer) - uartTxBufferInterruptIndex;
+    }
+
+    if (uartFlowControl && uartTxDmaLength > UART_TX_FLOW_CONTROL_DMA_SEGMENT)
+    {
+        uartTxDmaLength = UART_TX_FLOW_CONTROL_DMA_SEGMENT;
+    }
+
+    // WORDSIZE = 0, TMODE = 0 (single), TRIG = UTXN.
+    // SRCINC = 1, DESTINC = 0, IRQMASK = 0, M8 = 0, PRIORITY = 1 (assured).
+    uartDmaConfigure(uartTxDmaChannel, (uint16)&uartTxBuffer[uartTxBufferInterruptIndex],
+        XDATA_SFR_ADDRESS(UNDBUF), uartTxDmaLength, DMA_TRIGGER_UTX, 0x41);
+
+    UNCSR &= ~0x02;  // Clear UNCSR.TX_BYTE.
+    uartTxDmaStarted = 1;
+
+    DMAARM |= mask;
+
+    // The DMA controller takes 9 cycles to load the configuration after the channel is armed.
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+
+    // Send the first byte.  The UART triggers the rest of the transfers.
+    DMAREQ = mask;
+}
+
 void uartNInit(void)
 {
     /* USART0 UART Alt. 1:
@@ -96,6 +376,9 @@ void uartNInit(void)
      *                     RX  = P1_7
      */
 
+    URXNIE = 0;
+    IEN2 &= ~BV_UTXNIE;
+
     uartTxBufferMainLoopIndex = 0;
     uartTxBufferInterruptIndex = 0;
     uartRxBufferMainLoopIndex = 0;
@@ -103,6 +386,7 @@ void uartNInit(void)
     uartNRxParityErrorOccurred = 0;
     uartNRxFramingErrorOccurred = 0;
     uartNRxBufferFullOccurred = 0;
+    uartRxFrameActive = 0;
 
     // Note: We do NOT set the mode of the RX pin to "peripheral function"
     // because that seems to have no benefits, and is actually bad because
@@ -134,12 +418,57 @@ void uartNInit(void)
     IP0 |= (1<<INTERRUPT_PRIORITY_GROUP);
     IP1 &= ~(1<<INTERRUPT_PRIORITY_GROUP);
 
+#ifdef UART_DMA_SUPPORTED
+    if (uartNDmaMode && !uartRxDmaChannel)
+    {
+        uartDmaAllocate();
+    }
+
+    if (uartRxDmaChannel)
+    {
+        // DMA mode: the UART's interrupts are not used.
+        uartDmaInit();
+        return;
+    }
+#endif
+
     UTXNIF = 1; // Set TX flag so the interrupt fires when we enable it for the first time.
     URXNIF = 0; // Clear RX flag.
     URXNIE = 1; // Enable Rx interrupt.
     EA = 1;     // Enable interrupts in general.
 }
 
+// Calculates uartFrameTimeoutTicks from the frame timeout and the serial settings.
+static void uartUpdateFrameTimeout(void)
+{
+    uint32 ticks;
+    uint8 bitsPerCharacter;
+
+    if (uartFrameTimeoutCharacters == 0 || uartBaudRate == 0)
+    {
+        uartRxFrameDetection = 0;
+        uartFrameTimeoutTicks = 0;
+        return;
+    }
+
+    // Start bit, 8 data bits, and 1 stop bit, plus the 9th (parity) bit
+    // if UNUCR.BIT9 (4) is 1 and a second stop bit if UNUCR.SPB (2) is 1.
+    bitsPerCharacter = 10;
+    if (UNUCR & (1<<4)){ bitsPerCharacter++; }
+    if (UNUCR & (1<<2)){ bitsPerCharacter++; }
+
+    // Round up, so the timeout is never shorter than requested.
+    ticks = ((uint32)uartFrameTimeoutCharacters * bitsPerCharacter * UART_T4_FREQUENCY
+        + uartBaudRate - 1) / uartBaudRate;
+
+    if (ticks > UART_FRAME_TIMEOUT_MAX_TICKS)
+    {
+        ticks = UART_FRAME_TIMEOUT_MAX_TICKS;
+    }
+    uartFrameTimeoutTicks = ticks;
+    uartRxFrameDetection = 1;
+}
+
 void uartNSetBaudRate(uint32 baud)
 {
     uint32 baudMPlus256;
@@ -149,6 +478,9 @@ void uartNSetBaudRate(uint32 baud)
     if (baud < 23 || baud > 1500000)
         return;
 
+    uartBaudRate = baud;
+    uartUpdateFrameTimeout();
+
     // 495782 is the largest value that will not overflow the following calculation
     while (baud > 495782)
     {
@@ -190,6 +522,8 @@ void uartNSetParity(uint8 parity)
     }
 
     UNUCR = (UNUCR & 0b01000111) | tmp;
+
+    uartUpdateFrameTimeout();
 }
 
 void uartNSetStopBits(uint8 stopBits)
@@ -203,26 +537,132 @@ void uartNSetStopBits(uint8 stopBits)
         UNUCR &= ~(1<<2);   // 1 stop bit
         // NOTE: An argument of STOP_BITS_1_5 is treated the same as STOP_BITS_1.
     }
+
+    uartUpdateFrameTimeout();
+}
+
+// Enables the TX interrupt if there are bytes to send.  This is needed with
+// flow control because the TX interrupt disables itself while CTS is high.
+static void uartTxFlowService(void)
+{
+    BIT pending;
+
+    if (uartTxDmaChannel)
+    {
+        uartTxDmaService();
+        return;
+    }
+
+    UART_TX_LOCK();
+    pending = (uartTxBufferInterruptIndex != uartTxBufferMainLoopIndex);
+    UART_TX_UNLOCK();
+
+    if (pending && !UART_CTS)
+    {
+        IEN2 |= BV_UTXNIE; // Enable TX interrupt
+    }
+}
+
+// Drives RTS low if the main loop has made enough room in the RX buffer.
+// In DMA mode there is no RX interrupt, so this also drives RTS high.
+static void uartRxFlowService(void)
+{
+    UART_RX_INDEX freeBytes;
+
+    UART_RX_LOCK();
+    freeBytes = UART_RX_BUFFER_FREE_BYTES();
+    if (freeBytes >= UART_RX_RESUME_FREE_BYTES)
+    {
+        UART_RTS = 0;
+    }
+    else if (uartRxDmaChannel && freeBytes < UART_RX_STOP_FREE_BYTES)
+    {
+        UART_RTS = 1;
+    }
+    UART_RX_UNLOCK();
+}
+
+void uartNSetFlowControl(BIT enable)
+{
+    if (enable)
+    {
+        uartFlowControl = 1;
+        uartRxFlowService();
+        UART_RTS_DIR |= BV_UART_RTS;    // Make RTS an output.
+        uartTxFlowService();
+    }
+    else
+    {
+        uartFlowControl = 0;
+        UART_RTS_DIR &= ~BV_UART_RTS;   // Make RTS an input.
+        if (!uartTxDmaChannel)
+        {
+            IEN2 |= BV_UTXNIE; // Enable TX interrupt in case it was waiting for CTS.
+        }
+    }
 }
 
 uint8 uartNTxAvailable(void)
 {
-    return UART_TX_BUFFER_FREE_BYTES();
+    UART_TX_INDEX freeBytes;
+
+    if (uartFlowControl || uartTxDmaChannel){ uartTxFlowService(); }
+
+    UART_TX_LOCK();
+    freeBytes = UART_TX_BUFFER_FREE_BYTES();
+    UART_TX_UNLOCK();
+
+#if UART_TX_BUFFER_SIZE > 256
+    if (freeBytes > 255){ return 255; }
+#endif
+    return freeBytes;
 }
 
 void uartNTxSend(const uint8 XDATA * buffer, uint8 size)
 {
     // Assumption: uartNTxAvailable() was recently called and it returned a number at least as big as 'size'.
-    // TODO: after DMA memcpy is implemented, use it to make this function faster
 
-    while (size)
+    volatile uint8 XDATA * dest = &uartTxBuffer[uartTxBufferMainLoopIndex];
+    UART_TX_INDEX count;
+
+    if (size == 0)
+    {
+        return;
+    }
+
+    // Copy the bytes in at most two pieces (before and after the end of the
+    // ring buffer) and then tell the interrupt about all of them at once.
+    count = sizeof(uartTxBuffer) - uartTxBufferMainLoopIndex;
+    if (count > size)
     {
-        uartTxBuffer[uartTxBufferMainLoopIndex] = *buffer;
+        count = size;
+    }
+    size -= count;
 
-        buffer++;
-        uartTxBufferMainLoopIndex = (uartTxBufferMainLoopIndex + 1) & (sizeof(uartTxBuffer) - 1);
-        size--;
+    while (count--)
+    {
+        *dest++ = *buffer++;
+    }
 
+    if (size)
+    {
+        dest = uartTxBuffer;
+        while (size--)
+        {
+            *dest++ = *buffer++;
+        }
+    }
+
+    UART_TX_LOCK();
+    uartTxBufferMainLoopIndex = (dest - uartTxBuffer) & (sizeof(uartTxBuffer) - 1);
+    UART_TX_UNLOCK();
+
+    if (uartTxDmaChannel)
+    {
+        uartTxDmaService();
+    }
+    else
+    {
         IEN2 |= BV_UTXNIE; // Enable TX interrupt
     }
 }
@@ -232,14 +672,158 @@ void uartNTxSendByte(uint8 byte)
     // Assumption: uartNTxAvailable() was recently called and it returned a non-zero number.
 
     uartTxBuffer[uartTxBufferMainLoopIndex] = byte;
+    UART_TX_LOCK();
     uartTxBufferMainLoopIndex = (uartTxBufferMainLoopIndex + 1) & (sizeof(uartTxBuffer) - 1);
+    UART_TX_UNLOCK();
 
-    IEN2 |= BV_UTXNIE; // Enable TX interrupt
+    if (uartTxDmaChannel)
+    {
+        uartTxDmaService();
+    }
+    else
+    {
+        IEN2 |= BV_UTXNIE; // Enable TX interrupt
+    }
+}
+
+// In DMA mode, this gets the RX write index from the RX index channel.
+// There is no interrupt to record the time of each byte for frame detection,
+// so we record the time when we notice new bytes instead.
+static void uartRxDmaService(void)
+{
+    uint8 index = uartRxDmaIndex;
+    uint8 newBytes = index - uartRxBufferInterruptIndex;
+
+    if (newBytes)
+    {
+        // The RX data channel does not stop when the buffer is full.  If more
+        // bytes arrived than there was room for, it overwrote bytes that the
+        // main loop had not read yet, so throw away everything in the buffer.
+        if (newBytes > UART_RX_BUFFER_FREE_BYTES())
+        {
+            uartNRxBufferFullOccurred = 1;
+            uartRxBufferMainLoopIndex = index;
+        }
+
+        uartRxBufferInterruptIndex = index;
+        if (uartRxFrameDetection)
+        {
+            uint8 ms, cnt;
+            UART_READ_TIME(ms, cnt);
+            uartRxLastByteMs = ms;
+            uartRxLastByteCnt = cnt;
+            uartRxFrameActive = 1;
+        }
+    }
+}
+
+void uartNSetRxFrameTimeout(uint8 characterTimes)
+{
+    uartFrameTimeoutCharacters = characterTimes;
+    uartUpdateFrameTimeout();
+}
+
+BIT uartNRxFrameComplete(void)
+{
+    BIT complete = 0;
+    BIT rxInterruptEnabled;
+    uint8 ms, cnt;
+    uint16 now, last, elapsed;
+
+    if (uartRxDmaChannel){ uartRxDmaService(); }
+
+    if (!uartRxFrameDetection || !uartRxFrameActive)
+    {
+        return 0;
+    }
+
+    // Disable the RX interrupt so it can not record a new byte while we
+    // are deciding whether the frame has ended.
+    rxInterruptEnabled = URXNIE;
+    URXNIE = 0;
+
+    UART_READ_TIME(ms, cnt);
+    now = ms * (uint16)UART_TICKS_PER_MS + cnt;
+
+    // Both times are in the range [0, UART_TICKS_PERIOD), so if the timestamp
+    // wrapped around since the last byte, now is less than last.
+    last = uartRxLastByteMs * (uint16)UART_TICKS_PER_MS + uartRxLastByteCnt;
+    elapsed = (now >= last) ? now - last : now + UART_TICKS_PERIOD - last;
+
+    if (elapsed >= uartFrameTimeoutTicks)
+    {
+        uartRxFrameActive = 0;
+        complete = 1;
+    }
+
+    URXNIE = rxInterruptEnabled;
+    return complete;
 }
 
 uint8 uartNRxAvailable(void)
 {
-    return UART_RX_BUFFER_USED_BYTES();
+    UART_RX_INDEX usedBytes;
+
+    if (uartRxDmaChannel)
+    {
+        uartRxDmaService();
+    }
+
+    if (uartFlowControl)
+    {
+        uartRxFlowService();
+        uartTxFlowService();
+    }
+    else if (uartTxDmaChannel)
+    {
+        uartTxDmaService();
+    }
+
+    UART_RX_LOCK();
+    usedBytes = UART_RX_BUFFER_USED_BYTES();
+    UART_RX_UNLOCK();
+
+#if UART_RX_BUFFER_SIZE > 256
+    if (usedBytes > 255){ return 255; }
+#endif
+    return usedBytes;
+}
+
+uint8 uartNRxBufferAvailable(void)
+{
+    uint8 count = uartNRxAvailable();
+
+    if (count > sizeof(uartRxBuffer) - uartRxBufferMainLoopIndex)
+    {
+        count = sizeof(uartRxBuffer) - uartRxBufferMainLoopIndex;
+    }
+    return count;
+}
+
+uint8 XDATA * uartNRxBuffer(void)
+{
+    return (uint8 XDATA *)&uartRxBuffer[uartRxBufferMainLoopIndex];
+}
+
+void uartNRxConsume(uint8 size)
+{
+    // Assumption: uartNRxAvailable was recently called and it returned a value at least as big as 'size'.
+
+    UART_RX_LOCK();
+    uartRxBufferMainLoopIndex = (uartRxBufferMainLoopIndex + size) & (sizeof(uartRxBuffer) - 1);
+    UART_RX_UNLOCK();
+
+    if (uartFlowControl && UART_RTS)
+    {
+        uartRxFlowService();
+    }
+}
+
+uint8 uartNRxPeek(void)
+{
+    // Assumption: uartNRxAvailable was recently called and it returned a non-zero value.
+
+    return uartRxBuffer[uartRxBufferMainLoopIndex];
 }
 
 uint8 uartNRxReceiveByte(void)
@@ -247,10 +831,41 @@ uint8 uartNRxReceiveByte(void)
     // Assumption: uartNRxAvailable was recently called and it returned a non-zero value.
 
     uint8 byte = uartRxBuffer[uartRxBufferMainLoopIndex];
-    uartRxBufferMainLoopIndex = (uartRxBufferMainLoopIndex + 1) & (sizeof(uartRxBuffer) - 1);
+    uartNRxConsume(1);
     return byte;
 }
 
+void uartNRxReceive(uint8 XDATA * buffer, uint8 size)
+{
+    // Assumption: uartNRxAvailable was recently called and it returned a value at least as big as 'size'.
+
+    volatile uint8 XDATA * src = &uartRxBuffer[uartRxBufferMainLoopIndex];
+    UART_RX_INDEX count;
+    uint8 remaining = size;
+
+    // Copy the bytes in at most two pieces (before and after the end of the
+    // ring buffer) and then remove all of them from the buffer at once.
+    count = sizeof(uartRxBuffer) - uartRxBufferMainLoopIndex;
+    if (count > remaining)
+    {
+        count = remaining;
+    }
+    remaining -= count;
+
+    while (count--)
+    {
+        *buffer++ = *src++;
+    }
+
+    src = uartRxBuffer;
+    while (remaining--)
+    {
+        *buffer++ = *src++;
+    }
+
+    uartNRxConsume(size);
+}
+
 ISR_UTX()
 {
     // A byte has just started transmitting on TX and there is room in
@@ -258,6 +873,15 @@ ISR_UTX()
 
     if (uartTxBufferInterruptIndex != uartTxBufferMainLoopIndex)
     {
+        if (uartFlowControl && UART_CTS)
+        {
+            // The other device is not ready to receive, so disable the TX
+            // interrupt without clearing the flag.  The main loop will
+            // enable it again when CTS goes low (see uartTxFlowService).
+            IEN2 &= ~BV_UTXNIE;
+            return;
+        }
+
         // There more bytes available in our software buffer, so send
         // the next byte.
 
@@ -279,6 +903,15 @@ ISR_URX()
 
     URXNIF = 0;
 
+    if (uartRxFrameDetection)
+    {
+        uint8 ms, cnt;
+        UART_READ_TIME(ms, cnt);
+        uartRxLastByteMs = ms;
+        uartRxLastByteCnt = cnt;
+        uartRxFrameActive = 1;
+    }
+
     // Read the Control and Status register for the UART.
     // Reading this register clears the FE and ERR bits,
     // which we need to check later.
@@ -294,6 +927,12 @@ ISR_URX()
             // The software RX buffer has space, so add this new byte to the buffer.
             uartRxBuffer[uartRxBufferInterruptIndex] = UNDBUF;
             uartRxBufferInterruptIndex = (uartRxBufferInterruptIndex + 1) & (sizeof(uartRxBuffer) - 1);
+
+            if (uartFlowControl && UART_RX_BUFFER_FREE_BYTES() < UART_RX_STOP_FREE_BYTES)
+            {
+                // The buffer is almost full, so ask the other device to stop sending.
+                UART_RTS = 1;
+            }
         }
         else
         {
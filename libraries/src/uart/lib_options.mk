@@ -6,6 +6,10 @@ LIB_RELS := libraries/src/uart/uart0.rel libraries/src/uart/uart1.rel
 libraries/src/uart/uart0.rel : C_FLAGS += -DUART0
 libraries/src/uart/uart1.rel : C_FLAGS += -DUART1
 
+# To change the size of a UART's TX or RX buffer, add flags like these.
+# Each size must be a power of two from 2 to 1024 (the default is 256).
+#libraries/src/uart/uart1.rel : C_FLAGS += -DUART_TX_BUFFER_SIZE=512 -DUART_RX_BUFFER_SIZE=1024
+
 # The rel files will be compiled from uart0.c and uart1.c,
 # which will both be copies of core/uart.c.
 libraries/src/uart/uart0.c : libraries/src/uart/core/uart.c
@@ -2,8 +2,8 @@
 #include <cc2511_map.h>
 #include <cc2511_types.h>
 #include <board.h>
+#include <dma.h>
 
-// TODO: make the usb library work will with Sleep Mode 0 (an interrupt should be enabled for all the endpoints we care about so we can handle them quickly)
 // TODO: SUSPEND MODE!
 
 extern uint8 CODE usbConfigurationDescriptor[];
@@ -23,21 +23,110 @@ XDATA uint8 * controlTransferPointer;
 
 volatile BIT usbSuspendMode = 0;
 
-// TODO: eventually: Enable the USB interrupt and only set usbActivityFlag in the ISR
 volatile BIT usbActivityFlag = 0;
 
+// Reading USBCIF, USBIIF, or USBOIF clears the flags in it, so the USB ISR saves
+// the flags here until usbPoll can handle them.  The OUT endpoint flags are not
+// used by usbPoll (the higher-level libraries check their endpoint registers
+// directly) but they tell usbIdle that there is work to do.
+static volatile uint8 XDATA usbPendingCif = 0;
+static volatile uint8 XDATA usbPendingIif = 0;
+static volatile uint8 XDATA usbPendingOif = 0;
+
+// The USB interrupt shares a vector with the Port 2 interrupt.  The Wixel does
+// not use the Port 2 pin interrupts, so all we have to do here is record which
+// USB events happened.  Work that involves calling back into higher-level code
+// (control transfers, USB resets) is left for usbPoll, which runs in the main
+// loop, so none of the callbacks have to worry about being interrupted by this.
+// Running this ISR wakes the CPU from PM0, so the main loop can call usbIdle()
+// instead of spinning.
+ISR(USB, 0)
+{
+    uint8 flags;
+
+    USBIF = 0;    // Clear the CPU interrupt flag first so that any USB event after this sets it again.
+    P2IFG = 0;
+
+    flags = USBCIF;
+    usbPendingCif |= flags;
+    if (flags & (1<<0)) // Check SUSPENDIF
+    {
+        usbSuspendMode = 1;
+    }
+    if (flags & (1<<1)) // Check RESUMEIF
+    {
+        usbSuspendMode = 0;
+    }
+
+    flags = USBIIF;
+    usbPendingIif |= flags;
+    if (flags)
+    {
+        usbActivityFlag = 1;
+    }
+
+    flags = USBOIF;
+    usbPendingOif |= flags;
+    if (flags)
+    {
+        usbActivityFlag = 1;
+    }
+}
+
 void usbInit()
 {
 }
 
-// TODO: try using DMA in usbReadFifo and usbWriteFifo and see how that affects the speed of usbComTxSend(x, 128).
+// The DMA channel used to copy data to and from the USB FIFOs, or 0 if there was
+// no channel available.
+static uint8 XDATA usbDmaChannel = 0;
+
+// For transfers shorter than this, setting up the DMA channel takes longer than
+// just copying the bytes with the CPU.
+#define USB_FIFO_DMA_THRESHOLD 8
+
+// Copies count bytes from src to dest using DMA and waits for the copy to finish.
+// dc7 specifies which of the addresses should be incremented.
+static void usbDmaCopy(uint16 src, uint16 dest, uint8 count, uint8 dc7)
+{
+    volatile DMA_CONFIG XDATA * config = dmaChannelConfig(usbDmaChannel);
+    uint8 mask = 1 << usbDmaChannel;
+
+    config->SRCADDRH = src >> 8;
+    config->SRCADDRL = src;
+    config->DESTADDRH = dest >> 8;
+    config->DESTADDRL = dest;
+    config->VLEN_LENH = 0;
+    config->LENL = count;
+    config->DC6 = 0x20;  // WORDSIZE = 0, TMODE = 1 (block), TRIG = 0 (DMAREQ)
+    config->DC7 = dc7;   // IRQMASK = 0, M8 = 0, PRIORITY = 0
+
+    DMAARM |= mask;
+
+    // The DMA controller takes 9 cycles to load the configuration after the channel is armed.
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+
+    DMAREQ = mask;
+    while(DMAARM & mask){}  // The channel is disarmed when the transfer is done.
+}
+
 void usbReadFifo(uint8 endpointNumber, uint8 count, uint8 XDATA * buffer)
 {
     XDATA uint8 * fifo = (XDATA uint8 *)(0xDE20 + (uint8)(endpointNumber<<1));
-    while(count > 0)
+
+    if (usbDmaChannel && count >= USB_FIFO_DMA_THRESHOLD)
+    {
+        usbDmaCopy((uint16)fifo, (uint16)buffer, count, 0x10); // SRCINC = 0, DESTINC = 1
+    }
+    else
     {
-        count--;
-        *(buffer++) = *fifo;
+        while(count > 0)
+        {
+            count--;
+            *(buffer++) = *fifo;
+        }
     }
 
     usbActivityFlag = 1;
@@ -46,10 +135,18 @@ void usbReadFifo(uint8 endpointNumber, uint8 count, uint8 XDATA * buffer)
 void usbWriteFifo(uint8 endpointNumber, uint8 count, const uint8 XDATA * buffer)
 {
     XDATA uint8 * fifo = (XDATA uint8 *)(0xDE20 + (uint8)(endpointNumber<<1));
-    while(count > 0)
+
+    if (usbDmaChannel && count >= USB_FIFO_DMA_THRESHOLD)
+    {
+        usbDmaCopy((uint16)buffer, (uint16)fifo, count, 0x40); // SRCINC = 1, DESTINC = 0
+    }
+    else
     {
-        count--;
-        *fifo = *(buffer++);
+        while(count > 0)
+        {
+            count--;
+            *fifo = *(buffer++);
+        }
     }
 
     // We don't set the usbActivityFlag here; we wait until the packet is
@@ -68,20 +165,29 @@ static void basicUsbInit()
     // Enable the USB common interrupts we care about: Reset, Resume, Suspend.
     // Without this, we USBCIF.SUSPENDIF will not get set (the datasheet is incomplete).
     USBCIE = 0b0111;
+
+    // Enable the interrupts for all the IN endpoints (including endpoint 0) and all
+    // the OUT endpoints, and then enable the USB interrupt itself (IEN2.P2IE = 1).
+    USBIIE = 0b111111;
+    USBOIE = 0b111110;
+    IEN2 |= (1<<1);
 }
 
 void usbPoll()
 {
     uint8 usbcif;
     uint8 usbiif;
-    //uint8 usboif = USBOIF;
 
     if (!usbPowerPresent())
     {
         // The VBUS line is low.  This usually means that the USB cable has been
         // disconnected or the computer has been turned off.
 
+        IEN2 &= ~(1<<1);  // Disable the USB interrupt (IEN2.P2IE = 0).
         SLEEP &= ~(1<<7); // Disable the USB module (SLEEP.USB_EN = 0).
+        usbPendingCif = 0;
+        usbPendingIif = 0;
+        usbPendingOif = 0;
 
         disableUsbPullup();
         usbDeviceState = USB_STATE_DETACHED;
@@ -99,11 +205,22 @@ void usbPoll()
         __asm nop __endasm;
         usbDeviceState = USB_STATE_POWERED;
 
+        if (usbDmaChannel == 0)
+        {
+            usbDmaChannel = dmaAllocateChannel();
+        }
+
         basicUsbInit();
     }
 
-    usbcif = USBCIF;
-    usbiif = USBIIF;
+    // Get the flags that the ISR saved, along with any that are set now.
+    IEN2 &= ~(1<<1);  // Disable the USB interrupt (IEN2.P2IE = 0).
+    usbcif = usbPendingCif | USBCIF;
+    usbiif = usbPendingIif | USBIIF;
+    usbPendingCif = 0;
+    usbPendingIif = 0;
+    usbPendingOif = 0;
+    IEN2 |= (1<<1);   // Enable the USB interrupt (IEN2.P2IE = 1).
 
     if (usbcif & (1<<0)) // Check SUSPENDIF
     {
@@ -537,6 +654,23 @@ BIT usbSuspended()
     return usbSuspendMode;
 }
 
+void usbIdle()
+{
+    EA = 0;
+    if (usbPendingCif || usbPendingIif || usbPendingOif)
+    {
+        // The ISR has recorded an event that usbPoll has not handled yet.
+        EA = 1;
+        return;
+    }
+
+    // The instruction after the one that sets EA always runs before any interrupt,
+    // so an interrupt cannot sneak in between the check above and going idle.
+    SLEEP &= ~3;  // SLEEP.MODE = 0 : Selects Power Mode 0 (PM0).
+    EA = 1;
+    PCON |= 1;    // PCON.IDLE = 1 : Stop the CPU until the next interrupt.
+}
+
 // Sleeps until we receive USB resume signaling.
 // This uses PM1.  ( PM2 and PM3 are not usable because they will reset the USB module. )
 // NOTE: For some reason, USB suspend does not work if you plug your device into a computer
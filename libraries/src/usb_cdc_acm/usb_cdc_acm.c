@@ -15,17 +15,56 @@
 // We picked endpoint 4 for the data because it has a 256-byte FIFO memory area,
 // which is exactly enough for us to have two 64-byte IN buffers and two 64-byte
 // OUT buffers.
+//
+// This file is also compiled with USB_COM_PORT_COUNT=2 to make
+// usb_cdc_acm2.lib, a composite device with two ports.  The second port uses
+// endpoint 2 for notifications and endpoint 5 (which has a 512-byte FIFO) for
+// data.  There are no more endpoints with enough FIFO memory for a third port.
+
+#ifndef USB_COM_PORT_COUNT
+#define USB_COM_PORT_COUNT 1
+#endif
+
+#if USB_COM_PORT_COUNT != 1 && USB_COM_PORT_COUNT != 2
+#error USB_COM_PORT_COUNT must be 1 or 2.
+#endif
+
+// In the single-port library, PORT is a constant so that the compiler can
+// use fixed addresses for all of the per-port variables and registers.
+// Functions that only use PORT call USE_PORT() so that SDCC does not warn
+// about their unreferenced port argument in the single-port library.
+#if USB_COM_PORT_COUNT == 1
+#define PORT 0
+#define USE_PORT() (void)port
+#else
+#define PORT port
+#define USE_PORT()
+#endif
+
+// The USB product ID can be changed by adding -DUSB_COM_PRODUCT_ID=N to the
+// C_FLAGS in lib_options.mk.  The two-port library does not use the
+// single-port library's product ID, because the computer would load the
+// drivers it has for that ID, which only know about one port.
+#ifndef USB_COM_PRODUCT_ID
+#if USB_COM_PORT_COUNT == 1
+#define USB_COM_PRODUCT_ID 0x2200
+#else
+#define USB_COM_PRODUCT_ID 0x2202
+#endif
+#endif
 
 #define CDC_OUT_PACKET_SIZE          64
 #define CDC_IN_PACKET_SIZE           64
-#define CDC_CONTROL_INTERFACE_NUMBER 0
-#define CDC_DATA_INTERFACE_NUMBER    1
+#define CDC_CONTROL_INTERFACE_NUMBER(port)  ((port)<<1)
+#define CDC_DATA_INTERFACE_NUMBER(port)     (((port)<<1) + 1)
 
-#define CDC_NOTIFICATION_ENDPOINT    1
-#define CDC_NOTIFICATION_FIFO        USBF1   // This must match CDC_NOTIFICATION_ENDPOINT!
+#define CDC_NOTIFICATION_ENDPOINT(port)     (1 + (port))
+#define CDC_DATA_ENDPOINT(port)             (4 + (port))
 
-#define CDC_DATA_ENDPOINT            4
-#define CDC_DATA_FIFO                USBF4   // This must match CDC_DATA_ENDPOINT!
+// The FIFO registers (USBF0-USBF5) are two bytes apart.
+#define USB_FIFO(endpoint)           (*(volatile uint8 XDATA *)(0xDE20 + ((endpoint)<<1)))
+#define CDC_NOTIFICATION_FIFO(port)  USB_FIFO(CDC_NOTIFICATION_ENDPOINT(port))
+#define CDC_DATA_FIFO(port)          USB_FIFO(CDC_DATA_ENDPOINT(port))
 
 /* CDC and ACM Constants ******************************************************/
 
@@ -39,6 +78,13 @@
 // USB Protocol Codes
 #define CDC_PROTOCOL_V250 1          // (CDC 1.20 Section 4.4: Communications Class Protocol Codes).
 
+// USB Class, Subclass, and Protocol codes for devices that use Interface
+// Association Descriptors (USB Interface Association Descriptor Device Class Code
+// and Use Model, Table 1-1).
+#define MISC_CLASS 0xEF
+#define MISC_SUBCLASS_COMMON 2
+#define MISC_PROTOCOL_IAD 1
+
 // USB Descriptor types from CDC 1.20 Section 5.2.3, Table 12
 #define CDC_DESCRIPTOR_TYPE_CS_INTERFACE 0x24
 #define CDC_DESCRIPTOR_TYPE_CS_ENDPOINT  0x25
@@ -68,13 +114,13 @@ static void doNothing();
 /* USB COM Variables **********************************************************/
 
 // TODO: look at usb-to-serial adapters and figure out good default values for usbComControlLineState (RTS and CTS)
-uint8 usbComControlLineState = 0;
+static uint8 usbComControlLineState[USB_COM_PORT_COUNT];
 
-uint8 usbComSerialState = 0;
+static uint8 usbComSerialState[USB_COM_PORT_COUNT];
 
 // The last state we reported to the computer, or 0xFF if we have not reported
 // a state yet.
-static uint8 lastReportedSerialState = 0xFF;
+static uint8 XDATA lastReportedSerialState[USB_COM_PORT_COUNT];
 
 ACM_LINE_CODING XDATA usbComLineCoding =
 {
@@ -84,17 +130,41 @@ ACM_LINE_CODING XDATA usbComLineCoding =
     8,        // bDataBits = 8
 };
 
+#if USB_COM_PORT_COUNT > 1
+static ACM_LINE_CODING XDATA usbComLineCoding1 =
+{
+    9600,     // dwDTERate (baud rate)
+    0,        // bCharFormat = 0: 1 stop bit
+    0,        // bParityType = 0: no parity
+    8,        // bDataBits = 8
+};
+#endif
+
 HandlerFunction * usbComLineCodingChangeHandler = doNothing;
 
-// This bit is true if we need to send an empty (zero-length) packet of data to
+uint8 usbComLineCodingChangePort = 0;
+
+// This is non-zero if we need to send an empty (zero-length) packet of data to
 // the computer soon.  Every data transfer needs to be ended with a packet that
 // is less than full length, so sometimes we need to send empty packets.
-static BIT sendEmptyPacketSoon = 0;
+static uint8 DATA sendEmptyPacketSoon[USB_COM_PORT_COUNT];
 
 // The number of bytes that we have loaded into the IN FIFO that are NOT yet
 // queued up to be sent.  This will always be less than CDC_IN_PACKET_SIZE because
 // once we've loaded up a full packet we should always send it immediately.
-static uint8 DATA inFifoBytesLoaded = 0;
+static uint8 DATA inFifoBytesLoaded[USB_COM_PORT_COUNT];
+
+// The TX ring buffer used in streaming mode (see usbComTxStreamingEnable).
+// txRingMask is one less than the size of the ring, or 0 if streaming mode is
+// disabled.  Bytes are added at txRingHead and loaded into the FIFO from
+// txRingTail.  One byte of the ring is always left empty so that we can tell
+// a full ring from an empty one.
+static uint8 XDATA * XDATA txRing[USB_COM_PORT_COUNT];
+static uint16 XDATA txRingMask[USB_COM_PORT_COUNT];
+static uint16 XDATA txRingHead[USB_COM_PORT_COUNT];
+static uint16 XDATA txRingTail[USB_COM_PORT_COUNT];
+
+#define TX_RING_USED(port) ((txRingHead[port] - txRingTail[port]) & txRingMask[port])
 
 // True iff we have received a command from the user to enter bootloader mode.
 static BIT startBootloaderSoon = 0;
@@ -111,12 +181,18 @@ USB_DESCRIPTOR_DEVICE CODE usbDeviceDescriptor =
     sizeof(USB_DESCRIPTOR_DEVICE),
     USB_DESCRIPTOR_TYPE_DEVICE,
     0x0200,                 // USB Spec Release Number in BCD format
+#if USB_COM_PORT_COUNT == 1
     CDC_CLASS,              // Class Code: Communications Device Class
     0,                      // Subclass code: must be 0 according to CDC 1.20 spec
     0,                      // Protocol code: must be 0 according to CDC 1.20 spec
+#else
+    MISC_CLASS,             // Class Code: Miscellaneous (the functions are described by IADs)
+    MISC_SUBCLASS_COMMON,   // Subclass code: Common Class
+    MISC_PROTOCOL_IAD,      // Protocol code: Interface Association Descriptor
+#endif
     USB_EP0_PACKET_SIZE,    // Max packet size for Endpoint 0
     USB_VENDOR_ID_POLOLU,   // Vendor ID
-    0x2200,                 // Product ID (Generic Wixel with one CDC ACM port)
+    USB_COM_PRODUCT_ID,     // Product ID (Generic Wixel with CDC ACM ports)
     0x0000,                 // Device release number in BCD format
     1,                      // Index of Manufacturer String Descriptor
     2,                      // Index of Product String Descriptor
@@ -124,9 +200,8 @@ USB_DESCRIPTOR_DEVICE CODE usbDeviceDescriptor =
     1                       // Number of possible configurations.
 };
 
-CODE struct CONFIG1 {
-    USB_DESCRIPTOR_CONFIGURATION configuration;
-
+// The descriptors for one virtual COM port.
+struct CDC_FUNCTION {
     USB_DESCRIPTOR_INTERFACE communication_interface;
     unsigned char class_specific[19];  // CDC-Specific Descriptors
     USB_DESCRIPTOR_ENDPOINT notification_element;
@@ -134,6 +209,107 @@ CODE struct CONFIG1 {
     USB_DESCRIPTOR_INTERFACE data_interface;
     USB_DESCRIPTOR_ENDPOINT data_out;
     USB_DESCRIPTOR_ENDPOINT data_in;
+};
+
+#define CDC_FUNCTION_DESCRIPTORS(port)                                                                  \
+{                                                                                                       \
+    {                                                    /* Communications Interface: Used for device management. */ \
+        sizeof(USB_DESCRIPTOR_INTERFACE),                                                               \
+        USB_DESCRIPTOR_TYPE_INTERFACE,                                                                  \
+        CDC_CONTROL_INTERFACE_NUMBER(port),              /* bInterfaceNumber */                         \
+        0,                                               /* bAlternateSetting */                        \
+        1,                                               /* bNumEndpoints */                            \
+        CDC_CLASS,                                       /* bInterfaceClass */                          \
+        CDC_SUBCLASS_ACM,                                /* bInterfaceSubClass */                       \
+        CDC_PROTOCOL_V250,                               /* bInterfaceProtocol */                       \
+        0                                                /* iInterface */                               \
+    },                                                                                                  \
+    {                                                    /* Functional Descriptors. */                  \
+                                                                                                        \
+        5,                                               /* 5-byte General Descriptor: Header Functional Descriptor */ \
+        CDC_DESCRIPTOR_TYPE_CS_INTERFACE,                                                               \
+        CDC_DESCRIPTOR_SUBTYPE_HEADER,                                                                  \
+        0x20,0x01,                                       /* bcdCDC.  We conform to CDC 1.20. */         \
+                                                                                                        \
+        4,                                               /* 4-byte PTSN-Specific Descriptor: Abstract Control Management Functional Descriptor. */ \
+        CDC_DESCRIPTOR_TYPE_CS_INTERFACE,                                                               \
+        CDC_DESCRIPTOR_SUBTYPE_ABSTRACT_CONTROL_MANAGEMENT,                                              \
+        2,                                               /* bmCapabilities.  See USBPSTN1.2 Table 4.  We support SetLineCoding, */ \
+                                                         /* SetControlLineState, GetLineCoding, and SerialState notifications. */ \
+                                                                                                        \
+        5,                                               /* 5-byte General Descriptor: Union Interface Functional Descriptor (CDC 1.20 Table 16). */ \
+        CDC_DESCRIPTOR_TYPE_CS_INTERFACE,                                                               \
+        CDC_DESCRIPTOR_SUBTYPE_UNION,                                                                   \
+        CDC_CONTROL_INTERFACE_NUMBER(port),              /* index of the control interface */           \
+        CDC_DATA_INTERFACE_NUMBER(port),                 /* index of the subordinate interface */       \
+                                                                                                        \
+        5,                                               /* 5-byte PTSN-Specific Descriptor */          \
+        CDC_DESCRIPTOR_TYPE_CS_INTERFACE,                                                               \
+        CDC_DESCRIPTOR_SUBTYPE_CALL_MANAGEMENT,                                                         \
+        0x00,                                            /* bmCapabilities.  USBPSTN1.2 Table 3.  Device does not handle call management. */ \
+        CDC_DATA_INTERFACE_NUMBER(port)                  /* index of the data interface */              \
+    },                                                                                                  \
+    {                                                                                                   \
+        sizeof(USB_DESCRIPTOR_ENDPOINT),                                                                \
+        USB_DESCRIPTOR_TYPE_ENDPOINT,                                                                   \
+        USB_ENDPOINT_ADDRESS_IN | CDC_NOTIFICATION_ENDPOINT(port),  /* bEndpointAddress */             \
+        USB_TRANSFER_TYPE_INTERRUPT,                     /* bmAttributes */                             \
+        10,                                              /* wMaxPacketSize */                           \
+        1,                                               /* bInterval */                                \
+    },                                                                                                  \
+    {                                                                                                   \
+        sizeof(USB_DESCRIPTOR_INTERFACE),                /* Data Interface: used for RX and TX data. */ \
+        USB_DESCRIPTOR_TYPE_INTERFACE,                                                                  \
+        CDC_DATA_INTERFACE_NUMBER(port),                 /* bInterfaceNumber */                         \
+        0,                                               /* bAlternateSetting */                        \
+        2,                                               /* bNumEndpoints */                            \
+        CDC_DATA_INTERFACE_CLASS,                        /* bInterfaceClass */                          \
+        0,                                               /* bInterfaceSubClass */                       \
+        0,                                               /* bInterfaceProtocol */                       \
+        0                                                /* iInterface */                               \
+    },                                                                                                  \
+    {                                                    /* OUT Endpoint: Sends data out to Wixel. */   \
+        sizeof(USB_DESCRIPTOR_ENDPOINT),                                                                \
+        USB_DESCRIPTOR_TYPE_ENDPOINT,                                                                   \
+        USB_ENDPOINT_ADDRESS_OUT | CDC_DATA_ENDPOINT(port),  /* bEndpointAddress */                     \
+        USB_TRANSFER_TYPE_BULK,                          /* bmAttributes */                             \
+        CDC_OUT_PACKET_SIZE,                             /* wMaxPacketSize */                           \
+        0,                                               /* bInterval */                                \
+    },                                                                                                  \
+    {                                                                                                   \
+        sizeof(USB_DESCRIPTOR_ENDPOINT),                                                                \
+        USB_DESCRIPTOR_TYPE_ENDPOINT,                                                                   \
+        USB_ENDPOINT_ADDRESS_IN | CDC_DATA_ENDPOINT(port),   /* bEndpointAddress */                     \
+        USB_TRANSFER_TYPE_BULK,                          /* bmAttributes */                             \
+        CDC_IN_PACKET_SIZE,                              /* wMaxPacketSize */                           \
+        0,                                               /* bInterval */                                \
+    },                                                                                                  \
+}
+
+// The Interface Association Descriptor that groups the two interfaces of a port
+// together, so that the USB host knows which ones belong to the same port.
+#define CDC_ASSOCIATION_DESCRIPTOR(port)                                                                \
+{                                                                                                       \
+    sizeof(USB_DESCRIPTOR_INTERFACE_ASSOCIATION),                                                       \
+    USB_DESCRIPTOR_TYPE_INTERFACE_ASSOCIATION,                                                          \
+    CDC_CONTROL_INTERFACE_NUMBER(port),                  /* bFirstInterface */                          \
+    2,                                                   /* bInterfaceCount */                          \
+    CDC_CLASS,                                           /* bFunctionClass */                           \
+    CDC_SUBCLASS_ACM,                                    /* bFunctionSubClass */                        \
+    CDC_PROTOCOL_V250,                                   /* bFunctionProtocol */                        \
+    0                                                    /* iFunction */                                \
+}
+
+CODE struct CONFIG1 {
+    USB_DESCRIPTOR_CONFIGURATION configuration;
+#if USB_COM_PORT_COUNT == 1
+    struct CDC_FUNCTION port0;
+#else
+    USB_DESCRIPTOR_INTERFACE_ASSOCIATION association0;
+    struct CDC_FUNCTION port0;
+    USB_DESCRIPTOR_INTERFACE_ASSOCIATION association1;
+    struct CDC_FUNCTION port1;
+#endif
 } usbConfigurationDescriptor
 =
 {
@@ -141,84 +317,20 @@ CODE struct CONFIG1 {
         sizeof(USB_DESCRIPTOR_CONFIGURATION),
         USB_DESCRIPTOR_TYPE_CONFIGURATION,
         sizeof(struct CONFIG1),                          // wTotalLength
-        2,                                               // bNumInterfaces
+        2 * USB_COM_PORT_COUNT,                          // bNumInterfaces
         1,                                               // bConfigurationValue
         0,                                               // iConfiguration
         0xC0,                                            // bmAttributes: self powered (but may use bus power)
         50,                                              // bMaxPower
     },
-    {                                                    // Communications Interface: Used for device management.
-        sizeof(USB_DESCRIPTOR_INTERFACE),
-        USB_DESCRIPTOR_TYPE_INTERFACE,
-        CDC_CONTROL_INTERFACE_NUMBER,                    // bInterfaceNumber
-        0,                                               // bAlternateSetting
-        1,                                               // bNumEndpoints
-        CDC_CLASS,                                       // bInterfaceClass
-        CDC_SUBCLASS_ACM,                                // bInterfaceSubClass
-        CDC_PROTOCOL_V250,                               // bInterfaceProtocol
-        0                                                // iInterface
-    },
-    {                                                    // Functional Descriptors.
-
-        5,                                               // 5-byte General Descriptor: Header Functional Descriptor
-        CDC_DESCRIPTOR_TYPE_CS_INTERFACE,
-        CDC_DESCRIPTOR_SUBTYPE_HEADER,
-        0x20,0x01,                                       // bcdCDC.  We conform to CDC 1.20.
-
-
-        4,                                               // 4-byte PTSN-Specific Descriptor: Abstract Control Management Functional Descriptor.
-        CDC_DESCRIPTOR_TYPE_CS_INTERFACE,
-        CDC_DESCRIPTOR_SUBTYPE_ABSTRACT_CONTROL_MANAGEMENT,
-        2,                                               // bmCapabilities.  See USBPSTN1.2 Table 4.  We support SetLineCoding,
-                                                         //SetControlLineState, GetLineCoding, and SerialState notifications.
-
-        5,                                               // 5-byte General Descriptor: Union Interface Functional Descriptor (CDC 1.20 Table 16).
-        CDC_DESCRIPTOR_TYPE_CS_INTERFACE,
-        CDC_DESCRIPTOR_SUBTYPE_UNION,
-        CDC_CONTROL_INTERFACE_NUMBER,                    // index of the control interface
-        CDC_DATA_INTERFACE_NUMBER,                       // index of the subordinate interface
-
-        5,                                               // 5-byte PTSN-Specific Descriptor
-        CDC_DESCRIPTOR_TYPE_CS_INTERFACE,
-        CDC_DESCRIPTOR_SUBTYPE_CALL_MANAGEMENT,
-        0x00,                                            // bmCapabilities.  USBPSTN1.2 Table 3.  Device does not handle call management.
-        CDC_DATA_INTERFACE_NUMBER                        // index of the data interface
-    },
-    {
-        sizeof(USB_DESCRIPTOR_ENDPOINT),
-        USB_DESCRIPTOR_TYPE_ENDPOINT,
-        USB_ENDPOINT_ADDRESS_IN | CDC_NOTIFICATION_ENDPOINT,  // bEndpointAddress
-        USB_TRANSFER_TYPE_INTERRUPT,                     // bmAttributes
-        10,                                              // wMaxPacketSize
-        1,                                               // bInterval
-    },
-    {
-        sizeof(USB_DESCRIPTOR_INTERFACE),         // Data Interface: used for RX and TX data.
-        USB_DESCRIPTOR_TYPE_INTERFACE,
-        CDC_DATA_INTERFACE_NUMBER,                       // bInterfaceNumber
-        0,                                               // bAlternateSetting
-        2,                                               // bNumEndpoints
-        CDC_DATA_INTERFACE_CLASS,                        // bInterfaceClass
-        0,                                               // bInterfaceSubClass
-        0,                                               // bInterfaceProtocol
-        0                                                // iInterface
-    },
-    {                                                    // OUT Endpoint: Sends data out to Wixel.
-        sizeof(USB_DESCRIPTOR_ENDPOINT),
-        USB_DESCRIPTOR_TYPE_ENDPOINT,
-        USB_ENDPOINT_ADDRESS_OUT | CDC_DATA_ENDPOINT,    // bEndpointAddress
-        USB_TRANSFER_TYPE_BULK,                          // bmAttributes
-        CDC_OUT_PACKET_SIZE,                             // wMaxPacketSize
-        0,                                               // bInterval
-    },
-    {
-        sizeof(USB_DESCRIPTOR_ENDPOINT),
-        USB_DESCRIPTOR_TYPE_ENDPOINT,
-        USB_ENDPOINT_ADDRESS_IN | CDC_DATA_ENDPOINT,     // bEndpointAddress
-        USB_TRANSFER_TYPE_BULK,                          // bmAttributes
-        CDC_IN_PACKET_SIZE,                              // wMaxPacketSize
-        0,                                               // bInterval
-    },
+#if USB_COM_PORT_COUNT == 1
+    CDC_FUNCTION_DESCRIPTORS(0),
+#else
+    CDC_ASSOCIATION_DESCRIPTOR(0),
+    CDC_FUNCTION_DESCRIPTORS(0),
+    CDC_ASSOCIATION_DESCRIPTOR(1),
+    CDC_FUNCTION_DESCRIPTORS(1),
+#endif
 };
 
 uint8 CODE usbStringDescriptorCount = 4;
@@ -233,36 +345,59 @@ uint16 CODE * CODE usbStringDescriptors[] = { languages, manufacturer, product,
 
 void usbCallbackInitEndpoints()
 {
-    usbInitEndpointIn(CDC_NOTIFICATION_ENDPOINT, 10);
-    usbInitEndpointOut(CDC_DATA_ENDPOINT, CDC_OUT_PACKET_SIZE);
-    usbInitEndpointIn(CDC_DATA_ENDPOINT, CDC_IN_PACKET_SIZE);
+    uint8 port;
+    for (port = 0; port < USB_COM_PORT_COUNT; port++)
+    {
+        usbInitEndpointIn(CDC_NOTIFICATION_ENDPOINT(port), 10);
+        usbInitEndpointOut(CDC_DATA_ENDPOINT(port), CDC_OUT_PACKET_SIZE);
+        usbInitEndpointIn(CDC_DATA_ENDPOINT(port), CDC_IN_PACKET_SIZE);
 
-    // Force an update to be sent to the computer.
-    lastReportedSerialState = 0xFF;
+        // Force an update to be sent to the computer.
+        lastReportedSerialState[port] = 0xFF;
+
+        // Discard any bytes left in the TX ring from before the host
+        // (re)configured us; they belonged to a previous session.
+        txRingHead[port] = txRingTail[port] = 0;
+    }
+}
+
+ACM_LINE_CODING XDATA * usbComPortLineCoding(uint8 port)
+{
+    USE_PORT();
+
+#if USB_COM_PORT_COUNT > 1
+    if (port)
+    {
+        return &usbComLineCoding1;
+    }
+#endif
+    return &usbComLineCoding;
 }
 
 // Implements all the control transfers that are required by D1 of the
 // ACM descriptor bmCapabilities, (USBPSTN1.20 Table 4).
 void usbCallbackSetupHandler()
 {
+    uint8 port = usbSetupPacket.wIndex >> 1;  // Each port has two interfaces.
+
     if ((usbSetupPacket.bmRequestType & 0x7F) != 0x21)   // Require Type==Class and Recipient==Interface.
         return;
 
-    if (!(usbSetupPacket.wIndex == CDC_CONTROL_INTERFACE_NUMBER || usbSetupPacket.wIndex == CDC_DATA_INTERFACE_NUMBER))
+    if (usbSetupPacket.wIndex >= 2 * USB_COM_PORT_COUNT)
         return;
 
     switch(usbSetupPacket.bRequest)
     {
         case ACM_REQUEST_SET_LINE_CODING:                          // SetLineCoding (USBPSTN1.20 Section 6.3.10 SetLineCoding)
-            usbControlWrite(sizeof(usbComLineCoding), (uint8 XDATA *)&usbComLineCoding);
+            usbControlWrite(sizeof(ACM_LINE_CODING), (uint8 XDATA *)usbComPortLineCoding(port));
             break;
 
         case ACM_REQUEST_GET_LINE_CODING:                          // GetLineCoding (USBPSTN1.20 Section 6.3.11 GetLineCoding)
-            usbControlRead(sizeof(usbComLineCoding), (uint8 XDATA *)&usbComLineCoding);
+            usbControlRead(sizeof(ACM_LINE_CODING), (uint8 XDATA *)usbComPortLineCoding(port));
             break;
 
         case ACM_REQUEST_SET_CONTROL_LINE_STATE:                   // SetControlLineState (USBPSTN1.20 Section 6.3.12 SetControlLineState)
-            usbComControlLineState = usbSetupPacket.wValue;
+            usbComControlLineState[PORT] = usbSetupPacket.wValue;
             usbControlAcknowledge();
             break;
     }
@@ -280,9 +415,11 @@ static void doNothing(void)
 
 void usbCallbackControlWriteHandler()
 {
+    // The only control write transfer we accept is SetLineCoding.
+    usbComLineCodingChangePort = usbSetupPacket.wIndex >> 1;
     usbComLineCodingChangeHandler();
 
-    if (usbComLineCoding.dwDTERate == 333 && !startBootloaderSoon)
+    if (usbComPortLineCoding(usbComLineCodingChangePort)->dwDTERate == 333 && !startBootloaderSoon)
     {
         // The baud rate has been set to 333.  That is the special signal
         // sent by the USB host telling us to enter bootloader mode.
@@ -296,16 +433,18 @@ void usbCallbackControlWriteHandler()
 // These functions can be called by the higher-level user of the CDC ACM library
 // to receive bytes from the computer.
 
-uint8 usbComRxAvailable()
+uint8 usbComPortRxAvailable(uint8 port)
 {
+    USE_PORT();
+
     if (usbDeviceState != USB_STATE_CONFIGURED)
     {
         // We have not reached the Configured state yet, so we should not be touching the non-zero endpoints.
         return 0;
     }
 
-    USBINDEX = CDC_DATA_ENDPOINT;      // Select the data endpoint.
-    if (USBCSOL & USBCSOL_OUTPKT_RDY)  // Check the OUTPKT_RDY flag because USBCNTL is only valid when it is 1.
+    USBINDEX = CDC_DATA_ENDPOINT(PORT);  // Select the data endpoint.
+    if (USBCSOL & USBCSOL_OUTPKT_RDY)    // Check the OUTPKT_RDY flag because USBCNTL is only valid when it is 1.
     {
         // Assumption: We don't need to read USBCNTH because we can't receive packets
         // larger than 255 bytes.
@@ -322,12 +461,14 @@ uint8 usbComRxAvailable()
 // larger than 255 bytes.
 // Assumption: The user has previously called usbComRxAvailable and its return value
 // was non-zero.
-uint8 usbComRxReceiveByte()
+uint8 usbComPortRxReceiveByte(uint8 port)
 {
     uint8 tmp;
 
-    USBINDEX = CDC_DATA_ENDPOINT;         // Select the CDC data endpoint.
-    tmp = CDC_DATA_FIFO;                  // Read one byte from the FIFO.
+    USE_PORT();
+
+    USBINDEX = CDC_DATA_ENDPOINT(PORT);   // Select the CDC data endpoint.
+    tmp = CDC_DATA_FIFO(PORT);            // Read one byte from the FIFO.
 
     if (USBCNTL == 0)                     // If there are no bytes left in this packet...
     {
@@ -340,9 +481,11 @@ uint8 usbComRxReceiveByte()
 
 // Assumption: The user has previously called usbComRxAvailable and its return value
 // was greater than or equal to size.
-void usbComRxReceive(uint8 XDATA* buffer, uint8 size)
+void usbComPortRxReceive(uint8 port, uint8 XDATA* buffer, uint8 size)
 {
-    usbReadFifo(CDC_DATA_ENDPOINT, size, buffer);
+    USE_PORT();
+
+    usbReadFifo(CDC_DATA_ENDPOINT(PORT), size, buffer);
 
     if (USBCNTL == 0)
     {
@@ -355,23 +498,98 @@ void usbComRxReceive(uint8 XDATA* buffer, uint8 size)
 // These functions can be called by the higher-level user of the CDC ACM library
 // to send bytes to the computer.
 
-static void sendPacketNow()
+static void sendPacketNow(uint8 port)
 {
-    USBINDEX = CDC_DATA_ENDPOINT;
+    USE_PORT();
+
+    USBINDEX = CDC_DATA_ENDPOINT(PORT);
     USBCSIL |= USBCSIL_INPKT_RDY;                      // Send the packet.
 
     // If the last packet transmitted was a full packet, we should send an empty packet later.
-    sendEmptyPacketSoon = (inFifoBytesLoaded == CDC_IN_PACKET_SIZE);
+    sendEmptyPacketSoon[PORT] = (inFifoBytesLoaded[PORT] == CDC_IN_PACKET_SIZE);
 
     // There are 0 bytes in the IN FIFO now.
-    inFifoBytesLoaded = 0;
+    inFifoBytesLoaded[PORT] = 0;
 
     // Notify the USB library that some activity has occurred.
     usbActivityFlag = 1;
 }
 
+// Returns the number of bytes that can be loaded into the IN FIFO right now.
+// Assumption: We are using double buffering, so we can load either 0, 1, or 2
+// packets into the FIFO at this time.
+static uint8 fifoAvailable(uint8 port)
+{
+    uint8 tmp;
+
+    USE_PORT();
+
+    if (usbDeviceState != USB_STATE_CONFIGURED)
+    {
+        // We have not reached the Configured state yet, so we should not be touching the non-zero endpoints.
+        return 0;
+    }
+
+    USBINDEX = CDC_DATA_ENDPOINT(PORT);
+    tmp = USBCSIL;
+    if (tmp & USBCSIL_PKT_PRESENT)
+    {
+        if (tmp & USBCSIL_INPKT_RDY)
+        {
+            return 0;                                             // 2 packets are in the FIFO, so no room
+        }
+        return CDC_IN_PACKET_SIZE - inFifoBytesLoaded[PORT];      // 1 packet is in the FIFO, so there is room for 1 more
+    }
+    else
+    {
+        return (CDC_IN_PACKET_SIZE<<1) - inFifoBytesLoaded[PORT]; // 0 packets are in the FIFO, so there is room for 2 more
+    }
+}
+
+// Assumption: fifoAvailable() recently returned a number greater than or equal to size.
+static void fifoSend(uint8 port, const uint8 XDATA * buffer, uint8 size)
+{
+    uint8 packetSize;
+    while(size)
+    {
+        packetSize = CDC_IN_PACKET_SIZE - inFifoBytesLoaded[PORT];  // Decide how many bytes to send in this packet (packetSize).
+        if (packetSize > size){ packetSize = size; }
+
+        usbWriteFifo(CDC_DATA_ENDPOINT(PORT), packetSize, buffer);  // Write those bytes to the USB FIFO.
+
+        buffer += packetSize;                                       // Update pointers.
+        size -= packetSize;
+        inFifoBytesLoaded[PORT] += packetSize;
+
+        if (inFifoBytesLoaded[PORT] == CDC_IN_PACKET_SIZE)
+        {
+            sendPacketNow(port);
+        }
+    }
+}
+
+// Moves as many bytes as possible from the TX ring to the IN FIFO.
+// When this returns, either the ring is empty or the FIFO is full.
+static void txRingService(uint8 port)
+{
+    uint16 used;
+    uint8 chunkSize;
+
+    while((used = TX_RING_USED(PORT)) && (chunkSize = fifoAvailable(port)))
+    {
+        // Don't go past the end of the ring buffer in a single write.
+        if (chunkSize > used){ chunkSize = used; }
+        if (chunkSize > txRingMask[PORT] + 1 - txRingTail[PORT]){ chunkSize = txRingMask[PORT] + 1 - txRingTail[PORT]; }
+
+        fifoSend(port, txRing[PORT] + txRingTail[PORT], chunkSize);
+        txRingTail[PORT] = (txRingTail[PORT] + chunkSize) & txRingMask[PORT];
+    }
+}
+
 void usbComService(void)
 {
+    uint8 port;
+
     usbPoll();
 
     // Start bootloader if necessary.
@@ -394,117 +612,150 @@ void usbComService(void)
         return;
     }
 
-    // Send a packet now if there is data loaded in the FIFO waiting to be sent OR
-    //
-    // Typical USB systems wait for a short or empty packet before forwarding the data
-    // up to the software that requested it, so this is necessary.  However, we only transmit
-    // an empty packet if there are no packets currently loaded in the FIFO.
-    USBINDEX = CDC_DATA_ENDPOINT;
-    if (inFifoBytesLoaded || ( sendEmptyPacketSoon && !(USBCSIL & USBCSIL_PKT_PRESENT) ) )
+    for (port = 0; port < USB_COM_PORT_COUNT; port++)
     {
-        sendPacketNow();
-    }
+        // Refill the FIFO from the TX ring (if streaming mode is enabled).
+        if (txRingMask[PORT])
+        {
+            txRingService(port);
+        }
 
-    // Notify the computer of the current serial state if necessary.
-    USBINDEX = CDC_NOTIFICATION_ENDPOINT;
-    if (usbComSerialState != lastReportedSerialState && !(USBCSIL & USBCSIL_INPKT_RDY))
-    {
-        // The serial state has changed since the last time we sent it.
-        // AND we are ready to send it to the USB host, so send it.
-        // See PSTN Section 6.5.4, SerialState for an explanation of this packet.
+        // Send a packet now if there is data loaded in the FIFO waiting to be sent OR
+        //
+        // Typical USB systems wait for a short or empty packet before forwarding the data
+        // up to the software that requested it, so this is necessary.  However, we only transmit
+        // an empty packet if there are no packets currently loaded in the FIFO.
+        USBINDEX = CDC_DATA_ENDPOINT(PORT);
+        if (inFifoBytesLoaded[PORT] || ( sendEmptyPacketSoon[PORT] && !(USBCSIL & USBCSIL_PKT_PRESENT) ) )
+        {
+            sendPacketNow(port);
+        }
 
-        CDC_NOTIFICATION_FIFO = 0b10100001;   // bRequestType: Direction=IN, Type=Class, Sender=Interface
-        CDC_NOTIFICATION_FIFO = ACM_NOTIFICATION_SERIAL_STATE; // bRequest
+        // Notify the computer of the current serial state if necessary.
+        USBINDEX = CDC_NOTIFICATION_ENDPOINT(PORT);
+        if (usbComSerialState[PORT] != lastReportedSerialState[PORT] && !(USBCSIL & USBCSIL_INPKT_RDY))
+        {
+            // The serial state has changed since the last time we sent it.
+            // AND we are ready to send it to the USB host, so send it.
+            // See PSTN Section 6.5.4, SerialState for an explanation of this packet.
+
+            CDC_NOTIFICATION_FIFO(PORT) = 0b10100001;   // bRequestType: Direction=IN, Type=Class, Sender=Interface
+            CDC_NOTIFICATION_FIFO(PORT) = ACM_NOTIFICATION_SERIAL_STATE; // bRequest
 
-        // wValue is zero.
-        CDC_NOTIFICATION_FIFO = 0;
-        CDC_NOTIFICATION_FIFO = 0;
+            // wValue is zero.
+            CDC_NOTIFICATION_FIFO(PORT) = 0;
+            CDC_NOTIFICATION_FIFO(PORT) = 0;
 
-        // wIndex is the number of the interface this notification comes from.
-        CDC_NOTIFICATION_FIFO = CDC_CONTROL_INTERFACE_NUMBER;
-        CDC_NOTIFICATION_FIFO = 0;
+            // wIndex is the number of the interface this notification comes from.
+            CDC_NOTIFICATION_FIFO(PORT) = CDC_CONTROL_INTERFACE_NUMBER(PORT);
+            CDC_NOTIFICATION_FIFO(PORT) = 0;
 
-        // wLength is 2 because the data part has two bytes
-        CDC_NOTIFICATION_FIFO = 2;
-        CDC_NOTIFICATION_FIFO = 0;
+            // wLength is 2 because the data part has two bytes
+            CDC_NOTIFICATION_FIFO(PORT) = 2;
+            CDC_NOTIFICATION_FIFO(PORT) = 0;
 
-        // Data
-        CDC_NOTIFICATION_FIFO = usbComSerialState;
-        CDC_NOTIFICATION_FIFO = 0;
+            // Data
+            CDC_NOTIFICATION_FIFO(PORT) = usbComSerialState[PORT];
+            CDC_NOTIFICATION_FIFO(PORT) = 0;
 
-        USBCSIL |= USBCSIL_INPKT_RDY;
+            USBCSIL |= USBCSIL_INPKT_RDY;
 
-        // As specified in PSTN 1.20 Section 6.5.4, we clear the "irregular" signals.
-        usbComSerialState &= ~ACM_IRREGULAR_SIGNAL_MASK;
+            // As specified in PSTN 1.20 Section 6.5.4, we clear the "irregular" signals.
+            usbComSerialState[PORT] &= ~ACM_IRREGULAR_SIGNAL_MASK;
 
-        lastReportedSerialState = usbComSerialState;
+            lastReportedSerialState[PORT] = usbComSerialState[PORT];
 
-        // Notify the USB library that some activity has occurred.
-        usbActivityFlag = 1;
+            // Notify the USB library that some activity has occurred.
+            usbActivityFlag = 1;
+        }
     }
 }
 
-// Assumption: We are using double buffering, so we can load either 0, 1, or 2
-// packets into the FIFO at this time.
-uint8 usbComTxAvailable()
+void usbComPortTxStreamingEnable(uint8 port, uint8 XDATA * buffer, uint16 size)
 {
-    uint8 tmp;
+    USE_PORT();
+
+    txRing[PORT] = buffer;
+    txRingHead[PORT] = txRingTail[PORT] = 0;
+    txRingMask[PORT] = size - 1;
+}
 
+uint16 usbComPortTxSpace(uint8 port)
+{
     if (usbDeviceState != USB_STATE_CONFIGURED)
     {
-        // We have not reached the Configured state yet, so we should not be touching the non-zero endpoints.
+        // Don't let bytes pile up in the ring while there is no host to read
+        // them; they would be sent as stale data once we are configured.
         return 0;
     }
 
-    USBINDEX = CDC_DATA_ENDPOINT;
-    tmp = USBCSIL;
-    if (tmp & USBCSIL_PKT_PRESENT)
+    if (txRingMask[PORT] == 0)
     {
-        if (tmp & USBCSIL_INPKT_RDY)
-        {
-            return 0;                                       // 2 packets are in the FIFO, so no room
-        }
-        return CDC_IN_PACKET_SIZE - inFifoBytesLoaded;      // 1 packet is in the FIFO, so there is room for 1 more
-    }
-    else
-    {
-        return (CDC_IN_PACKET_SIZE<<1) - inFifoBytesLoaded; // 0 packets are in the FIFO, so there is room for 2 more
+        return fifoAvailable(port);
     }
+
+    // The ring only has data in it if the FIFO is full, so the space in the
+    // FIFO and the space in the ring can be added together.
+    txRingService(port);
+    return txRingMask[PORT] - TX_RING_USED(PORT) + fifoAvailable(port);
 }
 
-// Assumption: The user called usbComTxAvailable() before calling this function,
-// and it returned a number greater than or equal to size.
-void usbComTxSend(const uint8 XDATA * buffer, uint8 size)
+uint8 usbComPortTxAvailable(uint8 port)
 {
-    uint8 packetSize;
-    while(size)
-    {
-        packetSize = CDC_IN_PACKET_SIZE - inFifoBytesLoaded;   // Decide how many bytes to send in this packet (packetSize).
-        if (packetSize > size){ packetSize = size; }
+    uint16 space = usbComPortTxSpace(port);
+    return space > 255 ? 255 : space;
+}
 
-        usbWriteFifo(CDC_DATA_ENDPOINT, packetSize, buffer);    // Write those bytes to the USB FIFO.
+// Assumption: The user called usbComTxSpace() or usbComTxAvailable() before calling
+// this function, and it returned a number greater than or equal to size.
+void usbComPortTxSend(uint8 port, const uint8 XDATA * buffer, uint16 size)
+{
+    uint16 chunkSize;
 
-        buffer += packetSize;                                   // Update pointers.
-        size -= packetSize;
-        inFifoBytesLoaded += packetSize;
+    if (txRingMask[PORT] == 0)
+    {
+        fifoSend(port, buffer, (uint8)size);
+        return;
+    }
 
-        if (inFifoBytesLoaded == CDC_IN_PACKET_SIZE)
-        {
-            sendPacketNow();
-        }
+    // Bytes can only go directly to the FIFO if there are none waiting in the ring.
+    if (TX_RING_USED(PORT) == 0)
+    {
+        chunkSize = fifoAvailable(port);
+        if (chunkSize > size){ chunkSize = size; }
+        fifoSend(port, buffer, (uint8)chunkSize);
+        buffer += chunkSize;
+        size -= chunkSize;
+    }
+
+    // Put the rest of the bytes in the ring.  usbComService() will load them
+    // into the FIFO as soon as the USB host reads the packets ahead of them.
+    while(size)
+    {
+        txRing[PORT][txRingHead[PORT]] = *buffer++;
+        txRingHead[PORT] = (txRingHead[PORT] + 1) & txRingMask[PORT];
+        size--;
     }
 }
 
-void usbComTxSendByte(uint8 byte)
+void usbComPortTxSendByte(uint8 port, uint8 byte)
 {
     // Assumption: usbComTxAvailable() recently returned a non-zero number
 
-    CDC_DATA_FIFO = byte;                          // Give the byte to the USB module's FIFO.
-    inFifoBytesLoaded++;
+    if (txRingMask[PORT] && (TX_RING_USED(PORT) || fifoAvailable(port) == 0))
+    {
+        // The FIFO is full or there are bytes ahead of this one in the ring.
+        txRing[PORT][txRingHead[PORT]] = byte;
+        txRingHead[PORT] = (txRingHead[PORT] + 1) & txRingMask[PORT];
+        return;
+    }
+
+    CDC_DATA_FIFO(PORT) = byte;                    // Give the byte to the USB module's FIFO.
+    inFifoBytesLoaded[PORT]++;
 
-    if (inFifoBytesLoaded == CDC_IN_PACKET_SIZE)
+    if (inFifoBytesLoaded[PORT] == CDC_IN_PACKET_SIZE)
     {
-        sendPacketNow();
+        sendPacketNow(port);
     }
 
     // Don't set usbActivityFlag here; wait until we actually send the packet.
@@ -512,17 +763,79 @@ void usbComTxSendByte(uint8 byte)
 
 /* CDC ACM CONTROL SIGNAL FUNCTIONS *******************************************/
 
+uint8 usbComPortRxControlSignals(uint8 port)
+{
+    USE_PORT();
+    return usbComControlLineState[PORT];
+}
+
+void usbComPortTxControlSignals(uint8 port, uint8 signals)
+{
+    USE_PORT();
+    usbComSerialState[PORT] = (usbComSerialState[PORT] & ACM_IRREGULAR_SIGNAL_MASK) | signals;
+}
+
+void usbComPortTxControlSignalEvents(uint8 port, uint8 signalEvents)
+{
+    USE_PORT();
+    usbComSerialState[PORT] |= signalEvents;
+}
+
+/* SINGLE-PORT FUNCTIONS ******************************************************/
+// These functions use the first port, so code written for a device with one
+// virtual COM port works without changes.
+
+uint8 usbComRxAvailable()
+{
+    return usbComPortRxAvailable(0);
+}
+
+uint8 usbComRxReceiveByte()
+{
+    return usbComPortRxReceiveByte(0);
+}
+
+void usbComRxReceive(uint8 XDATA* buffer, uint8 size)
+{
+    usbComPortRxReceive(0, buffer, size);
+}
+
+void usbComTxStreamingEnable(uint8 XDATA * buffer, uint16 size)
+{
+    usbComPortTxStreamingEnable(0, buffer, size);
+}
+
+uint16 usbComTxSpace()
+{
+    return usbComPortTxSpace(0);
+}
+
+uint8 usbComTxAvailable()
+{
+    return usbComPortTxAvailable(0);
+}
+
+void usbComTxSend(const uint8 XDATA * buffer, uint16 size)
+{
+    usbComPortTxSend(0, buffer, size);
+}
+
+void usbComTxSendByte(uint8 byte)
+{
+    usbComPortTxSendByte(0, byte);
+}
+
 uint8 usbComRxControlSignals()
 {
-    return usbComControlLineState;
+    return usbComControlLineState[0];
 }
 
 void usbComTxControlSignals(uint8 signals)
 {
-    usbComSerialState = (usbComSerialState & ACM_IRREGULAR_SIGNAL_MASK) | signals;
+    usbComPortTxControlSignals(0, signals);
 }
 
 void usbComTxControlSignalEvents(uint8 signalEvents)
 {
-    usbComSerialState |= signalEvents;
+    usbComSerialState[0] |= signalEvents;
 }
@@ -0,0 +1,14 @@
+# This library is a composite USB device with two virtual COM ports.
+# It will be made from usb_cdc_acm2.rel.
+LIB_RELS := libraries/src/usb_cdc_acm2/usb_cdc_acm2.rel
+
+# When that rel (object) file is compiled, there will be a special
+# preprocessor flag to specify the number of ports.
+libraries/src/usb_cdc_acm2/usb_cdc_acm2.rel : C_FLAGS += -DUSB_COM_PORT_COUNT=2
+
+# The rel file will be compiled from usb_cdc_acm2.c, which will be a
+# copy of usb_cdc_acm/usb_cdc_acm.c.
+libraries/src/usb_cdc_acm2/usb_cdc_acm2.c : libraries/src/usb_cdc_acm/usb_cdc_acm.c
+	$(CP) $< $@
+
+TARGETS += libraries/src/usb_cdc_acm2/usb_cdc_acm2.c
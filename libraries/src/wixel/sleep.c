@@ -98,19 +98,19 @@ void sleepMode1(uint16 seconds)
    boardClockInit(); 
 }
 
-void sleepMode2(uint16 seconds, uint8 port_interrupts)
+// Enters sleep mode 2 until the sleep timer reaches desired_event0.
+// resolution is the value of WORCTRL.WOR_RES: 3 for units of 1 second or
+// 1 for units of 1/1024 second.
+static void sleepMode2Event(uint8 resolution, uint16 desired_event0, uint8 port_interrupts)
 {
    unsigned char temp;
-   unsigned short desired_event0;
    
    unsigned char storedDescHigh, storedDescLow;
    BIT	storedDma0Armed;
    unsigned char storedIEN0, storedIEN1, storedIEN2;
    
-   desired_event0 = seconds;
-   
-   // set Sleep Timer to the lowest resolution (1 second)      
-   WORCTRL |= 0x03; 
+   // set Sleep Timer resolution
+   WORCTRL = (WORCTRL & ~0x03) | resolution;
    // must be using RC OSC before going to PM2
    switchToRCOSC();
    
@@ -193,6 +193,19 @@ void sleepMode2(uint16 seconds, uint8 port_interrupts)
    boardClockInit();   
 }
 
+void sleepMode2(uint16 seconds, uint8 port_interrupts)
+{
+   // Use the lowest resolution (1 second)
+   sleepMode2Event(3, seconds, port_interrupts);
+}
+
+void sleepMode2Ms(uint16 milliseconds, uint8 port_interrupts)
+{
+   // Use a resolution of 1/1024 second (32 periods of the 32 kHz clock)
+   uint32 event0 = ((uint32)milliseconds * 1024 + 500) / 1000;
+   sleepMode2Event(1, event0 > 0xFFFF ? 0xFFFF : event0, port_interrupts);
+}
+
 
 void sleepMode3(void)
 {  
@@ -12,11 +12,15 @@ PDATA volatile uint32 timeMs;
 
 ISR(T4, 0)
 {
+    // Disable interrupts so that a higher-priority interrupt that calls
+    // getTicks() never sees a half-updated value.
+    EA = 0;
     timeMs++;
+    EA = 1;
     // T4CC0 ^= 1; // If we do this, then on average the interrupts will occur precisely 1.000 ms apart.
 }
 
-uint32 getMs()
+uint32 getMs() __reentrant
 {
     uint8 oldT4IE = T4IE;   // store state of timer 4 interrupt (active/inactive?)
     uint32 time;
@@ -26,6 +30,31 @@ uint32 getMs()
     return time;            // return timer count copy
 }
 
+uint16 getTicks() __reentrant
+{
+    uint8 interruptsEnabled = EA;
+    uint16 ms;
+    uint8 count;
+
+    EA = 0;
+    ms = timeMs;
+    count = T4CNT;
+
+    // If Timer 4 has overflowed but its interrupt has not run yet (because
+    // we are in a higher-priority interrupt or interrupts were disabled),
+    // timeMs is one behind.
+    if (T4IF && count < 94)
+    {
+        ms++;
+    }
+    EA = interruptsEnabled;
+
+    // T4CNT goes from 0 to 187 each millisecond; 43/256 is approximately 32/188.
+    // The multiplication is done with shifts so it does not call a non-reentrant
+    // library function.
+    return (ms << 5) + (uint8)((((uint16)count << 5) + ((uint16)count << 3) + (count << 1) + count) >> 8);
+}
+
 void timeInit()
 {
     T4CC0 = 187;
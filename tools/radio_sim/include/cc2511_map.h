@@ -0,0 +1,69 @@
+/* cc2511_map.h (radio_sim stand-in):
+ *  The radio simulator uses this file instead of libraries/include/cc2511_map.h.
+ *  Each register that the radio libraries use is an ordinary global variable, so
+ *  every simulated Wixel (which is a separate copy of a node library) has its
+ *  own set.  Registers that the libraries only write are just stored; the ones
+ *  that describe the radio configuration (CHANNR, PKTLEN, PKTCTRL0, MDMCFG1,
+ *  MDMCFG3, MDMCFG4, MCSM0, MCSM2, WOREVT1, FSCTRL1) are read by sim_radio.c when
+ *  radio_mac.c starts the simulated radio, and a calibration writes FSCAL1 and
+ *  FSCAL2.
+ *
+ *  The registers whose reads or writes make the hardware do something (RFST,
+ *  RFIF, S1CON, MARCSTATE and PKTSTATUS) are function calls into sim_radio.c.
+ *
+ *  To use a register that is not listed here, add it to SIM_REGISTERS.
+ */
+
+#ifndef _CC2511_MAP_H
+#define _CC2511_MAP_H
+
+#include <cc2511_types.h>
+
+#define SIM_REGISTERS(R) \
+  R(IEN2) R(EA) R(RFIM) R(RFD) \
+  R(DMAARM) R(DMAIRQ) \
+  R(WORCTRL) R(WOREVT0) R(WOREVT1) \
+  R(CHANNR) R(PKTLEN) R(PKTCTRL0) R(PKTCTRL1) \
+  R(MCSM0) R(MCSM1) R(MCSM2) \
+  R(MDMCFG0) R(MDMCFG1) R(MDMCFG2) R(MDMCFG3) R(MDMCFG4) R(DEVIATN) \
+  R(FREQ0) R(FREQ1) R(FREQ2) R(FSCTRL0) R(FSCTRL1) \
+  R(FSCAL0) R(FSCAL1) R(FSCAL2) R(FSCAL3) \
+  R(FREND0) R(FREND1) R(FOCCFG) R(BSCFG) \
+  R(AGCCTRL0) R(AGCCTRL1) R(AGCCTRL2) \
+  R(TEST0) R(TEST1) R(TEST2) R(PA_TABLE0) \
+  R(RSSI) R(LQI)
+
+#define SIM_DECLARE_REGISTER(name) extern volatile uint8 name;
+SIM_REGISTERS(SIM_DECLARE_REGISTER)
+
+// Writing to one of these stores the value, and the next access (or the end of
+// the ISR or main loop iteration) makes the simulated hardware act on it.
+volatile uint8 * simRfst(void);
+volatile uint8 * simRfif(void);
+volatile uint8 * simS1con(void);
+#define RFST  (*simRfst())
+#define RFIF  (*simRfif())
+#define S1CON (*simS1con())
+
+uint8 simMarcstate(void);
+uint8 simPktstatus(void);
+#define MARCSTATE (simMarcstate())
+#define PKTSTATUS (simPktstatus())
+
+// Only RFD is used with this macro.
+#define SFR_ADDRESS_RFD 0xD9
+#define XDATA_SFR_ADDRESS(sfr) (0xDF00 + SFR_ADDRESS_##sfr)
+
+typedef struct
+{
+    unsigned char SRCADDRH;
+    unsigned char SRCADDRL;
+    unsigned char DESTADDRH;
+    unsigned char DESTADDRL;
+    unsigned char VLEN_LENH;
+    unsigned char LENL;
+    unsigned char DC6;
+    unsigned char DC7;
+} DMA_CONFIG;
+
+#endif
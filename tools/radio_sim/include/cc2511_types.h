@@ -0,0 +1,29 @@
+/* cc2511_types.h (radio_sim stand-in):
+ *  The radio simulator compiles the radio libraries with gcc instead of SDCC, so it
+ *  uses this file instead of libraries/include/cc2511_types.h.  The integer types
+ *  have the same sizes as on the CC2511, the memory space qualifiers do nothing,
+ *  and BIT is a C99 _Bool so that it only ever holds 0 or 1, like an 8051 bit.
+ */
+
+#ifndef _TYPES_H
+#define _TYPES_H
+
+typedef unsigned char  uint8;
+typedef signed   char  int8;
+typedef unsigned short uint16;
+typedef signed   short int16;
+typedef unsigned int   uint32;
+typedef signed   int   int32;
+
+typedef _Bool BIT;
+
+#define CODE
+#define XDATA
+#define DATA
+#define PDATA
+#define __reentrant
+
+// In the simulator, an ISR is an ordinary function that the simulator calls.
+#define ISR(source, bank) void ISR_##source(void)
+
+#endif
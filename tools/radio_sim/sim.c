@@ -0,0 +1,988 @@
+/* sim.c:
+ *  A host (Linux) simulator for radio_link.lib, radio_com.lib, radio_net.lib and
+ *  radio_queue.lib.
+ *
+ *  It runs several simulated Wixels over a simulated channel with configurable
+ *  loss, corruption, latency and collisions.  Each Wixel is a copy of a node
+ *  library built from the unmodified radio libraries (including radio_mac.c and
+ *  radio_registers.c) and a small app:
+ *  - radio_sim_link.so (sim_link.c): radio_link.c and radio_com.c.
+ *    Wixels 2k and 2k+1 are a pair on their own channel (radio_link does not have
+ *    addresses): Wixel 2k streams bytes to Wixel 2k+1, and the other way too with -b.
+ *  - radio_sim_net.so (sim_net.c), with -N: radio_net.c.  Wixel 0 is the hub and
+ *    every other Wixel is a node that streams bytes to it.  With -b, the hub
+ *    streams bytes to every node too.
+ *  - radio_sim_queue.so (sim_queue.c), with -Q: radio_queue.c.  Wixel 0 receives
+ *    and every other Wixel streams bytes to it; with -T they use TDMA, and Wixel 0
+ *    sends the beacons.  radio_queue does not retransmit, so this shows how many
+ *    of the packets get through when several transmitters share the channel.
+ *  Time is simulated, so a run is deterministic for a given seed and takes much
+ *  less than the simulated time.
+ *
+ *  At the end, it prints the throughput and the latency percentiles of each
+ *  stream, and the counters from the radio libraries for each Wixel.
+ *
+ *  The radio model:
+ *  - A packet is on the air for (8 preamble + 4 sync + length + 2 CRC) bytes at the
+ *    data rate in MDMCFG3/MDMCFG4, doubled (and padded) when FEC is enabled.
+ *    With -d, it starts and ends that much later at the receivers than at the
+ *    sender, like a propagation delay.
+ *  - Starting RX or TX takes 30 us from FSTXON, 90 us from IDLE, or 800 us from
+ *    IDLE if radio_mac decided to calibrate.
+ *  - A Wixel hears a packet if it was in RX on the same channel, data rate and FEC
+ *    setting by the middle of the preamble.  It then gets the packet (an RX event)
+ *    when the packet ends, unless it stopped listening first.  With -l, that
+ *    many packets are missed completely, and with -c that many arrive with a bad CRC.
+ *    With -J, every packet on that channel arrives with a bad CRC, like a channel
+ *    with an interferer on it.
+ *  - A radio that starts on a channel without a calibration for it (FSCAL1 and
+ *    FSCAL2 from another channel or data rate) is off frequency: it does not hear
+ *    anything, and nothing hears it.
+ *  - Two packets that overlap at the receiver on the same channel collide: the
+ *    receiver gets the first one with a bad CRC and misses the second.
+ *  - An RX timeout happens at the programmed time unless a sync word was found.
+ *  - Each run of the RF ISR keeps the CPU busy for -i microseconds, and anything
+ *    the ISR starts on the radio starts at the end of it.  The main loop runs
+ *    between interrupts and takes -m microseconds per iteration plus 2 us per byte
+ *    it moves.
+ *
+ *  Build it with "make" in this directory (it needs gcc and glibc).  Run
+ *  "./radio_sim -h" for the options.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+#define MAX_NODES 14
+
+#define PREAMBLE_BYTES        8
+#define SYNC_BYTES            4
+#define CRC_BYTES             2
+#define PREAMBLE_DETECT_BYTES 4
+
+#define START_FROM_FSTXON_US  30
+#define START_FROM_IDLE_US    90
+#define CALIBRATION_US        800
+
+#define LOOP_BYTE_US          2
+
+#define EVENT_LOOP            0
+#define EVENT_ISR             1
+#define EVENT_RADIO_READY     2
+#define EVENT_TX_END          3
+#define EVENT_RX_END          4
+#define EVENT_RX_TIMEOUT      5
+#define EVENT_ARRIVAL         6
+
+// The number of recent transmissions the simulator remembers.  A packet is on the
+// air at the receivers from its start to its end, both delayed by -d, so the
+// simulator has to remember it until then.
+#define TRANSMISSION_COUNT    64
+
+typedef struct Event
+{
+    uint64_t time;
+    uint64_t sequence;
+    uint8_t type;
+    uint8_t node;
+    uint32_t generation;
+} Event;
+
+// A packet that was sent, as the receivers hear it (delayed by -d).
+typedef struct Transmission
+{
+    uint32_t index;             // Which transmission this is (it is in transmissions[index % TRANSMISSION_COUNT]).
+    uint8_t from;
+    SimRadioConfig config;
+    uint64_t start;             // When the preamble starts arriving.
+    uint64_t end;               // When the last byte has arrived.
+    uint8_t arrived;            // 1 after the receivers that were listening have started receiving it.
+    uint8_t length;
+    uint8_t data[256];
+} Transmission;
+
+typedef struct Radio
+{
+    uint8_t state;
+    uint8_t startingTx;         // In SIM_RADIO_STARTING: 1 if going to TX, 0 if going to RX.
+    uint32_t generation;        // Incremented whenever the radio is stopped or started, to cancel old events.
+    SimRadioConfig config;
+    uint8_t * rxBuffer;
+
+    // The packet being received.
+    uint8_t locked;
+    uint64_t lockSyncTime;
+    uint8_t lockCorrupt;
+    uint8_t lockLength;
+    uint8_t lockData[256];
+
+    // The packet being sent.
+    uint8_t txLength;
+    uint8_t txData[256];
+
+    uint8_t irqFlags;
+    uint8_t isrPending;
+} Radio;
+
+typedef struct Sample
+{
+    uint32_t total;
+    uint64_t time;
+} Sample;
+
+// The bytes that one Wixel sends to another.
+typedef struct Stream
+{
+    // When bytes of the stream were queued, for measuring latency.
+    Sample * samples;
+    uint32_t sampleCount, sampleFirst, sampleCapacity;
+
+    // The latency of the bytes the receiver got, in microseconds.
+    uint32_t * latencies;
+    uint32_t latencyCount, latencyCapacity;
+
+    uint32_t received;
+    uint32_t lost;              // Bytes before "received" that the receiver will never get.
+} Stream;
+
+typedef struct Node
+{
+    SimNodeInitFunction * init;
+    SimNodeLoopFunction * loop;
+    SimNodeIsrFunction * isr;
+    SimNodeReportFunction * report;
+
+    SimNodeConfig config;
+    Radio radio;
+    uint64_t busyUntil;
+    uint8_t inIsr;
+} Node;
+
+static Node nodes[MAX_NODES];
+static uint8_t nodeCount = 2;
+
+// streams[from][to]
+static Stream streams[MAX_NODES][MAX_NODES];
+
+static uint64_t simTime;
+static uint64_t eventSequence;
+static Event * events;
+static uint32_t eventCount, eventCapacity;
+
+static Transmission transmissions[TRANSMISSION_COUNT];
+static uint32_t transmissionCount;
+
+// Options.
+static double lossRate = 0;
+static double corruptRate = 0;
+static uint8_t jammed[256];
+static uint32_t latencyUs = 0;
+static uint32_t isrUs = 60;
+static uint32_t loopUs = 20;
+static int rssi = -50;
+static uint64_t randomState = 1;
+static uint8_t verbose = 0;
+static uint8_t netMode = 0;
+static uint8_t queueMode = 0;
+
+/* UTILITIES ******************************************************************/
+
+static void * checkedRealloc(void * p, size_t size)
+{
+    p = realloc(p, size);
+    if (p == NULL)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        exit(1);
+    }
+    return p;
+}
+
+// xorshift64*: a small deterministic random number generator for the channel.
+static double randomFraction()
+{
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return (double)((randomState * 0x2545F4914F6CDD1DULL) >> 11) / (double)(1ULL << 53);
+}
+
+/* EVENT QUEUE (a binary heap ordered by time, then by the order of scheduling) */
+
+static int eventBefore(const Event * a, const Event * b)
+{
+    return a->time < b->time || (a->time == b->time && a->sequence < b->sequence);
+}
+
+static void schedule(uint64_t time, uint8_t type, uint8_t node, uint32_t generation)
+{
+    uint32_t i;
+
+    if (eventCount == eventCapacity)
+    {
+        eventCapacity = eventCapacity ? eventCapacity * 2 : 64;
+        events = checkedRealloc(events, eventCapacity * sizeof(Event));
+    }
+
+    i = eventCount++;
+    events[i].time = time;
+    events[i].sequence = eventSequence++;
+    events[i].type = type;
+    events[i].node = node;
+    events[i].generation = generation;
+
+    while (i > 0 && eventBefore(&events[i], &events[(i - 1) / 2]))
+    {
+        Event tmp = events[i];
+        events[i] = events[(i - 1) / 2];
+        events[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+static Event popEvent()
+{
+    Event first = events[0];
+    uint32_t i = 0;
+
+    events[0] = events[--eventCount];
+    while (1)
+    {
+        uint32_t smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        Event tmp;
+        if (left < eventCount && eventBefore(&events[left], &events[smallest])) { smallest = left; }
+        if (right < eventCount && eventBefore(&events[right], &events[smallest])) { smallest = right; }
+        if (smallest == i) { break; }
+        tmp = events[i];
+        events[i] = events[smallest];
+        events[smallest] = tmp;
+        i = smallest;
+    }
+    return first;
+}
+
+/* RADIO MODEL ****************************************************************/
+
+static uint32_t byteUs(const SimRadioConfig * config)
+{
+    return 8000000 / config->bitRate;
+}
+
+// Returns the number of bytes on the air for a packet of the given length
+// (the length byte and payload, or PKTLEN bytes in fixed-length mode).
+static uint32_t airBytes(const SimRadioConfig * config, uint8_t length)
+{
+    uint32_t bytes = length + CRC_BYTES;
+    if (config->fec)
+    {
+        // The convolutional code doubles the data, and the interleaver works
+        // on blocks of 4 coded bytes.
+        bytes = (bytes * 2 + 3) / 4 * 4;
+    }
+    return PREAMBLE_BYTES + SYNC_BYTES + bytes;
+}
+
+static int sameAir(const SimRadioConfig * a, const SimRadioConfig * b)
+{
+    return a->channel == b->channel && a->bitRate == b->bitRate && a->fec == b->fec &&
+        a->tuned && b->tuned;
+}
+
+// The time at which a radio command given now takes effect: commands given in
+// the ISR happen at the end of it.
+static uint64_t commandTime(uint8_t n)
+{
+    return nodes[n].inIsr ? nodes[n].busyUntil : simTime;
+}
+
+static void raiseIrq(uint8_t n, uint8_t flags)
+{
+    Radio * radio = &nodes[n].radio;
+    radio->irqFlags |= flags;
+    if (!radio->isrPending)
+    {
+        radio->isrPending = 1;
+        schedule(simTime > nodes[n].busyUntil ? simTime : nodes[n].busyUntil, EVENT_ISR, n, 0);
+    }
+}
+
+static void stopRadio(uint8_t n, uint8_t state)
+{
+    Radio * radio = &nodes[n].radio;
+    radio->state = state;
+    radio->generation++;
+    radio->locked = 0;
+}
+
+static uint64_t startDelay(Radio * radio, uint8_t calibrate)
+{
+    if (radio->state == SIM_RADIO_IDLE)
+    {
+        return calibrate ? CALIBRATION_US : START_FROM_IDLE_US;
+    }
+    return START_FROM_FSTXON_US;
+}
+
+// Returns 1 if the transmission is arriving at the receivers now.
+static int onAir(const Transmission * t)
+{
+    return t->start <= simTime && simTime < t->end;
+}
+
+// Called when a receiver starts hearing a packet.
+static void lockOnto(uint8_t r, const Transmission * t)
+{
+    Radio * radio = &nodes[r].radio;
+    uint8_t i;
+
+    if (randomFraction() < lossRate)
+    {
+        return;
+    }
+
+    radio->locked = 1;
+    radio->lockSyncTime = t->start + (PREAMBLE_BYTES + SYNC_BYTES) * byteUs(&t->config);
+    radio->lockLength = t->length;
+    memcpy(radio->lockData, t->data, t->length);
+    radio->lockCorrupt = jammed[t->config.channel] || randomFraction() < corruptRate;
+
+    // Any other packet on the air on this channel garbles this one.
+    for (i = 0; i < TRANSMISSION_COUNT; i++)
+    {
+        const Transmission * other = &transmissions[i];
+        if (other != t && other->from != r && onAir(other) && other->config.channel == t->config.channel)
+        {
+            radio->lockCorrupt = 1;
+        }
+    }
+
+    schedule(t->end, EVENT_RX_END, r, radio->generation);
+}
+
+// Called when the preamble of a packet starts arriving at the receivers.
+static void arrival(uint32_t index)
+{
+    Transmission * t = &transmissions[index % TRANSMISSION_COUNT];
+    uint8_t i;
+
+    if (t->index != index)
+    {
+        // More than TRANSMISSION_COUNT packets were sent during the delay.
+        return;
+    }
+    t->arrived = 1;
+
+    for (i = 0; i < nodeCount; i++)
+    {
+        Radio * r = &nodes[i].radio;
+        if (i == t->from || r->state != SIM_RADIO_RX || r->config.channel != t->config.channel)
+        {
+            continue;
+        }
+        if (r->locked)
+        {
+            // Collision.
+            r->lockCorrupt = 1;
+        }
+        else if (sameAir(&r->config, &t->config))
+        {
+            lockOnto(i, t);
+        }
+    }
+}
+
+static void radioReady(uint8_t n)
+{
+    Radio * radio = &nodes[n].radio;
+    uint32_t i;
+
+    if (radio->startingTx)
+    {
+        uint64_t airUs = airBytes(&radio->config, radio->txLength) * byteUs(&radio->config);
+        Transmission * t = &transmissions[transmissionCount % TRANSMISSION_COUNT];
+
+        radio->state = SIM_RADIO_TX;
+        if (verbose)
+        {
+            printf("%10llu %u: tx ch %u len %u type 0x%02x%s%s\n", (unsigned long long)simTime, n,
+                radio->config.channel, radio->txLength, radio->txData[1], radio->config.fec ? " fec" : "",
+                radio->config.tuned ? "" : " untuned");
+        }
+        schedule(simTime + airUs, EVENT_TX_END, n, radio->generation);
+
+        t->index = transmissionCount;
+        t->from = n;
+        t->config = radio->config;
+        t->start = simTime + latencyUs;
+        t->end = t->start + airUs;
+        t->arrived = 0;
+        t->length = radio->txLength;
+        memcpy(t->data, radio->txData, radio->txLength);
+        schedule(t->start, EVENT_ARRIVAL, n, transmissionCount);
+        transmissionCount++;
+    }
+    else
+    {
+        radio->state = SIM_RADIO_RX;
+        if (verbose)
+        {
+            printf("%10llu %u: rx ch %u%s%s\n", (unsigned long long)simTime, n,
+                radio->config.channel, radio->config.fec ? " fec" : "", radio->config.tuned ? "" : " untuned");
+        }
+
+        // We might still catch the preamble of a packet that just started arriving.
+        // (If it has not arrived yet, arrival() takes care of it.)
+        for (i = 0; i < TRANSMISSION_COUNT; i++)
+        {
+            const Transmission * t = &transmissions[i];
+            if (t->from != n && t->arrived && onAir(t) && sameAir(&t->config, &radio->config) &&
+                simTime <= t->start + PREAMBLE_DETECT_BYTES * byteUs(&t->config))
+            {
+                lockOnto(n, t);
+                break;
+            }
+        }
+    }
+}
+
+static void rxEnd(uint8_t n)
+{
+    Radio * radio = &nodes[n].radio;
+    uint8_t length;
+
+    if (!radio->locked)
+    {
+        return;
+    }
+    radio->locked = 0;
+
+    if (verbose)
+    {
+        printf("%10llu %u: got len %u type 0x%02x%s\n", (unsigned long long)simTime, n,
+            radio->lockLength, radio->lockData[1], radio->lockCorrupt ? " bad crc" : "");
+    }
+
+    if (radio->config.fixedLength)
+    {
+        length = radio->config.fixedLength;
+        if (radio->lockLength != length)
+        {
+            radio->lockCorrupt = 1;
+        }
+    }
+    else
+    {
+        length = radio->lockData[0] + 1;
+        if (radio->lockData[0] > radio->config.maxLength)
+        {
+            // The radio drops packets that are longer than PKTLEN and keeps listening.
+            return;
+        }
+    }
+
+    memcpy(radio->rxBuffer, radio->lockData, length);
+    if (radio->lockCorrupt && length > 1)
+    {
+        // Garble one byte so that code which ignores the CRC would notice.
+        radio->rxBuffer[1 + (uint8_t)(randomFraction() * (length - 1))] ^= 0x5A;
+    }
+    radio->rxBuffer[length] = (uint8_t)((rssi + 71) * 2);
+    radio->rxBuffer[length + 1] = radio->lockCorrupt ? 0x20 : 0x80 | 0x20;
+
+    stopRadio(n, SIM_RADIO_FSTXON);
+    raiseIrq(n, SIM_IRQ_DONE);
+}
+
+static void rxTimeout(uint8_t n)
+{
+    Radio * radio = &nodes[n].radio;
+
+    if (radio->locked && simTime >= radio->lockSyncTime)
+    {
+        // We found a sync word, so the radio keeps receiving.
+        return;
+    }
+    if (verbose)
+    {
+        printf("%10llu %u: rx timeout\n", (unsigned long long)simTime, n);
+    }
+    stopRadio(n, SIM_RADIO_IDLE);
+    raiseIrq(n, SIM_IRQ_TIMEOUT);
+}
+
+/* HOST FUNCTIONS CALLED BY THE NODES *****************************************/
+
+static uint64_t hostNow(void)
+{
+    return simTime;
+}
+
+static void hostRadioIdle(uint8_t n)
+{
+    stopRadio(n, SIM_RADIO_IDLE);
+}
+
+static void hostRadioFstxon(uint8_t n)
+{
+    stopRadio(n, nodes[n].radio.state == SIM_RADIO_IDLE ? SIM_RADIO_IDLE : SIM_RADIO_FSTXON);
+}
+
+static void hostRadioRx(uint8_t n, uint8_t * buffer, const SimRadioConfig * config, uint32_t timeoutUs, uint8_t calibrate)
+{
+    Radio * radio = &nodes[n].radio;
+    uint64_t start = commandTime(n);
+    uint64_t delay = startDelay(radio, calibrate);
+
+    stopRadio(n, SIM_RADIO_STARTING);
+    radio->startingTx = 0;
+    radio->config = *config;
+    radio->rxBuffer = buffer;
+    schedule(start + delay, EVENT_RADIO_READY, n, radio->generation);
+    if (timeoutUs)
+    {
+        schedule(start + timeoutUs, EVENT_RX_TIMEOUT, n, radio->generation);
+    }
+}
+
+static void hostRadioTx(uint8_t n, const uint8_t * packet, const SimRadioConfig * config, uint8_t calibrate)
+{
+    Radio * radio = &nodes[n].radio;
+    uint64_t start = commandTime(n);
+    uint64_t delay = startDelay(radio, calibrate);
+
+    stopRadio(n, SIM_RADIO_STARTING);
+    radio->startingTx = 1;
+    radio->config = *config;
+    radio->txLength = config->fixedLength ? config->fixedLength : packet[0] + 1;
+    memcpy(radio->txData, packet, radio->txLength);
+    schedule(start + delay, EVENT_RADIO_READY, n, radio->generation);
+}
+
+static uint8_t hostRadioState(uint8_t n)
+{
+    return nodes[n].radio.state;
+}
+
+static uint8_t hostRadioReceiving(uint8_t n)
+{
+    Radio * radio = &nodes[n].radio;
+    return radio->state == SIM_RADIO_RX && radio->locked && simTime >= radio->lockSyncTime;
+}
+
+static void hostInterrupt(uint8_t n)
+{
+    raiseIrq(n, 0);
+}
+
+static void hostBytesQueued(uint8_t n, uint8_t to, uint32_t total)
+{
+    Stream * stream = &streams[n][to];
+
+    if (stream->sampleFirst + stream->sampleCount == stream->sampleCapacity)
+    {
+        if (stream->sampleFirst)
+        {
+            memmove(stream->samples, stream->samples + stream->sampleFirst, stream->sampleCount * sizeof(Sample));
+            stream->sampleFirst = 0;
+        }
+        else
+        {
+            stream->sampleCapacity = stream->sampleCapacity ? stream->sampleCapacity * 2 : 256;
+            stream->samples = checkedRealloc(stream->samples, stream->sampleCapacity * sizeof(Sample));
+        }
+    }
+    stream->samples[stream->sampleFirst + stream->sampleCount].total = total;
+    stream->samples[stream->sampleFirst + stream->sampleCount].time = simTime;
+    stream->sampleCount++;
+}
+
+static void hostBytesReceived(uint8_t n, uint8_t from, uint32_t total)
+{
+    Stream * stream = &streams[from][n];
+
+    stream->received = total;
+    while (stream->sampleCount && stream->samples[stream->sampleFirst].total <= total)
+    {
+        if (stream->latencyCount == stream->latencyCapacity)
+        {
+            stream->latencyCapacity = stream->latencyCapacity ? stream->latencyCapacity * 2 : 256;
+            stream->latencies = checkedRealloc(stream->latencies, stream->latencyCapacity * sizeof(uint32_t));
+        }
+        stream->latencies[stream->latencyCount++] = (uint32_t)(simTime - stream->samples[stream->sampleFirst].time);
+        stream->sampleFirst++;
+        stream->sampleCount--;
+    }
+}
+
+static void hostBytesLost(uint8_t n, uint8_t from, uint32_t total)
+{
+    Stream * stream = &streams[from][n];
+
+    stream->lost += total - stream->received;
+    stream->received = total;
+    while (stream->sampleCount && stream->samples[stream->sampleFirst].total <= total)
+    {
+        stream->sampleFirst++;
+        stream->sampleCount--;
+    }
+}
+
+static const SimHost host =
+{
+    hostNow,
+    hostRadioIdle,
+    hostRadioFstxon,
+    hostRadioRx,
+    hostRadioTx,
+    hostRadioState,
+    hostRadioReceiving,
+    hostInterrupt,
+    hostBytesQueued,
+    hostBytesReceived,
+    hostBytesLost,
+};
+
+/* MAIN ***********************************************************************/
+
+static void loadNode(uint8_t n, const char * path)
+{
+    void * handle = dlmopen(LM_ID_NEWLM, path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL)
+    {
+        fprintf(stderr, "Could not load %s: %s\n", path, dlerror());
+        exit(1);
+    }
+    nodes[n].init = (SimNodeInitFunction *)dlsym(handle, "simNodeInit");
+    nodes[n].loop = (SimNodeLoopFunction *)dlsym(handle, "simNodeLoop");
+    nodes[n].isr = (SimNodeIsrFunction *)dlsym(handle, "simNodeIsr");
+    nodes[n].report = (SimNodeReportFunction *)dlsym(handle, "simNodeReport");
+    if (!nodes[n].init || !nodes[n].loop || !nodes[n].isr || !nodes[n].report)
+    {
+        fprintf(stderr, "%s does not export the simNode functions.\n", path);
+        exit(1);
+    }
+}
+
+static void runEvent(const Event * e)
+{
+    Node * node = &nodes[e->node];
+
+    simTime = e->time;
+
+    switch (e->type)
+    {
+    case EVENT_LOOP:
+        if (simTime < node->busyUntil)
+        {
+            schedule(node->busyUntil, EVENT_LOOP, e->node, 0);
+        }
+        else
+        {
+            uint32_t moved = node->loop();
+            schedule(simTime + loopUs + moved * LOOP_BYTE_US, EVENT_LOOP, e->node, 0);
+        }
+        break;
+
+    case EVENT_ARRIVAL:
+        arrival(e->generation);
+        break;
+
+    case EVENT_ISR:
+    {
+        uint8_t flags;
+        if (simTime < node->busyUntil)
+        {
+            schedule(node->busyUntil, EVENT_ISR, e->node, 0);
+            break;
+        }
+        flags = node->radio.irqFlags;
+        node->radio.irqFlags = 0;
+        node->radio.isrPending = 0;
+        node->busyUntil = simTime + isrUs;
+        node->inIsr = 1;
+        node->isr(flags);
+        node->inIsr = 0;
+        break;
+    }
+
+    default:
+        if (e->generation != node->radio.generation)
+        {
+            break;
+        }
+        switch (e->type)
+        {
+        case EVENT_RADIO_READY: radioReady(e->node); break;
+        case EVENT_TX_END: stopRadio(e->node, SIM_RADIO_FSTXON); raiseIrq(e->node, SIM_IRQ_DONE); break;
+        case EVENT_RX_END: rxEnd(e->node); break;
+        case EVENT_RX_TIMEOUT: rxTimeout(e->node); break;
+        }
+        break;
+    }
+}
+
+static int compareLatency(const void * a, const void * b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Sorts the latencies of the stream so percentileMs can be used.
+static void sortLatencies(Stream * stream)
+{
+    qsort(stream->latencies, stream->latencyCount, sizeof(uint32_t), compareLatency);
+}
+
+static double percentileMs(const Stream * stream, double fraction)
+{
+    uint32_t index = (uint32_t)(fraction * (stream->latencyCount - 1) + 0.5);
+    return stream->latencies[index] / 1000.0;
+}
+
+static void printResults(double seconds)
+{
+    uint32_t sentBytes[MAX_NODES];
+    uint8_t n, to, i;
+
+    for (n = 0; n < nodeCount; n++)
+    {
+        SimNodeReport r;
+        Node * node = &nodes[n];
+
+        memset(&r, 0, sizeof(r));
+        node->report(&r);
+
+        printf("wixel %u: sent %u B, received %u B (%.0f B/s), %u bad bytes\n",
+            n, r.txBytes, r.rxBytes, r.rxBytes / seconds, r.rxErrors);
+        for (to = 0; to < nodeCount; to++)
+        {
+            Stream * stream = &streams[n][to];
+            if (stream->latencyCount)
+            {
+                uint32_t delivered = stream->received - stream->lost;
+
+                sortLatencies(stream);
+                printf("  to wixel %u: %u B (%.0f B/s)", to, delivered, delivered / seconds);
+                if (stream->lost)
+                {
+                    printf(", %u B lost", stream->lost);
+                }
+                printf(", latency p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+                    percentileMs(stream, 0.5), percentileMs(stream, 0.9), percentileMs(stream, 0.99),
+                    percentileMs(stream, 1.0));
+            }
+        }
+        if (netMode && n == 0)
+        {
+            printf("  net: peers %u, discarded %u\n", r.netPeers, r.netDiscarded);
+        }
+        else if (queueMode && n != 0)
+        {
+            printf("  queue: sent %u B\n", r.queueSentBytes);
+            sentBytes[n] = r.queueSentBytes;
+        }
+        else if (!netMode && !queueMode)
+        {
+            printf("  link: tx %u, rx %u, acks %u, retx %u, timeouts %u, resets %u, naks %u, pauses %u, rtt %u us, payload %u\n",
+                r.linkTxPackets, r.linkRxPackets, r.linkAckPackets, r.linkRetransmissions,
+                r.linkResponseTimeouts, r.linkResetPackets, r.linkNakPackets, r.linkTxPauses, r.linkRtt,
+                r.linkPayloadSize);
+            if (nodes[n].config.hopChannels)
+            {
+                printf("  hop: blacklist 0x%04x, losses/tries per channel:", r.linkHopBlacklist);
+                for (i = 0; i <= nodes[n].config.hopChannels; i++)
+                {
+                    printf(" %u/%u", r.linkHopLosses[i], r.linkHopTries[i]);
+                }
+                printf("\n");
+            }
+        }
+        printf("  mac: crc errors %u, rx timeouts %u, strobes deferred %u, calibrations %u, profile %u\n",
+            r.macCrcErrors, r.macRxTimeouts, r.macStrobesDeferred, r.macCalibrations, r.macProfile);
+    }
+
+    if (netMode || queueMode)
+    {
+        // How evenly the hub (or the receiver) shares the channel between the nodes.
+        uint32_t total = 0, least = UINT32_MAX, most = 0, sent = 0;
+        double worstP50 = 0, worstP99 = 0, leastDelivery = 1, mostDelivery = 0;
+
+        for (n = 1; n < nodeCount; n++)
+        {
+            Stream * stream = &streams[n][0];
+            uint32_t delivered = stream->received - stream->lost;
+
+            total += delivered;
+            least = delivered < least ? delivered : least;
+            most = delivered > most ? delivered : most;
+            if (queueMode)
+            {
+                double delivery = sentBytes[n] ? (double)delivered / sentBytes[n] : 0;
+                sent += sentBytes[n];
+                leastDelivery = delivery < leastDelivery ? delivery : leastDelivery;
+                mostDelivery = delivery > mostDelivery ? delivery : mostDelivery;
+            }
+            if (stream->latencyCount && percentileMs(stream, 0.5) > worstP50)
+            {
+                worstP50 = percentileMs(stream, 0.5);
+            }
+            if (stream->latencyCount && percentileMs(stream, 0.99) > worstP99)
+            {
+                worstP99 = percentileMs(stream, 0.99);
+            }
+        }
+        if (queueMode)
+        {
+            printf("transmitters to receiver: %.0f B/s in total, %.1f%% of the bytes sent delivered (%.1f%% to %.1f%% per transmitter), latency p50 up to %.2f ms, p99 up to %.2f ms\n",
+                total / seconds, sent ? 100.0 * total / sent : 0, 100 * leastDelivery, 100 * mostDelivery,
+                worstP50, worstP99);
+        }
+        else
+        {
+            printf("nodes to hub: %.0f B/s in total, %.0f to %.0f B/s per node, latency p50 up to %.2f ms, p99 up to %.2f ms\n",
+                total / seconds, least / seconds, most / seconds, worstP50, worstP99);
+        }
+    }
+}
+
+static void usage(const char * program)
+{
+    printf(
+        "Usage: %s [options]\n"
+        "  -n N    number of Wixels (at most %u, and even without -N or -Q; default 2)\n"
+        "  -N      radio_net: Wixel 0 is the hub and the others are nodes\n"
+        "  -Q      radio_queue: Wixel 0 receives and the others send to it\n"
+        "  -T      with -Q, TDMA: one slot for each sender, and Wixel 0 sends the beacons\n"
+        "  -t S    simulated seconds (default 10)\n"
+        "  -b      both Wixels of each pair send (default: only the even ones);\n"
+        "          with -N, the hub sends to every node too (default: only the nodes send)\n"
+        "  -r B    bytes per second to send to each Wixel (default 0: as fast as possible)\n"
+        "  -k B    bytes per second to read (default 0: as fast as possible)\n"
+        "  -l P    fraction of packets a receiver misses (default 0)\n"
+        "  -c P    fraction of packets received with a bad CRC (default 0)\n"
+        "  -J CH   every packet on channel CH is received with a bad CRC (repeatable)\n"
+        "  -d US   delay between sending and receiving a packet (default 0)\n"
+        "  -w      windowed protocol (radioLinkWindowedMode)\n"
+        "  -a      delayed ACKs (radioLinkDelayedAckMode)\n"
+        "  -p N    requested payload size (default 18)\n"
+        "  -f      FEC (radioLinkFecMode)\n"
+        "  -R      auto-rate (radioLinkAutoRateMode)\n"
+        "  -H N    number of extra hop channels (default 0)\n"
+        "  -P N    data rate profile (default 1: 350 kbps)\n"
+        "  -S dBm  signal strength of every packet (default -50)\n"
+        "  -i US   time the CPU spends in each RF interrupt (default 60)\n"
+        "  -m US   time of each main loop iteration (default 20)\n"
+        "  -x N    random seed (default 1)\n"
+        "  -v      print every radio event\n",
+        program, MAX_NODES);
+}
+
+int main(int argc, char ** argv)
+{
+    SimNodeConfig config;
+    double seconds = 10;
+    uint8_t bothSend = 0;
+    uint8_t tdma = 0;
+    char path[PATH_MAX];
+    char * self;
+    uint64_t endTime;
+    uint8_t n;
+    int option;
+
+    memset(&config, 0, sizeof(config));
+    config.profile = 1;
+    config.payloadSize = 18;
+
+    while ((option = getopt(argc, argv, "n:NQTt:br:k:l:c:J:d:wap:fRH:P:S:i:m:x:vh")) != -1)
+    {
+        switch (option)
+        {
+        case 'n': nodeCount = (uint8_t)atoi(optarg); break;
+        case 'N': netMode = 1; break;
+        case 'Q': queueMode = 1; break;
+        case 'T': tdma = 1; break;
+        case 't': seconds = atof(optarg); break;
+        case 'b': bothSend = 1; break;
+        case 'r': config.sendRate = (uint32_t)atol(optarg); break;
+        case 'k': config.readRate = (uint32_t)atol(optarg); break;
+        case 'l': lossRate = atof(optarg); break;
+        case 'c': corruptRate = atof(optarg); break;
+        case 'J': jammed[(uint8_t)atoi(optarg)] = 1; break;
+        case 'd': latencyUs = (uint32_t)atol(optarg); break;
+        case 'w': config.windowed = 1; break;
+        case 'a': config.delayedAck = 1; break;
+        case 'p': config.payloadSize = (uint8_t)atoi(optarg); break;
+        case 'f': config.fec = 1; break;
+        case 'R': config.autoRate = 1; break;
+        case 'H': config.hopChannels = (uint8_t)atoi(optarg); break;
+        case 'P': config.profile = (uint8_t)atoi(optarg); break;
+        case 'S': rssi = atoi(optarg); break;
+        case 'i': isrUs = (uint32_t)atol(optarg); break;
+        case 'm': loopUs = (uint32_t)atol(optarg); break;
+        case 'v': verbose = 1; break;
+        case 'x': randomState = (uint64_t)atoll(optarg) << 1 | 1; break;
+        default: usage(argv[0]); return option == 'h' ? 0 : 1;
+        }
+    }
+
+    if (nodeCount < 2 || nodeCount > MAX_NODES || (!netMode && !queueMode && (nodeCount & 1)))
+    {
+        fprintf(stderr, "The number of Wixels must be from 2 to %u, and even without -N or -Q.\n", MAX_NODES);
+        return 1;
+    }
+    if (netMode && queueMode)
+    {
+        fprintf(stderr, "-N and -Q cannot be used together.\n");
+        return 1;
+    }
+
+    self = strdup(argv[0]);
+    snprintf(path, sizeof(path), "%s/%s", dirname(self),
+        netMode ? "radio_sim_net.so" : queueMode ? "radio_sim_queue.so" : "radio_sim_link.so");
+    free(self);
+
+    for (n = 0; n < nodeCount; n++)
+    {
+        loadNode(n, path);
+        nodes[n].config = config;
+        if (netMode)
+        {
+            nodes[n].config.send = n != 0 || bothSend;
+            nodes[n].config.channel = 128;
+        }
+        else if (queueMode)
+        {
+            nodes[n].config.send = n != 0;
+            nodes[n].config.channel = 128;
+            nodes[n].config.tdma = tdma ? nodeCount - 1 : 0;
+        }
+        else
+        {
+            nodes[n].config.send = (n & 1) == 0 || bothSend;
+            nodes[n].config.channel = (uint8_t)(128 + (n / 2) * 32);
+        }
+        nodes[n].radio.state = SIM_RADIO_IDLE;
+        nodes[n].init(&host, n, &nodes[n].config);
+
+        // Like main() in an app: the main loop starts after the radio is initialized.
+        schedule(0, EVENT_LOOP, n, 0);
+    }
+
+    endTime = (uint64_t)(seconds * 1000000);
+    while (eventCount && events[0].time <= endTime)
+    {
+        Event e = popEvent();
+        runEvent(&e);
+    }
+
+    printResults(seconds);
+    return 0;
+}
@@ -0,0 +1,147 @@
+/* sim.h:
+ *  The interface between the simulator (sim.c) and the simulated Wixels.
+ *
+ *  Each simulated Wixel is a separate copy of a node library (radio_sim_link.so,
+ *  radio_sim_net.so or radio_sim_queue.so), loaded with dlmopen() so that it gets
+ *  its own copy of every global variable in the radio libraries.  The node calls
+ *  the simulator through the SimHost functions to use the radio and the clock,
+ *  and the simulator calls the node's exported sim* functions to run its main
+ *  loop and its RF interrupt.
+ *
+ *  This file is included by both sides, so it only uses standard C types.
+ */
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <stdint.h>
+
+// The states of a simulated radio (the interesting values of MARCSTATE).
+#define SIM_RADIO_IDLE      0
+#define SIM_RADIO_FSTXON    1   // After a packet is sent or received (MCSM1 = 0x05).
+#define SIM_RADIO_STARTING  2   // Settling (and maybe calibrating) before RX or TX.
+#define SIM_RADIO_RX        3
+#define SIM_RADIO_TX        4
+
+// Flags passed to simNodeIsr (the RFIF bits that radio_mac.c checks).
+#define SIM_IRQ_DONE        0x10
+#define SIM_IRQ_TIMEOUT     0x20
+
+// How a simulated radio is configured when it starts receiving or transmitting.
+// A receiver can only hear a transmitter with the same configuration.
+typedef struct SimRadioConfig
+{
+    uint8_t channel;        // CHANNR
+    uint8_t fec;            // MDMCFG1.FEC_EN
+    uint8_t fixedLength;    // PKTLEN if fixed-length packets are used (FEC), 0 otherwise.
+    uint8_t maxLength;      // PKTLEN in variable-length mode.
+    uint32_t bitRate;       // bits per second, from MDMCFG3 and MDMCFG4.
+    uint8_t tuned;          // 1 if FSCAL1-3 hold a calibration for this channel and IF.
+} SimRadioConfig;
+
+typedef struct SimHost
+{
+    // The current simulated time in microseconds.
+    uint64_t (*now)(void);
+
+    // Radio commands.  These are what radio_mac.c does with RFST and the DMA.
+    // calibrate is 1 if the radio should calibrate when starting from IDLE.
+    // timeoutUs is 0 for no RX timeout.
+    void (*radioIdle)(uint8_t node);
+    void (*radioFstxon)(uint8_t node);
+    void (*radioRx)(uint8_t node, uint8_t * buffer, const SimRadioConfig * config, uint32_t timeoutUs, uint8_t calibrate);
+    void (*radioTx)(uint8_t node, const uint8_t * packet, const SimRadioConfig * config, uint8_t calibrate);
+    uint8_t (*radioState)(uint8_t node);
+
+    // Returns 1 if the radio has found the sync word of a packet and is still
+    // receiving it (PKTSTATUS.SFD).
+    uint8_t (*radioReceiving)(uint8_t node);
+
+    // Makes the node's RF interrupt run soon, even if no RFIF flags are set
+    // (what radioMacStrobe does with S1CON).
+    void (*interrupt)(uint8_t node);
+
+    // The node reports how many bytes of its stream to node "to" it has queued so
+    // far, and how many bytes of the stream from node "from" it has received, so
+    // the simulator can measure the throughput and latency of each stream.
+    void (*bytesQueued)(uint8_t node, uint8_t to, uint32_t total);
+    void (*bytesReceived)(uint8_t node, uint8_t from, uint32_t total);
+
+    // The node reports that the bytes of the stream from node "from" before
+    // "total" that it has not received will never come (radio_queue does not
+    // retransmit).
+    void (*bytesLost)(uint8_t node, uint8_t from, uint32_t total);
+} SimHost;
+
+// What a simulated Wixel does.
+typedef struct SimNodeConfig
+{
+    uint8_t send;               // 1 to stream bytes to the other node (radio_link), nodes (radio_net) or receiver (radio_queue).
+    uint32_t sendRate;          // Bytes per second to send to each node, or 0 to send as fast as possible.
+    uint32_t readRate;          // Bytes per second to read, or 0 to read everything right away.
+    uint8_t channel;            // param_radio_channel
+    uint8_t profile;            // radioProfile (RADIO_PROFILE_*)
+    uint8_t windowed;           // radioLinkWindowedMode
+    uint8_t delayedAck;         // radioLinkDelayedAckMode
+    uint8_t payloadSize;        // radioLinkRequestedPayloadSize
+    uint8_t fec;                // radioLinkFecMode
+    uint8_t autoRate;           // radioLinkAutoRateMode
+    uint8_t hopChannels;        // radioLinkHopChannelCount (the channels follow param_radio_channel)
+    uint8_t tdma;               // radioQueueTdmaSlotCount
+} SimNodeConfig;
+
+// The counters that the simulator prints at the end of a run.
+// The same as RADIO_LINK_MAX_HOP_CHANNELS.
+#define SIM_MAX_HOP_CHANNELS 15
+
+typedef struct SimNodeReport
+{
+    uint32_t txBytes;           // Bytes queued with radio_com.
+    uint32_t rxBytes;           // Bytes received with radio_com.
+    uint32_t rxErrors;          // Received bytes that were not the expected ones.
+
+    uint32_t linkTxPackets;
+    uint32_t linkRxPackets;
+    uint32_t linkAckPackets;
+    uint32_t linkRetransmissions;
+    uint32_t linkResponseTimeouts;
+    uint32_t linkResetPackets;
+    uint32_t linkNakPackets;
+    uint32_t linkTxPauses;
+    uint32_t linkRtt;
+    uint32_t linkPayloadSize;
+    uint32_t linkHopBlacklist;          // radioLinkHopBlacklist()
+    uint32_t linkHopTries[SIM_MAX_HOP_CHANNELS + 1];    // radioLinkGetHopStats() for each hop index
+    uint32_t linkHopLosses[SIM_MAX_HOP_CHANNELS + 1];
+
+    uint32_t netPeers;          // radioNetPeerCount()
+    uint32_t netDiscarded;      // radioNetTxDiscardedPackets()
+
+    uint32_t queueSentBytes;    // Bytes in the packets that radio_queue has sent.
+
+    uint32_t macCrcErrors;
+    uint32_t macRxTimeouts;
+    uint32_t macStrobesDeferred;
+    uint32_t macCalibrations;
+    uint32_t macProfile;
+} SimNodeReport;
+
+// The functions exported by every node library.
+typedef void SimNodeInitFunction(const SimHost * host, uint8_t node, const SimNodeConfig * config);
+typedef uint32_t SimNodeLoopFunction(void);   // Returns the number of bytes it moved.
+typedef void SimNodeIsrFunction(uint8_t flags);
+typedef void SimNodeReportFunction(SimNodeReport * report);
+
+// The parts of a node that every simulated app shares: sim_wixel.c and sim_radio.c.
+extern const SimHost * simHost;
+extern uint8_t simNodeId;
+void simRadioSync(void);   // The app calls this at the end of every main loop iteration.
+
+// Byte N of the stream from node K.  It does not repeat for 251 bytes, so a lost,
+// duplicated or reordered byte is always noticed.
+static inline uint8_t simStreamByte(uint8_t node, uint32_t index)
+{
+    return (uint8_t)((index + node * 0x55) % 251);
+}
+
+#endif
@@ -0,0 +1,136 @@
+/* sim_link.c:
+ *  One simulated Wixel using radio_link.  This file is linked with radio_com.c,
+ *  radio_link.c, radio_mac.c, radio_registers.c, sim_radio.c and sim_wixel.c into
+ *  radio_sim_link.so, and the simulator loads one copy of that library for each
+ *  Wixel.
+ *
+ *  It is a small app that streams bytes to the other Wixel with radio_com and
+ *  checks the bytes it receives.  Byte N of the stream from Wixel K is
+ *  simStreamByte(K, N), so a lost, duplicated or reordered byte is always noticed.
+ */
+
+#include <radio_com.h>
+#include <radio_link.h>
+#include <radio_registers.h>
+
+#include "sim.h"
+
+static SimNodeConfig config;
+static uint32_t txTotal;
+static uint32_t rxTotal;
+static uint32_t rxErrors;
+
+void simNodeInit(const SimHost * host, uint8_t node, const SimNodeConfig * c)
+{
+    uint8 i;
+
+    simHost = host;
+    simNodeId = node;
+    config = *c;
+
+    param_radio_channel = config.channel;
+    radioProfile = config.profile;
+    radioLinkWindowedMode = config.windowed;
+    radioLinkDelayedAckMode = config.delayedAck;
+    radioLinkRequestedPayloadSize = config.payloadSize;
+    radioLinkFecMode = config.fec;
+    radioLinkAutoRateMode = config.autoRate;
+    radioLinkHopChannelCount = config.hopChannels;
+    for (i = 0; i < config.hopChannels; i++)
+    {
+        radioLinkHopChannels[i] = config.channel + 2 * (i + 1);
+    }
+
+    radioComRxEnforceOrdering = 1;
+    radioComInit();
+}
+
+uint32_t simNodeLoop()
+{
+    uint32_t moved = 0;
+
+    radioComTxService();
+
+    // Report the control signals so that radio_com gives us more data.
+    radioComRxControlSignals();
+
+    while (radioComRxAvailable() &&
+        (config.readRate == 0 || rxTotal < simHost->now() * config.readRate / 1000000))
+    {
+        if (radioComRxReceiveByte() != simStreamByte(simNodeId ^ 1, rxTotal))
+        {
+            rxErrors++;
+        }
+        rxTotal++;
+        moved++;
+    }
+    if (moved)
+    {
+        simHost->bytesReceived(simNodeId, simNodeId ^ 1, rxTotal);
+    }
+
+    if (config.send)
+    {
+        uint32_t allowed = 0xFFFFFFFF;
+        uint32_t queued = 0;
+
+        if (config.sendRate)
+        {
+            allowed = (uint32_t)(simHost->now() * config.sendRate / 1000000) - txTotal;
+        }
+
+        while (queued < allowed && radioComTxAvailable())
+        {
+            radioComTxSendByte(simStreamByte(simNodeId, txTotal));
+            txTotal++;
+            queued++;
+        }
+        if (queued)
+        {
+            simHost->bytesQueued(simNodeId, simNodeId ^ 1, txTotal);
+        }
+        moved += queued;
+    }
+
+    simRadioSync();
+    return moved;
+}
+
+void simNodeReport(SimNodeReport * report)
+{
+    RADIO_LINK_STATS XDATA linkStats;
+    RADIO_MAC_STATS XDATA macStats;
+    RADIO_LINK_HOP_STATS XDATA hopStats;
+    uint8 i;
+
+    radioLinkGetStats(&linkStats);
+    radioMacGetStats(&macStats);
+
+    report->txBytes = txTotal;
+    report->rxBytes = rxTotal;
+    report->rxErrors = rxErrors;
+
+    report->linkTxPackets = linkStats.txPackets;
+    report->linkRxPackets = linkStats.rxPackets;
+    report->linkAckPackets = linkStats.ackPackets;
+    report->linkRetransmissions = linkStats.retransmissions;
+    report->linkResponseTimeouts = linkStats.responseTimeouts;
+    report->linkResetPackets = linkStats.resetPackets;
+    report->linkNakPackets = linkStats.nakPackets;
+    report->linkTxPauses = linkStats.txPauses;
+    report->linkRtt = linkStats.rtt;
+    report->linkPayloadSize = radioLinkTxPayloadSize();
+    report->linkHopBlacklist = radioLinkHopBlacklist();
+    for (i = 0; i <= radioLinkHopChannelCount; i++)
+    {
+        radioLinkGetHopStats(i, &hopStats);
+        report->linkHopTries[i] = hopStats.tries;
+        report->linkHopLosses[i] = hopStats.losses;
+    }
+
+    report->macCrcErrors = macStats.crcErrors;
+    report->macRxTimeouts = macStats.rxTimeouts;
+    report->macStrobesDeferred = macStats.strobesDeferred;
+    report->macCalibrations = macStats.calibrations;
+    report->macProfile = radioProfile;
+}
@@ -0,0 +1,163 @@
+/* sim_net.c:
+ *  One simulated Wixel using radio_net.  This file is linked with radio_net.c,
+ *  radio_mac.c, radio_registers.c, sim_radio.c and sim_wixel.c into
+ *  radio_sim_net.so, and the simulator loads one copy of that library for each
+ *  Wixel.
+ *
+ *  Wixel 0 is the hub and the others are nodes with their Wixel number as their
+ *  address.  Each node streams bytes to the hub, and the hub streams bytes to
+ *  each node in its network if it is told to send.  Byte N of the stream from
+ *  Wixel K is simStreamByte(K, N), and every receiver checks the bytes it gets
+ *  from each sender.
+ */
+
+#include <radio_net.h>
+#include <radio_registers.h>
+
+#include "sim.h"
+
+#define MAX_ADDRESS 255
+
+static SimNodeConfig config;
+static uint8 payloadSize;
+static uint32_t txTotal[MAX_ADDRESS];
+static uint32_t rxTotal[MAX_ADDRESS];
+static uint32_t rxBytes;
+static uint32_t rxErrors;
+
+// The index of the peer the hub will send to next.
+static uint8 hubPeerIndex;
+
+void simNodeInit(const SimHost * host, uint8_t node, const SimNodeConfig * c)
+{
+    simHost = host;
+    simNodeId = node;
+    config = *c;
+
+    payloadSize = config.payloadSize < RADIO_NET_PAYLOAD_SIZE ? config.payloadSize : RADIO_NET_PAYLOAD_SIZE;
+
+    param_radio_channel = config.channel;
+    radioProfile = config.profile;
+    radioNetAddress = node;
+    radioNetInit();
+}
+
+// The packet we are putting bytes in (radioNetTxCurrentPacket()), like radio_com does:
+// it is sent when it is full or when nothing else is queued.
+static uint8 openAddress;
+static uint8 openLength;
+
+static void sendOpenPacket()
+{
+    radioNetTxCurrentPacket()[0] = openLength;
+    radioNetTxSendPacket(openAddress);
+    openLength = 0;
+}
+
+// Queues as many bytes of the stream to the given address as the send rate and
+// the TX buffers allow.  Returns the number of bytes queued.
+static uint32_t sendTo(uint8 address)
+{
+    uint32_t allowed = 0xFFFFFFFF;
+    uint32_t queued = 0;
+    uint8 XDATA * packet;
+
+    if (config.sendRate)
+    {
+        allowed = (uint32_t)(simHost->now() * config.sendRate / 1000000) - txTotal[address];
+    }
+
+    openAddress = address;
+    while (queued < allowed && (packet = radioNetTxCurrentPacket()))
+    {
+        packet[1 + openLength++] = simStreamByte(simNodeId, txTotal[address]++);
+        queued++;
+        if (openLength == payloadSize)
+        {
+            sendOpenPacket();
+        }
+    }
+    if (openLength && radioNetTxQueued() == 0)
+    {
+        sendOpenPacket();
+    }
+
+    if (queued)
+    {
+        simHost->bytesQueued(simNodeId, address, txTotal[address]);
+    }
+    return queued;
+}
+
+uint32_t simNodeLoop()
+{
+    uint32_t moved = 0;
+    uint8 XDATA * packet;
+
+    while ((packet = radioNetRxCurrentPacket()) &&
+        (config.readRate == 0 || rxBytes < simHost->now() * config.readRate / 1000000))
+    {
+        uint8 source = radioNetRxCurrentSource();
+        uint8 i;
+
+        for (i = 0; i < packet[0]; i++)
+        {
+            if (packet[1 + i] != simStreamByte(source, rxTotal[source]))
+            {
+                rxErrors++;
+            }
+            rxTotal[source]++;
+        }
+        rxBytes += packet[0];
+        moved += packet[0];
+        radioNetRxDoneWithPacket();
+        simHost->bytesReceived(simNodeId, source, rxTotal[source]);
+    }
+
+    if (config.send && !radioNetIsHub())
+    {
+        moved += sendTo(RADIO_NET_HUB_ADDRESS);
+    }
+    else if (config.send && openLength)
+    {
+        moved += sendTo(openAddress);
+    }
+    else if (config.send && radioNetPeerCount())
+    {
+        // Take turns, so each node gets the same share of the TX buffers.
+        if (hubPeerIndex >= radioNetPeerCount())
+        {
+            hubPeerIndex = 0;
+        }
+        moved += sendTo(radioNetPeerAddress(hubPeerIndex));
+        hubPeerIndex++;
+    }
+
+    simRadioSync();
+    return moved;
+}
+
+void simNodeReport(SimNodeReport * report)
+{
+    RADIO_MAC_STATS XDATA macStats;
+    uint16 i;
+
+    radioMacGetStats(&macStats);
+
+    report->txBytes = 0;
+    for (i = 0; i < MAX_ADDRESS; i++)
+    {
+        report->txBytes += txTotal[i];
+    }
+    report->rxBytes = rxBytes;
+    report->rxErrors = rxErrors;
+
+    report->netPeers = radioNetPeerCount();
+    report->netDiscarded = radioNetTxDiscardedPackets();
+
+    report->macCrcErrors = macStats.crcErrors;
+    report->macRxTimeouts = macStats.rxTimeouts;
+    report->macStrobesDeferred = macStats.strobesDeferred;
+    report->macCalibrations = macStats.calibrations;
+    report->macProfile = radioProfile;
+}
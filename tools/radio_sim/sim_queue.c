@@ -0,0 +1,185 @@
+/* sim_queue.c:
+ *  One simulated Wixel using radio_queue.  This file is linked with radio_queue.c,
+ *  radio_mac.c, radio_registers.c, sim_radio.c and sim_wixel.c into
+ *  radio_sim_queue.so, and the simulator loads one copy of that library for each
+ *  Wixel.
+ *
+ *  Wixel 0 is the receiver (and the TDMA beacon sender in TDMA mode), and every
+ *  other Wixel is a transmitter that streams bytes to it.  radio_queue does not
+ *  retransmit lost packets, so each packet starts with a small header that says
+ *  which Wixel sent it and where its bytes are in that Wixel's stream; the
+ *  receiver uses it to tell the simulator which bytes were lost.
+ *
+ *  With a send rate, each transmitter sends one packet in every period of
+ *  (data size / send rate), at a random time in the period, like sensors with
+ *  their own clocks; transmitters that all sent at the same moment would collide
+ *  every time.
+ */
+
+#include <radio_queue.h>
+#include <radio_registers.h>
+
+#include "sim.h"
+
+// The header at the start of each packet: the length byte, the sender and the
+// stream index of the first data byte (little-endian).  The data comes after it.
+#define HEADER_SOURCE  1
+#define HEADER_INDEX   2
+#define HEADER_SIZE    6
+
+#define MAX_ADDRESS 255
+
+static SimNodeConfig config;
+static uint8 dataSize;
+static uint32_t txTotal;
+static uint64_t nextSendUs;
+static uint32_t randomState;
+static uint32_t rxTotal[MAX_ADDRESS];
+static uint32_t rxBytes;
+static uint32_t rxErrors;
+
+// Returns a random time from 0 to one send period, in microseconds.  This does not
+// use randomNumber() so that the radio_queue's random delays stay the same.
+static uint32_t randomSendOffsetUs()
+{
+    uint64_t period = (uint64_t)dataSize * 1000000 / config.sendRate;
+
+    randomState = randomState * 1664525 + 1013904223;
+    return (uint32_t)((randomState >> 8) * period >> 24);
+}
+
+void simNodeInit(const SimHost * host, uint8_t node, const SimNodeConfig * c)
+{
+    simHost = host;
+    simNodeId = node;
+    config = *c;
+
+    dataSize = config.payloadSize < RADIO_QUEUE_PAYLOAD_SIZE + 1 - HEADER_SIZE ?
+        config.payloadSize : RADIO_QUEUE_PAYLOAD_SIZE + 1 - HEADER_SIZE;
+
+    param_radio_channel = config.channel;
+    radioProfile = config.profile;
+    if (config.tdma)
+    {
+        radioQueueTdmaSlotCount = config.tdma;
+        radioQueueTdmaBeaconSender = node == 0;
+        radioQueueTdmaSlot = node - 1;
+    }
+    radioQueueInit();
+
+    if (config.sendRate)
+    {
+        randomState = node;
+        nextSendUs = randomSendOffsetUs();
+    }
+}
+
+// Queues as many packets as the send rate and the TX buffers allow.  Returns the
+// number of bytes queued.
+static uint32_t send()
+{
+    uint32_t queued = 0;
+    uint8 XDATA * packet;
+    uint8 i;
+
+    while ((config.sendRate == 0 || nextSendUs <= simHost->now()) && (packet = radioQueueTxCurrentPacket()))
+    {
+        packet[0] = HEADER_SIZE - 1 + dataSize;
+        packet[HEADER_SOURCE] = simNodeId;
+        packet[HEADER_INDEX] = (uint8)txTotal;
+        packet[HEADER_INDEX + 1] = (uint8)(txTotal >> 8);
+        packet[HEADER_INDEX + 2] = (uint8)(txTotal >> 16);
+        packet[HEADER_INDEX + 3] = (uint8)(txTotal >> 24);
+        for (i = 0; i < dataSize; i++)
+        {
+            packet[HEADER_SIZE + i] = simStreamByte(simNodeId, txTotal++);
+        }
+        radioQueueTxSendPacket();
+        queued += dataSize;
+
+        if (config.sendRate)
+        {
+            // The start of the next period plus a random offset.
+            nextSendUs = (uint64_t)txTotal * 1000000 / config.sendRate + randomSendOffsetUs();
+        }
+    }
+
+    if (queued)
+    {
+        simHost->bytesQueued(simNodeId, 0, txTotal);
+    }
+    return queued;
+}
+
+uint32_t simNodeLoop()
+{
+    uint32_t moved = 0;
+    uint8 XDATA * packet;
+
+    while ((packet = radioQueueRxCurrentPacket()) &&
+        (config.readRate == 0 || rxBytes < simHost->now() * config.readRate / 1000000))
+    {
+        uint8 source = packet[HEADER_SOURCE];
+        uint8 length = packet[0] + 1 - HEADER_SIZE;
+        uint32_t index = packet[HEADER_INDEX] | (uint32_t)packet[HEADER_INDEX + 1] << 8 |
+            (uint32_t)packet[HEADER_INDEX + 2] << 16 | (uint32_t)packet[HEADER_INDEX + 3] << 24;
+        uint8 i;
+
+        if (simNodeId != 0)
+        {
+            // A transmitter hears the packets of the other transmitters too.
+        }
+        else if (packet[0] < HEADER_SIZE - 1 || source >= MAX_ADDRESS || index < rxTotal[source])
+        {
+            // A packet we did not expect: radio_queue never sends one twice.
+            rxErrors += packet[0];
+        }
+        else
+        {
+            if (index > rxTotal[source])
+            {
+                simHost->bytesLost(simNodeId, source, index);
+            }
+            for (i = 0; i < length; i++)
+            {
+                if (packet[HEADER_SIZE + i] != simStreamByte(source, index + i))
+                {
+                    rxErrors++;
+                }
+            }
+            rxTotal[source] = index + length;
+            rxBytes += length;
+            moved += length;
+            simHost->bytesReceived(simNodeId, source, rxTotal[source]);
+        }
+        radioQueueRxDoneWithPacket();
+    }
+
+    if (config.send)
+    {
+        moved += send();
+    }
+
+    simRadioSync();
+    return moved;
+}
+
+void simNodeReport(SimNodeReport * report)
+{
+    RADIO_MAC_STATS XDATA macStats;
+
+    radioMacGetStats(&macStats);
+
+    report->txBytes = txTotal;
+    report->rxBytes = rxBytes;
+    report->rxErrors = rxErrors;
+
+    // The packets still in the TX queue have not been sent yet.
+    report->queueSentBytes = txTotal - (uint32_t)radioQueueTxQueued() * dataSize;
+
+    report->macCrcErrors = macStats.crcErrors;
+    report->macRxTimeouts = macStats.rxTimeouts;
+    report->macStrobesDeferred = macStats.strobesDeferred;
+    report->macCalibrations = macStats.calibrations;
+    report->macProfile = radioProfile;
+}
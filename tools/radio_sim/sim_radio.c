@@ -0,0 +1,204 @@
+/* sim_radio.c:
+ *  The radio hardware that libraries/src/radio_mac/radio_mac.c controls, for the
+ *  radio simulator.  radio_mac.c is compiled unmodified; the stand-in cc2511_map.h
+ *  turns its accesses to RFST, RFIF, S1CON, MARCSTATE and PKTSTATUS into calls to
+ *  the functions below, which ask the simulator (sim.c) to start and stop the
+ *  simulated radio.
+ *
+ *  A write to RFST, RFIF or S1CON takes effect at the next access to one of these
+ *  registers or at the end of the ISR or main loop iteration, which is before the
+ *  simulator could notice the difference.
+ */
+
+#include <cc2511_map.h>
+#include <dma.h>
+
+#include "sim.h"
+
+// The RFST command strobes (see radio_mac.c).
+#define SFSTXON 0
+#define SRX     2
+#define STX     3
+#define SIDLE   4
+#define RFST_NONE 0xFF
+
+// The length of one unit of WOREVT1 when radio_mac.c sets up an RX timeout, in microseconds.
+#define RX_TIMEOUT_UNIT_US 922
+
+// MCSM0.FS_AUTOCAL = 01: calibrate when going from IDLE to RX or TX.
+#define MCSM0_FS_AUTOCAL_MASK 0x30
+#define MCSM0_FS_AUTOCAL_IDLE 0x10
+
+// A calibration leaves results in FSCAL1 and FSCAL2 that only fit the channel and
+// IF it was done for.  The simulated results are just those two settings, so the
+// radio knows whether radio_mac.c gave it the right ones.
+#define FSCAL1_FOR(channel) (channel)
+#define FSCAL2_FOR(ifFrequency) (ifFrequency)
+
+DMA14_CONFIG XDATA dmaConfig;
+
+static uint8 rfstWrite = RFST_NONE;
+static uint8 rfif;
+static uint8 rfifWrite;
+static uint8 s1conWrite;
+
+// The buffer given to the radio the last time it started RX, or 0 if it last started TX.
+static uint8 XDATA * rxPacket;
+
+void ISR_RF(void);
+
+// radio_mac.c gives the DMA the low 16 bits of the packet address, like an XDATA
+// address on the CC2511.  All of a node's XDATA variables are in the data segment
+// of its node library, which is much smaller than 32 KB, so the full address is
+// the one with those low 16 bits that is closest to dmaConfig.
+static uint8 XDATA * dmaAddress(uint8 high, uint8 low)
+{
+    uintptr_t anchor = (uintptr_t)&dmaConfig;
+    int16_t offset = (int16_t)(((uint16_t)high << 8 | low) - (uint16_t)anchor);
+    return (uint8 XDATA *)(anchor + offset);
+}
+
+// Reads the radio configuration registers.
+static void readConfig(SimRadioConfig * config)
+{
+    uint8 exponent = MDMCFG4 & 0x0F;
+
+    config->channel = CHANNR;
+    config->fec = (MDMCFG1 & 0x80) ? 1 : 0;
+    config->fixedLength = (PKTCTRL0 & 0x03) ? 0 : PKTLEN;
+    config->maxLength = PKTLEN;
+
+    // Data rate = (256 + MDMCFG3) * 2^(MDMCFG4 & 0xF) * 24 MHz / 2^28
+    config->bitRate = (uint32_t)(((uint64_t)(256 + MDMCFG3) << exponent) * 24000000 >> 28);
+
+    config->tuned = FSCAL1 == FSCAL1_FOR(CHANNR) && FSCAL2 == FSCAL2_FOR(FSCTRL1);
+}
+
+// Starting from IDLE with FS_AUTOCAL set calibrates the frequency synthesizer.
+static void calibrateIfNeeded(uint8 calibrate)
+{
+    if (calibrate && simHost->radioState(simNodeId) == SIM_RADIO_IDLE)
+    {
+        FSCAL1 = FSCAL1_FOR(CHANNR);
+        FSCAL2 = FSCAL2_FOR(FSCTRL1);
+    }
+}
+
+static void runStrobe()
+{
+    SimRadioConfig config;
+    uint8 calibrate = (MCSM0 & MCSM0_FS_AUTOCAL_MASK) == MCSM0_FS_AUTOCAL_IDLE;
+    uint8 strobe = rfstWrite;
+
+    rfstWrite = RFST_NONE;
+
+    switch (strobe)
+    {
+    case SIDLE:
+        simHost->radioIdle(simNodeId);
+        break;
+
+    case SFSTXON:
+        simHost->radioFstxon(simNodeId);
+        break;
+
+    case SRX:
+        calibrateIfNeeded(calibrate);
+        readConfig(&config);
+        rxPacket = dmaAddress(dmaConfig.radio.DESTADDRH, dmaConfig.radio.DESTADDRL);
+        simHost->radioRx(simNodeId, rxPacket, &config,
+            (MCSM2 & 7) == 7 ? 0 : (uint32_t)WOREVT1 * RX_TIMEOUT_UNIT_US, calibrate);
+        break;
+
+    case STX:
+        calibrateIfNeeded(calibrate);
+        readConfig(&config);
+        rxPacket = 0;
+        simHost->radioTx(simNodeId, dmaAddress(dmaConfig.radio.SRCADDRH, dmaConfig.radio.SRCADDRL),
+            &config, calibrate);
+        break;
+    }
+}
+
+// Makes the simulated hardware act on the last writes to RFST, RFIF and S1CON.
+static void sync()
+{
+    if (rfstWrite != RFST_NONE)
+    {
+        runStrobe();
+    }
+
+    // Writing 0 to an RFIF bit clears it and writing 1 does nothing.
+    rfif &= rfifWrite;
+    rfifWrite = rfif;
+
+    // Setting the RFIF bits in S1CON makes the RF interrupt run.
+    if (s1conWrite & 3)
+    {
+        simHost->interrupt(simNodeId);
+    }
+    s1conWrite = 0;
+}
+
+volatile uint8 * simRfst()
+{
+    sync();
+    return &rfstWrite;
+}
+
+volatile uint8 * simRfif()
+{
+    sync();
+    return &rfifWrite;
+}
+
+volatile uint8 * simS1con()
+{
+    sync();
+    return &s1conWrite;
+}
+
+uint8 simMarcstate()
+{
+    sync();
+    switch (simHost->radioState(simNodeId))
+    {
+    case SIM_RADIO_IDLE:   return 0x01;
+    case SIM_RADIO_FSTXON: return 0x12;
+    case SIM_RADIO_RX:     return 0x0D;
+    case SIM_RADIO_TX:     return 0x13;
+    default:               return 0x0A;  // FS_LOCK: settling before RX or TX.
+    }
+}
+
+uint8 simPktstatus()
+{
+    return simHost->radioReceiving(simNodeId) ? (1<<3) : 0;   // SFD
+}
+
+// The simulator calls this with the RFIF bits that are set, or with 0 if the node
+// asked for an interrupt with S1CON.
+void simNodeIsr(uint8_t flags)
+{
+    sync();
+
+    if ((flags & SIM_IRQ_DONE) && rxPacket)
+    {
+        // The simulator appended the two status bytes to the packet, like the real
+        // radio does, and the real radio also puts them in the RSSI and LQI registers.
+        uint8 length = (PKTCTRL0 & 0x03) ? rxPacket[0] + 1 : PKTLEN;
+        RSSI = rxPacket[length];
+        LQI = rxPacket[length + 1];
+    }
+
+    rfif |= flags;
+    rfifWrite = rfif;
+
+    ISR_RF();
+    sync();
+}
+
+void simRadioSync()
+{
+    sync();
+}
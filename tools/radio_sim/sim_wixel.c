@@ -0,0 +1,68 @@
+/* sim_wixel.c:
+ *  The parts of wixel.lib and random.lib that the radio libraries use, for the
+ *  radio simulator: the registers, the clock and the random number generator.
+ *  Every simulated app (sim_link.c, sim_net.c, sim_queue.c) is linked with this file.
+ */
+
+#include <cc2511_map.h>
+#include <random.h>
+#include <time.h>
+
+#include "sim.h"
+
+const SimHost * simHost;
+uint8_t simNodeId;
+
+/* REGISTERS ******************************************************************/
+
+#define SIM_DEFINE_REGISTER(name) volatile uint8 name;
+SIM_REGISTERS(SIM_DEFINE_REGISTER)
+
+/* TIME ***********************************************************************/
+
+uint32 getMs() __reentrant
+{
+    return (uint32)(simHost->now() / 1000);
+}
+
+uint16 getTicks() __reentrant
+{
+    return (uint16)(simHost->now() * TICKS_PER_MS / 1000);
+}
+
+/* RANDOM *********************************************************************/
+
+// The CC2511's random number generator is a 16-bit LFSR with the CRC16 polynomial.
+static uint16 randomState;
+
+uint8 randomNumber()
+{
+    uint8 i;
+    for (i = 0; i < 8; i++)
+    {
+        randomState = (randomState & 0x8000) ? (randomState << 1) ^ 0x8005 : randomState << 1;
+    }
+    return (uint8)randomState;
+}
+
+void randomSeed(uint8 seed_msb, uint8 seed_lsb)
+{
+    if ((seed_lsb == 0 && seed_msb == 0) || (seed_lsb == 0x03 && seed_msb == 0x80))
+    {
+        seed_lsb = 0xAA;
+    }
+    randomState = (uint16)seed_msb << 8 | seed_lsb;
+    randomNumber();
+    randomNumber();
+    randomNumber();
+}
+
+void randomSeedFromSerialNumber()
+{
+    randomSeed(0x5A ^ simNodeId, 0x3C + simNodeId * 17);
+}
+
+void randomSeedFromAdc()
+{
+    randomSeedFromSerialNumber();
+}